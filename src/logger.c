@@ -6,22 +6,223 @@ There are two kinds of logging types:
 - General Log Message
     This is a traditional Log message of the form [timestamp] [log level] [file] [linenumber] [message]
 - Arbitrary Data Message
-    This is to be used for printing stack traces or long, arbitrary data
+    This is to be used for printing stack traces or long, arbitrary data,
+    see logger_log_data()
 */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "logger.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fnmatch.h>
+#include <strings.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sched.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#define LOGGER_HAS_INOTIFY 1
+#define LOGGER_HAS_AFFINITY 1
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <link.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define LOGGER_HAS_TSC 1
+#endif
+
+typedef struct logging_queue logging_queue;
+typedef struct logging_config logging_config;
+typedef struct logging_watch logging_watch;
+typedef struct logging_shared logging_shared;
+
+#define LOGGER_CACHE_LINE 64
+
+/* Settings for the background threads of an instance, see logger_set_thread_affinity() */
 typedef struct {
-  int log_level;
+#ifdef LOGGER_HAS_AFFINITY
+  cpu_set_t cpus;
+#endif
+  bool has_cpus;
+  bool has_scheduling;
+  int policy;
+  int nice;
+  char name[16];
+  int wait;
+  int spin_us;
+} logging_threads;
+
+/*
+Group commit of the durable flushes of an instance without a pipeline,
+see logger_durable_commit(). A flush covers every caller that arrived
+before it started.
+*/
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  uint64_t started;
+  uint64_t finished;
+  bool syncing;
+  bool result;
+  _Atomic int64_t synced_at;
+} logging_durable;
+
+/*
+Context of one logger instance. Aligned to a cache line (and thus sized
+in multiples of it) and split into three lines:
+- gate: read by every logging call, only written by the setup functions.
+  Holds log_level + 1 while active and 0 while silent, so the filter is a
+  single relaxed load and an unsigned compare, see logger_gate_open()
+- configuration: read once a message passed the gate
+- counters: written by the logging threads and the writer
+Writes to the configuration or the counters never invalidate the line
+the filtered calls of other threads read.
+*/
+typedef struct logger_instance logging_context;
+
+struct logger_instance {
+  _Alignas(LOGGER_CACHE_LINE) _Atomic uint32_t gate;
+  _Alignas(LOGGER_CACHE_LINE) int log_level;
   void *output_object;
   logger_push_log output_function;
   logger_transform transform_function;
+  logger_flush flush_function;
+  void *data_object;
+  logger_push_data data_function;
+  int data_format;
+  int backtrace_level;
+  int backtrace_depth;
+  int clock_flags;
+  int numa_options;
+  logging_threads threads;
+  int flush_delay_us;
+  size_t flush_batch;
+  int durability;
+  int durability_interval_ms;
   bool is_active;
-} logging_context;
+  logging_queue *queue;
+  _Atomic(logging_config *) config;
+  logging_watch *watch;
+  logging_shared *shared;
+  logging_context *next_instance;
+  _Alignas(LOGGER_CACHE_LINE) _Atomic uint64_t sequence;
+  _Atomic uint64_t truncated;
+  _Atomic uint64_t config_reloads;
+  _Atomic uint64_t config_rejected;
+  logger_stats stats;
+  logging_durable durable;
+};
+
+#define LOGGER_CONFIG_MODULES 32
+#define LOGGER_CONFIG_PREFIX 128
+#define LOGGER_CONFIG_SITES 32
+
+/*
+Settings read from a configuration file, see logger_watch_config().
+A reload builds a new one and publishes it with a single pointer store,
+logging threads only ever read a complete one. Replaced configurations
+stay allocated until the watch ends, a thread may still hold one.
+*/
+struct logging_config {
+  int log_level;
+  int module_count;
+  struct {
+    char prefix[LOGGER_CONFIG_PREFIX];
+    size_t length;
+    int log_level;
+  } modules[LOGGER_CONFIG_MODULES];
+  uint32_t sample_rate[LOGGER_DEBUG + 1];
+  _Atomic uint32_t sampled[LOGGER_DEBUG + 1];
+  char *sink_path;
+  FILE *sink;
+  bool owns_sink;
+  int site_count;
+  char *sites[LOGGER_CONFIG_SITES];
+  logging_config *retired;
+};
+
+/* Frees config and the ones it replaced, closing the sinks they own */
+static void
+logger_config_free(logging_config *config) {
+  while(config != (void*)0) {
+    logging_config * const retired = config->retired;
+    if(config->owns_sink && config->sink != (void*)0) {fclose(config->sink);}
+    for(int index = 0;index < config->site_count;index++) {free(config->sites[index]);}
+    free(config->sink_path);
+    free(config);
+    config = retired;
+  }
+}
+
+/*
+Recomputes the gate after log_level, is_active or the configuration
+changed. Setup functions still must not run concurrently with logging
+calls, the gate only makes the filter itself race free. The lock orders
+the setup functions against the configuration watcher thread, both
+change log_level/is_active and call this only while holding it.
+*/
+static pthread_mutex_t logger_gate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+logger_gate_update(logging_context * const context) {
+  logging_config const * const config = atomic_load(&context->config);
+  int log_level = config != (void*)0 && config->log_level >= 0 ? config->log_level : context->log_level;
+  for(int index = 0;config != (void*)0 && index < config->module_count;index++) {
+    if(config->modules[index].log_level > log_level) {log_level = config->modules[index].log_level;}
+  }
+  if(log_level > LOGGER_DEBUG) {log_level = LOGGER_DEBUG;}
+  atomic_store_explicit(&context->gate,context->is_active && log_level >= 0 ? (uint32_t)log_level + 1 : 0,memory_order_release);
+}
+
+/* Levels outside LOGGER_EMERGENCY - LOGGER_DEBUG never pass */
+__attribute__((always_inline))
+static inline bool
+logger_gate_open(logging_context const * const context,int const log_level) {
+  return (uint32_t)log_level < atomic_load_explicit(&context->gate,memory_order_relaxed);
+}
+
+/*
+Second filter behind the gate while a configuration file is watched:
+the level of the longest matching module prefix (or the base level) and
+the sampling rate of the level.
+*/
+static bool
+logger_config_allows(logging_context * const context,int const log_level,char const * const file) {
+  logging_config * const config = atomic_load_explicit(&context->config,memory_order_acquire);
+  if(config == (void*)0) {return true;}
+  int threshold = config->log_level >= 0 ? config->log_level : context->log_level;
+  size_t matched = 0;
+  for(int index = 0;index < config->module_count;index++) {
+    if(config->modules[index].length > matched && strncmp(file,config->modules[index].prefix,config->modules[index].length) == 0) {
+      threshold = config->modules[index].log_level;
+      matched = config->modules[index].length;
+    }
+  }
+  if(log_level > threshold) {return false;}
+  uint32_t const rate = config->sample_rate[log_level];
+  return rate <= 1 || atomic_fetch_add_explicit(&config->sampled[log_level],1,memory_order_relaxed) % rate == 0;
+}
 
 /*
-Static context structure. This in turn limits this module
-to single-context operation.
+Static context structure of the default instance, used by all functions
+without handle. Further instances come from logger_create().
 
 An alternative extension Idea would be to allow for callbacks
 based on Module/File.
@@ -32,7 +233,438 @@ callbacks for transformation/output.
 After that, assign callbacks with a filename, so that the log entries
 coming in from "logger.c" will be assigned to different callbacks.
 */
-static logging_context Logger = {0};
+static logging_context Logger = {
+  .backtrace_level = -1,
+  .flush_delay_us = LOGGER_FLUSH_DELAY_US,
+  .flush_batch = LOGGER_BATCH_RECORDS,
+  .durable = {.lock = PTHREAD_MUTEX_INITIALIZER,.done = PTHREAD_COND_INITIALIZER}
+};
+
+/* Instances from logger_create(), linked through next_instance */
+static pthread_mutex_t logger_instances_lock = PTHREAD_MUTEX_INITIALIZER;
+static logging_context *logger_instances = (void*)0;
+
+/*
+Formatting layer of the factory transforms
+
+The factory transforms only concatenate known pieces (time, level name,
+file, line number, message), so instead of snprintf they are built from
+a few primitives that append to a buffer and return the new length:
+- padded level names from a precomputed table
+- integer to decimal without division loops per digit (two digits per
+  step from a lookup table, digit count from branchless comparisons)
+- memcpy for everything else
+The date part of the console time only changes once per second and is
+cached per thread, which saves localtime_r + strftime on most messages.
+All primitives truncate at the given capacity, which must be at least 1.
+*/
+#define LOGGER_FORMAT_PREFIX 512
+
+static char const logger_format_digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* " %-10s " of the level names, as used by the console transform */
+static char const logger_format_level_padded[LOGGER_DEBUG + 1][13] = {
+  " EMERGENCY  ",
+  " ALERT      ",
+  " CRITICAL   ",
+  " ERROR      ",
+  " WARNING    ",
+  " NOTICE     ",
+  " INFO       ",
+  " DEBUG      "
+};
+
+/* ",%s," of the lower case level names, as used by the CSV transform */
+static struct {
+  char name[12];
+  size_t length;
+} const logger_format_level_csv[LOGGER_DEBUG + 1] = {
+  {",emergency,",11},
+  {",alert,",7},
+  {",critical,",10},
+  {",error,",7},
+  {",warning,",9},
+  {",notice,",8},
+  {",info,",6},
+  {",debug,",7}
+};
+
+static inline size_t
+logger_format_bytes(char * const buffer,size_t const offset,size_t const capacity,char const * const data,size_t const length) {
+  if(offset >= capacity) {return offset;}
+  size_t const room = capacity - 1 - offset;
+  size_t const copied = length < room ? length : room;
+  memcpy(buffer + offset,data,copied);
+  return offset + copied;
+}
+
+static inline unsigned int
+logger_format_count_digits(uint64_t const value) {
+  return 1 + (value >= 10ULL) + (value >= 100ULL) + (value >= 1000ULL) + (value >= 10000ULL)
+           + (value >= 100000ULL) + (value >= 1000000ULL) + (value >= 10000000ULL)
+           + (value >= 100000000ULL) + (value >= 1000000000ULL) + (value >= 10000000000ULL)
+           + (value >= 100000000000ULL) + (value >= 1000000000000ULL) + (value >= 10000000000000ULL)
+           + (value >= 100000000000000ULL) + (value >= 1000000000000000ULL) + (value >= 10000000000000000ULL)
+           + (value >= 100000000000000000ULL) + (value >= 1000000000000000000ULL) + (value >= 10000000000000000000ULL);
+}
+
+/* Writes exactly digits characters, zero padded, into out */
+static inline void
+logger_format_write_digits(char * const out,uint64_t value,unsigned int digits) {
+  char *cursor = out + digits;
+  while(digits >= 2) {
+    cursor -= 2;
+    memcpy(cursor,&logger_format_digit_pairs[(value % 100) * 2],2);
+    value /= 100;
+    digits -= 2;
+  }
+  if(digits == 1) {
+    cursor[-1] = (char)('0' + value % 10);
+  }
+}
+
+static inline size_t
+logger_format_unsigned(char * const buffer,size_t const offset,size_t const capacity,uint64_t const value,unsigned int width) {
+  char digits[20];
+  unsigned int const count = logger_format_count_digits(value);
+  if(width < count) {width = count;}
+  logger_format_write_digits(digits,value,width);
+  return logger_format_bytes(buffer,offset,capacity,digits,width);
+}
+
+static inline size_t
+logger_format_signed(char * const buffer,size_t offset,size_t const capacity,int64_t const value) {
+  if(value < 0) {
+    offset = logger_format_bytes(buffer,offset,capacity,"-",1);
+    return logger_format_unsigned(buffer,offset,capacity,(uint64_t)0 - (uint64_t)value,0);
+  }
+  return logger_format_unsigned(buffer,offset,capacity,(uint64_t)value,0);
+}
+
+/*
+Moves the message behind the prefix and terminates the line with a
+newline. The buffer holds the message plus LOGGER_TRANSFORM_HEADROOM,
+but at least LOGGER_MESSAGE_BUFFER bytes; the message is cut if the line
+does not fit. Returns the length of the line.
+*/
+static size_t
+logger_format_line(char * const message,char const * const prefix,size_t prefix_length) {
+  size_t message_length = strlen(message);
+  size_t capacity = message_length + 1 + LOGGER_TRANSFORM_HEADROOM;
+  if(capacity < LOGGER_MESSAGE_BUFFER) {capacity = LOGGER_MESSAGE_BUFFER;}
+  if(prefix_length > LOGGER_TRANSFORM_HEADROOM - 1) {prefix_length = LOGGER_TRANSFORM_HEADROOM - 1;}
+  if(prefix_length + message_length + 2 > capacity) {
+    message_length = capacity - 2 - prefix_length;
+  }
+  memmove(message + prefix_length,message,message_length);
+  memcpy(message,prefix,prefix_length);
+  message[prefix_length + message_length] = '\n';
+  message[prefix_length + message_length + 1] = '\0';
+  return prefix_length + message_length + 1;
+}
+
+typedef struct {
+  time_t second;
+  size_t date_length;
+  char date[32];
+  char year[8];
+} logging_time_cache;
+
+static _Thread_local logging_time_cache logger_format_time_cache = {.second = -1};
+
+/* Same layout as "%c" in the C locale, with microseconds after the seconds */
+static size_t
+logger_format_console_time(char * const buffer,size_t offset,size_t const capacity,struct timespec const * const time) {
+  logging_time_cache *cache = &logger_format_time_cache;
+  if(cache->second != time->tv_sec) {
+    struct tm broken_down;
+    localtime_r(&time->tv_sec,&broken_down);
+    cache->date_length = strftime(cache->date,sizeof(cache->date),"%a %b %e %H:%M:%S",&broken_down);
+    if(strftime(cache->year,sizeof(cache->year)," %Y",&broken_down) != 5 || cache->date_length == 0) {
+      cache->second = -1;
+      return 0;
+    }
+    cache->second = time->tv_sec;
+  }
+  /* Whole cached field is copied, only date_length bytes of it count */
+  if(offset + sizeof(cache->date) < capacity) {
+    memcpy(buffer + offset,cache->date,sizeof(cache->date));
+    offset += cache->date_length;
+  } else {
+    return 0;
+  }
+  offset = logger_format_bytes(buffer,offset,capacity,".",1);
+  offset = logger_format_unsigned(buffer,offset,capacity,time->tv_nsec / 1000,6);
+  return logger_format_bytes(buffer,offset,capacity,cache->year,5);
+}
+
+/*
+Data encoders
+
+Render the payload of data messages (logger_log_data) as text:
+- LOGGER_DATA_HEXDUMP
+    Lines of 16 bytes in the layout of "hexdump -C":
+    "00000010  de ad be ef 00 01 02 03  04 05 06 07 08 09 0a 0b  |................|"
+    Lines are separated by '\n', the last one has none.
+- LOGGER_DATA_HEX
+    Two lower case hex digits per byte without separators
+- LOGGER_DATA_BASE64
+    RFC 4648 with padding, without line breaks
+Hex digits and the printable column are computed 16 bytes at a time with
+SSE2, base64 12 bytes at a time with SSSE3 if the CPU supports it (checked
+once at runtime). Other platforms use the scalar loops, the output is the
+same either way.
+*/
+#define LOGGER_DATA_HEXDUMP_LINE 79
+
+#if defined(__SSE2__)
+#define LOGGER_HAS_SSE2 1
+#endif
+
+static char const logger_encode_hex_digits[] = "0123456789abcdef";
+static char const logger_encode_base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#ifdef LOGGER_HAS_SSE2
+static inline __m128i
+logger_encode_nibbles(__m128i const nibbles) {
+  __m128i const letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles,_mm_set1_epi8(9)),_mm_set1_epi8('a' - '0' - 10));
+  return _mm_add_epi8(_mm_add_epi8(nibbles,_mm_set1_epi8('0')),letters);
+}
+
+/* 16 bytes to 32 hex digits */
+static inline void
+logger_encode_hex16(char * const output,unsigned char const * const input) {
+  __m128i const bytes = _mm_loadu_si128((__m128i const *)input);
+  __m128i const mask = _mm_set1_epi8(0x0f);
+  __m128i const high = _mm_and_si128(_mm_srli_epi16(bytes,4),mask);
+  __m128i const low = _mm_and_si128(bytes,mask);
+  _mm_storeu_si128((__m128i *)output,logger_encode_nibbles(_mm_unpacklo_epi8(high,low)));
+  _mm_storeu_si128((__m128i *)(output + 16),logger_encode_nibbles(_mm_unpackhi_epi8(high,low)));
+}
+
+/* 16 bytes to their printable column, everything outside 0x20 - 0x7e is '.' */
+static inline void
+logger_encode_printable16(char * const output,unsigned char const * const input) {
+  __m128i const bytes = _mm_loadu_si128((__m128i const *)input);
+  __m128i const printable = _mm_and_si128(_mm_cmpgt_epi8(bytes,_mm_set1_epi8(0x1f)),_mm_cmpgt_epi8(_mm_set1_epi8(0x7f),bytes));
+  __m128i const dots = _mm_andnot_si128(printable,_mm_set1_epi8('.'));
+  _mm_storeu_si128((__m128i *)output,_mm_or_si128(_mm_and_si128(printable,bytes),dots));
+}
+#endif
+
+static size_t
+logger_encode_hex(char * const output,unsigned char const * const input,size_t const length) {
+  size_t index = 0;
+#ifdef LOGGER_HAS_SSE2
+  for(;index + 16 <= length;index += 16) {
+    logger_encode_hex16(output + index * 2,input + index);
+  }
+#endif
+  for(;index < length;index++) {
+    output[index * 2] = logger_encode_hex_digits[input[index] >> 4];
+    output[index * 2 + 1] = logger_encode_hex_digits[input[index] & 0x0f];
+  }
+  return length * 2;
+}
+
+static size_t
+logger_encode_hexdump(char * const output,unsigned char const * const input,size_t const length) {
+  size_t offset = 0;
+  for(size_t line = 0;line < length;line += 16) {
+    size_t const count = length - line < 16 ? length - line : 16;
+    char digits[32];
+    char printable[16];
+#ifdef LOGGER_HAS_SSE2
+    if(count == 16) {
+      logger_encode_hex16(digits,input + line);
+      logger_encode_printable16(printable,input + line);
+    } else
+#endif
+    {
+      logger_encode_hex(digits,input + line,count);
+      for(size_t index = 0;index < count;index++) {
+        unsigned char const byte = input[line + index];
+        printable[index] = byte > 0x1f && byte < 0x7f ? (char)byte : '.';
+      }
+    }
+    char * const row = output + offset;
+    for(int shift = 28,position = 0;shift >= 0;shift -= 4,position++) {
+      row[position] = logger_encode_hex_digits[(line >> shift) & 0x0f];
+    }
+    memset(row + 8,' ',LOGGER_DATA_HEXDUMP_LINE - 8 - 19);
+    for(size_t index = 0;index < count;index++) {
+      char * const cell = row + 10 + index * 3 + (index >= 8);
+      cell[0] = digits[index * 2];
+      cell[1] = digits[index * 2 + 1];
+    }
+    row[60] = '|';
+    memcpy(row + 61,printable,count);
+    row[61 + count] = '|';
+    row[62 + count] = '\n';
+    offset += 63 + count;
+  }
+  /* No newline behind the last line */
+  return offset > 0 ? offset - 1 : 0;
+}
+
+static size_t
+logger_encode_base64_scalar(char * const output,unsigned char const * const input,size_t const length) {
+  size_t offset = 0;
+  size_t index = 0;
+  for(;index + 3 <= length;index += 3) {
+    uint32_t const group = (uint32_t)input[index] << 16 | (uint32_t)input[index + 1] << 8 | input[index + 2];
+    output[offset++] = logger_encode_base64_digits[group >> 18];
+    output[offset++] = logger_encode_base64_digits[(group >> 12) & 0x3f];
+    output[offset++] = logger_encode_base64_digits[(group >> 6) & 0x3f];
+    output[offset++] = logger_encode_base64_digits[group & 0x3f];
+  }
+  if(index < length) {
+    uint32_t group = (uint32_t)input[index] << 16;
+    if(index + 1 < length) {group |= (uint32_t)input[index + 1] << 8;}
+    output[offset++] = logger_encode_base64_digits[group >> 18];
+    output[offset++] = logger_encode_base64_digits[(group >> 12) & 0x3f];
+    output[offset++] = index + 1 < length ? logger_encode_base64_digits[(group >> 6) & 0x3f] : '=';
+    output[offset++] = '=';
+  }
+  return offset;
+}
+
+#ifdef LOGGER_HAS_SSE2
+/*
+Encodes 12 input bytes per step, reads 16 (the last step leaves enough
+input for the scalar tail). Splits the bytes into 6 bit indices with two
+multiplications and maps them to the alphabet with one table lookup per
+range, see W. Mula, "Faster Base64 Encoding and Decoding using AVX2".
+*/
+__attribute__((target("ssse3")))
+static size_t
+logger_encode_base64_ssse3(char * const output,unsigned char const * const input,size_t const length) {
+  size_t index = 0;
+  size_t offset = 0;
+  __m128i const shuffle = _mm_set_epi8(10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1);
+  __m128i const shift_table = _mm_setr_epi8('a' - 26,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,
+                                            '0' - 52,'0' - 52,'0' - 52,'+' - 62,'/' - 63,'A',0,0);
+  for(;index + 16 <= length;index += 12,offset += 16) {
+    __m128i const bytes = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(input + index)),shuffle);
+    __m128i const upper = _mm_mulhi_epu16(_mm_and_si128(bytes,_mm_set1_epi32(0x0fc0fc00)),_mm_set1_epi32(0x04000040));
+    __m128i const lower = _mm_mullo_epi16(_mm_and_si128(bytes,_mm_set1_epi32(0x003f03f0)),_mm_set1_epi32(0x01000010));
+    __m128i const indices = _mm_or_si128(upper,lower);
+    __m128i range = _mm_subs_epu8(indices,_mm_set1_epi8(51));
+    __m128i const letters = _mm_cmpgt_epi8(_mm_set1_epi8(26),indices);
+    range = _mm_or_si128(range,_mm_and_si128(letters,_mm_set1_epi8(13)));
+    __m128i const encoded = _mm_add_epi8(_mm_shuffle_epi8(shift_table,range),indices);
+    _mm_storeu_si128((__m128i *)(output + offset),encoded);
+  }
+  return offset + logger_encode_base64_scalar(output + offset,input + index,length - index);
+}
+#endif
+
+static size_t
+logger_encode_base64(char * const output,unsigned char const * const input,size_t const length) {
+#ifdef LOGGER_HAS_SSE2
+  static _Atomic int has_ssse3 = -1;
+  if(atomic_load_explicit(&has_ssse3,memory_order_relaxed) < 0) {
+    __builtin_cpu_init();
+    atomic_store_explicit(&has_ssse3,__builtin_cpu_supports("ssse3") ? 1 : 0,memory_order_relaxed);
+  }
+  if(atomic_load_explicit(&has_ssse3,memory_order_relaxed) > 0) {
+    return logger_encode_base64_ssse3(output,input,length);
+  }
+#endif
+  return logger_encode_base64_scalar(output,input,length);
+}
+
+static bool
+logger_is_data_format(int format) {
+  return format == LOGGER_DATA_HEXDUMP || format == LOGGER_DATA_HEX || format == LOGGER_DATA_BASE64;
+}
+
+/*
+Parameters:
+-----------
+format
+  LOGGER_DATA_HEXDUMP, LOGGER_DATA_HEX or LOGGER_DATA_BASE64
+
+length
+  Size of the payload in bytes
+
+Return Value:
+-------------
+Buffer size in bytes (including the terminating 0 byte) that is enough
+for logger_encode_data() to render the whole payload, 0 for an invalid format
+
+Description:
+------------
+Allows transform and data callbacks to size their buffers
+*/
+extern size_t
+logger_encoded_size(int format,size_t length) {
+  if(format == LOGGER_DATA_HEXDUMP) {
+    return length > 0 ? (length + 15) / 16 * LOGGER_DATA_HEXDUMP_LINE : 1;
+  } else if(format == LOGGER_DATA_HEX) {
+    return length * 2 + 1;
+  } else if(format == LOGGER_DATA_BASE64) {
+    return (length + 2) / 3 * 4 + 1;
+  }
+  return 0;
+}
+
+/*
+Parameters:
+-----------
+format
+  LOGGER_DATA_HEXDUMP, LOGGER_DATA_HEX or LOGGER_DATA_BASE64
+
+output
+  Buffer for the text
+
+capacity
+  Size of output in bytes, at least 1
+
+data / length
+  The payload
+
+Return Value:
+-------------
+Number of characters written without the terminating 0 byte
+
+Description:
+------------
+Renders the payload as text. If output is smaller than
+logger_encoded_size(), only as many whole hexdump lines / hex digit
+pairs / base64 groups as fit are written.
+*/
+extern size_t
+logger_encode_data(int format,char *output,size_t capacity,void const * const data,size_t length) {
+  if(output == (void*)0 || capacity == 0) {return 0;}
+  if(data == (void*)0 || logger_is_data_format(format) == false) {
+    output[0] = '\0';
+    return 0;
+  }
+  size_t written = 0;
+  if(format == LOGGER_DATA_HEXDUMP) {
+    if(logger_encoded_size(format,length) > capacity) {length = capacity / LOGGER_DATA_HEXDUMP_LINE * 16;}
+    written = logger_encode_hexdump(output,data,length);
+  } else if(format == LOGGER_DATA_HEX) {
+    if(logger_encoded_size(format,length) > capacity) {length = (capacity - 1) / 2;}
+    written = logger_encode_hex(output,data,length);
+  } else {
+    if(logger_encoded_size(format,length) > capacity) {length = (capacity - 1) / 4 * 3;}
+    written = logger_encode_base64(output,data,length);
+  }
+  output[written] = '\0';
+  return written;
+}
 
 /*
 Factory Functions or default behaviour, for example
@@ -41,104 +673,139 @@ output to the console or a simple .txt file.
 Can be skipped or reviewed for a sample implementation
 */
 static char *
-logger_factory_console_transform(time_t const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
-  if(log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG || message == (void*)0 || file == (void*)0) {
+logger_factory_console_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  if(log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG || message == (void*)0 || file == (void*)0 || timestamp == (void*)0) {
     fprintf(stderr,"Could not transform message, invalid parameters");
     return (void*)0;
   }
-  char tmp_buffer[LOGGER_MESSAGE_BUFFER] = {0};
-  char const log_level_mapping[][10] = {
-    "EMERGENCY",
-    "ALERT",
-    "CRITICAL",
-    "ERROR",
-    "WARNING",
-    "NOTICE",
-    "INFO",
-    "DEBUG"
-  };
-  int const offset = strftime(tmp_buffer,LOGGER_MESSAGE_BUFFER,"%c",localtime(&timestamp));
+  char prefix[LOGGER_FORMAT_PREFIX];
+  size_t offset = logger_format_console_time(prefix,0,LOGGER_FORMAT_PREFIX,&timestamp->realtime);
   if(offset < 1) {
     fprintf(stderr,"Could not write time to buffer\n");
     return (void*)0;
   }
-  if(snprintf(tmp_buffer + offset,LOGGER_MESSAGE_BUFFER," %-10s %s:%d - %s\n",log_level_mapping[log_level],file,filenumber,message) < 1) {
-    fprintf(stderr,"Could not amalgamate Message - sprintf returned 0 bytes");
-    return (void*)0;
-  }
-  memset(message,0,LOGGER_MESSAGE_BUFFER);
-  memcpy(message,&tmp_buffer,LOGGER_MESSAGE_BUFFER);
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,logger_format_level_padded[log_level],12);
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,file,strlen(file));
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,":",1);
+  offset = logger_format_signed(prefix,offset,LOGGER_FORMAT_PREFIX,filenumber);
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX," - ",3);
+  logger_format_line(message,prefix,offset);
   return message;
 }
 
 static int
 logger_factory_console_output(void const * const custom_object,char const * const message) {
-  /* Using this setup to remove compiler warning about unused variables */
-  fprintf((FILE *)custom_object,message);
+  /* The message is not a format string, it may contain any '%' */
+  if(fputs(message,(FILE *)custom_object) == EOF) {return 0;}
+  return 1;
+}
+
+/* The data of the file on stable storage, metadata only as far as needed to read it back */
+static int
+logger_sync_file(int const descriptor) {
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+  return fdatasync(descriptor);
+#else
+  return fsync(descriptor);
+#endif
+}
+
+static int
+logger_factory_console_flush(void const * const custom_object,bool const durable) {
+  FILE *stream = (FILE *)custom_object;
+  if(fflush(stream) != 0) {return 0;}
+  /* Terminals and pipes cannot be synced, that is not an error */
+  if(durable && logger_sync_file(fileno(stream)) != 0 && errno != EINVAL && errno != EROFS) {return 0;}
   return 1;
 }
 
 extern int
 logger_factory_console(int log_level) {
-  return logger_setup_context(log_level,stdout,logger_factory_console_output,logger_factory_console_transform,true);
+  int const ret_code = logger_setup_context(log_level,stdout,logger_factory_console_output,logger_factory_console_transform,true);
+  if(ret_code <= 0) {return ret_code;}
+  logger_set_flush_callback(logger_factory_console_flush);
+  return ret_code;
 }
 
 static FILE *
 logger_factory_file_file = (void*)0;
 
+static bool logger_queue_abandoned(logging_queue *queue);
+
+/* Kept for logger_set_fork_reopen() */
+static char *
+logger_factory_file_path = (void*)0;
+
 static void
 logger_factory_file_exit(void) {
   if(logger_factory_file_file != (void*)0) {
-    fflush(logger_factory_file_file);
+    if(Logger.output_object == logger_factory_file_file) {
+      /* The writer may still hold records for the file, later calls must not reach it */
+      logger_shutdown(LOGGER_SHUTDOWN_TIMEOUT_MS,(void*)0);
+      /* A writer detached at the deadline may still be writing to it, exit leaves it open */
+      if(Logger.queue != (void*)0 && logger_queue_abandoned(Logger.queue)) {
+        logger_stop_async();
+        return;
+      }
+      logger_stop_async();
+    }
     fclose(logger_factory_file_file);
+    logger_factory_file_file = (void*)0;
   }
 }
 
 extern int
 logger_factory_file(int log_level,char const * const file_path) {
+  static bool exit_handler = false;
   if(file_path == (void*)0 || log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG) {
     return -1;
   }
-  if(logger_factory_file_file != (void*)0) {
-    fflush(logger_factory_file_file);
-    fclose(logger_factory_file_file);
+  if(exit_handler == false) {
+    if(atexit(logger_factory_file_exit) != 0) {
+      fprintf(stderr,"Could not setup atexit handler\n");
+      return -3;
+    }
+    exit_handler = true;
   }
-  logger_factory_file_file = fopen(file_path,"w");
-  if(logger_factory_file_file == (void*)0) {
+  FILE * const stream = fopen(file_path,"w");
+  if(stream == (void*)0) {
     perror("Could not open File for factory setup");
     return -2;
   }
-  if(atexit(logger_factory_file_exit) != 0) {
-    fprintf(stderr,"Could not setup atexit handler\n");
-    fclose(logger_factory_file_file);
-    return -3;
+  FILE * const previous = logger_factory_file_file;
+  /* Records queued so far still belong to the previous file */
+  if(previous != (void*)0) {logger_sync(-1);}
+  logger_factory_file_file = stream;
+  free(logger_factory_file_path);
+  logger_factory_file_path = strdup(file_path);
+  int const ret_code = logger_setup_context(log_level,stream,logger_factory_console_output,logger_factory_console_transform,true);
+  if(ret_code > 0) {logger_set_flush_callback(logger_factory_console_flush);}
+  if(previous != (void*)0) {
+    /* The writer may have picked up the previous file for a record logged in between */
+    logger_sync(-1);
+    fclose(previous);
   }
-  return logger_setup_context(log_level,logger_factory_file_file,logger_factory_console_output,logger_factory_console_transform,true);
+  return ret_code;
 }
 
 static char *
-logger_factory_csv_transform(time_t const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
-  if(log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG || message == (void*)0 || file == (void*)0) {
+logger_factory_csv_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  if(log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG || message == (void*)0 || file == (void*)0 || timestamp == (void*)0) {
     fprintf(stderr,"Could not transform message, invalid parameters");
     return (void*)0;
   }
-  char tmp_buffer[LOGGER_MESSAGE_BUFFER] = {0};
-  char const log_level_mapping[][10] = {
-    "emergency",
-    "alert",
-    "critical",
-    "error",
-    "warning",
-    "notice",
-    "info",
-    "debug"
-  };
-  if(snprintf(tmp_buffer,LOGGER_MESSAGE_BUFFER,"%ld,%s,%s,%i,%s\n",timestamp,log_level_mapping[log_level],file,filenumber,message) < 1) {
-    fprintf(stderr,"Could not amalgamate Message - sprintf returned 0 bytes");
-    return (void*)0;
-  }
-  memset(message,0,LOGGER_MESSAGE_BUFFER);
-  memcpy(message,&tmp_buffer,LOGGER_MESSAGE_BUFFER);
+  char prefix[LOGGER_FORMAT_PREFIX];
+  size_t offset = logger_format_signed(prefix,0,LOGGER_FORMAT_PREFIX,timestamp->realtime.tv_sec);
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,".",1);
+  offset = logger_format_unsigned(prefix,offset,LOGGER_FORMAT_PREFIX,timestamp->realtime.tv_nsec,9);
+  /* The timestamp is at most 31 bytes, the whole level field always fits */
+  memcpy(prefix + offset,logger_format_level_csv[log_level].name,sizeof(logger_format_level_csv[log_level].name));
+  offset += logger_format_level_csv[log_level].length;
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,file,strlen(file));
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,",",1);
+  offset = logger_format_signed(prefix,offset,LOGGER_FORMAT_PREFIX,filenumber);
+  offset = logger_format_bytes(prefix,offset,LOGGER_FORMAT_PREFIX,",",1);
+  logger_format_line(message,prefix,offset);
   return message;
 }
 
@@ -150,140 +817,280 @@ logger_factory_csv(int log_level,char const * const file_path) {
   fprintf(logger_factory_file_file,"timestamp,priority,filename,linenumber,message\n");
   return ret_code;
 }
-/*
-Parameters:
------------
-log_level
-  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
-  Is set so that the most critical level, is the lowest value and vice versa
 
-file
-  A constant string provided by the macros (preprocessor __FILE__ value)
+static FILE *
+logger_factory_data_file_file = (void*)0;
 
-linenumber
-  A constant number provided by the macros (preprocessor __LINE__ value)
+static char *
+logger_factory_data_file_path = (void*)0;
 
-message
-  Format string that fits the standard conversion specifiers
+static void
+logger_factory_data_file_exit(void) {
+  if(logger_factory_data_file_file != (void*)0) {
+    logger_stop_async();
+    logger_set_data_callback((void*)0,(void*)0);
+    fclose(logger_factory_data_file_file);
+    logger_factory_data_file_file = (void*)0;
+  }
+}
 
-...
-  Variadic parameters - used in the format string "message"
+static int
+logger_factory_data_file_output(void const * const custom_object,logger_time const * const timestamp,int const log_level,
+                                char const * const file,int const filenumber,char const * const label,void const * const data,size_t const length) {
+  FILE *stream = (FILE *)custom_object;
+  logger_data_header header = {
+    .log_level = log_level,
+    .sequence = logger_current_sequence(),
+    .seconds = timestamp->realtime.tv_sec,
+    .nanoseconds = (int32_t)timestamp->realtime.tv_nsec,
+    .linenumber = filenumber,
+    .file_length = (uint32_t)strlen(file),
+    .label_length = (uint32_t)strlen(label),
+    .data_length = length
+  };
+  memcpy(header.magic,LOGGER_DATA_MAGIC,sizeof(header.magic));
+  if(fwrite(&header,sizeof(header),1,stream) != 1
+     || fwrite(file,1,header.file_length,stream) != header.file_length
+     || fwrite(label,1,header.label_length,stream) != header.label_length
+     || fwrite(data,1,length,stream) != length) {
+    return 0;
+  }
+  if(log_level <= LOGGER_CRITICAL && fflush(stream) != 0) {return 0;}
+  return 1;
+}
 
-Return Values:
---------------
-None
+/*
+Parameters:
+-----------
+file_path
+  Path of the binary data file, it is truncated
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
 
 Description:
 ------------
-This function is being called by the macros logger_emergency() ... logger_debug()
-and prepares the message buffer, concatenates the variadic parameters into the
-format string and pushes it to the Logger.transform_function and Logger.output_function
+Stores data messages raw in a binary file instead of rendering them as
+text, each as a logger_data_header followed by file name, label and
+payload. Regular messages still go to the output function. Replaces a
+data file set up before, the asynchronous pipeline keeps running and
+writes what was queued for the previous file first.
 */
-extern void
-logger_log(int log_level,char const * const file,int linenumber,char const * const message, ...) {
-  if(log_level < 0 || log_level > 7 || message == (void*)0 || file == (void*)0) {
-    fprintf(stderr,"Could not log message - empty or outside log levels\n");
-    return;
+extern int
+logger_factory_data_file(char const * const file_path) {
+  static bool exit_handler = false;
+  if(file_path == (void*)0) {return -1;}
+  FILE *stream = fopen(file_path,"wb");
+  if(stream == (void*)0) {
+    perror("Could not open data file for factory setup");
+    return -2;
   }
-  if(log_level > Logger.log_level || Logger.is_active == false) {return;}
-  char message_buffer[LOGGER_MESSAGE_BUFFER] = {0};
-  va_list parameter_list;
-  va_start(parameter_list,message);
-  if(vsnprintf(message_buffer,LOGGER_MESSAGE_BUFFER,message,parameter_list) < 1) {
-    fprintf(stderr,"Could not log message - pre-formatting returned 0 bytes\n");
-    return;
+  if(exit_handler == false) {
+    if(atexit(logger_factory_data_file_exit) != 0) {
+      fprintf(stderr,"Could not setup atexit handler\n");
+      fclose(stream);
+      return -3;
+    }
+    exit_handler = true;
   }
-  va_end(parameter_list);
-  if(Logger.output_function(Logger.output_object,Logger.transform_function(time((void*)0),log_level,file,linenumber,message_buffer)) < 1) {
-    fprintf(stderr,"Could not log message - push function failed\n");
-    return;
+  FILE * const previous = logger_factory_data_file_file;
+  /* Records queued so far still belong to the previous file */
+  if(previous != (void*)0) {logger_sync(-1);}
+  logger_factory_data_file_file = stream;
+  free(logger_factory_data_file_path);
+  logger_factory_data_file_path = strdup(file_path);
+  int const ret_code = logger_set_data_callback(stream,logger_factory_data_file_output);
+  if(previous != (void*)0) {
+    /* The writer may have picked up the previous file for a record logged in between */
+    logger_sync(-1);
+    fclose(previous);
   }
+  return ret_code;
 }
 
 /*
-Parameters:
------------
-log_level
-  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
-  Is set so that the most critical level, is the lowest value and vice versa
-  Determines with what starting log level we push messages to the
-  output routine
+Shared memory ring
 
-output_data
-  Any kind of User Data that can be used to push messages to. For example
-  a buffer, file stream, network connection, custom struct for databases.
+logger_factory_shared() leaves formatting and writing to a local daemon,
+tools/loggerd.c. Every process creates a ring file <pid>-<n>.ring in the
+ring directory, laid out as described at logger_ring_header. A message
+becomes a raw record: a compare and swap on head reserves the space, the
+copy is committed by writing the record size last. The daemon looks at
+the rings on its own schedule, so logging makes no system call at all.
+A full ring drops the record and counts it in dropped, the daemon
+reports those. The process holds a shared flock() on the file as long as
+it lives: once the lock is gone, after an exit or a crash, the daemon
+drains what was committed and removes the file. A forked child keeps
+writing into the ring of its parent and never removes it.
+*/
+struct logging_shared {
+  int descriptor;
+  /* Process that created the ring, forked children only write into it */
+  pid_t owner;
+  char *path;
+  logger_ring_header *header;
+  char *data;
+  uint64_t mask;
+};
 
-output_function
-  Used to push messages to the output medium
-  Signature: int fname(void const * const custom_object,char const * const message)
+static logging_shared *
+logger_factory_shared_ring = (void*)0;
 
-transform_function
-  Used to prepare a buffer used in the output routine. This buffer must be the
-  final message (in regards to format). Size is controlled via LOGGER_MESSAGE_BUFFER
-  Signature: char * fname(time_t const timestamp,int const log_level,char const * const file, int const filenumber,char * message)
+/* Longest file name kept in a record, longer ones keep their end */
+#define LOGGER_SHARED_FILE 256
 
-is_active
-  Start setting if the Logging is currently turned on. If set to "false",
-  all messages stop being transformed + pushed
-
-Return Value:
--------------
-value <= 0 = ERROR
-value > 0 = SUCCESS
-
-Description:
-------------
-Initializes the static structure in this module. Performs a few checks
-and sets initial values.
+/* false if the ring was full, the record is counted as dropped */
+static bool
+logger_shared_push(logging_shared * const shared,uint64_t const sequence,logger_time const * const timestamp,int const log_level,char const * const file,int const linenumber,char const * const message) {
+  logger_ring_header * const header = shared->header;
+  uint64_t const capacity = shared->mask + 1;
+  size_t file_length = strlen(file);
+  char const * const file_tail = file_length > LOGGER_SHARED_FILE ? file + file_length - LOGGER_SHARED_FILE : file;
+  if(file_length > LOGGER_SHARED_FILE) {file_length = LOGGER_SHARED_FILE;}
+  /* A record takes at most a quarter of the ring, the message is cut to fit */
+  size_t const message_limit = capacity / 4 - sizeof(logger_ring_record) - LOGGER_SHARED_FILE;
+  size_t message_length = strlen(message);
+  if(message_length > message_limit) {message_length = message_limit;}
+  uint64_t const size = (sizeof(logger_ring_record) + file_length + message_length + 7) & ~(uint64_t)7;
+  uint64_t head = __atomic_load_n(&header->head,__ATOMIC_RELAXED);
+  uint64_t pad;
+  do {
+    uint64_t const tail = __atomic_load_n(&header->tail,__ATOMIC_ACQUIRE);
+    uint64_t const position = head & shared->mask;
+    /* Records do not wrap, a filler takes the rest of the data */
+    pad = capacity - position < size ? capacity - position : 0;
+    if(head + pad + size - tail > capacity) {
+      __atomic_fetch_add(&header->dropped,1,__ATOMIC_RELAXED);
+      return false;
+    }
+  } while(__atomic_compare_exchange_n(&header->head,&head,head + pad + size,true,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED) == false);
+  if(pad > 0) {
+    logger_ring_record * const filler = (logger_ring_record *)(shared->data + (head & shared->mask));
+    __atomic_store_n(&filler->size,(uint32_t)pad | LOGGER_RING_PAD,__ATOMIC_RELEASE);
+  }
+  logger_ring_record * const record = (logger_ring_record *)(shared->data + ((head + pad) & shared->mask));
+  record->log_level = log_level;
+  record->sequence = sequence;
+  record->seconds = timestamp->realtime.tv_sec;
+  record->nanoseconds = (int32_t)timestamp->realtime.tv_nsec;
+  record->linenumber = linenumber;
+  record->file_length = (uint32_t)file_length;
+  record->message_length = (uint32_t)message_length;
+  memcpy((char *)(record + 1),file_tail,file_length);
+  memcpy((char *)(record + 1) + file_length,message,message_length);
+  __atomic_store_n(&record->size,(uint32_t)size,__ATOMIC_RELEASE);
+  return true;
+}
 
-ToDo: Maybe add a memory check if everything checks out?
+/*
+A drained ring is not left for the daemon, unless a forked child closes
+it: the parent still uses it. The mapping and descriptor of the child are
+its own, the lock belongs to the open file shared with the parent and
+stays until the parent closes it as well.
 */
-extern int
-logger_setup_context(int log_level,
-                    void *output_data,
-                    logger_push_log output_function,
-                    logger_transform transform_function,
-                    bool is_active) {
-  if(log_level < 0 || log_level > 7) {
-    return 0;
-  } else if(output_function == (void*)0 || transform_function == (void*)0) {
-    return -1;
+static void
+logger_shared_close(logging_shared * const shared) {
+  if(getpid() == shared->owner
+     && __atomic_load_n(&shared->header->head,__ATOMIC_ACQUIRE) == __atomic_load_n(&shared->header->tail,__ATOMIC_ACQUIRE)) {
+    unlink(shared->path);
   }
-  Logger.log_level = log_level;
-  Logger.output_object = output_data;
-  Logger.output_function = output_function;
-  Logger.transform_function = transform_function;
-  Logger.is_active = is_active;
-  return 1;
+  munmap(shared->header,shared->header->header_size + shared->mask + 1);
+  close(shared->descriptor);
+  free(shared->path);
+  free(shared);
 }
 
 /*
-Parameters:
------------
-new_output
-  The new output function to be used from this point forward.
-
-Return Value:
--------------
-value <= 0 = ERROR
-value > 0 = SUCCESS
-
-Description:
-------------
-Sets the new output function for pushing messages to the destination medium
+Creates and maps the ring file. It is set up under a temporary name and
+linked to its final one, so the daemon never sees a ring without header
+and a ring left behind by a crashed process of the same pid is never
+replaced.
 */
-extern int
-logger_set_output_callback(logger_push_log new_output) {
-  if(Logger.output_function == (void*)0 || new_output == (void*)0) {return 0;}
-  Logger.output_function = new_output;
-  return 1;
+static logging_shared *
+logger_shared_open(char const * const directory,uint64_t const capacity) {
+  static _Atomic unsigned int generation = 0;
+  logging_shared * const shared = calloc(1,sizeof(logging_shared));
+  size_t const length = strlen(directory) + 64;
+  char * const temporary = malloc(length);
+  if(shared == (void*)0 || temporary == (void*)0 || (shared->path = malloc(length)) == (void*)0) {
+    free(temporary);
+    free(shared);
+    return (void*)0;
+  }
+  if(mkdir(directory,0777) != 0 && errno != EEXIST) {
+    perror("Could not create the logger ring directory");
+  }
+  snprintf(temporary,length,"%s/.%ld.tmp",directory,(long)getpid());
+  size_t const size = sizeof(logger_ring_header) + capacity;
+  shared->descriptor = open(temporary,O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+  void *map = MAP_FAILED;
+  if(shared->descriptor >= 0 && flock(shared->descriptor,LOCK_SH) == 0 && ftruncate(shared->descriptor,(off_t)size) == 0) {
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    /* Page faults would be the only kernel entries left on the logging path */
+    flags |= MAP_POPULATE;
+#endif
+    map = mmap((void*)0,size,PROT_READ | PROT_WRITE,flags,shared->descriptor,0);
+  }
+  if(map != MAP_FAILED) {
+    shared->header = map;
+    shared->data = (char *)map + sizeof(logger_ring_header);
+    shared->mask = capacity - 1;
+    memcpy(shared->header->magic,LOGGER_RING_MAGIC,sizeof(shared->header->magic));
+    shared->header->header_size = sizeof(logger_ring_header);
+    shared->header->capacity = capacity;
+    shared->header->pid = getpid();
+    shared->owner = getpid();
+#ifdef __GLIBC__
+    strncpy(shared->header->name,program_invocation_short_name,sizeof(shared->header->name) - 1);
+#endif
+    /* link() does not replace an existing ring, unlike rename() */
+    int ret_code;
+    do {
+      snprintf(shared->path,length,"%s/%ld-%u.ring",directory,(long)getpid(),atomic_fetch_add(&generation,1));
+      ret_code = link(temporary,shared->path);
+    } while(ret_code != 0 && errno == EEXIST);
+    unlink(temporary);
+    if(ret_code == 0) {
+      free(temporary);
+      return shared;
+    }
+    munmap(map,size);
+  } else if(shared->descriptor >= 0) {
+    unlink(temporary);
+  }
+  perror("Could not create the logger ring");
+  if(shared->descriptor >= 0) {close(shared->descriptor);}
+  free(temporary);
+  free(shared->path);
+  free(shared);
+  return (void*)0;
+}
+
+static void
+logger_factory_shared_exit(void) {
+  logging_shared * const shared = logger_factory_shared_ring;
+  if(shared == (void*)0) {return;}
+  if(Logger.shared == shared) {Logger.shared = (void*)0;}
+  logger_factory_shared_ring = (void*)0;
+  logger_shared_close(shared);
 }
 
 /*
 Parameters:
 -----------
 log_level
-  The new Log level in the Range LOGGER_EMERGENCY -> LOGGER_DEBUG
+  Same as logger_factory_file()
+
+directory
+  Directory of the rings, (void*)0 for LOGGER_SHARED_DIRECTORY. It has to
+  be the one loggerd watches
+
+capacity
+  Bytes of records in the ring, rounded up to a power of 2 between 4 KiB
+  and 1 GiB, 0 for LOGGER_SHARED_CAPACITY
 
 Return Value:
 -------------
@@ -292,208 +1099,5813 @@ value > 0 = SUCCESS
 
 Description:
 ------------
-Sets the new output log level for pushing messages to the destination medium
+Sends the messages as raw records through a shared memory ring to
+tools/loggerd.c, which formats, merges and writes the messages of all
+processes, see "Shared memory ring" above. Transform and output
+functions are not called, neither is there a need for a pipeline.
+Messages that do not fit a quarter of the ring are cut, a full ring
+drops messages. logger_log_durable() can only confirm that a message
+reached the ring. Replaces a ring set up before.
 */
 extern int
-logger_set_loglevel(int log_level) {
-  if(log_level < 0 || Logger.log_level == log_level) {return 0;}
-  Logger.log_level = log_level;
-  return 1;
+logger_factory_shared(int log_level,char const * const directory,size_t capacity) {
+  static bool exit_handler = false;
+  if(log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG) {return -1;}
+  size_t const target = capacity != 0 ? capacity : LOGGER_SHARED_CAPACITY;
+  uint64_t size = 4096;
+  while(size < target && size < (1u << 30)) {size <<= 1;}
+  logging_shared * const shared = logger_shared_open(directory != (void*)0 ? directory : LOGGER_SHARED_DIRECTORY,size);
+  if(shared == (void*)0) {return -2;}
+  if(exit_handler == false) {
+    if(atexit(logger_factory_shared_exit) != 0) {
+      fprintf(stderr,"Could not setup atexit handler\n");
+      logger_shared_close(shared);
+      return -3;
+    }
+    exit_handler = true;
+  }
+  logger_factory_shared_exit();
+  /* Only used again once the ring is closed at exit, there is nothing to flush before */
+  int const ret_code = logger_setup_context(log_level,stderr,logger_factory_console_output,logger_factory_console_transform,true);
+  if(ret_code <= 0) {
+    logger_shared_close(shared);
+    return ret_code;
+  }
+  logger_factory_shared_ring = shared;
+  Logger.shared = shared;
+  return ret_code;
 }
 
 /*
-Parameters:
------------
-new_transform
-  The new transform function to be used from this point forward.
-
-Return Value:
--------------
-value <= 0 = ERROR
-value > 0 = SUCCESS
+Sequence number of the record currently handed to the transform and
+output functions on this thread, see logger_current_sequence()
+*/
+static _Thread_local uint64_t logger_sequence_current = 0;
 
-Description:
-------------
-Sets the new transform function for modifying messages to the output function
+/*
+Reads the clocks selected with logger_set_clock(). The coarse clocks are
+only updated once per tick (usually 1-4 ms) but are considerably cheaper
+to read.
 */
-extern int
-logger_set_transform(logger_transform new_transform) {
-  if(Logger.output_function == (void*)0 || new_transform == (void*)0) {return 0;}
-  Logger.transform_function = new_transform;
-  return 1;
+static void
+logger_clock_now(int const clock_flags,logger_time * const now) {
+  clockid_t realtime = CLOCK_REALTIME;
+  clockid_t monotonic = CLOCK_MONOTONIC;
+#if defined(CLOCK_REALTIME_COARSE) && defined(CLOCK_MONOTONIC_COARSE)
+  if(clock_flags & LOGGER_CLOCK_COARSE) {
+    realtime = CLOCK_REALTIME_COARSE;
+    monotonic = CLOCK_MONOTONIC_COARSE;
+  }
+#endif
+  clock_gettime(realtime,&now->realtime);
+  if(clock_flags & LOGGER_CLOCK_MONOTONIC) {
+    clock_gettime(monotonic,&now->monotonic);
+  } else {
+    now->monotonic.tv_sec = 0;
+    now->monotonic.tv_nsec = 0;
+  }
 }
 
 /*
-Parameters:
------------
-set_active
-  true = messages are pushed / false = messages are silent
+TSC timestamps (LOGGER_CLOCK_TSC)
 
-Return Value:
--------------
-None
+The hot path only stores the raw time stamp counter. It is converted to
+realtime / monotonic nanoseconds right before the transform function
+runs, which is the writer thread for the asynchronous pipeline.
 
-Description:
-------------
-Determines, if messages are silent or should be pushed
+Conversion is linear around a base sample:
+  ns = base_ns + ((tsc - tsc_base) * multiplier) >> 32
+The multiplier is measured against CLOCK_MONOTONIC. Once a converted
+stamp is more than LOGGER_TSC_RECALIBRATION_NS past the base, the
+converting thread takes a new sample, derives the multiplier over the
+whole interval and moves the base. That way realtime adjustments (NTP)
+are picked up and the frequency estimate keeps getting more precise.
+
+The calibration is read under a sequence lock, only one thread at a time
+recalibrates. Without an invariant TSC (constant rate, not stopped in
+deep C-states, CPUID 0x80000007 EDX bit 8) the flag is ignored and
+clock_gettime is used instead.
 */
-extern void
-logger_toggle(bool set_active) {
-  if(set_active == Logger.is_active) {return;}
-  Logger.is_active = set_active;
-}
+#define LOGGER_TSC_RECALIBRATION_NS 1000000000LL
 
-/*
-Parameters:
------------
-None
+typedef struct {
+  _Atomic uint32_t version;
+  _Atomic uint64_t tsc_base;
+  _Atomic int64_t realtime_base;
+  _Atomic int64_t monotonic_base;
+  _Atomic uint64_t multiplier;
+  _Atomic uint64_t recalibration_ticks;
+  atomic_flag recalibrating;
+} logging_tsc;
 
-Return Value:
--------------
-bool
-  true = messages are pushed / false = messages are silent
+static logging_tsc logger_tsc_calibration = {.recalibrating = ATOMIC_FLAG_INIT};
 
-Description:
-------------
+static inline uint64_t
+logger_tsc_read(void) {
+#ifdef LOGGER_HAS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
 
-*/
-extern bool
-logger_get_status(void) {
-  return Logger.is_active;
+static bool
+logger_tsc_is_invariant(void) {
+#ifdef LOGGER_HAS_TSC
+  unsigned int eax,ebx,ecx,edx;
+  if(__get_cpuid(0x80000000,&eax,&ebx,&ecx,&edx) == 0 || eax < 0x80000007) {return false;}
+  if(__get_cpuid(0x80000007,&eax,&ebx,&ecx,&edx) == 0) {return false;}
+  return (edx & (1u << 8)) != 0;
+#else
+  return false;
+#endif
 }
 
-/*
-Parameters:
------------
-None
+static int64_t
+logger_timespec_ns(struct timespec const * const time) {
+  return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
 
-Return Value:
--------------
-bool
-  true = struct seems initialized / false = struct appears to be invalid
+/* Brackets the clock reads with two TSC reads and takes the middle */
+static void
+logger_tsc_sample(uint64_t *tsc,int64_t *realtime,int64_t *monotonic) {
+  struct timespec realtime_now,monotonic_now;
+  uint64_t const before = logger_tsc_read();
+  clock_gettime(CLOCK_MONOTONIC,&monotonic_now);
+  clock_gettime(CLOCK_REALTIME,&realtime_now);
+  uint64_t const after = logger_tsc_read();
+  *tsc = before + (after - before) / 2;
+  *realtime = logger_timespec_ns(&realtime_now);
+  *monotonic = logger_timespec_ns(&monotonic_now);
+}
 
-Description:
-------------
+static void
+logger_tsc_publish(uint64_t tsc,int64_t realtime,int64_t monotonic,uint64_t multiplier) {
+  logging_tsc *calibration = &logger_tsc_calibration;
+  atomic_fetch_add_explicit(&calibration->version,1,memory_order_acq_rel);
+  atomic_store_explicit(&calibration->tsc_base,tsc,memory_order_relaxed);
+  atomic_store_explicit(&calibration->realtime_base,realtime,memory_order_relaxed);
+  atomic_store_explicit(&calibration->monotonic_base,monotonic,memory_order_relaxed);
+  atomic_store_explicit(&calibration->multiplier,multiplier,memory_order_relaxed);
+  atomic_store_explicit(&calibration->recalibration_ticks,((uint64_t)LOGGER_TSC_RECALIBRATION_NS << 32) / multiplier,memory_order_relaxed);
+  atomic_fetch_add_explicit(&calibration->version,1,memory_order_release);
+}
 
+/*
+Takes the initial calibration over a short 10 ms interval.
+Returns false without an invariant TSC.
 */
-extern bool
-logger_is_initialized(void) {
-  if(Logger.transform_function != (void*)0 && Logger.output_function != (void*)0 && Logger.log_level >= LOGGER_EMERGENCY && Logger.log_level <= LOGGER_DEBUG) {
-    return true;
+static bool
+logger_tsc_calibrate(void) {
+  if(logger_tsc_is_invariant() == false) {return false;}
+  uint64_t first_tsc,second_tsc;
+  int64_t first_realtime,second_realtime,first_monotonic,second_monotonic;
+  logger_tsc_sample(&first_tsc,&first_realtime,&first_monotonic);
+  struct timespec const interval = {.tv_sec = 0,.tv_nsec = 10000000L};
+  nanosleep(&interval,(void*)0);
+  logger_tsc_sample(&second_tsc,&second_realtime,&second_monotonic);
+  if(second_tsc <= first_tsc || second_monotonic <= first_monotonic) {return false;}
+  uint64_t const multiplier = ((uint64_t)(second_monotonic - first_monotonic) << 32) / (second_tsc - first_tsc);
+  if(multiplier == 0) {return false;}
+  logger_tsc_publish(second_tsc,second_realtime,second_monotonic,multiplier);
+  return true;
+}
+
+static void
+logger_tsc_recalibrate(void) {
+  logging_tsc *calibration = &logger_tsc_calibration;
+  if(atomic_flag_test_and_set_explicit(&calibration->recalibrating,memory_order_acquire)) {return;}
+  uint64_t const old_tsc = atomic_load_explicit(&calibration->tsc_base,memory_order_relaxed);
+  int64_t const old_monotonic = atomic_load_explicit(&calibration->monotonic_base,memory_order_relaxed);
+  uint64_t tsc;
+  int64_t realtime,monotonic;
+  logger_tsc_sample(&tsc,&realtime,&monotonic);
+  if(tsc > old_tsc && monotonic > old_monotonic) {
+    uint64_t const multiplier = (uint64_t)(((unsigned __int128)(monotonic - old_monotonic) << 32) / (tsc - old_tsc));
+    if(multiplier != 0) {
+      logger_tsc_publish(tsc,realtime,monotonic,multiplier);
+    }
   }
-  return false;
+  atomic_flag_clear_explicit(&calibration->recalibrating,memory_order_release);
 }
 
-#ifdef LOGGERTESTSUITE
+static void
+logger_ns_timespec(int64_t ns,struct timespec *time) {
+  time->tv_sec = ns / 1000000000LL;
+  time->tv_nsec = ns % 1000000000LL;
+}
 
+/* Converts a raw stamp taken with LOGGER_CLOCK_TSC */
 static void
-tests_preinit_check(void **state) {
-  (void*)state;
-  assert_true(sizeof(logging_context) > 0);
-  char const * const check_pointer = (char const * const)&Logger;
-  for(size_t index = 0;index < sizeof(logging_context);index++) {
-    assert_true(*check_pointer == 0);
+logger_tsc_convert(uint64_t const tsc,int const clock_flags,logger_time * const time) {
+  logging_tsc *calibration = &logger_tsc_calibration;
+  uint64_t tsc_base,multiplier;
+  int64_t realtime_base,monotonic_base;
+  for(;;) {
+    uint32_t const version = atomic_load_explicit(&calibration->version,memory_order_acquire);
+    if(version & 1) {continue;}
+    tsc_base = atomic_load_explicit(&calibration->tsc_base,memory_order_relaxed);
+    realtime_base = atomic_load_explicit(&calibration->realtime_base,memory_order_relaxed);
+    monotonic_base = atomic_load_explicit(&calibration->monotonic_base,memory_order_relaxed);
+    multiplier = atomic_load_explicit(&calibration->multiplier,memory_order_relaxed);
+    uint64_t const recalibration_ticks = atomic_load_explicit(&calibration->recalibration_ticks,memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if(atomic_load_explicit(&calibration->version,memory_order_relaxed) != version) {continue;}
+    if(tsc > tsc_base && tsc - tsc_base > recalibration_ticks) {
+      logger_tsc_recalibrate();
+      continue;
+    }
+    break;
+  }
+  int64_t offset;
+  if(tsc >= tsc_base) {
+    offset = (int64_t)(((unsigned __int128)(tsc - tsc_base) * multiplier) >> 32);
+  } else {
+    offset = -(int64_t)(((unsigned __int128)(tsc_base - tsc) * multiplier) >> 32);
+  }
+  logger_ns_timespec(realtime_base + offset,&time->realtime);
+  if(clock_flags & LOGGER_CLOCK_MONOTONIC) {
+    logger_ns_timespec(monotonic_base + offset,&time->monotonic);
+  } else {
+    time->monotonic.tv_sec = 0;
+    time->monotonic.tv_nsec = 0;
   }
 }
 
-static char tests_output_simple[LOGGER_MESSAGE_BUFFER] = {0};
+/*
+Hot path stamp. With LOGGER_CLOCK_TSC only the raw counter is returned
+and now is left untouched, otherwise now is filled and 0 returned.
+*/
+static inline uint64_t
+logger_clock_stamp(int const clock_flags,logger_time * const now) {
+  if(clock_flags & LOGGER_CLOCK_TSC) {
+    return logger_tsc_read();
+  }
+  logger_clock_now(clock_flags,now);
+  return 0;
+}
 
-static int
-tests_init_output(void const * const custom_object,char const * const message) {
-  snprintf((char *)custom_object,LOGGER_MESSAGE_BUFFER,"%s",message);
-  return 1;
+/*
+Shared tail of the synchronous and the asynchronous path: runs the
+transform function and hands the result to the output function.
+*/
+static void
+logger_push(logging_context const * const context,uint64_t const sequence,logger_time const * const timestamp,int const log_level,char const * const file,int const linenumber,char *message) {
+  if(context->shared != (void*)0) {
+    logger_shared_push(context->shared,sequence,timestamp,log_level,file,linenumber,message);
+    return;
+  }
+  logger_sequence_current = sequence;
+  char const * const transformed = context->transform_function(timestamp,log_level,file,linenumber,message);
+  /* The sink of a watched configuration file replaces the output */
+  logging_config const * const config = atomic_load_explicit(&context->config,memory_order_acquire);
+  bool const configured = config != (void*)0 && config->sink != (void*)0;
+  logger_push_log const output_function = configured ? logger_factory_console_output : context->output_function;
+  void const * const output_object = configured ? config->sink : context->output_object;
+  if(transformed == (void*)0 || output_function(output_object,transformed) < 1) {
+    fprintf(stderr,"Could not log message - push function failed\n");
+  }
+  logger_sequence_current = 0;
 }
 
-static char *
-tests_init_transform(time_t const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
-  assert_true(timestamp > 0);
-  assert_true(log_level >= LOGGER_EMERGENCY);
-  assert_true(log_level <= LOGGER_DEBUG);
-  assert_true(file != (void*)0);
-  assert_true(filenumber > -1);
-  assert_true(message != (void*)0);
-  char tmp_buffer[LOGGER_MESSAGE_BUFFER] = {0};
-  char const log_level_mapping[][10] = {
-    "EMERGENCY",
-    "ALERT",
-    "CRITICAL",
-    "ERROR",
-    "WARNING",
-    "NOTICE",
-    "INFO",
-    "DEBUG"
-  };
-  time_t fixed_time = 1633035745;
-  int const offset = strftime(tmp_buffer,LOGGER_MESSAGE_BUFFER,"%c",localtime(&fixed_time));
-  if(offset < 1) {
-    fprintf(stderr,"Could not write time to buffer\n");
-    return (void*)0;
+/* false if the flush callback failed */
+static bool
+logger_flush_output(logging_context const * const context,bool const durable) {
+  logging_config const * const config = atomic_load_explicit(&context->config,memory_order_acquire);
+  bool const configured = config != (void*)0 && config->sink != (void*)0;
+  logger_flush const flush_function = configured ? logger_factory_console_flush : context->flush_function;
+  void const * const output_object = configured ? config->sink : context->output_object;
+  if(flush_function != (void*)0 && flush_function(output_object,durable) < 1) {
+    fprintf(stderr,"Could not flush log output\n");
+    return false;
   }
-  if(snprintf(tmp_buffer + offset,LOGGER_MESSAGE_BUFFER," %-10s %s:%d - %s\n",log_level_mapping[log_level],file,filenumber,message) < 1) {
-    fprintf(stderr,"Could not amalgamate Message - sprintf returned 0 bytes");
-    return (void*)0;
+  return true;
+}
+
+static int64_t
+logger_monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return logger_timespec_ns(&now);
+}
+
+/*
+Flushes the output durably for a caller without a pipeline. Returns once
+a durable flush that started after the call has finished, callers that
+arrive while one runs wait for it and share the next. false if that
+flush failed.
+*/
+static bool
+logger_durable_commit(logging_context * const context) {
+  logging_durable * const durable = &context->durable;
+  pthread_mutex_lock(&durable->lock);
+  uint64_t const needed = durable->started + 1;
+  while(durable->finished < needed) {
+    if(durable->syncing) {
+      pthread_cond_wait(&durable->done,&durable->lock);
+      continue;
+    }
+    durable->syncing = true;
+    uint64_t const round = ++durable->started;
+    pthread_mutex_unlock(&durable->lock);
+    bool const result = logger_flush_output(context,true);
+    pthread_mutex_lock(&durable->lock);
+    durable->syncing = false;
+    durable->finished = round;
+    durable->result = result;
+    atomic_store(&durable->synced_at,logger_monotonic_ns());
+    pthread_cond_broadcast(&durable->done);
   }
-  memset(message,0,LOGGER_MESSAGE_BUFFER);
-  memcpy(message,&tmp_buffer,LOGGER_MESSAGE_BUFFER);
-  return message;
+  bool const result = durable->result;
+  pthread_mutex_unlock(&durable->lock);
+  return result;
 }
 
+/*
+Message buffers
+
+logger_log() formats into a per thread buffer of LOGGER_MESSAGE_BUFFER
+bytes (plus the transform headroom) that is never cleared, vsnprintf
+terminates the message anyway. Only if vsnprintf reports a longer
+message, it is formatted a second time into a per thread arena. The
+arena grows in powers of two up to LOGGER_MESSAGE_MAX and is kept for
+the next long message, it is released when the thread exits.
+Messages that still do not fit (or if the arena could not grow) are cut
+and end with LOGGER_TRUNCATION_MARK, logger_stats.truncated counts them.
+A second arena holds messages with their backtrace appended.
+
+An output or transform function that logs itself would overwrite the
+buffer that is currently pushed, such nested calls use a stack buffer
+without arena instead.
+*/
+typedef struct {
+  bool busy;
+  bool tracing;
+  char *arena;
+  size_t arena_capacity;
+  char *trace;
+  size_t trace_capacity;
+  char message[LOGGER_MESSAGE_BUFFER + LOGGER_TRANSFORM_HEADROOM];
+} logging_buffer;
+
+static _Thread_local logging_buffer logger_thread_buffer;
+static pthread_key_t logger_arena_key;
+static pthread_once_t logger_arena_once = PTHREAD_ONCE_INIT;
+
 static void
-tests_init_check(void **state) {
-  assert_true(logger_setup_context(-1,(void*)0,tests_init_output,tests_init_transform,true) < 1);
-  assert_true(logger_setup_context(LOGGER_DEBUG,(void*)0,(void*)0,tests_init_transform,true) < 1);
-  assert_true(logger_setup_context(LOGGER_DEBUG,(void*)0,tests_init_output,(void*)0,true) < 1);
-  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_init_transform,true) > 0);
-  assert_true(logger_get_status() == true);
-  logger_toggle(false);
-  assert_true(logger_get_status() == false);
-  logger_toggle(true);
-  assert_true(logger_get_status() == true);
+logger_arena_release(void *custom_object) {
+  logging_buffer *buffer = custom_object;
+  free(buffer->arena);
+  free(buffer->trace);
+  buffer->arena = buffer->trace = (void*)0;
+  buffer->arena_capacity = buffer->trace_capacity = 0;
 }
 
 static void
-tests_simpleoutputs_check(void **state) {
-  logger_info("This is one Test");
-  assert_string_equal(tests_output_simple,"Thu Sep 30 23:02:25 2021 INFO       ./src/logger.c:456 - This is one Test\n");
-  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
-  logger_debug("This is a parameter test: %s","parameter");
-  assert_string_equal(tests_output_simple,"Thu Sep 30 23:02:25 2021 DEBUG      ./src/logger.c:459 - This is a parameter test: parameter\n");
-  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
-  logger_debug("Another slightly longer message 000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000...");
-  assert_string_equal(tests_output_simple,"Thu Sep 30 23:02:25 2021 DEBUG      ./src/logger.c:462 - Another slightly longer message 000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000...\n");
-  logger_toggle(false);
-  logger_debug("A string that will disappear");
-  assert_string_equal(tests_output_simple,"Thu Sep 30 23:02:25 2021 DEBUG      ./src/logger.c:462 - Another slightly longer message 000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000...\n");
-  logger_toggle(true);
-  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+logger_arena_key_create(void) {
+  if(pthread_key_create(&logger_arena_key,logger_arena_release) != 0) {
+    fprintf(stderr,"Could not create arena key - arenas leak on thread exit\n");
+  }
 }
 
+/* Releases the arenas of this thread once it exits */
 static void
-tests_simplefile_check(void **state) {
-  assert_true(logger_factory_file(LOGGER_DEBUG,"./logger_tests_long_filename.txt") > 0);
-  assert_true(logger_set_transform(tests_init_transform) == 1);
-  logger_info("this is one exact test output");
-  logger_debug("Another line in the file %s","lsdkfjlsdkfjsldfkjsldfkjsdflksjdflkjsdfklj");
-  fflush(logger_factory_file_file);
-  fclose(logger_factory_file_file);
-  logger_factory_file_file = (void*)0;
-  remove("./logger_tests_long_filename.txt");
+logger_arena_register(logging_buffer * const buffer) {
+  pthread_once(&logger_arena_once,logger_arena_key_create);
+  pthread_setspecific(logger_arena_key,buffer);
+}
+
+/* Returns a buffer of at least size bytes or 0 if the arena can not grow */
+static char *
+logger_arena_reserve(logging_buffer * const buffer,size_t const size) {
+  if(size <= buffer->arena_capacity) {return buffer->arena;}
+  size_t capacity = buffer->arena_capacity > 0 ? buffer->arena_capacity : LOGGER_MESSAGE_BUFFER * 2;
+  while(capacity < size) {capacity *= 2;}
+  if(capacity > LOGGER_MESSAGE_MAX + LOGGER_TRANSFORM_HEADROOM) {
+    capacity = LOGGER_MESSAGE_MAX + LOGGER_TRANSFORM_HEADROOM;
+  }
+  char *arena = realloc(buffer->arena,capacity);
+  if(arena == (void*)0) {return (void*)0;}
+  logger_arena_register(buffer);
+  buffer->arena = arena;
+  buffer->arena_capacity = capacity;
+  return arena;
 }
 
+/* Ends the length bytes in message with the truncation mark */
 static void
-tests_simplecsv_check(void **state) {
-  assert_true(logger_factory_csv(LOGGER_DEBUG,"./logger_tests_long_filename.csv") > 0);
-  logger_info("this is the first test");
-  logger_debug("about to finish the test: %s","02034020342394827394");
-  for(size_t index = 0;index < 200;index++) {
-    switch(index % (LOGGER_DEBUG + 1)) {
-      case LOGGER_EMERGENCY:
-        logger_emergency("a message that comes in from the loop");
-        break;
-      case LOGGER_ALERT:
-        logger_alert("a message that comes in from the loop");
-        break;
-      case LOGGER_CRITICAL:
+logger_mark_truncated(logging_context * const context,char * const message,size_t const length) {
+  size_t const mark_length = sizeof(LOGGER_TRUNCATION_MARK) - 1;
+  size_t const offset = length > mark_length ? length - mark_length : 0;
+  memcpy(message + offset,LOGGER_TRUNCATION_MARK,length - offset);
+  message[length] = '\0';
+  atomic_fetch_add_explicit(&context->truncated,1,memory_order_relaxed);
+}
+
+/*
+Backtraces
+
+With logger_set_backtrace() the dispatch captures the raw return
+addresses of messages up to a given level with backtrace(), which is
+cheap after its first call (done in logger_set_backtrace, it may load
+libgcc). The addresses travel with the record, symbolization happens
+when the record is pushed - on the writer thread with a running
+asynchronous pipeline - and appends one line per frame:
+  "\n  #0 function+0x1f (module)"
+Output functions get the raw addresses from logger_current_backtrace().
+
+Symbols come from dladdr() for the module and from the ELF symbol table
+of the module file (.symtab, .dynsym if stripped), which also knows
+static functions. Each module file is mapped and its function symbols
+sorted once, resolved addresses are kept in a small direct mapped cache.
+Modules that are unloaded with dlclose() are not tracked.
+*/
+#if defined(__linux__) && defined(__GLIBC__)
+#define LOGGER_HAS_BACKTRACE 1
+#endif
+
+#define LOGGER_BACKTRACE_LINE 256
+#define LOGGER_BACKTRACE_SKIP 3
+#define LOGGER_SYMBOL_MODULES 64
+#define LOGGER_SYMBOL_CACHE 1024
+
+static _Thread_local struct {
+  void * const *frames;
+  int count;
+} logger_backtrace_current;
+
+#ifdef LOGGER_HAS_BACKTRACE
+typedef struct {
+  uintptr_t start;
+  uintptr_t size;
+  char const *name;
+} logging_symbol;
+
+typedef struct {
+  uintptr_t base;
+  uintptr_t bias;
+  char const *name;
+  logging_symbol *symbols;
+  size_t count;
+} logging_module;
+
+static struct {
+  pthread_mutex_t lock;
+  logging_module modules[LOGGER_SYMBOL_MODULES];
+  size_t module_count;
+  struct {
+    uintptr_t address;
+    uintptr_t start;
+    char const *name;
+    logging_module const *module;
+  } cache[LOGGER_SYMBOL_CACHE];
+} logger_symbols = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int
+logger_symbol_compare(void const *left,void const *right) {
+  uintptr_t const first = ((logging_symbol const *)left)->start;
+  uintptr_t const second = ((logging_symbol const *)right)->start;
+  return first < second ? -1 : first > second;
+}
+
+/* Maps the module file and collects its function symbols, the mapping stays for the names */
+static void
+logger_symbols_load(logging_module *module,char const *path) {
+  int const descriptor = open(path,O_RDONLY | O_CLOEXEC);
+  if(descriptor < 0) {return;}
+  struct stat status;
+  void *image = MAP_FAILED;
+  if(fstat(descriptor,&status) == 0 && (size_t)status.st_size >= sizeof(ElfW(Ehdr))) {
+    image = mmap((void*)0,status.st_size,PROT_READ,MAP_PRIVATE,descriptor,0);
+  }
+  close(descriptor);
+  if(image == MAP_FAILED) {return;}
+  size_t const size = status.st_size;
+  unsigned char const * const bytes = image;
+  ElfW(Ehdr) const * const header = image;
+  if(memcmp(header->e_ident,ELFMAG,SELFMAG) != 0 || header->e_shentsize != sizeof(ElfW(Shdr))
+     || header->e_shoff > size || header->e_shnum > (size - header->e_shoff) / sizeof(ElfW(Shdr))) {
+    munmap(image,size);
+    return;
+  }
+  module->bias = header->e_type == ET_DYN ? module->base : 0;
+  ElfW(Shdr) const * const sections = (ElfW(Shdr) const *)(bytes + header->e_shoff);
+  ElfW(Shdr) const *table = (void*)0;
+  for(size_t index = 0;index < header->e_shnum;index++) {
+    if(sections[index].sh_type == SHT_SYMTAB || (sections[index].sh_type == SHT_DYNSYM && table == (void*)0)) {
+      table = &sections[index];
+    }
+  }
+  if(table == (void*)0 || table->sh_link >= header->e_shnum || table->sh_offset > size
+     || table->sh_size > size - table->sh_offset || sections[table->sh_link].sh_offset > size
+     || sections[table->sh_link].sh_size > size - sections[table->sh_link].sh_offset) {
+    munmap(image,size);
+    return;
+  }
+  ElfW(Sym) const * const symbols = (ElfW(Sym) const *)(bytes + table->sh_offset);
+  size_t const symbol_count = table->sh_size / sizeof(ElfW(Sym));
+  char const * const names = (char const *)(bytes + sections[table->sh_link].sh_offset);
+  size_t const names_size = sections[table->sh_link].sh_size;
+  module->symbols = malloc(sizeof(logging_symbol) * (symbol_count + 1));
+  if(module->symbols == (void*)0) {
+    munmap(image,size);
+    return;
+  }
+  for(size_t index = 0;index < symbol_count;index++) {
+    if(ELF64_ST_TYPE(symbols[index].st_info) != STT_FUNC || symbols[index].st_value == 0
+       || symbols[index].st_name >= names_size || memchr(names + symbols[index].st_name,'\0',names_size - symbols[index].st_name) == (void*)0) {
+      continue;
+    }
+    module->symbols[module->count++] = (logging_symbol){symbols[index].st_value,symbols[index].st_size,names + symbols[index].st_name};
+  }
+  qsort(module->symbols,module->count,sizeof(logging_symbol),logger_symbol_compare);
+}
+
+static logging_module *
+logger_symbols_module(Dl_info const * const info) {
+  uintptr_t const base = (uintptr_t)info->dli_fbase;
+  for(size_t index = 0;index < logger_symbols.module_count;index++) {
+    if(logger_symbols.modules[index].base == base) {return &logger_symbols.modules[index];}
+  }
+  if(logger_symbols.module_count == LOGGER_SYMBOL_MODULES) {return (void*)0;}
+  logging_module *module = &logger_symbols.modules[logger_symbols.module_count++];
+  /* dladdr() reports argv[0] for the main program, which may be relative */
+  bool const main_program = info->dli_fname == (void*)0 || info->dli_fname[0] == '\0'
+                         || strcmp(info->dli_fname,program_invocation_name) == 0;
+  char const * const path = main_program ? "/proc/self/exe" : info->dli_fname;
+  char const * const slash = main_program ? strrchr(program_invocation_name,'/') : strrchr(info->dli_fname,'/');
+  module->base = base;
+  module->name = slash != (void*)0 ? slash + 1 : (main_program ? program_invocation_name : info->dli_fname);
+  logger_symbols_load(module,path);
+  return module;
+}
+
+static logging_symbol const *
+logger_symbols_find(logging_module const * const module,uintptr_t const address) {
+  size_t low = 0;
+  size_t high = module->count;
+  while(low < high) {
+    size_t const middle = low + (high - low) / 2;
+    if(module->symbols[middle].start <= address) {low = middle + 1;} else {high = middle;}
+  }
+  if(low == 0) {return (void*)0;}
+  logging_symbol const * const symbol = &module->symbols[low - 1];
+  return symbol->size == 0 || address < symbol->start + symbol->size ? symbol : (void*)0;
+}
+#endif
+
+static size_t
+logger_format_address(char * const buffer,size_t offset,size_t const capacity,uintptr_t const address) {
+  char digits[2 + sizeof(uintptr_t) * 2];
+  size_t position = sizeof(digits);
+  uintptr_t value = address;
+  do {
+    digits[--position] = logger_encode_hex_digits[value & 0x0f];
+    value >>= 4;
+  } while(value != 0);
+  digits[--position] = 'x';
+  digits[--position] = '0';
+  return logger_format_bytes(buffer,offset,capacity,digits + position,sizeof(digits) - position);
+}
+
+/*
+Parameters:
+-----------
+address
+  A return address, e.g. from logger_current_backtrace()
+
+output / capacity
+  Buffer for the text, capacity must be at least 1
+
+Return Value:
+-------------
+Length of the text without the terminating 0 byte
+
+Description:
+------------
+Writes "function+0x1f (module)". Without a symbol the address and its
+offset in the module file are written instead, "0x7f3a... (module+0x1783)",
+which addr2line can resolve offline.
+The address is looked up one byte before, so calls at the very end of a
+function still resolve to that function.
+*/
+extern size_t
+logger_symbolize(void const * const address,char *output,size_t capacity) {
+  if(output == (void*)0 || capacity == 0) {return 0;}
+  uintptr_t const call = (uintptr_t)address - 1;
+  char const *name = (void*)0;
+  char const *module_name = (void*)0;
+  uintptr_t start = 0;
+  uintptr_t base = 0;
+#ifdef LOGGER_HAS_BACKTRACE
+  logging_module const *module = (void*)0;
+  pthread_mutex_lock(&logger_symbols.lock);
+  size_t const slot = (call >> 2) % LOGGER_SYMBOL_CACHE;
+  if(logger_symbols.cache[slot].address == call && call != 0) {
+    name = logger_symbols.cache[slot].name;
+    start = logger_symbols.cache[slot].start;
+    module = logger_symbols.cache[slot].module;
+  } else {
+    Dl_info info;
+    if(dladdr((void *)call,&info) != 0 && (module = logger_symbols_module(&info)) != (void*)0) {
+      logging_symbol const * const symbol = logger_symbols_find(module,call - module->bias);
+      if(symbol != (void*)0) {
+        name = symbol->name;
+        start = symbol->start + module->bias;
+      } else if(info.dli_sname != (void*)0) {
+        name = info.dli_sname;
+        start = (uintptr_t)info.dli_saddr;
+      }
+    }
+    logger_symbols.cache[slot].address = call;
+    logger_symbols.cache[slot].name = name;
+    logger_symbols.cache[slot].start = start;
+    logger_symbols.cache[slot].module = module;
+  }
+  if(module != (void*)0) {
+    module_name = module->name;
+    base = module->base;
+  }
+  pthread_mutex_unlock(&logger_symbols.lock);
+#endif
+  size_t offset = 0;
+  if(name != (void*)0) {
+    offset = logger_format_bytes(output,offset,capacity,name,strlen(name));
+    offset = logger_format_bytes(output,offset,capacity,"+",1);
+    offset = logger_format_address(output,offset,capacity,(uintptr_t)address - start);
+  } else {
+    offset = logger_format_address(output,offset,capacity,(uintptr_t)address);
+  }
+  if(module_name != (void*)0) {
+    offset = logger_format_bytes(output,offset,capacity," (",2);
+    offset = logger_format_bytes(output,offset,capacity,module_name,strlen(module_name));
+    if(name == (void*)0) {
+      offset = logger_format_bytes(output,offset,capacity,"+",1);
+      offset = logger_format_address(output,offset,capacity,(uintptr_t)address - base);
+    }
+    offset = logger_format_bytes(output,offset,capacity,")",1);
+  }
+  output[offset < capacity ? offset : capacity - 1] = '\0';
+  return offset < capacity ? offset : capacity - 1;
+}
+
+/*
+Captures the return addresses of the caller of the logging function.
+entry is the return address of the dispatch, frames up to and including
+it and inner_frames more are skipped. Unwinders that report it
+differently fall back to skipping this function, the dispatch and the
+logging function.
+*/
+__attribute__((noinline))
+static int
+logger_backtrace_capture(void **frames,int const depth,void const * const entry,int const inner_frames) {
+#ifdef LOGGER_HAS_BACKTRACE
+  void *captured[LOGGER_BACKTRACE_DEPTH + LOGGER_BACKTRACE_SKIP + 1];
+  int const captured_count = backtrace(captured,depth + LOGGER_BACKTRACE_SKIP + inner_frames);
+  int skip = LOGGER_BACKTRACE_SKIP + inner_frames;
+  for(int index = 0;index < captured_count && index <= LOGGER_BACKTRACE_SKIP;index++) {
+    if(captured[index] == entry) {
+      skip = index + 1 + inner_frames;
+      break;
+    }
+  }
+  int count = captured_count - skip;
+  if(count <= 0) {return 0;}
+  if(count > depth) {count = depth;}
+  memcpy(frames,captured + skip,sizeof(void *) * count);
+  return count;
+#else
+  return 0;
+#endif
+}
+
+/*
+Pushes a message with its backtrace appended. The combined text goes
+into a second per thread arena, message may live in the first one.
+*/
+static void
+logger_push_traced(logging_context * const context,uint64_t const sequence,logger_time const * const timestamp,int const log_level,char const * const file,int const linenumber,char *message,void * const *frames,int const count) {
+  logging_buffer * const buffer = &logger_thread_buffer;
+  /* A traced message logged from within the output function goes without its trace */
+  if(count <= 0 || buffer->tracing) {
+    logger_push(context,sequence,timestamp,log_level,file,linenumber,message);
+    return;
+  }
+  size_t const length = strlen(message);
+  size_t const size = length + (size_t)count * LOGGER_BACKTRACE_LINE + 1 + LOGGER_TRANSFORM_HEADROOM;
+  char *text = buffer->trace;
+  if(buffer->trace_capacity < size) {
+    text = realloc(buffer->trace,size);
+    if(text == (void*)0) {
+      logger_push(context,sequence,timestamp,log_level,file,linenumber,message);
+      return;
+    }
+    buffer->trace = text;
+    buffer->trace_capacity = size;
+    logger_arena_register(buffer);
+  }
+  memcpy(text,message,length);
+  size_t offset = length;
+  for(int index = 0;index < count;index++) {
+    offset = logger_format_bytes(text,offset,size,"\n  #",4);
+    offset = logger_format_unsigned(text,offset,size,index,0);
+    offset = logger_format_bytes(text,offset,size," ",1);
+    offset += logger_symbolize(frames[index],text + offset,LOGGER_BACKTRACE_LINE - 16);
+  }
+  text[offset] = '\0';
+  logger_backtrace_current.frames = frames;
+  logger_backtrace_current.count = count;
+  buffer->tracing = true;
+  logger_push(context,sequence,timestamp,log_level,file,linenumber,text);
+  buffer->tracing = false;
+  logger_backtrace_current.frames = (void*)0;
+  logger_backtrace_current.count = 0;
+}
+
+/*
+Shared tail for data messages: hands the payload to the data callback
+as is, or renders it as text (see logger_set_data_format) behind a
+"label (N bytes)" line and pushes that like any other message.
+*/
+static void
+logger_push_payload(logging_context * const context,uint64_t const sequence,logger_time const * const timestamp,int const log_level,char const * const file,int const linenumber,char const * const label,void const * const data,size_t const length) {
+  if(context->data_function != (void*)0) {
+    logger_sequence_current = sequence;
+    if(context->data_function(context->data_object,timestamp,log_level,file,linenumber,label,data,length) < 1) {
+      fprintf(stderr,"Could not log data - data function failed\n");
+    }
+    logger_sequence_current = 0;
+    return;
+  }
+  char header[LOGGER_FORMAT_PREFIX];
+  size_t offset = logger_format_bytes(header,0,LOGGER_FORMAT_PREFIX - 32,label,strlen(label));
+  offset = logger_format_bytes(header,offset,LOGGER_FORMAT_PREFIX," (",2);
+  offset = logger_format_unsigned(header,offset,LOGGER_FORMAT_PREFIX,length,0);
+  offset = logger_format_bytes(header,offset,LOGGER_FORMAT_PREFIX,context->data_format == LOGGER_DATA_HEXDUMP ? " bytes)\n" : " bytes) ",8);
+  size_t size = offset + logger_encoded_size(context->data_format,length);
+  bool const cut = size > LOGGER_MESSAGE_MAX;
+  if(cut) {size = LOGGER_MESSAGE_MAX;}
+  logging_buffer * const buffer = &logger_thread_buffer;
+  bool const nested = buffer->busy;
+  char *text = (void*)0;
+  if(nested == false) {
+    text = size <= LOGGER_MESSAGE_BUFFER ? buffer->message : logger_arena_reserve(buffer,size + LOGGER_TRANSFORM_HEADROOM);
+  }
+  char *allocated = (void*)0;
+  if(text == (void*)0) {
+    text = allocated = malloc(size + LOGGER_TRANSFORM_HEADROOM);
+    if(text == (void*)0) {
+      fprintf(stderr,"Could not log data - no memory for %zu bytes of text\n",size);
+      return;
+    }
+  }
+  memcpy(text,header,offset);
+  size_t const written = offset + logger_encode_data(context->data_format,text + offset,size - offset,data,length);
+  if(cut) {
+    logger_mark_truncated(context,text,written);
+  }
+  buffer->busy = true;
+  logger_push(context,sequence,timestamp,log_level,file,linenumber,text);
+  buffer->busy = nested;
+  free(allocated);
+}
+
+/* CLOCK_MONOTONIC time timeout_ms from now, for condition variables on that clock */
+static void
+logger_deadline(struct timespec *deadline,int const timeout_ms) {
+  clock_gettime(CLOCK_MONOTONIC,deadline);
+  deadline->tv_sec += timeout_ms / 1000;
+  deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+  if(deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
+  }
+}
+
+/*
+NUMA topology
+
+Read once from /sys/devices/system/node. Only nodes with CPUs count,
+each of them gets a shard of a sharded pipeline (see logger_set_numa()),
+in the order of their node numbers. Without that tree there is a single
+node -1 that covers all CPUs and is neither bound to nor pinned to.
+*/
+#define LOGGER_NUMA_NODES 64
+#define LOGGER_NUMA_CPUS 1024
+/* MPOL_PREFERRED of <linux/mempolicy.h> */
+#define LOGGER_MPOL_PREFERRED 1
+
+typedef struct {
+  size_t count;
+  int node[LOGGER_NUMA_NODES];
+#ifdef LOGGER_HAS_AFFINITY
+  cpu_set_t cpus[LOGGER_NUMA_NODES];
+#endif
+  uint8_t cpu_shard[LOGGER_NUMA_CPUS];
+} logging_numa;
+
+static logging_numa logger_numa = {.count = 1,.node = {-1}};
+static pthread_once_t logger_numa_once = PTHREAD_ONCE_INIT;
+
+#ifdef LOGGER_HAS_AFFINITY
+/* Adds the CPUs of a list like "0-3,8-11" to set, false if it is malformed */
+static bool
+logger_cpu_list_parse(char const *list,cpu_set_t * const set) {
+  char *end;
+  while(*list >= '0' && *list <= '9') {
+    long const first = strtol(list,&end,10);
+    long last = first;
+    if(*end == '-') {
+      list = end + 1;
+      last = strtol(list,&end,10);
+      if(end == list || last < first) {return false;}
+    }
+    for(long cpu = first;cpu <= last && cpu < CPU_SETSIZE;cpu++) {
+      CPU_SET(cpu,set);
+    }
+    list = *end == ',' ? end + 1 : end;
+  }
+  return *list == '\0' || *list == '\n';
+}
+#endif
+
+static void
+logger_numa_read(void) {
+#ifdef LOGGER_HAS_AFFINITY
+  size_t count = 0;
+  for(int node = 0;node < LOGGER_NUMA_NODES;node++) {
+    char path[64];
+    char list[4096];
+    snprintf(path,sizeof(path),"/sys/devices/system/node/node%d/cpulist",node);
+    FILE *file = fopen(path,"r");
+    if(file == (void*)0) {continue;}
+    bool const read = fgets(list,sizeof(list),file) != (void*)0;
+    fclose(file);
+    /* Nodes with memory only have an empty list */
+    if(read == false) {continue;}
+    CPU_ZERO(&logger_numa.cpus[count]);
+    if(logger_cpu_list_parse(list,&logger_numa.cpus[count]) == false || CPU_COUNT(&logger_numa.cpus[count]) == 0) {
+      continue;
+    }
+    for(int cpu = 0;cpu < LOGGER_NUMA_CPUS;cpu++) {
+      if(CPU_ISSET(cpu,&logger_numa.cpus[count])) {logger_numa.cpu_shard[cpu] = (uint8_t)count;}
+    }
+    logger_numa.node[count++] = node;
+  }
+  if(count > 0) {logger_numa.count = count;}
+#endif
+}
+
+static logging_numa const *
+logger_numa_topology(void) {
+  pthread_once(&logger_numa_once,logger_numa_read);
+  return &logger_numa;
+}
+
+/*
+Large buffers
+
+The record storage of the queues and the slabs of the record pool are
+mapped through logger_mapping_create(), which applies the options of
+logger_set_memory_options():
+- LOGGER_MEMORY_HUGETLB: reserved huge pages (MAP_HUGETLB), the length is
+  rounded up to LOGGER_HUGE_PAGE. Without reserved pages the mapping falls
+  back to regular pages.
+- LOGGER_MEMORY_THP: regular pages aligned to LOGGER_HUGE_PAGE and
+  advised for transparent huge pages (MADV_HUGEPAGE), before they are
+  faulted in.
+- LOGGER_MEMORY_PREFAULT: all pages are faulted in up front (MAP_POPULATE,
+  MADV_POPULATE_WRITE or one write per page), so the first burst does
+  not pay for page faults.
+- LOGGER_MEMORY_LOCK: mlock(), kept unlocked if RLIMIT_MEMLOCK is too low.
+Buffers of a shard bound to a NUMA node (LOGGER_NUMA_BIND) prefer that
+node (mbind with MPOL_PREFERRED) and are only faulted in afterwards.
+Every option degrades to the plain mapping if the system does not
+support it, memory_huge and memory_locked in logger_stats show what was
+applied (memory_huge includes ranges advised for transparent huge pages,
+whether the kernel backs them is up to khugepaged and the fault path).
+*/
+#define LOGGER_HUGE_PAGE (2 * 1024 * 1024)
+
+typedef struct {
+  void *address;
+  size_t length;
+  bool huge;
+  bool locked;
+} logging_mapping;
+
+static _Atomic int logger_memory_options = LOGGER_MEMORY_PREFAULT;
+static _Atomic size_t logger_memory_mapped = 0;
+static _Atomic size_t logger_memory_huge = 0;
+static _Atomic size_t logger_memory_locked = 0;
+
+static size_t
+logger_mapping_round(size_t const length,size_t const page) {
+  return (length + page - 1) & ~(page - 1);
+}
+
+/* Regular pages, aligned to LOGGER_HUGE_PAGE so transparent huge pages can back all of it */
+static void *
+logger_mapping_aligned(size_t const length) {
+  char *address = mmap((void*)0,length + LOGGER_HUGE_PAGE,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+  if(address == MAP_FAILED) {return MAP_FAILED;}
+  char *aligned = (char *)logger_mapping_round((uintptr_t)address,LOGGER_HUGE_PAGE);
+  if(aligned > address) {munmap(address,aligned - address);}
+  munmap(aligned + length,address + LOGGER_HUGE_PAGE - aligned);
+  return aligned;
+}
+
+static void
+logger_mapping_prefault(logging_mapping * const mapping) {
+#ifdef MADV_POPULATE_WRITE
+  if(madvise(mapping->address,mapping->length,MADV_POPULATE_WRITE) == 0) {return;}
+#endif
+  long const page = sysconf(_SC_PAGESIZE);
+  for(size_t offset = 0;offset < mapping->length;offset += page) {
+    ((volatile char *)mapping->address)[offset] = 0;
+  }
+}
+
+/* Prefers node for the pages of mapping, they must not be faulted in yet */
+static void
+logger_mapping_bind(logging_mapping * const mapping,int const node) {
+#if defined(LOGGER_HAS_AFFINITY) && defined(SYS_mbind)
+  size_t const bits = 8 * sizeof(unsigned long);
+  unsigned long mask[LOGGER_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+  mask[node / bits] |= 1UL << (node % bits);
+  /* Fails without NUMA support in the kernel, the pages then stay local to the faulting thread */
+  syscall(SYS_mbind,mapping->address,mapping->length,LOGGER_MPOL_PREFERRED,mask,(unsigned long)LOGGER_NUMA_NODES + 1,0U);
+#endif
+}
+
+/*
+Maps at least length zeroed bytes, false if even a plain mapping fails.
+A node >= 0 binds the pages to that NUMA node.
+*/
+static bool
+logger_mapping_create(logging_mapping * const mapping,size_t const length,int const node) {
+  int const options = atomic_load(&logger_memory_options);
+  bool const prefault = options & LOGGER_MEMORY_PREFAULT;
+  /* Bound pages are faulted in after mbind() */
+  bool const populate = prefault && node < 0;
+  mapping->address = MAP_FAILED;
+  mapping->huge = false;
+  mapping->locked = false;
+#ifdef MAP_HUGETLB
+  if(options & LOGGER_MEMORY_HUGETLB) {
+    mapping->length = logger_mapping_round(length,LOGGER_HUGE_PAGE);
+    mapping->address = mmap((void*)0,mapping->length,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (populate ? MAP_POPULATE : 0),-1,0);
+    mapping->huge = mapping->address != MAP_FAILED;
+  }
+#endif
+  if(mapping->address == MAP_FAILED && (options & LOGGER_MEMORY_THP)) {
+    mapping->length = logger_mapping_round(length,LOGGER_HUGE_PAGE);
+    mapping->address = logger_mapping_aligned(mapping->length);
+#ifdef MADV_HUGEPAGE
+    mapping->huge = mapping->address != MAP_FAILED && madvise(mapping->address,mapping->length,MADV_HUGEPAGE) == 0;
+#endif
+    if(mapping->address != MAP_FAILED && populate) {logger_mapping_prefault(mapping);}
+  }
+  if(mapping->address == MAP_FAILED) {
+    mapping->length = logger_mapping_round(length,sysconf(_SC_PAGESIZE));
+    mapping->address = mmap((void*)0,mapping->length,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0),-1,0);
+  }
+  if(mapping->address == MAP_FAILED) {
+    mapping->address = (void*)0;
+    return false;
+  }
+  if(node >= 0) {
+    logger_mapping_bind(mapping,node);
+    if(prefault) {logger_mapping_prefault(mapping);}
+  }
+  if(options & LOGGER_MEMORY_LOCK) {
+    mapping->locked = mlock(mapping->address,mapping->length) == 0;
+  }
+  atomic_fetch_add(&logger_memory_mapped,mapping->length);
+  if(mapping->huge) {atomic_fetch_add(&logger_memory_huge,mapping->length);}
+  if(mapping->locked) {atomic_fetch_add(&logger_memory_locked,mapping->length);}
+  return true;
+}
+
+static void
+logger_mapping_destroy(logging_mapping * const mapping) {
+  if(mapping->address == (void*)0) {return;}
+  atomic_fetch_sub(&logger_memory_mapped,mapping->length);
+  if(mapping->huge) {atomic_fetch_sub(&logger_memory_huge,mapping->length);}
+  if(mapping->locked) {atomic_fetch_sub(&logger_memory_locked,mapping->length);}
+  munmap(mapping->address,mapping->length);
+  mapping->address = (void*)0;
+}
+
+/*
+Parameters:
+-----------
+options
+  Combination of LOGGER_MEMORY_PREFAULT, LOGGER_MEMORY_HUGETLB,
+  LOGGER_MEMORY_THP and LOGGER_MEMORY_LOCK, 0 = plain lazily faulted pages
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets how the large buffers (queue records, record pool slabs) are
+backed, see "Large buffers" above. Applies to buffers mapped afterwards,
+so call it before logger_setup_async(). LOGGER_MEMORY_PREFAULT is the
+default.
+*/
+extern int
+logger_set_memory_options(int options) {
+  int const known = LOGGER_MEMORY_PREFAULT | LOGGER_MEMORY_HUGETLB | LOGGER_MEMORY_THP | LOGGER_MEMORY_LOCK;
+  if((options & ~known) != 0) {return 0;}
+  atomic_store(&logger_memory_options,options);
+  return 1;
+}
+
+/*
+Record storage
+
+Messages and payloads that do not fit into a queued record are copied
+into chunks of a dedicated allocator instead of malloc. Chunks come in
+power of two size classes from LOGGER_POOL_CLASS_MIN to
+LOGGER_POOL_CLASS_MAX bytes and are carved from slabs of
+LOGGER_POOL_SLAB bytes, mapped as large buffers (pre-faulted by default,
+see logger_set_memory_options()).
+
+Every thread keeps a free list per size class. Allocation pops from it
+without any lock. An empty list is refilled with a batch of up to
+LOGGER_POOL_BATCH_BYTES from the shared lists (or a fresh slab) under the
+pool lock. Chunks are mostly freed by the writer thread, they go into
+its own lists and are handed back in batches once a list holds two
+batches, once the queue ran empty and on thread exit. The pool lock is
+thus taken once per batch, not once per message.
+
+Larger payloads are allocated with malloc but count against the cap
+too. The cap (logger_set_memory_cap(), LOGGER_POOL_CAP by default) limits
+the memory reserved for slabs and large allocations, slabs are kept for
+reuse and never unmapped. Once it is reached, long messages are cut to
+the inline record buffer and data messages are dropped like under
+backpressure (counted and reported). With LOGGER_BACKPRESSURE_BLOCK the
+caller first waits up to block_timeout_ms for the writer to return
+chunks, as long as queued records still hold some.
+Chunks parked in the lists of other producer threads are not taken back,
+the cap should leave room for LOGGER_POOL_BATCH_BYTES per size class and
+thread. The pool is shared by all instances.
+*/
+#define LOGGER_POOL_CLASS_MIN 4096
+#define LOGGER_POOL_CLASS_MAX 262144
+#define LOGGER_POOL_CLASSES 7
+#define LOGGER_POOL_SLAB (2 * 1024 * 1024)
+#define LOGGER_POOL_BATCH_BYTES 65536
+
+typedef struct logging_chunk {
+  struct logging_chunk *next;
+  /* Usable bytes, the size class or the size of a large allocation */
+  size_t size;
+} logging_chunk;
+
+typedef struct {
+  bool registered;
+  logging_chunk *free[LOGGER_POOL_CLASSES];
+  size_t count[LOGGER_POOL_CLASSES];
+} logging_pool_cache;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t returned;
+  logging_chunk *free[LOGGER_POOL_CLASSES];
+  char *slab;
+  size_t slab_offset;
+  size_t reserved;
+  size_t available;
+  size_t cap;
+  uint64_t refills;
+  uint64_t returns;
+  uint64_t large;
+  /* Bumped whenever waiting producers should retry */
+  uint64_t generation;
+  _Atomic uint64_t exhausted;
+  _Atomic int waiters;
+} logger_pool = {.lock = PTHREAD_MUTEX_INITIALIZER,.cap = LOGGER_POOL_CAP};
+
+static _Thread_local logging_pool_cache logger_thread_pool;
+static pthread_key_t logger_pool_key;
+static pthread_once_t logger_pool_once = PTHREAD_ONCE_INIT;
+
+static void logger_pool_release(void *custom_object);
+
+/* Also used to recreate it in a forked child, see logger_fork_child() */
+static void
+logger_pool_condition_init(void) {
+  pthread_condattr_t condition_attributes;
+  pthread_condattr_init(&condition_attributes);
+  pthread_condattr_setclock(&condition_attributes,CLOCK_MONOTONIC);
+  pthread_cond_init(&logger_pool.returned,&condition_attributes);
+  pthread_condattr_destroy(&condition_attributes);
+}
+
+static void
+logger_pool_init(void) {
+  logger_pool_condition_init();
+  if(pthread_key_create(&logger_pool_key,logger_pool_release) != 0) {
+    fprintf(stderr,"Could not create pool key - chunks stay with exiting threads\n");
+  }
+}
+
+static int
+logger_pool_class(size_t const size) {
+  int size_class = 0;
+  while(((size_t)LOGGER_POOL_CLASS_MIN << size_class) < size) {size_class++;}
+  return size_class;
+}
+
+static size_t
+logger_pool_batch(int const size_class) {
+  size_t const batch = LOGGER_POOL_BATCH_BYTES / ((size_t)LOGGER_POOL_CLASS_MIN << size_class);
+  return batch > 0 ? batch : 1;
+}
+
+/* Hands back all but keep chunks of the size class, with the pool lock held */
+static void
+logger_pool_return_locked(logging_pool_cache * const cache,int const size_class,size_t const keep) {
+  size_t const chunk_size = (size_t)LOGGER_POOL_CLASS_MIN << size_class;
+  while(cache->count[size_class] > keep) {
+    logging_chunk *chunk = cache->free[size_class];
+    cache->free[size_class] = chunk->next;
+    cache->count[size_class]--;
+    chunk->next = logger_pool.free[size_class];
+    logger_pool.free[size_class] = chunk;
+    logger_pool.available += chunk_size;
+  }
+  logger_pool.returns++;
+  logger_pool.generation++;
+  pthread_cond_broadcast(&logger_pool.returned);
+}
+
+/*
+Returns every chunk of this thread, e.g. once the writer ran out of work.
+Waiting producers are woken up in any case, so they can give up.
+*/
+static void
+logger_pool_flush(void) {
+  logging_pool_cache * const cache = &logger_thread_pool;
+  bool const waiting = atomic_load(&logger_pool.waiters) > 0;
+  bool returned = false;
+  for(int size_class = 0;size_class < LOGGER_POOL_CLASSES;size_class++) {
+    if(cache->count[size_class] == 0) {continue;}
+    pthread_mutex_lock(&logger_pool.lock);
+    logger_pool_return_locked(cache,size_class,0);
+    pthread_mutex_unlock(&logger_pool.lock);
+    returned = true;
+  }
+  if(waiting && returned == false) {
+    pthread_mutex_lock(&logger_pool.lock);
+    logger_pool.generation++;
+    pthread_cond_broadcast(&logger_pool.returned);
+    pthread_mutex_unlock(&logger_pool.lock);
+  }
+}
+
+static void
+logger_pool_release(void *custom_object) {
+  (void)custom_object;
+  logger_pool_flush();
+}
+
+/* Returns the chunks of this thread once it exits */
+static void
+logger_pool_register(logging_pool_cache * const cache) {
+  if(cache->registered == false) {
+    pthread_setspecific(logger_pool_key,cache);
+    cache->registered = true;
+  }
+}
+
+/* Moves one batch into the cache of this thread, false if the cap is reached */
+static bool
+logger_pool_refill(logging_pool_cache * const cache,int const size_class) {
+  logger_pool_register(cache);
+  size_t const chunk_size = (size_t)LOGGER_POOL_CLASS_MIN << size_class;
+  size_t const batch = logger_pool_batch(size_class);
+  size_t moved = 0;
+  pthread_mutex_lock(&logger_pool.lock);
+  for(;moved < batch && logger_pool.free[size_class] != (void*)0;moved++) {
+    logging_chunk *chunk = logger_pool.free[size_class];
+    logger_pool.free[size_class] = chunk->next;
+    chunk->next = cache->free[size_class];
+    cache->free[size_class] = chunk;
+    logger_pool.available -= chunk_size;
+  }
+  for(;moved < batch;moved++) {
+    size_t const stride = sizeof(logging_chunk) + chunk_size;
+    if(logger_pool.slab == (void*)0 || logger_pool.slab_offset + stride > LOGGER_POOL_SLAB) {
+      if(moved > 0 || logger_pool.reserved + LOGGER_POOL_SLAB > logger_pool.cap) {break;}
+      logging_mapping slab;
+      if(logger_mapping_create(&slab,LOGGER_POOL_SLAB,-1) == false) {break;}
+      /* The rest of the previous slab is too small for this class, it stays unused */
+      if(logger_pool.slab != (void*)0) {logger_pool.available -= LOGGER_POOL_SLAB - logger_pool.slab_offset;}
+      logger_pool.slab = slab.address;
+      logger_pool.slab_offset = 0;
+      logger_pool.reserved += LOGGER_POOL_SLAB;
+      logger_pool.available += LOGGER_POOL_SLAB;
+    }
+    logging_chunk *chunk = (logging_chunk *)(logger_pool.slab + logger_pool.slab_offset);
+    logger_pool.slab_offset += stride;
+    logger_pool.available -= stride;
+    chunk->size = chunk_size;
+    chunk->next = cache->free[size_class];
+    cache->free[size_class] = chunk;
+  }
+  if(moved > 0) {logger_pool.refills++;}
+  pthread_mutex_unlock(&logger_pool.lock);
+  cache->count[size_class] += moved;
+  return moved > 0;
+}
+
+static void *
+logger_pool_alloc_large(size_t const size) {
+  pthread_mutex_lock(&logger_pool.lock);
+  bool const fits = logger_pool.reserved + sizeof(logging_chunk) + size <= logger_pool.cap;
+  if(fits) {
+    logger_pool.reserved += sizeof(logging_chunk) + size;
+    logger_pool.large++;
+  }
+  pthread_mutex_unlock(&logger_pool.lock);
+  if(fits == false) {return (void*)0;}
+  logging_chunk *chunk = malloc(sizeof(logging_chunk) + size);
+  if(chunk == (void*)0) {
+    pthread_mutex_lock(&logger_pool.lock);
+    logger_pool.reserved -= sizeof(logging_chunk) + size;
+    pthread_mutex_unlock(&logger_pool.lock);
+    return (void*)0;
+  }
+  chunk->size = size;
+  return chunk + 1;
+}
+
+/* Returns at least size bytes, 0 once the cap is reached */
+static void *
+logger_pool_alloc(size_t const size) {
+  pthread_once(&logger_pool_once,logger_pool_init);
+  if(size > LOGGER_POOL_CLASS_MAX) {return logger_pool_alloc_large(size);}
+  logging_pool_cache * const cache = &logger_thread_pool;
+  int const size_class = logger_pool_class(size);
+  if(cache->free[size_class] == (void*)0 && logger_pool_refill(cache,size_class) == false) {
+    return (void*)0;
+  }
+  logging_chunk *chunk = cache->free[size_class];
+  cache->free[size_class] = chunk->next;
+  cache->count[size_class]--;
+  return chunk + 1;
+}
+
+static void
+logger_pool_free(void * const pointer) {
+  if(pointer == (void*)0) {return;}
+  logging_chunk *chunk = (logging_chunk *)pointer - 1;
+  if(chunk->size > LOGGER_POOL_CLASS_MAX) {
+    pthread_mutex_lock(&logger_pool.lock);
+    logger_pool.reserved -= sizeof(logging_chunk) + chunk->size;
+    logger_pool.generation++;
+    pthread_cond_broadcast(&logger_pool.returned);
+    pthread_mutex_unlock(&logger_pool.lock);
+    free(chunk);
+    return;
+  }
+  logging_pool_cache * const cache = &logger_thread_pool;
+  logger_pool_register(cache);
+  int const size_class = logger_pool_class(chunk->size);
+  chunk->next = cache->free[size_class];
+  cache->free[size_class] = chunk;
+  cache->count[size_class]++;
+  size_t const batch = logger_pool_batch(size_class);
+  bool const waiting = atomic_load_explicit(&logger_pool.waiters,memory_order_relaxed) > 0;
+  if(cache->count[size_class] >= 2 * batch || waiting) {
+    pthread_mutex_lock(&logger_pool.lock);
+    logger_pool_return_locked(cache,size_class,waiting ? 0 : batch);
+    pthread_mutex_unlock(&logger_pool.lock);
+  }
+}
+
+/*
+Parameters:
+-----------
+bytes
+  Upper limit for slabs and large allocations of the record storage,
+  0 = long messages and data are never copied out of the record
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets the memory cap of the record storage (see "Record storage" above).
+Memory already reserved is not released, a lower cap only stops new
+reservations. The cap is shared by all instances.
+*/
+extern int
+logger_set_memory_cap(size_t bytes) {
+  pthread_mutex_lock(&logger_pool.lock);
+  logger_pool.cap = bytes;
+  pthread_mutex_unlock(&logger_pool.lock);
+  return 1;
+}
+
+/*
+Background threads
+
+The writer threads of the asynchronous pipeline and the watcher of a
+configuration file apply the settings of their instance when they start:
+- name: pthread_setname_np(), "logger" by default. Writers of a sharded
+  pipeline append "/<shard>", the config watcher "-config". Names are cut
+  to 15 characters.
+- CPU affinity: the set of logger_set_thread_affinity(). A writer pinned
+  to its NUMA node (LOGGER_NUMA_PIN) runs on the intersection with the
+  CPUs of the node, or on the set alone if they do not overlap.
+- scheduling: SCHED_BATCH or SCHED_IDLE and the nice value, which Linux
+  keeps per thread.
+Settings the system refuses (CPUs outside the cgroup, negative nice
+values without CAP_SYS_NICE) are reported on stderr, the thread keeps
+running with what it inherited.
+*/
+static void
+logger_thread_apply(logging_context const * const context,char const * const suffix,int const pin_shard) {
+#ifdef LOGGER_HAS_AFFINITY
+  logging_threads const * const threads = &context->threads;
+  char name[16];
+  snprintf(name,sizeof(name),"%s%s",threads->name[0] != '\0' ? threads->name : "logger",suffix);
+  pthread_setname_np(pthread_self(),name);
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if(threads->has_cpus && pin_shard >= 0) {
+    CPU_AND(&cpus,&threads->cpus,&logger_numa.cpus[pin_shard]);
+    if(CPU_COUNT(&cpus) == 0) {cpus = threads->cpus;}
+  } else if(threads->has_cpus) {
+    cpus = threads->cpus;
+  } else if(pin_shard >= 0) {
+    cpus = logger_numa.cpus[pin_shard];
+  }
+  if(CPU_COUNT(&cpus) > 0 && pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus) != 0) {
+    fprintf(stderr,"Could not set the CPU affinity of logger thread %s\n",name);
+  }
+  if(threads->has_scheduling == false) {return;}
+  if(threads->policy != LOGGER_SCHED_INHERIT) {
+    struct sched_param const parameter = {.sched_priority = 0};
+    int const policy = threads->policy == LOGGER_SCHED_IDLE ? SCHED_IDLE : SCHED_BATCH;
+    if(pthread_setschedparam(pthread_self(),policy,&parameter) != 0) {
+      fprintf(stderr,"Could not set the scheduling policy of logger thread %s\n",name);
+    }
+  }
+  if(setpriority(PRIO_PROCESS,(id_t)syscall(SYS_gettid),threads->nice) != 0) {
+    fprintf(stderr,"Could not set the nice value of logger thread %s: %s\n",name,strerror(errno));
+  }
+#endif
+}
+
+static inline void
+logger_cpu_relax(void) {
+#ifdef LOGGER_HAS_TSC
+  _mm_pause();
+#else
+  atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+/*
+Direct file sink
+
+logger_factory_direct_file() writes with O_DIRECT, so large log volumes
+do not push other data out of the page cache and every write costs the
+same. Messages are packed into two buffers of LOGGER_DIRECT_BUFFER
+bytes: once one is full, an I/O thread writes it while the output
+function fills the other and only waits if the previous write has not
+finished yet. A flush writes the filled part of the current buffer up to
+the next LOGGER_DIRECT_BLOCK boundary, padded with 0 bytes, and keeps
+the partial last block in the buffer. The next write starts at that
+block again and replaces the padding, so padding only ever sits at the
+end of the file: readers skip trailing 0 bytes, and closing the sink
+truncates the file to its real size. File systems without O_DIRECT
+(tmpfs) get the same writes through the page cache, which is told to
+drop them right away.
+*/
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t thread;
+  int descriptor;
+  bool direct;
+  char *buffers[2];
+  size_t active;
+  size_t fill;
+  /* File offset of the active buffer, a multiple of LOGGER_DIRECT_BLOCK */
+  off_t offset;
+  /* Full buffer handed to the I/O thread, -1 = none */
+  int pending;
+  off_t pending_offset;
+  bool stopping;
+  bool failed;
+  char *path;
+} logging_direct_file;
+
+static logging_direct_file *
+logger_factory_direct_file_sink = (void*)0;
+
+/* Opens path for the sink, without O_DIRECT where the file system refuses it */
+static int
+logger_direct_open(char const * const path,bool * const direct) {
+  *direct = false;
+#ifdef O_DIRECT
+  int const descriptor = open(path,O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT,0644);
+  if(descriptor >= 0 || errno != EINVAL) {
+    *direct = descriptor >= 0;
+    return descriptor;
+  }
+#endif
+  return open(path,O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+}
+
+/* Writes length bytes at offset, both aligned to LOGGER_DIRECT_BLOCK */
+static bool
+logger_direct_write(logging_direct_file * const sink,char const *data,size_t const length,off_t const offset) {
+  for(size_t done = 0;done < length;) {
+    ssize_t const written = pwrite(sink->descriptor,data + done,length - done,offset + (off_t)done);
+    if(written < 0 && errno == EINTR) {continue;}
+    if(written <= 0) {return false;}
+    done += written;
+  }
+  if(sink->direct == false) {
+    posix_fadvise(sink->descriptor,offset,(off_t)length,POSIX_FADV_DONTNEED);
+  }
+  return true;
+}
+
+static void *
+logger_direct_run(void *custom_object) {
+  logging_direct_file * const sink = custom_object;
+  logger_thread_apply(&Logger,"-io",-1);
+  pthread_mutex_lock(&sink->lock);
+  for(;;) {
+    while(sink->pending < 0 && sink->stopping == false) {
+      pthread_cond_wait(&sink->changed,&sink->lock);
+    }
+    if(sink->pending < 0) {break;}
+    char const * const buffer = sink->buffers[sink->pending];
+    off_t const offset = sink->pending_offset;
+    pthread_mutex_unlock(&sink->lock);
+    bool const written = logger_direct_write(sink,buffer,LOGGER_DIRECT_BUFFER,offset);
+    pthread_mutex_lock(&sink->lock);
+    if(written == false) {sink->failed = true;}
+    sink->pending = -1;
+    pthread_cond_broadcast(&sink->changed);
+  }
+  pthread_mutex_unlock(&sink->lock);
+  return (void*)0;
+}
+
+static int
+logger_factory_direct_output(void const * const custom_object,char const * const message) {
+  logging_direct_file * const sink = (logging_direct_file *)custom_object;
+  char const *rest = message;
+  size_t length = strlen(message);
+  pthread_mutex_lock(&sink->lock);
+  while(length > 0) {
+    size_t part = LOGGER_DIRECT_BUFFER - sink->fill;
+    if(part > length) {part = length;}
+    memcpy(sink->buffers[sink->active] + sink->fill,rest,part);
+    sink->fill += part;
+    rest += part;
+    length -= part;
+    if(sink->fill == LOGGER_DIRECT_BUFFER) {
+      while(sink->pending >= 0) {
+        pthread_cond_wait(&sink->changed,&sink->lock);
+      }
+      sink->pending = (int)sink->active;
+      sink->pending_offset = sink->offset;
+      sink->active ^= 1;
+      sink->offset += LOGGER_DIRECT_BUFFER;
+      sink->fill = 0;
+      pthread_cond_broadcast(&sink->changed);
+    }
+  }
+  bool const failed = sink->failed;
+  pthread_mutex_unlock(&sink->lock);
+  return failed ? 0 : 1;
+}
+
+static int
+logger_factory_direct_flush(void const * const custom_object,bool const durable) {
+  logging_direct_file * const sink = (logging_direct_file *)custom_object;
+  pthread_mutex_lock(&sink->lock);
+  while(sink->pending >= 0) {
+    pthread_cond_wait(&sink->changed,&sink->lock);
+  }
+  bool result = sink->failed == false;
+  if(sink->fill > 0) {
+    char * const buffer = sink->buffers[sink->active];
+    size_t const length = (sink->fill + LOGGER_DIRECT_BLOCK - 1) / LOGGER_DIRECT_BLOCK * LOGGER_DIRECT_BLOCK;
+    memset(buffer + sink->fill,0,length - sink->fill);
+    result = logger_direct_write(sink,buffer,length,sink->offset) && result;
+    /* Complete blocks are done, the partial one is written again with the next messages */
+    size_t const complete = sink->fill / LOGGER_DIRECT_BLOCK * LOGGER_DIRECT_BLOCK;
+    memmove(buffer,buffer + complete,sink->fill - complete);
+    sink->offset += complete;
+    sink->fill -= complete;
+  }
+  if(result && durable && logger_sync_file(sink->descriptor) != 0) {result = false;}
+  pthread_mutex_unlock(&sink->lock);
+  return result ? 1 : 0;
+}
+
+/* Writes what is left, stops the I/O thread and cuts the padding off */
+static void
+logger_direct_close(logging_direct_file * const sink) {
+  logger_factory_direct_flush(sink,false);
+  pthread_mutex_lock(&sink->lock);
+  sink->stopping = true;
+  pthread_cond_broadcast(&sink->changed);
+  pthread_mutex_unlock(&sink->lock);
+  pthread_join(sink->thread,(void*)0);
+  if(ftruncate(sink->descriptor,sink->offset + (off_t)sink->fill) != 0) {
+    perror("Could not truncate direct log file");
+  }
+  close(sink->descriptor);
+  pthread_cond_destroy(&sink->changed);
+  pthread_mutex_destroy(&sink->lock);
+  free(sink->buffers[0]);
+  free(sink->path);
+  free(sink);
+}
+
+/* Also used to restart the I/O thread in a forked child */
+static bool
+logger_direct_start(logging_direct_file * const sink) {
+  pthread_mutex_init(&sink->lock,(void*)0);
+  pthread_cond_init(&sink->changed,(void*)0);
+  if(pthread_create(&sink->thread,(void*)0,logger_direct_run,sink) != 0) {
+    pthread_cond_destroy(&sink->changed);
+    pthread_mutex_destroy(&sink->lock);
+    return false;
+  }
+  return true;
+}
+
+static void
+logger_factory_direct_file_exit(void) {
+  logging_direct_file * const sink = logger_factory_direct_file_sink;
+  if(sink == (void*)0) {return;}
+  if(Logger.output_object == sink) {
+    /* The writer may still hold records for the file, later calls must not reach it */
+    logger_shutdown(LOGGER_SHUTDOWN_TIMEOUT_MS,(void*)0);
+    logger_stop_async();
+  }
+  logger_factory_direct_file_sink = (void*)0;
+  logger_direct_close(sink);
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Same as logger_factory_file()
+
+file_path
+  The file is created or truncated
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+logger_factory_file() with the direct file sink described above: same
+line format, written in LOGGER_DIRECT_BLOCK aligned blocks around the
+page cache. Until the sink is closed at exit, the file may end in 0
+bytes of padding. Replaces a direct file set up before, a running
+pipeline writing to it is stopped first.
+*/
+extern int
+logger_factory_direct_file(int log_level,char const * const file_path) {
+  static bool exit_handler = false;
+  if(file_path == (void*)0 || log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG) {
+    return -1;
+  }
+  if(logger_factory_direct_file_sink != (void*)0) {
+    if(Logger.output_object == logger_factory_direct_file_sink) {logger_stop_async();}
+    logger_direct_close(logger_factory_direct_file_sink);
+    logger_factory_direct_file_sink = (void*)0;
+  }
+  logging_direct_file * const sink = calloc(1,sizeof(logging_direct_file));
+  char * const buffers = aligned_alloc(LOGGER_DIRECT_BLOCK,2 * LOGGER_DIRECT_BUFFER);
+  char * const path = strdup(file_path);
+  if(sink == (void*)0 || buffers == (void*)0 || path == (void*)0) {
+    free(sink);
+    free(buffers);
+    free(path);
+    return -2;
+  }
+  sink->buffers[0] = buffers;
+  sink->buffers[1] = buffers + LOGGER_DIRECT_BUFFER;
+  sink->path = path;
+  sink->pending = -1;
+  sink->descriptor = logger_direct_open(file_path,&sink->direct);
+  if(sink->descriptor < 0 || logger_direct_start(sink) == false) {
+    perror("Could not open File for factory setup");
+    if(sink->descriptor >= 0) {close(sink->descriptor);}
+    free(buffers);
+    free(path);
+    free(sink);
+    return -2;
+  }
+  logger_factory_direct_file_sink = sink;
+  if(exit_handler == false) {
+    if(atexit(logger_factory_direct_file_exit) != 0) {
+      fprintf(stderr,"Could not setup atexit handler\n");
+      logger_factory_direct_file_exit();
+      return -3;
+    }
+    exit_handler = true;
+  }
+  int const ret_code = logger_setup_context(log_level,sink,logger_factory_direct_output,logger_factory_console_transform,true);
+  if(ret_code <= 0) {return ret_code;}
+  logger_set_flush_callback(logger_factory_direct_flush);
+  return ret_code;
+}
+
+/*
+Asynchronous pipeline
+
+After logger_setup_async(), logger_log() only formats the message and
+copies it into a bounded queue. A background writer thread pulls the
+records and runs the transform + output functions, so a stalled output
+medium no longer stalls the caller.
+
+What happens once the queue is full is controlled by the backpressure
+policy:
+- LOGGER_BACKPRESSURE_BLOCK
+    Wait for the writer to free a slot, at most block_timeout_ms
+    (negative = forever). The record is dropped once the timeout passes.
+- LOGGER_BACKPRESSURE_DROP_NEWEST
+    Drop the record that is about to be queued
+- LOGGER_BACKPRESSURE_DROP_OLDEST
+    Drop the oldest queued record to make room
+- LOGGER_BACKPRESSURE_DROP_BY_LEVEL
+    Drop the least severe record, queued or incoming (DEBUG first).
+    LOGGER_ERROR and above are never dropped, the caller waits instead.
+
+Dropped records are counted per level. Once the queue has drained below
+half of its capacity, the writer pushes one synthetic LOGGER_WARNING
+record with the counts since the last report.
+
+Priority lane:
+LOGGER_EMERGENCY, LOGGER_ALERT and LOGGER_CRITICAL records bypass the
+queue above and go to a small dedicated lane of LOGGER_PRIORITY_CAPACITY
+records. The lane is never dropped from, a caller waits if it is full.
+The writer always drains it first and flushes the output durably
+(flush callback with durable = true) after every priority record. Normal
+records are batched, see "Flushing" below.
+
+Ordering guarantee:
+Every record gets a sequence number when it is queued. Within a lane,
+records are written in sequence order. Across lanes, a priority record
+is written before any normal record with a higher sequence number (the
+writer checks the priority lane before each normal record), but it may
+overtake normal records with a lower one that were still queued.
+logger_current_sequence() returns the number of the record being pushed,
+which allows output functions to verify this.
+
+Each lane only holds pointers, records live in a separate pool of
+capacity + 1 entries (one is in flight at the writer). Dropping from the
+middle of a lane thus only moves pointers. Messages shorter than
+LOGGER_MESSAGE_BUFFER are stored inline, longer ones in a heap copy that
+is released together with the record. Data records keep the label in
+message and the payload behind it or in the heap copy.
+
+Shards:
+With LOGGER_NUMA_SHARDS (see logger_set_numa()) the pipeline is split
+into one queue per NUMA node, each with its own lock, lanes of capacity
+records, counters and writer thread. Producers queue into the shard of
+the node they run on (sched_getcpu()), so records and locks stay on the
+socket that touches them. The writers merge the shards by sequence
+number: a writer outputs a normal record only once no other shard holds
+an older one, queued or in flight. Priority records are written as soon
+as their writer takes them. The merge lock of the first shard
+serializes all output, lock order is merge lock before shard lock.
+
+Waiting for work:
+By default an idle writer sleeps on a condition variable, a producer
+that queues into an empty lane pays for the futex wake-up and the
+record for the writer's scheduling latency. With LOGGER_WAIT_SPIN (see
+logger_set_writer_wait()) the writer busy-polls a counter every wake-up
+bumps for up to spin_us before it goes to sleep, trading a CPU for
+latency.
+
+Flushing:
+Every flush of the output is at least one syscall, flushing per record
+wastes them under load while a fixed batch delays records under light
+traffic. The writer thus keeps two moving averages, updated after each
+batch flush: the time between records arriving at its shard and the
+time a flush takes. Their ratio gives the batch target, the smallest
+batch that spends at most 1/LOGGER_FLUSH_SHARE of the arrival time in
+flushes, and the flush delay, the time that many records take to
+arrive. Both stay within the bounds of logger_set_flush_latency(): at
+most max_batch records and max_delay_us. Records already queued join
+the batch without delaying anyone, so the writer only flushes once the
+lane ran empty and the batch reached the target, once it holds
+max_batch records or once its first record was written flush delay ago.
+Below the target an idle writer waits for more records until then. So
+sparse records are flushed one by one right away, bursts and dense
+traffic in large batches, and a slow sink makes the writer batch more.
+
+Durability:
+Batch flushes are not durable. With LOGGER_DURABILITY_INTERVAL (see
+logger_set_durability()) a batch flush becomes durable once the last
+durable flush of the shard is interval_ms ago, and an idle writer with
+output that was never flushed durably wakes up for it then. Callers that
+need their record on stable storage (logger_log_durable() and with
+LOGGER_DURABILITY_ERROR every LOGGER_ERROR and above) use the flush
+barrier of logger_sync() for their own sequence number on the shard they
+queued into. The writer serves all requests pending at that point with
+one durable flush, so concurrent callers share it (group commit).
+*/
+#define LOGGER_FLUSH_SHARE 10
+
+typedef struct {
+  uint64_t sequence;
+  uint64_t tsc;
+  logger_time timestamp;
+  int log_level;
+  int linenumber;
+  char const *file;
+  char *overflow;
+  char const *data;
+  size_t data_length;
+  int frame_count;
+  void *frames[LOGGER_BACKTRACE_DEPTH];
+  char message[LOGGER_MESSAGE_BUFFER + LOGGER_TRANSFORM_HEADROOM];
+} logging_record;
+
+typedef struct {
+  logging_mapping mapping;
+  logging_record *storage;
+  logging_record **free_records;
+  size_t free_count;
+  logging_record **slots;
+  size_t capacity;
+  size_t head;
+  size_t count;
+} logging_lane;
+
+struct logging_queue {
+  _Alignas(LOGGER_CACHE_LINE) pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_cond_t drained;
+  pthread_t writer;
+  logging_context *context;
+  logging_lane priority;
+  logging_lane normal;
+  int policy;
+  int block_timeout_ms;
+  bool running;
+  bool writing;
+  /* Set by logger_shutdown(), which also stops the writer */
+  bool closing;
+  /* Holds the writer between two records while a single shard is forked, see logger_fork_drain() */
+  bool forking;
+  /* The writer missed the deadline of logger_shutdown() and was detached, the queue is kept until it exited */
+  bool abandoned;
+  bool exited;
+  bool pending_drops;
+  /* Flush barrier, see logger_sync() */
+  uint64_t sync_requested;
+  uint64_t sync_done;
+  bool sync_result;
+  uint64_t unreported[LOGGER_DEBUG + 1];
+  logging_config *retired;
+  /* Counters of this shard, added to the ones of the context on release */
+  logger_stats stats;
+  /* A pipeline is an array of shard_count shards, the queue of the context is the first */
+  size_t shard;
+  size_t shard_count;
+  bool pinned;
+  /* Sequence, level and slot of the record the writer took but did not write yet, 0 = none */
+  uint64_t in_flight;
+  int in_flight_level;
+  logging_record *in_flight_record;
+  /* See "Waiting for work" above, spin_ns < 0 = never sleep */
+  int wait;
+  int64_t spin_ns;
+  _Atomic uint64_t posted;
+  /* See "Flushing" above, times in ns, a max_delay of 0 flushes once the lane ran empty */
+  int64_t max_delay;
+  size_t max_batch;
+  size_t batch_target;
+  int64_t flush_delay;
+  int64_t arrival;
+  int64_t flush_cost;
+  uint64_t adapt_queued;
+  int64_t adapt_time;
+  /* See "Durability" above, sync_interval 0 = no interval */
+  int64_t sync_interval;
+  int64_t synced_at;
+  bool unsynced;
+  /* Only used in the first shard, see "Shards" above */
+  pthread_mutex_t merge;
+  pthread_cond_t turn;
+};
+
+/* Records and both pointer arrays share one mapping, bound to node if >= 0 */
+static int
+logger_lane_init(logging_lane *lane,size_t capacity,int const node) {
+  if(logger_mapping_create(&lane->mapping,(sizeof(logging_record) + 2 * sizeof(logging_record *)) * (capacity + 1),node) == false) {
+    return -1;
+  }
+  lane->storage = lane->mapping.address;
+  lane->free_records = (logging_record **)(lane->storage + capacity + 1);
+  lane->slots = lane->free_records + capacity + 1;
+  for(size_t index = 0;index <= capacity;index++) {
+    lane->free_records[index] = &lane->storage[index];
+  }
+  lane->free_count = capacity + 1;
+  lane->capacity = capacity;
+  return 1;
+}
+
+static void
+logger_lane_free(logging_lane *lane) {
+  logger_mapping_destroy(&lane->mapping);
+}
+
+static logging_record **
+logger_lane_slot(logging_lane *lane,size_t position) {
+  return &lane->slots[(lane->head + position) % lane->capacity];
+}
+
+/* Removes the record at position (0 = oldest), later records move up */
+static logging_record *
+logger_lane_take(logging_lane *lane,size_t position) {
+  logging_record *record = *logger_lane_slot(lane,position);
+  if(position == 0) {
+    lane->head = (lane->head + 1) % lane->capacity;
+  } else {
+    for(size_t index = position;index + 1 < lane->count;index++) {
+      *logger_lane_slot(lane,index) = *logger_lane_slot(lane,index + 1);
+    }
+  }
+  lane->count--;
+  return record;
+}
+
+static void
+logger_lane_release(logging_lane *lane,logging_record *record) {
+  logger_pool_free(record->overflow);
+  record->overflow = (void*)0;
+  record->data = (void*)0;
+  lane->free_records[lane->free_count++] = record;
+}
+
+/* Must be called with the queue lock held */
+static void
+logger_queue_count_drop(logging_queue *queue,int const log_level) {
+  queue->stats.dropped[log_level]++;
+  queue->unreported[log_level]++;
+  queue->pending_drops = true;
+}
+
+static void
+logger_queue_report_drops(logging_context * const context,uint64_t const dropped[LOGGER_DEBUG + 1]) {
+  char message_buffer[LOGGER_MESSAGE_BUFFER + LOGGER_TRANSFORM_HEADROOM];
+  uint64_t total = 0;
+  for(int level = LOGGER_EMERGENCY;level <= LOGGER_DEBUG;level++) {
+    total += dropped[level];
+  }
+  snprintf(message_buffer,LOGGER_MESSAGE_BUFFER,
+           "Dropped %llu messages under backpressure (emergency %llu, alert %llu, critical %llu, error %llu, warning %llu, notice %llu, info %llu, debug %llu)",
+           (unsigned long long)total,
+           (unsigned long long)dropped[LOGGER_EMERGENCY],(unsigned long long)dropped[LOGGER_ALERT],
+           (unsigned long long)dropped[LOGGER_CRITICAL],(unsigned long long)dropped[LOGGER_ERROR],
+           (unsigned long long)dropped[LOGGER_WARNING],(unsigned long long)dropped[LOGGER_NOTICE],
+           (unsigned long long)dropped[LOGGER_INFO],(unsigned long long)dropped[LOGGER_DEBUG]);
+  logger_time now;
+  logger_clock_now(context->clock_flags,&now);
+  logger_push(context,atomic_fetch_add(&context->sequence,1) + 1,&now,LOGGER_WARNING,__FILE__,__LINE__,message_buffer);
+}
+
+/*
+Writer side: pushes the pending drop report once the pressure is gone.
+Must be called with the queue lock held, releases it temporarily.
+*/
+static void
+logger_queue_flush_drops(logging_queue *queue) {
+  if(queue->pending_drops == false) {return;}
+  uint64_t dropped[LOGGER_DEBUG + 1];
+  memcpy(dropped,queue->unreported,sizeof(dropped));
+  memset(queue->unreported,0,sizeof(queue->unreported));
+  queue->pending_drops = false;
+  pthread_mutex_unlock(&queue->lock);
+  logger_queue_report_drops(queue->context,dropped);
+  pthread_mutex_lock(&queue->lock);
+}
+
+/* Whether the writer has records left to write, with the queue lock held */
+static bool
+logger_queue_busy(logging_queue const * const queue) {
+  return queue->writing || queue->priority.count > 0 || queue->normal.count > 0;
+}
+
+/*
+true while another shard holds a record older than sequence, queued or
+in flight. Must be called with the merge lock held.
+*/
+static bool
+logger_queue_behind(logging_queue * const queue,uint64_t const sequence) {
+  logging_queue * const shards = queue - queue->shard;
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    logging_queue * const shard = &shards[index];
+    if(shard == queue) {continue;}
+    pthread_mutex_lock(&shard->lock);
+    bool const older = (shard->in_flight != 0 && shard->in_flight < sequence)
+                    || (shard->priority.count > 0 && (*logger_lane_slot(&shard->priority,0))->sequence < sequence)
+                    || (shard->normal.count > 0 && (*logger_lane_slot(&shard->normal,0))->sequence < sequence);
+    pthread_mutex_unlock(&shard->lock);
+    if(older) {return true;}
+  }
+  return false;
+}
+
+/*
+Takes the merge lock before a writer outputs anything, a no-op with a
+single shard. With a sequence != 0 it waits until that record is the
+oldest of all shards. The writer of the oldest record never waits, so
+one of them always makes progress.
+*/
+static void
+logger_queue_output_begin(logging_queue * const queue,uint64_t const sequence) {
+  if(queue->shard_count == 1) {return;}
+  logging_queue * const shards = queue - queue->shard;
+  pthread_mutex_lock(&shards->merge);
+  /* The record just taken may be the one the others wait for */
+  pthread_cond_broadcast(&shards->turn);
+  while(sequence != 0 && logger_queue_behind(queue,sequence)) {
+    pthread_cond_wait(&shards->turn,&shards->merge);
+  }
+}
+
+static void
+logger_queue_output_end(logging_queue * const queue) {
+  if(queue->shard_count == 1) {return;}
+  logging_queue * const shards = queue - queue->shard;
+  pthread_cond_broadcast(&shards->turn);
+  pthread_mutex_unlock(&shards->merge);
+}
+
+/*
+Writer side of logger_sync(). Lanes are in sequence order, so all records
+up to the requested sequence are written once the oldest record of each
+lane is newer. Must be called with the queue lock held.
+*/
+static bool
+logger_queue_sync_due(logging_queue *queue) {
+  uint64_t const target = queue->sync_requested;
+  if(target <= queue->sync_done) {return false;}
+  if(queue->priority.count > 0 && (*logger_lane_slot(&queue->priority,0))->sequence <= target) {return false;}
+  if(queue->normal.count > 0 && (*logger_lane_slot(&queue->normal,0))->sequence <= target) {return false;}
+  return true;
+}
+
+/* Wakes the writer, sleeping on not_empty or spinning on posted. Must be called with the queue lock held */
+static void
+logger_queue_wake(logging_queue * const queue) {
+  atomic_fetch_add_explicit(&queue->posted,1,memory_order_release);
+  pthread_cond_signal(&queue->not_empty);
+}
+
+/*
+Busy-polls until posted moves away from the given value, at most spin_ns
+(negative = no limit). false once the time is up. Called without the
+queue lock.
+*/
+static bool
+logger_queue_spin(logging_queue * const queue,uint64_t const posted,int64_t const spin_ns) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  int64_t const deadline = logger_timespec_ns(&now) + spin_ns;
+  for(unsigned int round = 1;;round++) {
+    if(atomic_load_explicit(&queue->posted,memory_order_acquire) != posted) {return true;}
+    logger_cpu_relax();
+    if(spin_ns >= 0 && round % 64 == 0) {
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      if(logger_timespec_ns(&now) >= deadline) {return false;}
+    }
+  }
+}
+
+/*
+Updates the estimates after a batch flush that took cost ns and derives
+the next batch target and flush delay, see "Flushing" above. Must be
+called with the queue lock held.
+*/
+static void
+logger_queue_adapt(logging_queue * const queue,int64_t const now,int64_t const cost) {
+  uint64_t const arrived = queue->stats.queued - queue->adapt_queued;
+  int64_t const gap = (now - queue->adapt_time) / (int64_t)(arrived > 0 ? arrived : 1);
+  queue->adapt_queued = queue->stats.queued;
+  queue->adapt_time = now;
+  queue->stats.flushes++;
+  /* Averages over about the last four flushes */
+  queue->arrival = queue->arrival == 0 ? gap : queue->arrival + (gap - queue->arrival) / 4;
+  queue->flush_cost = queue->flush_cost == 0 ? cost : queue->flush_cost + (cost - queue->flush_cost) / 4;
+  if(queue->max_delay == 0) {return;}
+  int64_t const arrival = queue->arrival > 0 ? queue->arrival : 1;
+  int64_t target = (queue->flush_cost * LOGGER_FLUSH_SHARE + arrival - 1) / arrival;
+  if(target < 1) {target = 1;}
+  if(target > (int64_t)queue->max_batch) {target = (int64_t)queue->max_batch;}
+  queue->batch_target = (size_t)target;
+  queue->flush_delay = target > 1 ? target * arrival : 0;
+  if(queue->flush_delay > queue->max_delay) {queue->flush_delay = queue->max_delay;}
+}
+
+/* Whether a flush at now must be durable for LOGGER_DURABILITY_INTERVAL, with the queue lock held */
+static bool
+logger_queue_sync_interval_due(logging_queue const * const queue,int64_t const now) {
+  return queue->sync_interval > 0 && now - queue->synced_at >= queue->sync_interval;
+}
+
+/* Notes a flush of the output at now, with the queue lock held */
+static void
+logger_queue_flushed(logging_queue * const queue,int64_t const now,bool const durable) {
+  if(durable) {queue->synced_at = now;}
+  queue->unsynced = durable == false;
+}
+
+/* Applies the bounds of logger_set_flush_latency(), with the queue lock held */
+static void
+logger_queue_bound(logging_queue * const queue,int const max_delay_us,size_t const max_batch) {
+  queue->max_delay = (int64_t)max_delay_us * 1000;
+  queue->max_batch = max_batch;
+  if(queue->max_delay == 0) {
+    /* Fixed batches, flushed once they are full or the lane ran empty */
+    queue->batch_target = max_batch;
+    queue->flush_delay = 0;
+  } else {
+    if(queue->batch_target < 1) {queue->batch_target = 1;}
+    if(queue->batch_target > max_batch) {queue->batch_target = max_batch;}
+    if(queue->flush_delay > queue->max_delay) {queue->flush_delay = queue->max_delay;}
+  }
+}
+
+static void *
+logger_queue_writer(void *custom_object) {
+  logging_queue *queue = custom_object;
+  size_t batch = 0;
+  /* When the first record of the pending batch was written */
+  int64_t pending_since = 0;
+  char suffix[24] = "";
+  if(queue->shard_count > 1) {snprintf(suffix,sizeof(suffix),"/%zu",queue->shard);}
+  logger_thread_apply(queue->context,suffix,queue->pinned ? (int)queue->shard : -1);
+  pthread_mutex_lock(&queue->lock);
+  queue->adapt_queued = queue->stats.queued;
+  queue->adapt_time = logger_monotonic_ns();
+  queue->synced_at = queue->adapt_time;
+  for(;;) {
+    bool spun = false;
+    bool due = false;
+    while(queue->forking) {
+      pthread_cond_broadcast(&queue->drained);
+      pthread_cond_wait(&queue->not_empty,&queue->lock);
+    }
+    while(queue->priority.count == 0 && queue->normal.count == 0 && queue->running && logger_queue_sync_due(queue) == false) {
+      /* A pending batch bounds the wait by its flush delay, output that is not durable yet by the interval */
+      int64_t deadline = -1;
+      if(batch > 0) {
+        deadline = pending_since + queue->flush_delay;
+      } else if(queue->unsynced && queue->sync_interval > 0) {
+        deadline = queue->synced_at + queue->sync_interval;
+      }
+      int64_t const now = deadline >= 0 ? logger_monotonic_ns() : 0;
+      if(deadline >= 0 && now >= deadline) {
+        due = true;
+        break;
+      }
+      if(queue->wait == LOGGER_WAIT_SPIN && spun == false) {
+        uint64_t const posted = atomic_load_explicit(&queue->posted,memory_order_relaxed);
+        int64_t spin_ns = queue->spin_ns;
+        if(deadline >= 0 && (spin_ns < 0 || spin_ns > deadline - now)) {spin_ns = deadline - now;}
+        pthread_mutex_unlock(&queue->lock);
+        /* After a spin that timed out the writer sleeps until it is woken */
+        spun = logger_queue_spin(queue,posted,spin_ns) == false;
+        pthread_mutex_lock(&queue->lock);
+        continue;
+      }
+      if(deadline >= 0) {
+        struct timespec until;
+        logger_ns_timespec(deadline,&until);
+        pthread_cond_timedwait(&queue->not_empty,&queue->lock,&until);
+      } else {
+        pthread_cond_wait(&queue->not_empty,&queue->lock);
+      }
+    }
+    if(due) {
+      int64_t const started = logger_monotonic_ns();
+      bool const durable = logger_queue_sync_interval_due(queue,started);
+      queue->writing = true;
+      pthread_mutex_unlock(&queue->lock);
+      logger_queue_output_begin(queue,0);
+      logger_flush_output(queue->context,durable);
+      int64_t const flushed = logger_monotonic_ns();
+      logger_queue_output_end(queue);
+      pthread_mutex_lock(&queue->lock);
+      queue->writing = false;
+      logger_queue_flushed(queue,flushed,durable);
+      if(batch > 0) {logger_queue_adapt(queue,flushed,flushed - started);}
+      batch = 0;
+      pthread_cond_broadcast(&queue->drained);
+      continue;
+    }
+    if(logger_queue_sync_due(queue)) {
+      uint64_t const target = queue->sync_requested;
+      queue->writing = true;
+      pthread_mutex_unlock(&queue->lock);
+      logger_queue_output_begin(queue,0);
+      bool const result = logger_flush_output(queue->context,true);
+      logger_queue_output_end(queue);
+      pthread_mutex_lock(&queue->lock);
+      queue->writing = false;
+      queue->sync_done = target;
+      queue->sync_result = result;
+      logger_queue_flushed(queue,logger_monotonic_ns(),true);
+      batch = 0;
+      pthread_cond_broadcast(&queue->drained);
+      continue;
+    }
+    if(queue->priority.count == 0 && queue->normal.count == 0) {break;}
+    logging_lane *lane = queue->priority.count > 0 ? &queue->priority : &queue->normal;
+    logging_record *record = logger_lane_take(lane,0);
+    queue->in_flight = record->sequence;
+    queue->in_flight_level = record->log_level;
+    queue->in_flight_record = record;
+    queue->writing = true;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    if(record->tsc != 0) {
+      logger_tsc_convert(record->tsc,queue->context->clock_flags,&record->timestamp);
+    }
+    /* Priority records do not wait for the other shards */
+    logger_queue_output_begin(queue,lane == &queue->priority ? 0 : record->sequence);
+    if(record->data != (void*)0) {
+      logger_push_payload(queue->context,record->sequence,&record->timestamp,record->log_level,record->file,record->linenumber,record->message,record->data,record->data_length);
+    } else {
+      char *message = record->overflow != (void*)0 ? record->overflow : record->message;
+      logger_push_traced(queue->context,record->sequence,&record->timestamp,record->log_level,record->file,record->linenumber,message,record->frames,record->frame_count);
+    }
+    if(lane == &queue->priority) {
+      logger_flush_output(queue->context,true);
+      batch = 0;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->in_flight = 0;
+    queue->in_flight_record = (void*)0;
+    logger_lane_release(lane,record);
+    queue->stats.written++;
+    if(lane == &queue->priority) {
+      logger_queue_flushed(queue,logger_monotonic_ns(),true);
+    } else {
+      int64_t const now = logger_monotonic_ns();
+      if(batch++ == 0) {pending_since = now;}
+      /* Queued records join the batch for free, below the target an empty lane waits for the delay */
+      bool const empty = queue->normal.count == 0;
+      if(batch >= queue->max_batch || (empty && (batch >= queue->batch_target || queue->flush_delay == 0)) || (queue->flush_delay > 0 && now - pending_since >= queue->flush_delay)) {
+        bool const durable = logger_queue_sync_interval_due(queue,now);
+        pthread_mutex_unlock(&queue->lock);
+        logger_flush_output(queue->context,durable);
+        int64_t const flushed = logger_monotonic_ns();
+        pthread_mutex_lock(&queue->lock);
+        logger_queue_flushed(queue,flushed,durable);
+        logger_queue_adapt(queue,flushed,flushed - now);
+        batch = 0;
+      }
+    }
+    if(queue->normal.count < queue->normal.capacity / 2 + 1) {
+      logger_queue_flush_drops(queue);
+    }
+    logger_queue_output_end(queue);
+    queue->writing = false;
+    if(queue->priority.count == 0 && queue->normal.count == 0) {
+      pthread_cond_broadcast(&queue->drained);
+      logger_pool_flush();
+    }
+  }
+  pthread_mutex_unlock(&queue->lock);
+  logger_queue_output_begin(queue,0);
+  pthread_mutex_lock(&queue->lock);
+  logger_queue_flush_drops(queue);
+  pthread_mutex_unlock(&queue->lock);
+  logger_flush_output(queue->context,false);
+  logger_queue_output_end(queue);
+  pthread_mutex_lock(&queue->lock);
+  queue->exited = true;
+  pthread_mutex_unlock(&queue->lock);
+  return (void*)0;
+}
+
+/*
+Producer side. Priority records wait for a free slot in their lane.
+Normal records are subject to the backpressure policy while the queue is
+full. Returns a free record with the queue lock held, or 0 without the
+lock if the record got dropped.
+*/
+static logging_record *
+logger_queue_acquire(logging_queue *queue,int const log_level) {
+  pthread_mutex_lock(&queue->lock);
+  logging_lane *lane = log_level <= LOGGER_CRITICAL ? &queue->priority : &queue->normal;
+  bool has_deadline = false;
+  struct timespec deadline;
+  while(lane->count == lane->capacity) {
+    if(lane == &queue->priority) {
+      queue->stats.blocked++;
+      pthread_cond_wait(&queue->not_full,&queue->lock);
+    } else if(queue->policy == LOGGER_BACKPRESSURE_DROP_NEWEST) {
+      logger_queue_count_drop(queue,log_level);
+      pthread_mutex_unlock(&queue->lock);
+      return (void*)0;
+    } else if(queue->policy == LOGGER_BACKPRESSURE_DROP_OLDEST) {
+      logging_record *victim = logger_lane_take(lane,0);
+      logger_queue_count_drop(queue,victim->log_level);
+      logger_lane_release(lane,victim);
+      break;
+    } else if(queue->policy == LOGGER_BACKPRESSURE_DROP_BY_LEVEL) {
+      size_t victim = lane->count;
+      int victim_level = log_level;
+      for(size_t index = 0;index < lane->count;index++) {
+        int const queued_level = (*logger_lane_slot(lane,index))->log_level;
+        if(queued_level > victim_level) {
+          victim = index;
+          victim_level = queued_level;
+        }
+      }
+      if(victim_level > LOGGER_ERROR && victim == lane->count) {
+        logger_queue_count_drop(queue,log_level);
+        pthread_mutex_unlock(&queue->lock);
+        return (void*)0;
+      } else if(victim_level > LOGGER_ERROR) {
+        logging_record *record = logger_lane_take(lane,victim);
+        logger_queue_count_drop(queue,record->log_level);
+        logger_lane_release(lane,record);
+        break;
+      }
+      /* Only LOGGER_ERROR left, that is never dropped */
+      queue->stats.blocked++;
+      pthread_cond_wait(&queue->not_full,&queue->lock);
+    } else if(queue->block_timeout_ms < 0) {
+      queue->stats.blocked++;
+      pthread_cond_wait(&queue->not_full,&queue->lock);
+    } else {
+      if(has_deadline == false) {
+        logger_deadline(&deadline,queue->block_timeout_ms);
+        has_deadline = true;
+        queue->stats.blocked++;
+      }
+      if(pthread_cond_timedwait(&queue->not_full,&queue->lock,&deadline) == ETIMEDOUT && lane->count == lane->capacity) {
+        logger_queue_count_drop(queue,log_level);
+        pthread_mutex_unlock(&queue->lock);
+        return (void*)0;
+      }
+    }
+  }
+  if(queue->closing) {
+    /* Intake stopped by logger_shutdown() */
+    queue->stats.dropped[log_level]++;
+    pthread_mutex_unlock(&queue->lock);
+    return (void*)0;
+  }
+  logging_record *record = lane->free_records[--lane->free_count];
+  record->sequence = atomic_fetch_add(&queue->context->sequence,1) + 1;
+  record->log_level = log_level;
+  return record;
+}
+
+/* Queues a record from logger_queue_acquire() and releases the lock, returns its sequence number */
+static uint64_t
+logger_queue_commit(logging_queue *queue,logging_record *record) {
+  logging_lane *lane = record->log_level <= LOGGER_CRITICAL ? &queue->priority : &queue->normal;
+  uint64_t const sequence = record->sequence;
+  *logger_lane_slot(lane,lane->count) = record;
+  lane->count++;
+  queue->stats.queued++;
+  logger_queue_wake(queue);
+  pthread_mutex_unlock(&queue->lock);
+  return sequence;
+}
+
+/*
+Record storage for a copy of size bytes, 0 once the cap is reached. With
+LOGGER_BACKPRESSURE_BLOCK it waits up to block_timeout_ms for the writer
+to return chunks, as long as queued records may still hold some.
+*/
+static char *
+logger_queue_storage(logging_queue *queue,size_t const size) {
+  char *storage = logger_pool_alloc(size);
+  if(storage != (void*)0) {return storage;}
+  pthread_mutex_lock(&queue->lock);
+  bool const block = queue->policy == LOGGER_BACKPRESSURE_BLOCK;
+  int const timeout_ms = queue->block_timeout_ms;
+  pthread_mutex_unlock(&queue->lock);
+  struct timespec deadline;
+  if(timeout_ms >= 0) {logger_deadline(&deadline,timeout_ms);}
+  atomic_fetch_add(&logger_pool.waiters,1);
+  while(block) {
+    pthread_mutex_lock(&logger_pool.lock);
+    uint64_t const generation = logger_pool.generation;
+    pthread_mutex_unlock(&logger_pool.lock);
+    storage = logger_pool_alloc(size);
+    if(storage != (void*)0) {break;}
+    /* Never take the queue lock with the pool lock held, the writer nests them the other way */
+    pthread_mutex_lock(&queue->lock);
+    bool const idle = logger_queue_busy(queue) == false;
+    pthread_mutex_unlock(&queue->lock);
+    if(idle) {break;}
+    int result = 0;
+    pthread_mutex_lock(&logger_pool.lock);
+    while(generation == logger_pool.generation && result != ETIMEDOUT) {
+      if(timeout_ms < 0) {
+        pthread_cond_wait(&logger_pool.returned,&logger_pool.lock);
+      } else {
+        result = pthread_cond_timedwait(&logger_pool.returned,&logger_pool.lock,&deadline);
+      }
+    }
+    pthread_mutex_unlock(&logger_pool.lock);
+    if(result == ETIMEDOUT) {break;}
+  }
+  atomic_fetch_sub(&logger_pool.waiters,1);
+  if(storage == (void*)0) {atomic_fetch_add(&logger_pool.exhausted,1);}
+  return storage;
+}
+
+/* Returns the sequence number of the record, 0 if it was dropped */
+static uint64_t
+logger_queue_push(logging_queue *queue,uint64_t const tsc,logger_time const * const timestamp,int const log_level,char const * const file,int const linenumber,char const * const message,size_t length,void * const *frames,int const frame_count) {
+  char *overflow = (void*)0;
+  if(length >= LOGGER_MESSAGE_BUFFER) {
+    overflow = logger_queue_storage(queue,length + 1 + LOGGER_TRANSFORM_HEADROOM);
+    if(overflow != (void*)0) {
+      memcpy(overflow,message,length + 1);
+    }
+  }
+  logging_record *record = logger_queue_acquire(queue,log_level);
+  if(record == (void*)0) {
+    logger_pool_free(overflow);
+    return 0;
+  }
+  record->tsc = tsc;
+  if(tsc == 0) {record->timestamp = *timestamp;}
+  record->file = file;
+  record->linenumber = linenumber;
+  record->overflow = overflow;
+  record->data = (void*)0;
+  record->frame_count = frame_count;
+  memcpy(record->frames,frames,sizeof(void *) * frame_count);
+  if(length >= LOGGER_MESSAGE_BUFFER && overflow == (void*)0) {
+    memcpy(record->message,message,LOGGER_MESSAGE_BUFFER - 1);
+    logger_mark_truncated(queue->context,record->message,LOGGER_MESSAGE_BUFFER - 1);
+  } else if(overflow == (void*)0) {
+    memcpy(record->message,message,length + 1);
+  }
+  return logger_queue_commit(queue,record);
+}
+
+/* The one copy of a data message: label and payload go into the record. Returns like logger_queue_push() */
+static uint64_t
+logger_queue_push_data(logging_queue *queue,uint64_t const tsc,logger_time const * const timestamp,int const log_level,char const * const file,int const linenumber,char const * const label,void const * const data,size_t const length) {
+  size_t label_length = strlen(label);
+  if(label_length > LOGGER_MESSAGE_BUFFER - 1) {label_length = LOGGER_MESSAGE_BUFFER - 1;}
+  char *overflow = (void*)0;
+  if(label_length + 1 + length > sizeof(((logging_record *)0)->message)) {
+    overflow = logger_queue_storage(queue,length);
+    if(overflow == (void*)0) {
+      /* Memory cap reached, handled like a full queue */
+      pthread_mutex_lock(&queue->lock);
+      logger_queue_count_drop(queue,log_level);
+      pthread_mutex_unlock(&queue->lock);
+      return 0;
+    }
+    memcpy(overflow,data,length);
+  }
+  logging_record *record = logger_queue_acquire(queue,log_level);
+  if(record == (void*)0) {
+    logger_pool_free(overflow);
+    return 0;
+  }
+  record->tsc = tsc;
+  if(tsc == 0) {record->timestamp = *timestamp;}
+  record->file = file;
+  record->linenumber = linenumber;
+  memcpy(record->message,label,label_length);
+  record->message[label_length] = '\0';
+  record->overflow = overflow;
+  if(overflow == (void*)0) {
+    memcpy(record->message + label_length + 1,data,length);
+    record->data = record->message + label_length + 1;
+  } else {
+    record->data = overflow;
+  }
+  record->data_length = length;
+  record->frame_count = 0;
+  return logger_queue_commit(queue,record);
+}
+
+/* Shard of the NUMA node the calling thread runs on */
+static logging_queue *
+logger_queue_shard(logging_queue * const queue) {
+#ifdef LOGGER_HAS_AFFINITY
+  if(queue->shard_count > 1) {
+    int const cpu = sched_getcpu();
+    if(cpu >= 0 && cpu < LOGGER_NUMA_CPUS && logger_numa.cpu_shard[cpu] < queue->shard_count) {
+      return &queue[logger_numa.cpu_shard[cpu]];
+    }
+  }
+#endif
+  return queue;
+}
+
+/* Also used to recreate them in a forked child, see logger_fork_child() */
+static void
+logger_queue_sync_init(logging_queue *queue) {
+  pthread_condattr_t condition_attributes;
+  pthread_condattr_init(&condition_attributes);
+  pthread_condattr_setclock(&condition_attributes,CLOCK_MONOTONIC);
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    logging_queue * const shard = &queue[index];
+    pthread_mutex_init(&shard->lock,(void*)0);
+    pthread_cond_init(&shard->not_empty,&condition_attributes);
+    pthread_cond_init(&shard->not_full,&condition_attributes);
+    pthread_cond_init(&shard->drained,&condition_attributes);
+  }
+  pthread_mutex_init(&queue->merge,(void*)0);
+  pthread_cond_init(&queue->turn,(void*)0);
+  pthread_condattr_destroy(&condition_attributes);
+}
+
+/* Adds the pipeline counters of a shard to total */
+static void
+logger_stats_add(logger_stats * const total,logger_stats const * const shard) {
+  total->queued += shard->queued;
+  total->written += shard->written;
+  total->blocked += shard->blocked;
+  total->flushes += shard->flushes;
+  for(int level = LOGGER_EMERGENCY;level <= LOGGER_DEBUG;level++) {
+    total->dropped[level] += shard->dropped[level];
+  }
+}
+
+/* Releases all shards, their counters go to the context */
+static void
+logger_queue_destroy(logging_queue *queue) {
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    logging_queue * const shard = &queue[index];
+    logger_stats_add(&queue->context->stats,&shard->stats);
+    pthread_cond_destroy(&shard->drained);
+    pthread_cond_destroy(&shard->not_full);
+    pthread_cond_destroy(&shard->not_empty);
+    pthread_mutex_destroy(&shard->lock);
+    logger_lane_free(&shard->priority);
+    logger_lane_free(&shard->normal);
+  }
+  pthread_cond_destroy(&queue->turn);
+  pthread_mutex_destroy(&queue->merge);
+  logger_config_free(queue->retired);
+  free(queue);
+}
+
+/* Lets the writers of the first count shards drain them and joins them */
+static void
+logger_queue_stop(logging_queue *queue,size_t const count) {
+  for(size_t index = 0;index < count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    queue[index].running = false;
+    logger_queue_wake(&queue[index]);
+    /* Flush barriers stop waiting for it */
+    pthread_cond_broadcast(&queue[index].drained);
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  for(size_t index = 0;index < count;index++) {
+    pthread_join(queue[index].writer,(void*)0);
+  }
+}
+
+/* Joins the writer of the shard, until deadline if not (void*)0. false if it still runs then */
+static bool
+logger_queue_join(logging_queue * const shard,struct timespec const * const deadline) {
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2,31)
+  if(deadline != (void*)0) {
+    return pthread_clockjoin_np(shard->writer,(void*)0,CLOCK_MONOTONIC,deadline) == 0;
+  }
+#endif
+#endif
+  return pthread_join(shard->writer,(void*)0) == 0;
+}
+
+/* true while a writer detached by logger_queue_shutdown() still runs */
+static bool
+logger_queue_abandoned(logging_queue *queue) {
+  bool abandoned = false;
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    abandoned |= queue[index].abandoned && queue[index].exited == false;
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  return abandoned;
+}
+
+/*
+Starts a writer per shard, it pins itself to its node if requested (see
+"Background threads"). If one can not be started, the ones already
+running are stopped again.
+*/
+static bool
+logger_queue_start(logging_queue *queue) {
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    if(pthread_create(&queue[index].writer,(void*)0,logger_queue_writer,&queue[index]) != 0) {
+      logger_queue_stop(queue,index);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Stops intake, lets the writers drain the shards until the deadline and
+discards what is left. The writers are joined until the same deadline,
+the closed queue stays in place for logging calls that already passed the
+gate, they drop their record. A writer that is still pushing a record
+then is detached and its record counts as discarded, logger_stop_async()
+leaves the queue allocated while it runs. Returns the number of
+discarded records.
+*/
+static uint64_t
+logger_queue_shutdown(logging_queue *queue,int const timeout_ms) {
+  struct timespec deadline;
+  if(timeout_ms >= 0) {logger_deadline(&deadline,timeout_ms);}
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    queue[index].closing = true;
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  uint64_t lost = 0;
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    logging_queue * const shard = &queue[index];
+    pthread_mutex_lock(&shard->lock);
+    while(logger_queue_busy(shard)) {
+      if(timeout_ms < 0) {
+        pthread_cond_wait(&shard->drained,&shard->lock);
+      } else if(pthread_cond_timedwait(&shard->drained,&shard->lock,&deadline) == ETIMEDOUT) {
+        break;
+      }
+    }
+    logging_lane * const lanes[] = {&shard->priority,&shard->normal};
+    for(size_t lane = 0;lane < 2;lane++) {
+      while(lanes[lane]->count > 0) {
+        logging_record *record = logger_lane_take(lanes[lane],0);
+        shard->stats.dropped[record->log_level]++;
+        logger_lane_release(lanes[lane],record);
+        lost++;
+      }
+    }
+    shard->running = false;
+    logger_queue_wake(shard);
+    pthread_cond_broadcast(&shard->not_full);
+    pthread_cond_broadcast(&shard->drained);
+    pthread_mutex_unlock(&shard->lock);
+    if(queue->shard_count > 1) {
+      /* Writers of other shards may wait for a discarded record */
+      pthread_mutex_lock(&queue->merge);
+      pthread_cond_broadcast(&queue->turn);
+      pthread_mutex_unlock(&queue->merge);
+    }
+  }
+  /* A record a writer is pushing right now is not interrupted */
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    logging_queue * const shard = &queue[index];
+    if(logger_queue_join(shard,timeout_ms >= 0 ? &deadline : (void*)0)) {continue;}
+    pthread_detach(shard->writer);
+    pthread_mutex_lock(&shard->lock);
+    shard->abandoned = true;
+    if(shard->in_flight != 0) {
+      shard->stats.dropped[shard->in_flight_level]++;
+      lost++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return lost;
+}
+
+static void
+logger_async_exit_context(logging_context * const context) {
+  if(context->queue == (void*)0) {return;}
+  if(context->queue->closing == false) {
+    uint64_t const lost = logger_queue_shutdown(context->queue,LOGGER_SHUTDOWN_TIMEOUT_MS);
+    if(lost > 0) {
+      fprintf(stderr,"Logger lost %llu queued records at exit\n",(unsigned long long)lost);
+    }
+  }
+  logger_stop_async_to(context);
+}
+
+static void
+logger_async_exit(void) {
+  logger_async_exit_context(&Logger);
+  pthread_mutex_lock(&logger_instances_lock);
+  for(logging_context *instance = logger_instances;instance != (void*)0;instance = instance->next_instance) {
+    logger_async_exit_context(instance);
+  }
+  pthread_mutex_unlock(&logger_instances_lock);
+}
+
+static bool
+logger_is_policy(int policy) {
+  return policy == LOGGER_BACKPRESSURE_BLOCK || policy == LOGGER_BACKPRESSURE_DROP_NEWEST
+      || policy == LOGGER_BACKPRESSURE_DROP_OLDEST || policy == LOGGER_BACKPRESSURE_DROP_BY_LEVEL;
+}
+
+/*
+Parameters:
+-----------
+options
+  Combination of LOGGER_NUMA_SHARDS, LOGGER_NUMA_BIND and LOGGER_NUMA_PIN,
+  0 = a single queue and writer (the default)
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS, the number of shards logger_setup_async() will create
+
+Description:
+------------
+Sets how the next logger_setup_async() lays out the pipeline on a NUMA
+host, see "Shards" above:
+- LOGGER_NUMA_SHARDS: one queue and writer per node with CPUs
+- LOGGER_NUMA_BIND: the records of each shard are bound to its node
+- LOGGER_NUMA_PIN: the writer of each shard runs on the CPUs of its node
+BIND and PIN only apply together with SHARDS. On hosts with a single
+node (or without /sys/devices/system/node) the pipeline keeps one shard.
+*/
+extern int
+logger_set_numa(int options) {
+  return logger_set_numa_to(&Logger,options);
+}
+
+/* logger_set_numa() for an instance, see logger_create() */
+extern int
+logger_set_numa_to(logger_t *logger,int options) {
+  if(logger == (void*)0) {return 0;}
+  int const known = LOGGER_NUMA_SHARDS | LOGGER_NUMA_BIND | LOGGER_NUMA_PIN;
+  if((options & ~known) != 0) {return 0;}
+  logger->numa_options = options;
+  return (options & LOGGER_NUMA_SHARDS) ? (int)logger_numa_topology()->count : 1;
+}
+
+/*
+Parameters:
+-----------
+cpus
+  CPU list in the format of /sys/devices/system/cpu/online, e.g. "2-3,6",
+  (void*)0 = no affinity of their own
+
+Return Value:
+-------------
+value <= 0 = ERROR (malformed list, no affinity support)
+value > 0 = SUCCESS
+
+Description:
+------------
+CPUs the background threads (writers, config watcher) run on, e.g. to
+keep them off cores reserved for latency critical threads. Applies to
+threads started afterwards, see "Background threads" above.
+*/
+extern int
+logger_set_thread_affinity(char const * const cpus) {
+  return logger_set_thread_affinity_to(&Logger,cpus);
+}
+
+/* logger_set_thread_affinity() for an instance, see logger_create() */
+extern int
+logger_set_thread_affinity_to(logger_t *logger,char const * const cpus) {
+  if(logger == (void*)0) {return 0;}
+#ifdef LOGGER_HAS_AFFINITY
+  if(cpus == (void*)0) {
+    logger->threads.has_cpus = false;
+    return 1;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if(logger_cpu_list_parse(cpus,&set) == false || CPU_COUNT(&set) == 0) {return 0;}
+  logger->threads.cpus = set;
+  logger->threads.has_cpus = true;
+  return 1;
+#else
+  return cpus == (void*)0 ? 1 : 0;
+#endif
+}
+
+/*
+Parameters:
+-----------
+policy
+  LOGGER_SCHED_INHERIT (keep the policy of the creating thread),
+  LOGGER_SCHED_BATCH or LOGGER_SCHED_IDLE
+
+nice
+  Nice value of the threads, -20 - 19. Negative values need CAP_SYS_NICE.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Scheduling of the background threads started afterwards. SCHED_IDLE
+only runs them on otherwise idle CPUs, which suits hosts whose cores are
+all busy with work that must not be disturbed, at the price of records
+piling up under full load (see the backpressure policies).
+*/
+extern int
+logger_set_thread_scheduling(int policy,int nice) {
+  return logger_set_thread_scheduling_to(&Logger,policy,nice);
+}
+
+/* logger_set_thread_scheduling() for an instance, see logger_create() */
+extern int
+logger_set_thread_scheduling_to(logger_t *logger,int policy,int nice) {
+  if(logger == (void*)0) {return 0;}
+  if(policy != LOGGER_SCHED_INHERIT && policy != LOGGER_SCHED_BATCH && policy != LOGGER_SCHED_IDLE) {return 0;}
+  if(nice < -20 || nice > 19) {return 0;}
+  logger->threads.policy = policy;
+  logger->threads.nice = nice;
+  logger->threads.has_scheduling = true;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+name
+  Base name of the background threads, (void*)0 = "logger"
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Name the background threads started afterwards show in top, ps -L or a
+debugger. Suffixes for shards and the config watcher are appended, the
+result is cut to the 15 characters the kernel keeps.
+*/
+extern int
+logger_set_thread_name(char const * const name) {
+  return logger_set_thread_name_to(&Logger,name);
+}
+
+/* logger_set_thread_name() for an instance, see logger_create() */
+extern int
+logger_set_thread_name_to(logger_t *logger,char const * const name) {
+  if(logger == (void*)0) {return 0;}
+  snprintf(logger->threads.name,sizeof(logger->threads.name),"%s",name != (void*)0 ? name : "");
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+mode
+  LOGGER_WAIT_BLOCK or LOGGER_WAIT_SPIN
+
+spin_us
+  Only used with LOGGER_WAIT_SPIN. How long an idle writer busy-polls
+  before it sleeps, negative = it never sleeps.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+How an idle writer waits for records, see "Waiting for work" above.
+Takes effect right away for a running pipeline. Spinning without a
+limit occupies one CPU per writer, combine it with
+logger_set_thread_affinity() to give the writers cores of their own.
+*/
+extern int
+logger_set_writer_wait(int mode,int spin_us) {
+  return logger_set_writer_wait_to(&Logger,mode,spin_us);
+}
+
+/* logger_set_writer_wait() for an instance, see logger_create() */
+extern int
+logger_set_writer_wait_to(logger_t *logger,int mode,int spin_us) {
+  if(logger == (void*)0) {return 0;}
+  if(mode != LOGGER_WAIT_BLOCK && mode != LOGGER_WAIT_SPIN) {return 0;}
+  logger->threads.wait = mode;
+  logger->threads.spin_us = spin_us;
+  logging_queue *queue = logger->queue;
+  for(size_t index = 0;queue != (void*)0 && index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    queue[index].wait = mode;
+    queue[index].spin_ns = (int64_t)spin_us * 1000;
+    logger_queue_wake(&queue[index]);
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+max_delay_us
+  Longest time a written record waits for its batch to be flushed,
+  0 = fixed batches of max_batch records, flushed early once the queue
+  ran empty
+
+max_batch
+  Largest number of records flushed together, at least 1
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Bounds the adaptive flushing of the asynchronous writer, see "Flushing"
+above. Defaults are LOGGER_FLUSH_DELAY_US and LOGGER_BATCH_RECORDS.
+Takes effect right away for a running pipeline, logger_get_stats()
+reports what the writer currently decides within these bounds.
+Priority records and logger_sync() are flushed durably regardless.
+*/
+extern int
+logger_set_flush_latency(int max_delay_us,size_t max_batch) {
+  return logger_set_flush_latency_to(&Logger,max_delay_us,max_batch);
+}
+
+/* logger_set_flush_latency() for an instance, see logger_create() */
+extern int
+logger_set_flush_latency_to(logger_t *logger,int max_delay_us,size_t max_batch) {
+  if(logger == (void*)0) {return 0;}
+  if(max_delay_us < 0 || max_batch == 0) {return 0;}
+  logger->flush_delay_us = max_delay_us;
+  logger->flush_batch = max_batch;
+  logging_queue *queue = logger->queue;
+  for(size_t index = 0;queue != (void*)0 && index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    logger_queue_bound(&queue[index],max_delay_us,max_batch);
+    logger_queue_wake(&queue[index]);
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+mode
+  LOGGER_DURABILITY_NONE or a combination of
+  LOGGER_DURABILITY_INTERVAL and LOGGER_DURABILITY_ERROR
+
+interval_ms
+  Only used with LOGGER_DURABILITY_INTERVAL, at least 1. Longest time
+  written records stay without a durable flush.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+When the output of this instance is flushed to stable storage (flush
+callback with durable = true, fdatasync for the factory files), see
+"Durability" above. LOGGER_CRITICAL and above, logger_sync() and
+logger_log_durable() always are. LOGGER_DURABILITY_ERROR makes
+LOGGER_ERROR and above wait for it like logger_log_durable().
+Without a pipeline the interval is checked by the logging calls, the
+first call after it passed does the flush. Takes effect right away for
+a running pipeline.
+*/
+extern int
+logger_set_durability(int mode,int interval_ms) {
+  return logger_set_durability_to(&Logger,mode,interval_ms);
+}
+
+/* logger_set_durability() for an instance, see logger_create() */
+extern int
+logger_set_durability_to(logger_t *logger,int mode,int interval_ms) {
+  if(logger == (void*)0) {return 0;}
+  if(mode & ~(LOGGER_DURABILITY_INTERVAL | LOGGER_DURABILITY_ERROR)) {return 0;}
+  if((mode & LOGGER_DURABILITY_INTERVAL) && interval_ms < 1) {return 0;}
+  logger->durability = mode;
+  logger->durability_interval_ms = interval_ms;
+  logging_queue *queue = logger->queue;
+  for(size_t index = 0;queue != (void*)0 && index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    queue[index].sync_interval = (mode & LOGGER_DURABILITY_INTERVAL) ? (int64_t)interval_ms * 1000000 : 0;
+    logger_queue_wake(&queue[index]);
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+capacity
+  Number of normal records the queue can hold before the backpressure
+  policy applies. The priority lane always holds LOGGER_PRIORITY_CAPACITY.
+  With shards (see logger_set_numa()) these are per shard.
+
+policy
+  One of LOGGER_BACKPRESSURE_BLOCK, LOGGER_BACKPRESSURE_DROP_NEWEST,
+  LOGGER_BACKPRESSURE_DROP_OLDEST or LOGGER_BACKPRESSURE_DROP_BY_LEVEL
+
+block_timeout_ms
+  Only used with LOGGER_BACKPRESSURE_BLOCK. Maximum time a caller waits for
+  a free slot before its record is dropped. Negative values wait forever.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Starts the background writer thread. From this point forward the transform
+and output functions run on that thread and logger_log() only queues the
+formatted message. The context must be initialized beforehand.
+Setup functions must not run concurrently with logging calls.
+*/
+extern int
+logger_setup_async(size_t capacity,int policy,int block_timeout_ms) {
+  return logger_setup_async_to(&Logger,capacity,policy,block_timeout_ms);
+}
+
+/* logger_setup_async() for an instance, see logger_create() */
+extern int
+logger_setup_async_to(logger_t *logger,size_t capacity,int policy,int block_timeout_ms) {
+  if(logger == (void*)0) {return 0;}
+  static bool exit_handler = false;
+  if(logger_is_initialized_to(logger) == false || capacity == 0 || logger_is_policy(policy) == false) {
+    return 0;
+  } else if(logger->queue != (void*)0) {
+    return -1;
+  }
+  int const numa_options = logger->numa_options;
+  size_t const count = (numa_options & LOGGER_NUMA_SHARDS) ? logger_numa_topology()->count : 1;
+  logging_queue *queue = aligned_alloc(LOGGER_CACHE_LINE,sizeof(logging_queue) * count);
+  if(queue == (void*)0) {return -2;}
+  memset(queue,0,sizeof(logging_queue) * count);
+  bool allocated = true;
+  for(size_t index = 0;index < count;index++) {
+    logging_queue * const shard = &queue[index];
+    int const node = (numa_options & LOGGER_NUMA_SHARDS) ? logger_numa.node[index] : -1;
+    int const bind = (numa_options & LOGGER_NUMA_BIND) ? node : -1;
+    shard->shard = index;
+    shard->shard_count = count;
+    shard->pinned = (numa_options & LOGGER_NUMA_PIN) && node >= 0;
+    shard->policy = policy;
+    shard->block_timeout_ms = block_timeout_ms;
+    shard->wait = logger->threads.wait;
+    shard->spin_ns = (int64_t)logger->threads.spin_us * 1000;
+    logger_queue_bound(shard,logger->flush_delay_us,logger->flush_batch);
+    shard->sync_interval = (logger->durability & LOGGER_DURABILITY_INTERVAL) ? (int64_t)logger->durability_interval_ms * 1000000 : 0;
+    shard->context = logger;
+    shard->running = true;
+    if(logger_lane_init(&shard->priority,LOGGER_PRIORITY_CAPACITY,bind) <= 0 || logger_lane_init(&shard->normal,capacity,bind) <= 0) {
+      allocated = false;
+    }
+  }
+  if(allocated == false) {
+    for(size_t index = 0;index < count;index++) {
+      logger_lane_free(&queue[index].priority);
+      logger_lane_free(&queue[index].normal);
+    }
+    free(queue);
+    return -2;
+  }
+  logger_queue_sync_init(queue);
+  if(logger_queue_start(queue) == false) {
+    fprintf(stderr,"Could not start logger writer thread\n");
+    logger_queue_destroy(queue);
+    return -3;
+  }
+  if(exit_handler == false) {
+    if(atexit(logger_async_exit) != 0) {
+      fprintf(stderr,"Could not setup atexit handler\n");
+    } else {
+      exit_handler = true;
+    }
+  }
+  logger->queue = queue;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+policy
+  The new backpressure policy, see logger_setup_async()
+
+block_timeout_ms
+  The new timeout for LOGGER_BACKPRESSURE_BLOCK, negative = forever
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Changes the backpressure policy of a running asynchronous pipeline
+*/
+extern int
+logger_set_backpressure(int policy,int block_timeout_ms) {
+  return logger_set_backpressure_to(&Logger,policy,block_timeout_ms);
+}
+
+/* logger_set_backpressure() for an instance, see logger_create() */
+extern int
+logger_set_backpressure_to(logger_t *logger,int policy,int block_timeout_ms) {
+  if(logger == (void*)0) {return 0;}
+  logging_queue *queue = logger->queue;
+  if(queue == (void*)0 || logger_is_policy(policy) == false) {return 0;}
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    queue[index].policy = policy;
+    queue[index].block_timeout_ms = block_timeout_ms;
+    pthread_cond_broadcast(&queue[index].not_full);
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+value <= 0 = ERROR (no asynchronous pipeline running)
+value > 0 = SUCCESS
+
+Description:
+------------
+Writes all queued records, stops the writer thread and switches back to
+synchronous logging. Must not run concurrently with logging calls.
+After logger_shutdown() it only releases the closed queue.
+*/
+extern int
+logger_stop_async(void) {
+  return logger_stop_async_to(&Logger);
+}
+
+/* logger_stop_async() for an instance, see logger_create() */
+extern int
+logger_stop_async_to(logger_t *logger) {
+  if(logger == (void*)0) {return 0;}
+  logging_queue *queue = logger->queue;
+  if(queue == (void*)0) {return 0;}
+  if(queue->closing == false) {
+    logger_queue_stop(queue,queue->shard_count);
+  }
+  logger->queue = (void*)0;
+  if(logger_queue_abandoned(queue)) {
+    /* A detached writer still uses the queue, it is left allocated and only its counters are taken over */
+    for(size_t index = 0;index < queue->shard_count;index++) {
+      pthread_mutex_lock(&queue[index].lock);
+      logger_stats_add(&logger->stats,&queue[index].stats);
+      memset(&queue[index].stats,0,sizeof(queue[index].stats));
+      pthread_mutex_unlock(&queue[index].lock);
+    }
+    return 1;
+  }
+  logger_queue_destroy(queue);
+  return 1;
+}
+
+/*
+Asks the writer of the shard to flush durably once it wrote every record
+up to target and waits for it, until deadline if not (void*)0. Requests
+that arrive until then are merged, one flush serves all of them. Returns
+like logger_sync(), -2 as well if the writer stopped first.
+*/
+static int
+logger_queue_barrier(logging_queue * const shard,uint64_t const target,struct timespec const * const deadline) {
+  pthread_mutex_lock(&shard->lock);
+  if(target > shard->sync_requested) {
+    shard->sync_requested = target;
+    logger_queue_wake(shard);
+  }
+  int ret_code = 1;
+  while(shard->sync_done < target && shard->running) {
+    if(deadline == (void*)0) {
+      pthread_cond_wait(&shard->drained,&shard->lock);
+    } else if(pthread_cond_timedwait(&shard->drained,&shard->lock,deadline) == ETIMEDOUT && shard->sync_done < target) {
+      ret_code = -1;
+      break;
+    }
+  }
+  if(ret_code > 0 && (shard->sync_done < target || shard->sync_result == false)) {ret_code = -2;}
+  pthread_mutex_unlock(&shard->lock);
+  return ret_code;
+}
+
+/*
+Parameters:
+-----------
+timeout_ms
+  How long to wait for the writer, negative = forever
+
+Return Value:
+-------------
+value <= 0 = ERROR
+  -1 = timeout, the records are still queued and get written later
+  -2 = the flush callback failed
+value > 0 = SUCCESS
+
+Description:
+------------
+Flush barrier: returns once every record logged before the call is
+written and the output is flushed durably (flush callback with
+durable = true, fdatasync for the factory files). Records logged
+concurrently by other threads are not waited for.
+
+Without an asynchronous pipeline the output is flushed right away. With
+one, the writer thread does the flush after the last record up to the
+current sequence number, so output and flush callbacks keep running on
+the writer (every shard's writer flushes once). Use it before exec, fork
+or acknowledging a request whose log lines must not get lost.
+*/
+extern int
+logger_sync(int timeout_ms) {
+  return logger_sync_to(&Logger,timeout_ms);
+}
+
+/* logger_sync() for an instance, see logger_create() */
+extern int
+logger_sync_to(logger_t *logger,int timeout_ms) {
+  if(logger == (void*)0) {return 0;}
+  logging_queue *queue = logger->queue;
+  if(queue == (void*)0 || queue->closing) {
+    return logger_flush_output(logger,true) ? 1 : -2;
+  }
+  struct timespec deadline;
+  if(timeout_ms >= 0) {logger_deadline(&deadline,timeout_ms);}
+  /* Sequence numbers are taken under the shard locks, with all held everything up to target is queued */
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+  }
+  uint64_t const target = atomic_load(&logger->sequence);
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  int ret_code = 1;
+  for(size_t index = 0;index < queue->shard_count && ret_code > 0;index++) {
+    ret_code = logger_queue_barrier(&queue[index],target,timeout_ms >= 0 ? &deadline : (void*)0);
+  }
+  return ret_code;
+}
+
+/*
+Parameters:
+-----------
+timeout_ms
+  Deadline for draining the queue, negative = no deadline
+
+lost
+  Receives the number of queued records that were discarded at the
+  deadline, can be (void*)0
+
+Return Value:
+-------------
+value <= 0 = ERROR
+  -1 = records were lost
+  -2 = the final flush failed
+value > 0 = SUCCESS
+
+Description:
+------------
+Graceful shutdown in bounded time. Deactivates the logger (see
+logger_toggle()), so no new records are accepted, lets the writer drain
+the queue until the deadline and discards whatever is still queued then.
+Discarded records are counted in logger_stats.dropped. Finally the
+output is flushed durably.
+
+A record the writer is pushing is not interrupted, it has until the
+deadline to finish. A writer still busy then is detached, its record
+counts as lost and the final flush is skipped, as the writer may still
+be inside the output. The writer thread is stopped, calls that were
+already past the level check drop their record. logger_stop_async()
+releases the queue, after that logger_toggle(true) resumes synchronous
+logging.
+The atexit handler of the pipeline does the same with a deadline of
+LOGGER_SHUTDOWN_TIMEOUT_MS, but leaves the logger active.
+*/
+extern int
+logger_shutdown(int timeout_ms,uint64_t *lost) {
+  return logger_shutdown_to(&Logger,timeout_ms,lost);
+}
+
+/* logger_shutdown() for an instance, see logger_create() */
+extern int
+logger_shutdown_to(logger_t *logger,int timeout_ms,uint64_t *lost) {
+  if(logger == (void*)0) {return 0;}
+  logger_toggle_to(logger,false);
+  uint64_t discarded = 0;
+  if(logger->queue != (void*)0 && logger->queue->closing == false) {
+    discarded = logger_queue_shutdown(logger->queue,timeout_ms);
+  }
+  if(lost != (void*)0) {*lost = discarded;}
+  /* A detached writer may still be inside the output */
+  if(logger->queue != (void*)0 && logger_queue_abandoned(logger->queue)) {return -1;}
+  if(logger_flush_output(logger,true) == false) {return -2;}
+  return discarded > 0 ? -1 : 1;
+}
+
+/*
+Parameters:
+-----------
+stats
+  Structure to be filled with the current counters
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Copies the pipeline counters. Counters keep their values across
+logger_stop_async(), the queue fields are 0 without a running pipeline
+and summed over all shards with one.
+The pool fields describe the record storage shared by all instances,
+the memory fields all large buffers (see logger_set_memory_options()).
+*/
+extern int
+logger_get_stats(logger_stats *stats) {
+  return logger_get_stats_to(&Logger,stats);
+}
+
+/* logger_get_stats() for an instance, see logger_create() */
+extern int
+logger_get_stats_to(logger_t *logger,logger_stats *stats) {
+  if(logger == (void*)0) {return 0;}
+  if(stats == (void*)0) {return 0;}
+  logging_queue *queue = logger->queue;
+  size_t const count = queue != (void*)0 ? queue->shard_count : 0;
+  *stats = logger->stats;
+  stats->queue_depth = 0;
+  stats->queue_capacity = 0;
+  stats->priority_depth = 0;
+  stats->queue_shards = count;
+  stats->flush_batch = 0;
+  stats->flush_delay_ns = 0;
+  stats->arrival_ns = 0;
+  stats->flush_cost_ns = 0;
+  for(size_t index = 0;index < count;index++) {
+    pthread_mutex_lock(&queue[index].lock);
+    logger_stats_add(stats,&queue[index].stats);
+    stats->queue_depth += queue[index].normal.count;
+    stats->queue_capacity += queue[index].normal.capacity;
+    stats->priority_depth += queue[index].priority.count;
+    if(index == 0 || (queue[index].arrival > 0 && (stats->arrival_ns == 0 || (uint64_t)queue[index].arrival < stats->arrival_ns))) {
+      stats->flush_batch = queue[index].batch_target;
+      stats->flush_delay_ns = (uint64_t)queue[index].flush_delay;
+      stats->arrival_ns = (uint64_t)queue[index].arrival;
+      stats->flush_cost_ns = (uint64_t)queue[index].flush_cost;
+    }
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  stats->sequence = atomic_load(&logger->sequence);
+  stats->truncated = atomic_load(&logger->truncated);
+  stats->config_reloads = atomic_load(&logger->config_reloads);
+  stats->config_rejected = atomic_load(&logger->config_rejected);
+  pthread_mutex_lock(&logger_pool.lock);
+  stats->pool_reserved = logger_pool.reserved;
+  stats->pool_available = logger_pool.available;
+  stats->pool_cap = logger_pool.cap;
+  stats->pool_refills = logger_pool.refills;
+  stats->pool_returns = logger_pool.returns;
+  stats->pool_large = logger_pool.large;
+  pthread_mutex_unlock(&logger_pool.lock);
+  stats->pool_exhausted = atomic_load(&logger_pool.exhausted);
+  stats->memory_mapped = atomic_load(&logger_memory_mapped);
+  stats->memory_huge = atomic_load(&logger_memory_huge);
+  stats->memory_locked = atomic_load(&logger_memory_locked);
+  return 1;
+}
+
+/*
+Call sites
+
+The logging macros place a logger_site per use in the logger_sites
+section (see logger.h), the linker provides the bounds of the section.
+Queries in the style of the kernel's dynamic debug select sites and set
+their enable byte:
+
+  file src/net/listen*.c line 120-180 format "accept" +p
+
+- file: glob (fnmatch) against the path as compiled or its last component
+- line: a single line or a range
+- format: substring of the macro arguments as written in the source
+- +p logs the sites regardless of the log level, -p returns them to it
+All given conditions must match. The byte is read inline by the macro,
+sites that are not enabled cost one load and a predicted branch.
+*/
+
+#if defined(__GNUC__) && defined(__ELF__) && !defined(LOGGER_NO_SITES)
+#define LOGGER_HAS_SITES 1
+extern logger_site __start_logger_sites[] __attribute__((weak));
+extern logger_site __stop_logger_sites[] __attribute__((weak));
+#endif
+
+#define LOGGER_SITE_QUERY 256
+
+typedef struct {
+  char text[LOGGER_SITE_QUERY];
+  char const *file;
+  char const *format;
+  int line_first;
+  int line_last;
+  unsigned char enabled;
+} logging_site_query;
+
+/* Next blank separated or double quoted token, (void*)0 at the end */
+static char *
+logger_site_token(char **cursor) {
+  char *text = *cursor;
+  while(*text == ' ' || *text == '\t') {text++;}
+  if(*text == '\0') {return (void*)0;}
+  char *end;
+  if(*text == '"') {
+    text++;
+    end = strchr(text,'"');
+    if(end == (void*)0) {return (void*)0;}
+  } else {
+    end = text + strcspn(text," \t");
+  }
+  *cursor = *end != '\0' ? end + 1 : end;
+  *end = '\0';
+  return text;
+}
+
+/* Parses command into query, returns the reason if it is invalid */
+static char const *
+logger_site_parse(char const * const command,logging_site_query * const query) {
+  memset(query,0,sizeof(logging_site_query));
+  query->line_last = INT32_MAX;
+  size_t const length = strlen(command);
+  if(length >= LOGGER_SITE_QUERY) {return "query too long";}
+  memcpy(query->text,command,length + 1);
+  char *cursor = query->text;
+  bool flagged = false;
+  for(char *token = logger_site_token(&cursor);token != (void*)0;token = logger_site_token(&cursor)) {
+    if(strcmp(token,"+p") == 0 || strcmp(token,"-p") == 0) {
+      query->enabled = token[0] == '+';
+      flagged = true;
+      continue;
+    }
+    char * const value = logger_site_token(&cursor);
+    if(value == (void*)0) {return "missing value or closing quote";}
+    if(strcmp(token,"file") == 0) {
+      query->file = value;
+    } else if(strcmp(token,"format") == 0) {
+      query->format = value;
+    } else if(strcmp(token,"line") == 0) {
+      char *end = (void*)0;
+      long const first = strtol(value,&end,10);
+      long last = first;
+      if(*end == '-') {
+        char const * const start = end + 1;
+        last = strtol(start,&end,10);
+        if(end == start) {return "invalid line range";}
+      }
+      if(end == value || *end != '\0' || first < 0 || last < first || last > INT32_MAX) {return "invalid line range";}
+      query->line_first = (int)first;
+      query->line_last = (int)last;
+    } else {
+      return "unknown keyword";
+    }
+  }
+  return flagged ? (void*)0 : "missing +p or -p";
+}
+
+static bool
+logger_site_matches(logging_site_query const * const query,logger_site const * const site) {
+  if(site->linenumber < query->line_first || site->linenumber > query->line_last) {return false;}
+  if(query->format != (void*)0 && strstr(site->arguments,query->format) == (void*)0) {return false;}
+  if(query->file != (void*)0 && fnmatch(query->file,site->file,0) != 0) {
+    char const * const name = strrchr(site->file,'/');
+    if(name == (void*)0 || fnmatch(query->file,name + 1,0) != 0) {return false;}
+  }
+  return true;
+}
+
+/* Sets the enable byte of every matching site, returns their number */
+static int
+logger_site_apply(logging_site_query const * const query) {
+  int matched = 0;
+#ifdef LOGGER_HAS_SITES
+  for(logger_site *site = __start_logger_sites;site != (void*)0 && site < __stop_logger_sites;site++) {
+    if(logger_site_matches(query,site)) {
+      __atomic_store_n(&site->enabled,query->enabled,__ATOMIC_RELAXED);
+      matched++;
+    }
+  }
+#endif
+  return matched;
+}
+
+/*
+Parameters:
+-----------
+command
+  Query selecting call sites, e.g. "file socket*.c line 10-20 +p"
+
+Return Value:
+-------------
+value < 0 = ERROR (invalid query)
+value >= 0 = number of sites changed, 0 if nothing matched
+
+Description:
+------------
+Enables (+p) or resets (-p) the logging macros selected by command, see
+the format above. Enabled sites of the default instance are logged even
+below its log level, as long as logging is active. Sites are only
+registered for the macros of the module logger.c is linked into, and
+not with LOGGER_NO_SITES. The config file takes the same queries as
+"site = ..." lines.
+*/
+extern int
+logger_site_control(char const * const command) {
+  if(command == (void*)0) {return -1;}
+  logging_site_query query;
+  char const * const reason = logger_site_parse(command,&query);
+  if(reason != (void*)0) {
+    fprintf(stderr,"Rejected site query \"%s\" - %s\n",command,reason);
+    return -1;
+  }
+  return logger_site_apply(&query);
+}
+
+/*
+Configuration file
+
+A small text file that is watched with inotify on a background thread:
+
+  # comments and empty lines are ignored
+  level = info                 # base level, name or 0 - 7
+  level.src/net/ = debug       # level for files starting with src/net/
+  sample.debug = 100           # keep 1 of every 100 debug messages
+  sink = /var/log/app.log      # append to this file instead of the output
+  site = file tls.c line 80-95 +p    # call sites, see logger_site_control()
+
+Every change builds a new logging_config that is published as a whole.
+Logging threads never wait for a reload, they keep using the previous
+configuration until the pointer changes. A file that does not parse (or
+a sink that cannot be opened) is rejected and the running configuration
+stays in place. Site queries are applied in order after each successful
+load, sites they do not mention keep their state.
+*/
+
+struct logging_watch {
+  pthread_t thread;
+  int inotify;
+  int stop[2];
+  char *path;
+  char const *name;
+  logging_config *retired;
+};
+
+static int
+logger_config_level(char const * const value) {
+  static char const * const names[] = {"emergency","alert","critical","error","warning","notice","info","debug"};
+  if(value[0] >= '0' && value[0] <= '7' && value[1] == '\0') {return value[0] - '0';}
+  for(int log_level = LOGGER_EMERGENCY;log_level <= LOGGER_DEBUG;log_level++) {
+    if(strcasecmp(value,names[log_level]) == 0) {return log_level;}
+  }
+  return -1;
+}
+
+static char *
+logger_config_trim(char *text) {
+  while(*text == ' ' || *text == '\t') {text++;}
+  size_t length = strlen(text);
+  while(length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t' || text[length - 1] == '\n' || text[length - 1] == '\r')) {
+    text[--length] = '\0';
+  }
+  return text;
+}
+
+/* Applies one "key = value" line, returns the reason if it is invalid */
+static char const *
+logger_config_apply(logging_config * const config,char * const key,char * const value) {
+  if(strcmp(key,"level") == 0) {
+    config->log_level = logger_config_level(value);
+    return config->log_level < 0 ? "unknown level" : (void*)0;
+  } else if(strncmp(key,"level.",6) == 0) {
+    size_t const length = strlen(key + 6);
+    if(length == 0 || length >= LOGGER_CONFIG_PREFIX) {return "invalid module prefix";}
+    if(config->module_count >= LOGGER_CONFIG_MODULES) {return "too many modules";}
+    int const log_level = logger_config_level(value);
+    if(log_level < 0) {return "unknown level";}
+    memcpy(config->modules[config->module_count].prefix,key + 6,length + 1);
+    config->modules[config->module_count].length = length;
+    config->modules[config->module_count].log_level = log_level;
+    config->module_count++;
+    return (void*)0;
+  } else if(strncmp(key,"sample.",7) == 0) {
+    int const log_level = logger_config_level(key + 7);
+    if(log_level < 0) {return "unknown level";}
+    char *end = (void*)0;
+    errno = 0;
+    unsigned long const rate = strtoul(value,&end,10);
+    if(errno != 0 || end == value || *end != '\0' || rate == 0 || rate > UINT32_MAX) {return "invalid sampling rate";}
+    config->sample_rate[log_level] = (uint32_t)rate;
+    return (void*)0;
+  } else if(strcmp(key,"site") == 0) {
+    logging_site_query query;
+    char const * const reason = logger_site_parse(value,&query);
+    if(reason != (void*)0) {return reason;}
+    if(config->site_count >= LOGGER_CONFIG_SITES) {return "too many site queries";}
+    config->sites[config->site_count] = strdup(value);
+    if(config->sites[config->site_count] == (void*)0) {return "out of memory";}
+    config->site_count++;
+    return (void*)0;
+  } else if(strcmp(key,"sink") == 0) {
+    if(value[0] == '\0') {return "empty sink path";}
+    free(config->sink_path);
+    config->sink_path = strdup(value);
+    return config->sink_path == (void*)0 ? "out of memory" : (void*)0;
+  }
+  return "unknown key";
+}
+
+static logging_config *
+logger_config_parse(char const * const path) {
+  FILE *file = fopen(path,"r");
+  if(file == (void*)0) {
+    fprintf(stderr,"Rejected logger config %s - %s\n",path,strerror(errno));
+    return (void*)0;
+  }
+  logging_config *config = calloc(1,sizeof(logging_config));
+  if(config == (void*)0) {
+    fclose(file);
+    return (void*)0;
+  }
+  config->log_level = -1;
+  char *line = (void*)0;
+  size_t capacity = 0;
+  int linenumber = 0;
+  char const *reason = (void*)0;
+  while(reason == (void*)0 && getline(&line,&capacity,file) != -1) {
+    linenumber++;
+    /* A '#' after a blank starts a comment, paths may contain one */
+    for(char *cursor = strchr(line,'#');cursor != (void*)0;cursor = strchr(cursor + 1,'#')) {
+      if(cursor == line || cursor[-1] == ' ' || cursor[-1] == '\t') {
+        *cursor = '\0';
+        break;
+      }
+    }
+    char * const text = logger_config_trim(line);
+    if(text[0] == '\0' || text[0] == '#') {continue;}
+    char * const separator = strchr(text,'=');
+    if(separator == (void*)0) {
+      reason = "missing '='";
+      break;
+    }
+    *separator = '\0';
+    reason = logger_config_apply(config,logger_config_trim(text),logger_config_trim(separator + 1));
+  }
+  free(line);
+  fclose(file);
+  if(reason != (void*)0) {
+    fprintf(stderr,"Rejected logger config %s:%d - %s\n",path,linenumber,reason);
+    logger_config_free(config);
+    return (void*)0;
+  }
+  return config;
+}
+
+/*
+Parses the file and publishes the result. The sink is reused if the path
+did not change, otherwise opened before publishing, so a bad path
+rejects the whole file.
+*/
+static int
+logger_config_reload(logging_context * const context) {
+  logging_watch * const watch = context->watch;
+  logging_config * const config = logger_config_parse(watch->path);
+  logging_config * const current = atomic_load(&context->config);
+  if(config == (void*)0) {
+    atomic_fetch_add(&context->config_rejected,1);
+    return 0;
+  }
+  if(config->sink_path != (void*)0) {
+    if(current != (void*)0 && current->sink_path != (void*)0 && strcmp(current->sink_path,config->sink_path) == 0) {
+      config->sink = current->sink;
+      config->owns_sink = current->owns_sink;
+      current->owns_sink = false;
+    } else {
+      config->sink = fopen(config->sink_path,"a");
+      if(config->sink == (void*)0) {
+        fprintf(stderr,"Rejected logger config %s - could not open sink %s: %s\n",watch->path,config->sink_path,strerror(errno));
+        logger_config_free(config);
+        atomic_fetch_add(&context->config_rejected,1);
+        return -1;
+      }
+      config->owns_sink = true;
+    }
+  }
+  pthread_mutex_lock(&logger_gate_lock);
+  atomic_store_explicit(&context->config,config,memory_order_release);
+  logger_gate_update(context);
+  pthread_mutex_unlock(&logger_gate_lock);
+  if(current != (void*)0) {
+    if(current->sink != (void*)0 && current->owns_sink) {fflush(current->sink);}
+    current->retired = watch->retired;
+    watch->retired = current;
+  }
+  for(int index = 0;index < config->site_count;index++) {
+    logging_site_query query;
+    logger_site_parse(config->sites[index],&query);
+    logger_site_apply(&query);
+  }
+  atomic_fetch_add(&context->config_reloads,1);
+  return 1;
+}
+
+#ifdef LOGGER_HAS_INOTIFY
+static void *
+logger_config_watcher(void *argument) {
+  logging_context * const context = argument;
+  logging_watch * const watch = context->watch;
+  logger_thread_apply(context,"-config",-1);
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd descriptors[2] = {
+    {.fd = watch->inotify,.events = POLLIN},
+    {.fd = watch->stop[0],.events = POLLIN}
+  };
+  while(true) {
+    if(poll(descriptors,2,-1) < 0) {
+      if(errno == EINTR) {continue;}
+      fprintf(stderr,"Could not wait for logger config changes\n");
+      break;
+    }
+    if(descriptors[1].revents != 0) {break;}
+    ssize_t const length = read(watch->inotify,events,sizeof(events));
+    bool changed = false;
+    for(ssize_t offset = 0;offset < length;) {
+      struct inotify_event const * const event = (struct inotify_event const *)(events + offset);
+      if(event->len > 0 && strcmp(event->name,watch->name) == 0) {changed = true;}
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+    if(changed) {logger_config_reload(context);}
+  }
+  return (void*)0;
+}
+
+/*
+Sets up inotify on the directory of the file and starts the watcher
+thread. On failure nothing is left open and watch->inotify is -1.
+*/
+static int
+logger_config_start(logging_context * const context) {
+  logging_watch * const watch = context->watch;
+  /* The directory part of the path, "." without one */
+  size_t const length = watch->name != watch->path ? (size_t)(watch->name - watch->path) - 1 : 0;
+  char directory[length + 2];
+  if(watch->name == watch->path) {
+    strcpy(directory,".");
+  } else if(length == 0) {
+    strcpy(directory,"/");
+  } else {
+    memcpy(directory,watch->path,length);
+    directory[length] = '\0';
+  }
+  watch->inotify = inotify_init1(IN_CLOEXEC);
+  if(watch->inotify < 0 || inotify_add_watch(watch->inotify,directory,IN_CLOSE_WRITE | IN_MOVED_TO) < 0 || pipe2(watch->stop,O_CLOEXEC) != 0) {
+    perror("Could not watch logger config");
+    if(watch->inotify >= 0) {close(watch->inotify);}
+    watch->inotify = -1;
+    return -4;
+  }
+  if(pthread_create(&watch->thread,(void*)0,logger_config_watcher,context) != 0) {
+    fprintf(stderr,"Could not start logger config thread\n");
+    close(watch->stop[0]);
+    close(watch->stop[1]);
+    close(watch->inotify);
+    watch->inotify = -1;
+    return -5;
+  }
+  return 1;
+}
+#endif
+
+/*
+Parameters:
+-----------
+path
+  Configuration file, see the format above
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Loads the configuration file and starts a background thread that reloads
+it whenever it is written or replaced (editors that save through a
+rename are covered, the directory is watched). The initial file must be
+valid. While watched, a level in the file takes precedence over
+logger_set_loglevel(). Only available on Linux.
+*/
+extern int
+logger_watch_config(char const * const path) {
+  return logger_watch_config_to(&Logger,path);
+}
+
+/* logger_watch_config() for an instance, see logger_create() */
+extern int
+logger_watch_config_to(logger_t *logger,char const * const path) {
+  if(logger == (void*)0 || path == (void*)0 || logger_is_initialized_to(logger) == false) {
+    return 0;
+  } else if(logger->watch != (void*)0) {
+    return -1;
+  }
+#ifdef LOGGER_HAS_INOTIFY
+  logging_watch *watch = calloc(1,sizeof(logging_watch));
+  if(watch == (void*)0) {return -2;}
+  watch->path = strdup(path);
+  if(watch->path == (void*)0) {
+    free(watch);
+    return -2;
+  }
+  char * const slash = strrchr(watch->path,'/');
+  watch->name = slash != (void*)0 ? slash + 1 : watch->path;
+  watch->inotify = -1;
+  logger->watch = watch;
+  if(logger_config_reload(logger) <= 0) {
+    logger->watch = (void*)0;
+    free(watch->path);
+    free(watch);
+    return -3;
+  }
+  int const ret_code = logger_config_start(logger);
+  if(ret_code <= 0) {
+    logger_unwatch_config_to(logger);
+    return ret_code;
+  }
+  return 1;
+#else
+  fprintf(stderr,"Watching a logger config needs inotify\n");
+  return -6;
+#endif
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+value <= 0 = ERROR (no configuration file watched)
+value > 0 = SUCCESS
+
+Description:
+------------
+Stops the watcher thread and drops the configuration, the level and
+output set through the setup functions apply again. Must not run
+concurrently with logging calls.
+*/
+extern int
+logger_unwatch_config(void) {
+  return logger_unwatch_config_to(&Logger);
+}
+
+/* logger_unwatch_config() for an instance, see logger_create() */
+extern int
+logger_unwatch_config_to(logger_t *logger) {
+  if(logger == (void*)0 || logger->watch == (void*)0) {return 0;}
+  logging_watch * const watch = logger->watch;
+  if(watch->inotify >= 0) {
+    char const stop = 1;
+    if(write(watch->stop[1],&stop,1) != 1) {
+      perror("Could not stop logger config thread");
+    }
+    pthread_join(watch->thread,(void*)0);
+    close(watch->stop[0]);
+    close(watch->stop[1]);
+    close(watch->inotify);
+  }
+  pthread_mutex_lock(&logger_gate_lock);
+  logging_config * config = atomic_exchange(&logger->config,(void*)0);
+  logger_gate_update(logger);
+  pthread_mutex_unlock(&logger_gate_lock);
+  if(config != (void*)0) {
+    config->retired = watch->retired;
+  } else {
+    config = watch->retired;
+  }
+  if(logger->queue != (void*)0) {
+    /* The writer may still hold one, the queue frees them after it stopped */
+    pthread_mutex_lock(&logger->queue->lock);
+    logging_config **tail = &config;
+    while(*tail != (void*)0) {tail = &(*tail)->retired;}
+    *tail = logger->queue->retired;
+    logger->queue->retired = config;
+    pthread_mutex_unlock(&logger->queue->lock);
+  } else {
+    logger_config_free(config);
+  }
+  logger->watch = (void*)0;
+  free(watch->path);
+  free(watch);
+  return 1;
+}
+
+/*
+Makes a pushed record durable if it asks for it (durable, or its level
+with LOGGER_DURABILITY_ERROR), see "Durability". queue is the shard the
+record with the given sequence number went to, (void*)0 without a
+pipeline. Returns like logger_log_durable().
+*/
+static int
+logger_durable_wait(logging_context * const context,logging_queue * const queue,uint64_t const sequence,int const log_level,bool durable) {
+  durable = durable || ((context->durability & LOGGER_DURABILITY_ERROR) && log_level <= LOGGER_ERROR);
+  if(queue != (void*)0) {
+    if(sequence == 0) {return -1;}
+    return durable ? logger_queue_barrier(queue,sequence,(void*)0) : 1;
+  }
+  /* The record is in the ring, writing it out is up to the daemon */
+  if(context->shared != (void*)0) {return 1;}
+  bool const interval = (context->durability & LOGGER_DURABILITY_INTERVAL) &&
+                        logger_monotonic_ns() - atomic_load(&context->durable.synced_at) >= (int64_t)context->durability_interval_ms * 1000000;
+  if(durable || interval || log_level <= LOGGER_CRITICAL) {
+    return logger_durable_commit(context) ? 1 : -2;
+  }
+  return 1;
+}
+
+/*
+Takes the timestamp and hands a formatted message either to the
+asynchronous pipeline or straight to the transform / output functions.
+message must be a writable buffer of length + 1 + LOGGER_TRANSFORM_HEADROOM
+and at least LOGGER_MESSAGE_BUFFER bytes. Not inlined, the backtrace
+capture starts behind its caller and inner_frames more frames, which
+leaves out the public logging function. Returns like logger_log_durable().
+*/
+__attribute__((noinline))
+static int
+logger_dispatch(logging_context * const context,int const log_level,char const * const file,int const linenumber,char *message,size_t const length,int const inner_frames,bool const durable) {
+  void *frames[LOGGER_BACKTRACE_DEPTH];
+  int frame_count = 0;
+  if(log_level <= context->backtrace_level) {
+    frame_count = logger_backtrace_capture(frames,context->backtrace_depth,__builtin_return_address(0),inner_frames);
+  }
+  logger_time now;
+  uint64_t const tsc = logger_clock_stamp(context->clock_flags,&now);
+  if(context->queue != (void*)0) {
+    logging_queue * const shard = logger_queue_shard(context->queue);
+    uint64_t const sequence = logger_queue_push(shard,tsc,&now,log_level,file,linenumber,message,length,frames,frame_count);
+    return logger_durable_wait(context,shard,sequence,log_level,durable);
+  }
+  if(tsc != 0) {
+    logger_tsc_convert(tsc,context->clock_flags,&now);
+  }
+  logger_push_traced(context,atomic_fetch_add(&context->sequence,1) + 1,&now,log_level,file,linenumber,message,frames,frame_count);
+  return logger_durable_wait(context,(void*)0,0,log_level,durable);
+}
+
+/* Reports calls that did not pass the gate because of an invalid level */
+__attribute__((cold,noinline))
+static void
+logger_check_level(int const log_level) {
+  if(log_level < 0 || log_level > 7) {
+    fprintf(stderr,"Could not log message - empty or outside log levels\n");
+  }
+}
+
+/*
+Bodies of the logging functions, shared by the default instance and
+logger_*_to(). The backtrace capture skips the frames up to the public
+function: logger_vlog() is one frame of its own, logger_log_formatted()
+is always inlined.
+*/
+__attribute__((noinline))
+static int
+logger_vlog(logging_context * const context,int const log_level,char const * const file,int const linenumber,bool const durable,char const * const message,va_list parameter_list) {
+  if(message == (void*)0 || file == (void*)0) {
+    fprintf(stderr,"Could not log message - empty or outside log levels\n");
+    return 0;
+  }
+  logging_buffer * const buffer = &logger_thread_buffer;
+  bool const nested = buffer->busy;
+  char nested_buffer[LOGGER_MESSAGE_BUFFER + LOGGER_TRANSFORM_HEADROOM];
+  char *message_buffer = nested ? nested_buffer : buffer->message;
+  va_list retry_list;
+  va_copy(retry_list,parameter_list);
+  int const length = vsnprintf(message_buffer,LOGGER_MESSAGE_BUFFER,message,parameter_list);
+  if(length < 1) {
+    va_end(retry_list);
+    fprintf(stderr,"Could not log message - pre-formatting returned 0 bytes\n");
+    return 0;
+  }
+  size_t stored = length;
+  if(stored >= LOGGER_MESSAGE_BUFFER) {
+    stored = stored < LOGGER_MESSAGE_MAX ? stored : LOGGER_MESSAGE_MAX - 1;
+    char *arena = nested ? (void*)0 : logger_arena_reserve(buffer,stored + 1 + LOGGER_TRANSFORM_HEADROOM);
+    if(arena != (void*)0) {
+      vsnprintf(arena,stored + 1,message,retry_list);
+      message_buffer = arena;
+    } else {
+      stored = LOGGER_MESSAGE_BUFFER - 1;
+    }
+    if(stored < (size_t)length) {
+      logger_mark_truncated(context,message_buffer,stored);
+    }
+  }
+  va_end(retry_list);
+  buffer->busy = true;
+  int const ret_code = logger_dispatch(context,log_level,file,linenumber,message_buffer,stored,1,durable);
+  buffer->busy = nested;
+  return ret_code;
+}
+
+__attribute__((always_inline))
+static inline void
+logger_log_formatted(logging_context * const context,int const log_level,char const * const file,int const linenumber,char *message,size_t length) {
+  if(logger_gate_open(context,log_level) == false) {
+    logger_check_level(log_level);
+    return;
+  } else if(message == (void*)0 || file == (void*)0) {
+    fprintf(stderr,"Could not log message - empty or outside log levels\n");
+    return;
+  }
+  if(logger_config_allows(context,log_level,file) == false) {return;}
+  if(length > LOGGER_MESSAGE_MAX - 1) {
+    length = LOGGER_MESSAGE_MAX - 1;
+    logger_mark_truncated(context,message,length);
+  }
+  message[length] = '\0';
+  logger_dispatch(context,log_level,file,linenumber,message,length,0,false);
+}
+
+/*
+Same as logger_vlog() for a message written by a logger_generate function.
+It writes into the per thread buffer first, only a longer message is
+generated a second time into the arena.
+*/
+__attribute__((always_inline))
+static inline void
+logger_log_generator(logging_context * const context,int const log_level,char const * const file,int const linenumber,logger_generate const generate,void * const custom_object) {
+  if(logger_gate_open(context,log_level) == false) {
+    logger_check_level(log_level);
+    return;
+  } else if(generate == (void*)0 || file == (void*)0) {
+    fprintf(stderr,"Could not log message - empty or outside log levels\n");
+    return;
+  }
+  if(logger_config_allows(context,log_level,file) == false) {return;}
+  logging_buffer * const buffer = &logger_thread_buffer;
+  bool const nested = buffer->busy;
+  char nested_buffer[LOGGER_MESSAGE_BUFFER + LOGGER_TRANSFORM_HEADROOM];
+  char *message_buffer = nested ? nested_buffer : buffer->message;
+  size_t const length = generate(custom_object,message_buffer,LOGGER_MESSAGE_BUFFER);
+  size_t stored = length;
+  if(stored >= LOGGER_MESSAGE_BUFFER) {
+    stored = stored < LOGGER_MESSAGE_MAX ? stored : LOGGER_MESSAGE_MAX - 1;
+    char *arena = nested ? (void*)0 : logger_arena_reserve(buffer,stored + 1 + LOGGER_TRANSFORM_HEADROOM);
+    if(arena != (void*)0) {
+      generate(custom_object,arena,stored + 1);
+      message_buffer = arena;
+    } else {
+      stored = LOGGER_MESSAGE_BUFFER - 1;
+    }
+    if(stored < length) {
+      logger_mark_truncated(context,message_buffer,stored);
+    }
+  }
+  message_buffer[stored] = '\0';
+  buffer->busy = true;
+  logger_dispatch(context,log_level,file,linenumber,message_buffer,stored,0,false);
+  buffer->busy = nested;
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
+  Is set so that the most critical level, is the lowest value and vice versa
+
+file
+  A constant string provided by the macros (preprocessor __FILE__ value)
+
+linenumber
+  A constant number provided by the macros (preprocessor __LINE__ value)
+
+message
+  Format string that fits the standard conversion specifiers
+
+...
+  Variadic parameters - used in the format string "message"
+
+Return Values:
+--------------
+None
+
+Description:
+------------
+This function is being called by the macros logger_emergency() ... logger_debug()
+and prepares the message buffer, concatenates the variadic parameters into the
+format string and pushes it to the Logger.transform_function and Logger.output_function.
+Messages longer than LOGGER_MESSAGE_MAX - 1 bytes end with LOGGER_TRUNCATION_MARK.
+With a running asynchronous pipeline the message is queued for the writer thread instead.
+LOGGER_CRITICAL and above are flushed durably right after they have been pushed.
+*/
+extern void
+logger_log(int log_level,char const * const file,int linenumber,char const * const message, ...) {
+  if(logger_gate_open(&Logger,log_level) == false) {
+    logger_check_level(log_level);
+    return;
+  } else if(file != (void*)0 && logger_config_allows(&Logger,log_level,file) == false) {
+    return;
+  }
+  va_list parameter_list;
+  va_start(parameter_list,message);
+  logger_vlog(&Logger,log_level,file,linenumber,false,message,parameter_list);
+  va_end(parameter_list);
+}
+
+/* logger_log() for an instance, see logger_create() */
+extern void
+logger_log_to(logger_t *logger,int log_level,char const * const file,int linenumber,char const * const message, ...) {
+  if(logger == (void*)0) {return;}
+  if(logger_gate_open(logger,log_level) == false) {
+    logger_check_level(log_level);
+    return;
+  } else if(file != (void*)0 && logger_config_allows(logger,log_level,file) == false) {
+    return;
+  }
+  va_list parameter_list;
+  va_start(parameter_list,message);
+  logger_vlog(logger,log_level,file,linenumber,false,message,parameter_list);
+  va_end(parameter_list);
+}
+
+/*
+Parameters:
+-----------
+site
+  Call site of the macro
+
+message
+  Format string, followed by its parameters
+
+Return Value:
+-------------
+None
+
+Description:
+------------
+Called by the macros for enabled sites instead of logger_log(). Pushes
+the message to the default instance without looking at its log level or
+the config file.
+*/
+extern void
+logger_log_site(logger_site *site,char const * const message, ...) {
+  if(site == (void*)0 || atomic_load_explicit(&Logger.gate,memory_order_relaxed) == 0) {return;}
+  va_list parameter_list;
+  va_start(parameter_list,message);
+  logger_vlog(&Logger,site->log_level,site->file,site->linenumber,false,message,parameter_list);
+  va_end(parameter_list);
+}
+
+/*
+Parameters:
+-----------
+log_level, file, linenumber, message, ...
+  Same as logger_log(), the logger_durable() macro fills in file and linenumber
+
+Return Value:
+-------------
+value <= 0 = ERROR
+  0 = not logged: level, configuration or invalid parameters
+  -1 = the record was dropped by the queue
+  -2 = the durable flush failed or the writer stopped before it
+value > 0 = SUCCESS
+
+Description:
+------------
+Logs like logger_log() and returns only once the record is on stable
+storage (flush callback with durable = true, fdatasync for the factory
+files). Concurrent calls share one flush, see "Durability". Made for
+audit records and acknowledgements, every call waits for the sink.
+*/
+extern int
+logger_log_durable(int log_level,char const * const file,int linenumber,char const * const message, ...) {
+  if(logger_gate_open(&Logger,log_level) == false) {
+    logger_check_level(log_level);
+    return 0;
+  } else if(file != (void*)0 && logger_config_allows(&Logger,log_level,file) == false) {
+    return 0;
+  }
+  va_list parameter_list;
+  va_start(parameter_list,message);
+  int const ret_code = logger_vlog(&Logger,log_level,file,linenumber,true,message,parameter_list);
+  va_end(parameter_list);
+  return ret_code;
+}
+
+/* logger_log_durable() for an instance, see logger_create() */
+extern int
+logger_log_durable_to(logger_t *logger,int log_level,char const * const file,int linenumber,char const * const message, ...) {
+  if(logger == (void*)0) {return 0;}
+  if(logger_gate_open(logger,log_level) == false) {
+    logger_check_level(log_level);
+    return 0;
+  } else if(file != (void*)0 && logger_config_allows(logger,log_level,file) == false) {
+    return 0;
+  }
+  va_list parameter_list;
+  va_start(parameter_list,message);
+  int const ret_code = logger_vlog(logger,log_level,file,linenumber,true,message,parameter_list);
+  va_end(parameter_list);
+  return ret_code;
+}
+
+/* Same as logger_log_preformatted() for an instance */
+extern void
+logger_log_preformatted_to(logger_t *logger,int log_level,char const * const file,int linenumber,char *message,size_t length) {
+  if(logger == (void*)0) {return;}
+  logger_log_formatted(logger,log_level,file,linenumber,message,length);
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
+
+file
+  A constant string, e.g. __FILE__ or std::source_location::file_name()
+
+linenumber
+  The line number of the call site
+
+generate
+  Writes the message, called as generate(custom_object,buffer,capacity).
+  It stores at most capacity - 1 bytes in buffer and returns the length
+  of the whole message, like snprintf() does.
+
+custom_object
+  Passed to generate
+
+Return Values:
+--------------
+None
+
+Description:
+------------
+Same as logger_log() for callers with a formatter of their own, e.g. the
+C++ frontend in logger.hpp. generate writes into the per thread message
+buffer; a message that does not fit is generated a second time into the
+arena. Messages longer than LOGGER_MESSAGE_MAX - 1 bytes (or
+LOGGER_MESSAGE_BUFFER - 1 bytes if the arena can not grow, or in a
+nested call from an output function) end with LOGGER_TRUNCATION_MARK.
+*/
+extern void
+logger_log_generated(int log_level,char const * const file,int linenumber,logger_generate generate,void *custom_object) {
+  logger_log_generator(&Logger,log_level,file,linenumber,generate,custom_object);
+}
+
+/* Same as logger_log_generated() for an instance */
+extern void
+logger_log_generated_to(logger_t *logger,int log_level,char const * const file,int linenumber,logger_generate generate,void *custom_object) {
+  if(logger == (void*)0) {return;}
+  logger_log_generator(logger,log_level,file,linenumber,generate,custom_object);
+}
+
+/* Same as logger_dispatch() for data messages */
+static void
+logger_dispatch_data(logging_context * const context,int const log_level,char const * const file,int const linenumber,char const * const label,void const * const data,size_t const length) {
+  logger_time now;
+  uint64_t const tsc = logger_clock_stamp(context->clock_flags,&now);
+  if(context->queue != (void*)0) {
+    logging_queue * const shard = logger_queue_shard(context->queue);
+    uint64_t const sequence = logger_queue_push_data(shard,tsc,&now,log_level,file,linenumber,label,data,length);
+    logger_durable_wait(context,shard,sequence,log_level,false);
+    return;
+  }
+  if(tsc != 0) {
+    logger_tsc_convert(tsc,context->clock_flags,&now);
+  }
+  logger_push_payload(context,atomic_fetch_add(&context->sequence,1) + 1,&now,log_level,file,linenumber,label,data,length);
+  logger_durable_wait(context,(void*)0,0,log_level,false);
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
+
+file
+  A constant string provided by the macro (preprocessor __FILE__ value)
+
+linenumber
+  A constant number provided by the macro (preprocessor __LINE__ value)
+
+data
+  The payload, e.g. a packet buffer
+
+length
+  Size of the payload in bytes
+
+label
+  Short description of the payload, may be 0
+
+Return Values:
+--------------
+None
+
+Description:
+------------
+Arbitrary data message, called by the macro logger_data(). With a data
+callback (logger_set_data_callback) the payload is handed over by
+reference on the synchronous path and copied once into the queue on the
+asynchronous path. Without one the payload is rendered as text, see
+logger_set_data_format(), and goes through the transform and output
+functions like any other message.
+*/
+extern void
+logger_log_data(int log_level,char const * const file,int linenumber,void const * const data,size_t length,char const * const label) {
+  logger_log_data_to(&Logger,log_level,file,linenumber,data,length,label);
+}
+
+/* logger_log_data() for an instance, see logger_create() */
+extern void
+logger_log_data_to(logger_t *logger,int log_level,char const * const file,int linenumber,void const * const data,size_t length,char const * const label) {
+  if(logger == (void*)0) {return;}
+  if(log_level < 0 || log_level > 7 || file == (void*)0 || (data == (void*)0 && length > 0)) {
+    fprintf(stderr,"Could not log data - empty or outside log levels\n");
+    return;
+  }
+  if(logger_gate_open(logger,log_level) == false || logger_config_allows(logger,log_level,file) == false) {return;}
+  logger_dispatch_data(logger,log_level,file,linenumber,label != (void*)0 ? label : "",data != (void*)0 ? data : "",length);
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
+
+file
+  A constant string, e.g. __FILE__ or std::source_location::file_name()
+
+linenumber
+  The line number of the call site
+
+message
+  The final message text. Must point to a writable buffer of
+  length + 1 + LOGGER_TRANSFORM_HEADROOM bytes, but at least
+  LOGGER_MESSAGE_BUFFER bytes. The transform function rewrites it in place.
+
+length
+  Length of the message text without the terminating 0 byte
+
+Return Values:
+--------------
+None
+
+Description:
+------------
+Same as logger_log() for messages that have already been formatted, e.g.
+by the C++ frontend in logger.hpp. Skips the printf formatting.
+*/
+extern void
+logger_log_preformatted(int log_level,char const * const file,int linenumber,char *message,size_t length) {
+  logger_log_formatted(&Logger,log_level,file,linenumber,message,length);
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
+
+Return Value:
+-------------
+bool
+  true = a message of this level would be pushed / false = it would be ignored
+
+Description:
+------------
+Allows callers to skip expensive preparation of messages that are
+filtered anyway.
+*/
+extern bool
+logger_is_enabled(int log_level) {
+  return logger_is_enabled_to(&Logger,log_level);
+}
+
+/* logger_is_enabled() for an instance, see logger_create() */
+extern bool
+logger_is_enabled_to(logger_t *logger,int log_level) {
+  if(logger == (void*)0) {return false;}
+  return logger_gate_open(logger,log_level);
+}
+
+/*
+Fork handling
+
+Registered with pthread_atfork() on the first setup. Before the fork
+every asynchronous queue writes the records logged up to then, like
+logger_sync() does, and its writers stop between two records. Then every
+output is flushed, so no line buffered in the parent is written a second
+time by the child. Records logged concurrently stay queued, the parent
+writes them after the fork and the child discards its copy. The locks
+of the instance registry, the gate, the queues and the symbol cache are
+held across the fork, none of them can be left locked by a thread that
+does not exist in the child. The child releases them, gets fresh
+condition variables, a new writer thread for every asynchronous queue
+and a new watcher thread for a watched configuration file. Per thread
+buffers of the forking thread stay valid, the ones of other threads are
+gone with their threads.
+
+With logger_set_fork_reopen(true) the child additionally switches the
+files of logger_factory_file(), logger_factory_data_file() and the sink
+of a configuration file to "<path>.<pid>".
+*/
+
+static pthread_once_t logger_fork_once = PTHREAD_ONCE_INIT;
+static _Atomic bool logger_fork_reopen = false;
+
+static void
+logger_fork_each(void (*handler)(logging_context * const)) {
+  handler(&Logger);
+  for(logging_context *instance = logger_instances;instance != (void*)0;instance = instance->next_instance) {
+    handler(instance);
+  }
+}
+
+/*
+Waits until every record logged before is written, then keeps all shards
+locked with no writer inside the output. Records logged in the meantime
+are not waited for, other threads may keep logging.
+*/
+static void
+logger_fork_drain(logging_context * const context) {
+  logging_queue * const queue = context->queue;
+  if(queue != (void*)0) {
+    for(size_t index = 0;index < queue->shard_count;index++) {
+      pthread_mutex_lock(&queue[index].lock);
+    }
+    uint64_t const target = atomic_load(&context->sequence);
+    for(size_t index = 0;index < queue->shard_count;index++) {
+      pthread_mutex_unlock(&queue[index].lock);
+    }
+    for(size_t index = 0;index < queue->shard_count;index++) {
+      logger_queue_barrier(&queue[index],target,(void*)0);
+    }
+    if(queue->shard_count > 1) {
+      /* Writers of several shards output only with the merge lock held */
+      pthread_mutex_lock(&queue->merge);
+      for(size_t index = 0;index < queue->shard_count;index++) {
+        pthread_mutex_lock(&queue[index].lock);
+      }
+    } else {
+      pthread_mutex_lock(&queue->lock);
+      queue->forking = true;
+      while(queue->running && queue->writing) {
+        pthread_cond_wait(&queue->drained,&queue->lock);
+      }
+    }
+  }
+  logger_flush_output(context,false);
+}
+
+static void
+logger_fork_release(logging_context * const context) {
+  logging_queue * const queue = context->queue;
+  if(queue == (void*)0) {return;}
+  if(queue->forking) {
+    queue->forking = false;
+    pthread_cond_broadcast(&queue->not_empty);
+  }
+  for(size_t index = 0;index < queue->shard_count;index++) {
+    pthread_mutex_unlock(&queue[index].lock);
+  }
+  if(queue->shard_count > 1) {pthread_mutex_unlock(&queue->merge);}
+}
+
+/* Returns the records of the parent to the free lists of the child */
+static void
+logger_fork_discard(logging_queue * const shard) {
+  while(shard->priority.count > 0) {
+    logger_lane_release(&shard->priority,logger_lane_take(&shard->priority,0));
+  }
+  while(shard->normal.count > 0) {
+    logger_lane_release(&shard->normal,logger_lane_take(&shard->normal,0));
+  }
+  logging_record * const record = shard->in_flight_record;
+  if(record != (void*)0) {
+    logger_lane_release(record->log_level <= LOGGER_CRITICAL ? &shard->priority : &shard->normal,record);
+  }
+  shard->in_flight = 0;
+  shard->in_flight_record = (void*)0;
+  shard->writing = false;
+  shard->forking = false;
+}
+
+static void
+logger_fork_prepare(void) {
+  pthread_mutex_lock(&logger_instances_lock);
+  pthread_mutex_lock(&logger_gate_lock);
+  logger_fork_each(logger_fork_drain);
+  fflush(logger_factory_file_file);
+  fflush(logger_factory_data_file_file);
+  logging_direct_file * const sink = logger_factory_direct_file_sink;
+  if(sink != (void*)0) {
+    /* No write of the I/O thread is in flight, the child restarts it */
+    pthread_mutex_lock(&sink->lock);
+    while(sink->pending >= 0) {
+      pthread_cond_wait(&sink->changed,&sink->lock);
+    }
+  }
+  pthread_mutex_lock(&logger_pool.lock);
+  pthread_mutex_lock(&logger_symbols.lock);
+}
+
+static void
+logger_fork_parent(void) {
+  pthread_mutex_unlock(&logger_symbols.lock);
+  pthread_mutex_unlock(&logger_pool.lock);
+  if(logger_factory_direct_file_sink != (void*)0) {
+    pthread_mutex_unlock(&logger_factory_direct_file_sink->lock);
+  }
+  logger_fork_each(logger_fork_release);
+  pthread_mutex_unlock(&logger_gate_lock);
+  pthread_mutex_unlock(&logger_instances_lock);
+}
+
+/* Opens "<path>.<pid>" with mode, (void*)0 if that fails */
+static FILE *
+logger_fork_open(char const * const path,char const * const mode) {
+  char name[strlen(path) + 24];
+  snprintf(name,sizeof(name),"%s.%ld",path,(long)getpid());
+  FILE *stream = fopen(name,mode);
+  if(stream == (void*)0) {
+    fprintf(stderr,"Could not reopen %s after fork: %s\n",name,strerror(errno));
+  }
+  return stream;
+}
+
+/* Points everything that used the stream of the parent to its replacement */
+static void
+logger_fork_replace(FILE * const previous,FILE * const stream) {
+  if(Logger.output_object == previous) {Logger.output_object = stream;}
+  if(Logger.data_object == previous) {Logger.data_object = stream;}
+  for(logging_context *instance = logger_instances;instance != (void*)0;instance = instance->next_instance) {
+    if(instance->output_object == previous) {instance->output_object = stream;}
+    if(instance->data_object == previous) {instance->data_object = stream;}
+  }
+  fclose(previous);
+}
+
+static void
+logger_fork_child_context(logging_context * const context) {
+  logging_queue * const queue = context->queue;
+  /* A durable flush of another thread never finishes here */
+  pthread_mutex_init(&context->durable.lock,(void*)0);
+  pthread_cond_init(&context->durable.done,(void*)0);
+  context->durable.syncing = false;
+  if(queue != (void*)0) {
+    /* The condition variables may still count the writers of the parent as waiters */
+    for(size_t index = 0;index < queue->shard_count;index++) {
+      pthread_mutex_unlock(&queue[index].lock);
+      logger_fork_discard(&queue[index]);
+    }
+    if(queue->shard_count > 1) {pthread_mutex_unlock(&queue->merge);}
+    logger_queue_sync_init(queue);
+    if(queue->closing == false && logger_queue_start(queue) == false) {
+      /* Without a writer the records are pushed synchronously */
+      fprintf(stderr,"Could not restart logger writer thread after fork\n");
+      context->queue = (void*)0;
+      logger_queue_destroy(queue);
+    }
+  }
+  logging_config * const config = atomic_load(&context->config);
+  if(atomic_load(&logger_fork_reopen) && config != (void*)0 && config->sink != (void*)0 && config->owns_sink) {
+    FILE * const stream = logger_fork_open(config->sink_path,"a");
+    if(stream != (void*)0) {
+      fclose(config->sink);
+      config->sink = stream;
+    }
+  }
+#ifdef LOGGER_HAS_INOTIFY
+  logging_watch * const watch = context->watch;
+  if(watch != (void*)0 && watch->inotify >= 0) {
+    /* The inotify instance is shared with the parent, it would steal events */
+    close(watch->inotify);
+    close(watch->stop[0]);
+    close(watch->stop[1]);
+    logger_config_start(context);
+  }
+#endif
+}
+
+static void
+logger_fork_child(void) {
+  /* The forking thread is the only one left and owns all of them */
+  pthread_mutex_unlock(&logger_symbols.lock);
+  pthread_mutex_unlock(&logger_pool.lock);
+  pthread_mutex_unlock(&logger_gate_lock);
+  pthread_mutex_unlock(&logger_instances_lock);
+  /* Waiters are gone, so are the chunks cached by other threads */
+  logger_pool_condition_init();
+  atomic_store(&logger_pool.waiters,0);
+  /* A recalibration cut short by the fork leaves an odd version behind */
+  if(atomic_load(&logger_tsc_calibration.version) & 1) {
+    atomic_fetch_add(&logger_tsc_calibration.version,1);
+  }
+  atomic_flag_clear(&logger_tsc_calibration.recalibrating);
+  if(atomic_load(&logger_fork_reopen)) {
+    if(logger_factory_file_file != (void*)0 && logger_factory_file_path != (void*)0) {
+      FILE * const stream = logger_fork_open(logger_factory_file_path,"w");
+      if(stream != (void*)0) {
+        logger_fork_replace(logger_factory_file_file,stream);
+        logger_factory_file_file = stream;
+        if(Logger.transform_function == logger_factory_csv_transform) {
+          fputs("timestamp,priority,filename,linenumber,message\n",stream);
+        }
+      }
+    }
+    if(logger_factory_data_file_file != (void*)0 && logger_factory_data_file_path != (void*)0) {
+      FILE * const stream = logger_fork_open(logger_factory_data_file_path,"wb");
+      if(stream != (void*)0) {
+        logger_fork_replace(logger_factory_data_file_file,stream);
+        logger_factory_data_file_file = stream;
+      }
+    }
+  }
+  logging_direct_file * const sink = logger_factory_direct_file_sink;
+  if(sink != (void*)0) {
+    pthread_mutex_unlock(&sink->lock);
+    if(atomic_load(&logger_fork_reopen)) {
+      char name[strlen(sink->path) + 24];
+      snprintf(name,sizeof(name),"%s.%ld",sink->path,(long)getpid());
+      bool direct;
+      int const descriptor = logger_direct_open(name,&direct);
+      if(descriptor >= 0) {
+        close(sink->descriptor);
+        sink->descriptor = descriptor;
+        sink->direct = direct;
+        sink->offset = 0;
+        sink->fill = 0;
+      } else {
+        fprintf(stderr,"Could not reopen %s after fork: %s\n",name,strerror(errno));
+      }
+    }
+    if(logger_direct_start(sink) == false) {
+      fprintf(stderr,"Could not restart the direct file thread after fork\n");
+    }
+  }
+  logger_fork_each(logger_fork_child_context);
+}
+
+static void
+logger_fork_register(void) {
+  if(pthread_atfork(logger_fork_prepare,logger_fork_parent,logger_fork_child) != 0) {
+    fprintf(stderr,"Could not setup fork handlers\n");
+  }
+}
+
+/*
+Parameters:
+-----------
+reopen
+  true = children write to "<path>.<pid>" files of their own
+
+Return Value:
+-------------
+None
+
+Description:
+------------
+Without reopening, parent and children keep appending to the same files.
+Buffers are flushed before every fork, so no line is written twice, but
+lines of different processes can interleave per flushed batch. With
+reopening every child starts its own files right after the fork (see
+"Fork handling" above for which files are covered).
+*/
+extern void
+logger_set_fork_reopen(bool reopen) {
+  atomic_store(&logger_fork_reopen,reopen);
+}
+
+static int
+logger_context_setup(logging_context * const context,int log_level,void *output_data,logger_push_log output_function,logger_transform transform_function,bool is_active) {
+  if(log_level < 0 || log_level > 7) {
+    return 0;
+  } else if(output_function == (void*)0 || transform_function == (void*)0) {
+    return -1;
+  }
+  context->output_object = output_data;
+  context->output_function = output_function;
+  context->transform_function = transform_function;
+  context->flush_function = (void*)0;
+  pthread_once(&logger_fork_once,logger_fork_register);
+  pthread_mutex_lock(&logger_gate_lock);
+  context->log_level = log_level;
+  context->is_active = is_active;
+  logger_gate_update(context);
+  pthread_mutex_unlock(&logger_gate_lock);
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Value between LOGGER_EMERGENCY - LOGGER_DEBUG
+  Is set so that the most critical level, is the lowest value and vice versa
+  Determines with what starting log level we push messages to the
+  output routine
+
+output_data
+  Any kind of User Data that can be used to push messages to. For example
+  a buffer, file stream, network connection, custom struct for databases.
+
+output_function
+  Used to push messages to the output medium
+  Signature: int fname(void const * const custom_object,char const * const message)
+
+transform_function
+  Used to prepare a buffer used in the output routine. This buffer must be the
+  final message (in regards to format). The buffer holds the message plus
+  LOGGER_TRANSFORM_HEADROOM bytes, but at least LOGGER_MESSAGE_BUFFER
+  Signature: char * fname(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message)
+  timestamp->realtime is the wall clock time with nanosecond resolution,
+  timestamp->monotonic is only set with LOGGER_CLOCK_MONOTONIC (see logger_set_clock)
+
+is_active
+  Start setting if the Logging is currently turned on. If set to "false",
+  all messages stop being transformed + pushed
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Initializes the static structure in this module. Performs a few checks
+and sets initial values.
+
+ToDo: Maybe add a memory check if everything checks out?
+*/
+extern int
+logger_setup_context(int log_level,
+                    void *output_data,
+                    logger_push_log output_function,
+                    logger_transform transform_function,
+                    bool is_active) {
+  return logger_context_setup(&Logger,log_level,output_data,output_function,transform_function,is_active);
+}
+
+/*
+Parameters:
+-----------
+See logger_setup_context()
+
+Return Value:
+-------------
+Handle of the new instance, (void*)0 on invalid parameters or if the
+memory could not be allocated
+
+Description:
+------------
+Creates an independent logger instance with its own level, sinks, clock,
+backtrace settings, asynchronous pipeline and counters. The handle is
+used with the logger_*_to() functions and macros. Instances are aligned
+to a cache line, so threads logging to different instances do not
+contend on shared lines. Asynchronous pipelines of instances that are
+still alive are stopped at exit like the one of the default instance.
+*/
+extern logger_t *
+logger_create(int log_level,
+              void *output_data,
+              logger_push_log output_function,
+              logger_transform transform_function,
+              bool is_active) {
+  logging_context *instance = aligned_alloc(LOGGER_CACHE_LINE,sizeof(logging_context));
+  if(instance == (void*)0) {
+    fprintf(stderr,"Could not allocate logger instance\n");
+    return (void*)0;
+  }
+  memset(instance,0,sizeof(logging_context));
+  instance->backtrace_level = -1;
+  instance->flush_delay_us = LOGGER_FLUSH_DELAY_US;
+  instance->flush_batch = LOGGER_BATCH_RECORDS;
+  if(logger_context_setup(instance,log_level,output_data,output_function,transform_function,is_active) <= 0) {
+    free(instance);
+    return (void*)0;
+  }
+  pthread_mutex_init(&instance->durable.lock,(void*)0);
+  pthread_cond_init(&instance->durable.done,(void*)0);
+  pthread_mutex_lock(&logger_instances_lock);
+  instance->next_instance = logger_instances;
+  logger_instances = instance;
+  pthread_mutex_unlock(&logger_instances_lock);
+  return instance;
+}
+
+/*
+Parameters:
+-----------
+logger
+  Handle from logger_create(), (void*)0 is ignored
+
+Return Value:
+-------------
+None
+
+Description:
+------------
+Writes the queued records of the instance, stops its writer thread and
+releases it. Must not run concurrently with logging calls on the same
+handle. The default instance can not be destroyed.
+*/
+extern void
+logger_destroy(logger_t *logger) {
+  if(logger == (void*)0 || logger == &Logger) {return;}
+  pthread_mutex_lock(&logger_instances_lock);
+  for(logging_context **link = &logger_instances;*link != (void*)0;link = &(*link)->next_instance) {
+    if(*link == logger) {
+      *link = logger->next_instance;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&logger_instances_lock);
+  logger_unwatch_config_to(logger);
+  logger_stop_async_to(logger);
+  pthread_cond_destroy(&logger->durable.done);
+  pthread_mutex_destroy(&logger->durable.lock);
+  free(logger);
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+Handle of the default instance used by the functions without handle
+
+Description:
+------------
+Allows passing the default instance to code that takes a handle.
+*/
+extern logger_t *
+logger_default(void) {
+  return &Logger;
+}
+
+/*
+Parameters:
+-----------
+new_output
+  The new output function to be used from this point forward.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets the new output function for pushing messages to the destination medium
+*/
+extern int
+logger_set_output_callback(logger_push_log new_output) {
+  return logger_set_output_callback_to(&Logger,new_output);
+}
+
+/* logger_set_output_callback() for an instance, see logger_create() */
+extern int
+logger_set_output_callback_to(logger_t *logger,logger_push_log new_output) {
+  if(logger == (void*)0) {return 0;}
+  if(logger->output_function == (void*)0 || new_output == (void*)0) {return 0;}
+  logger->output_function = new_output;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+log_level
+  The new Log level in the Range LOGGER_EMERGENCY -> LOGGER_DEBUG
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets the new output log level for pushing messages to the destination medium
+*/
+extern int
+logger_set_loglevel(int log_level) {
+  return logger_set_loglevel_to(&Logger,log_level);
+}
+
+/* logger_set_loglevel() for an instance, see logger_create() */
+extern int
+logger_set_loglevel_to(logger_t *logger,int log_level) {
+  if(logger == (void*)0) {return 0;}
+  if(log_level < 0) {return 0;}
+  pthread_mutex_lock(&logger_gate_lock);
+  bool const changed = logger->log_level != log_level;
+  logger->log_level = log_level;
+  logger_gate_update(logger);
+  pthread_mutex_unlock(&logger_gate_lock);
+  return changed ? 1 : 0;
+}
+
+/*
+Parameters:
+-----------
+new_transform
+  The new transform function to be used from this point forward.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets the new transform function for modifying messages to the output function
+*/
+extern int
+logger_set_transform(logger_transform new_transform) {
+  return logger_set_transform_to(&Logger,new_transform);
+}
+
+/* logger_set_transform() for an instance, see logger_create() */
+extern int
+logger_set_transform_to(logger_t *logger,logger_transform new_transform) {
+  if(logger == (void*)0) {return 0;}
+  if(logger->output_function == (void*)0 || new_transform == (void*)0) {return 0;}
+  logger->transform_function = new_transform;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+new_flush
+  The new flush function, (void*)0 disables flushing
+  Signature: int fname(void const * const custom_object,bool const durable)
+  With durable = true, the function must not return before the pushed
+  messages are on stable storage (e.g. fflush + fdatasync).
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets the function used to flush the output medium. It is called after
+LOGGER_CRITICAL and above (durable) and after every batch of the
+asynchronous writer. logger_setup_context() resets it.
+*/
+extern int
+logger_set_flush_callback(logger_flush new_flush) {
+  return logger_set_flush_callback_to(&Logger,new_flush);
+}
+
+/* logger_set_flush_callback() for an instance, see logger_create() */
+extern int
+logger_set_flush_callback_to(logger_t *logger,logger_flush new_flush) {
+  if(logger == (void*)0) {return 0;}
+  if(logger->output_function == (void*)0) {return 0;}
+  logger->flush_function = new_flush;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+data_object
+  Any kind of User Data handed to the data function, e.g. a FILE * or socket
+
+new_data
+  The function that receives data messages, (void*)0 renders them as text
+  Signature: int fname(void const * const custom_object,logger_time const * const timestamp,int const log_level,
+                       char const * const file,int const filenumber,char const * const label,void const * const data,size_t const length)
+  The payload is only valid during the call.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets the sink for messages of logger_log_data(), e.g. a binary file that
+stores the payload raw. It is independent of the output function and is
+kept by logger_setup_context().
+*/
+extern int
+logger_set_data_callback(void *data_object,logger_push_data new_data) {
+  return logger_set_data_callback_to(&Logger,data_object,new_data);
+}
+
+/* logger_set_data_callback() for an instance, see logger_create() */
+extern int
+logger_set_data_callback_to(logger_t *logger,void *data_object,logger_push_data new_data) {
+  if(logger == (void*)0) {return 0;}
+  logger->data_object = data_object;
+  logger->data_function = new_data;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+format
+  LOGGER_DATA_HEXDUMP (default), LOGGER_DATA_HEX or LOGGER_DATA_BASE64
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Sets how logger_log_data() renders payloads without a data callback.
+The hexdump spans several lines, single line sinks like CSV should use
+LOGGER_DATA_HEX or LOGGER_DATA_BASE64.
+*/
+extern int
+logger_set_data_format(int format) {
+  return logger_set_data_format_to(&Logger,format);
+}
+
+/* logger_set_data_format() for an instance, see logger_create() */
+extern int
+logger_set_data_format_to(logger_t *logger,int format) {
+  if(logger == (void*)0) {return 0;}
+  if(logger_is_data_format(format) == false) {return 0;}
+  logger->data_format = format;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+clock_flags
+  0 or any combination of
+  LOGGER_CLOCK_COARSE
+    Use the coarse clocks (tick resolution, cheaper to read) where available
+  LOGGER_CLOCK_MONOTONIC
+    Additionally take a monotonic timestamp, e.g. for latency analysis
+  LOGGER_CLOCK_TSC
+    Only read the time stamp counter on the calling thread and convert it
+    before the transform function runs (on the writer thread when
+    asynchronous). Falls back to clock_gettime without an invariant TSC.
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Selects the clocks read for every message. The default (0) is
+CLOCK_REALTIME only. Enabling LOGGER_CLOCK_TSC calibrates the counter,
+which takes about 10 ms. logger_get_clock() returns the flags in effect.
+*/
+extern int
+logger_set_clock(int clock_flags) {
+  return logger_set_clock_to(&Logger,clock_flags);
+}
+
+/* logger_set_clock() for an instance, see logger_create() */
+extern int
+logger_set_clock_to(logger_t *logger,int clock_flags) {
+  if(logger == (void*)0) {return 0;}
+  if(clock_flags & ~(LOGGER_CLOCK_COARSE | LOGGER_CLOCK_MONOTONIC | LOGGER_CLOCK_TSC)) {return 0;}
+  if((clock_flags & LOGGER_CLOCK_TSC) && (logger->clock_flags & LOGGER_CLOCK_TSC) == 0 && logger_tsc_calibrate() == false) {
+    clock_flags &= ~LOGGER_CLOCK_TSC;
+  }
+  logger->clock_flags = clock_flags;
+  return 1;
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+int
+  The clock flags in effect, see logger_set_clock()
+
+Description:
+------------
+
+*/
+extern int
+logger_get_clock(void) {
+  return logger_get_clock_to(&Logger);
+}
+
+/* logger_get_clock() for an instance, see logger_create() */
+extern int
+logger_get_clock_to(logger_t *logger) {
+  if(logger == (void*)0) {return 0;}
+  return logger->clock_flags;
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+uint64_t
+  Sequence number of the record currently being pushed, 0 outside of
+  the transform / output / flush functions
+
+Description:
+------------
+Every record is numbered in the order it was accepted by logger_log().
+Meant to be called from within transform or output functions.
+*/
+extern uint64_t
+logger_current_sequence(void) {
+  return logger_sequence_current;
+}
+
+/*
+Parameters:
+-----------
+log_level
+  Messages up to this level (LOGGER_EMERGENCY - LOGGER_DEBUG) get a
+  backtrace, a negative value turns capturing off
+
+depth
+  Maximum number of frames, 1 - LOGGER_BACKTRACE_DEPTH
+
+Return Value:
+-------------
+value <= 0 = ERROR (also if the platform has no backtrace())
+value > 0 = SUCCESS
+
+Description:
+------------
+Captures the raw return addresses of messages from logger_log() and
+logger_log_preformatted(). They are symbolized when the message is
+pushed and appended to it, one line per frame:
+  "\n  #0 function+0x1f (module)"
+Setup functions must not run concurrently with logging calls.
+*/
+extern int
+logger_set_backtrace(int log_level,int depth) {
+  return logger_set_backtrace_to(&Logger,log_level,depth);
+}
+
+/* logger_set_backtrace() for an instance, see logger_create() */
+extern int
+logger_set_backtrace_to(logger_t *logger,int log_level,int depth) {
+  if(logger == (void*)0) {return 0;}
+  if(log_level < 0) {
+    logger->backtrace_level = -1;
+    return 1;
+  } else if(log_level > LOGGER_DEBUG || depth < 1 || depth > LOGGER_BACKTRACE_DEPTH) {
+    return 0;
+  }
+#ifdef LOGGER_HAS_BACKTRACE
+  /* The first call may load libgcc and allocate, not on a logging call */
+  void *frames[1];
+  backtrace(frames,1);
+  logger->backtrace_depth = depth;
+  logger->backtrace_level = log_level;
+  return 1;
+#else
+  return -1;
+#endif
+}
+
+/*
+Parameters:
+-----------
+frames
+  Set to the return addresses of the record being pushed, innermost first
+
+Return Value:
+-------------
+int
+  Number of frames, 0 without a backtrace or outside of the transform /
+  output functions
+
+Description:
+------------
+Lets output functions store the raw addresses (e.g. binary sinks that
+symbolize later with logger_symbolize()).
+*/
+extern int
+logger_current_backtrace(void * const **frames) {
+  if(frames != (void*)0) {*frames = logger_backtrace_current.frames;}
+  return logger_backtrace_current.count;
+}
+
+/*
+Parameters:
+-----------
+set_active
+  true = messages are pushed / false = messages are silent
+
+Return Value:
+-------------
+None
+
+Description:
+------------
+Determines, if messages are silent or should be pushed
+*/
+extern void
+logger_toggle(bool set_active) {
+  logger_toggle_to(&Logger,set_active);
+}
+
+/* logger_toggle() for an instance, see logger_create() */
+extern void
+logger_toggle_to(logger_t *logger,bool set_active) {
+  if(logger == (void*)0) {return;}
+  pthread_mutex_lock(&logger_gate_lock);
+  logger->is_active = set_active;
+  logger_gate_update(logger);
+  pthread_mutex_unlock(&logger_gate_lock);
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+bool
+  true = messages are pushed / false = messages are silent
+
+Description:
+------------
+
+*/
+extern bool
+logger_get_status(void) {
+  return logger_get_status_to(&Logger);
+}
+
+/* logger_get_status() for an instance, see logger_create() */
+extern bool
+logger_get_status_to(logger_t *logger) {
+  if(logger == (void*)0) {return false;}
+  return logger->is_active;
+}
+
+/*
+Parameters:
+-----------
+None
+
+Return Value:
+-------------
+bool
+  true = struct seems initialized / false = struct appears to be invalid
+
+Description:
+------------
+
+*/
+extern bool
+logger_is_initialized(void) {
+  return logger_is_initialized_to(&Logger);
+}
+
+/* logger_is_initialized() for an instance, see logger_create() */
+extern bool
+logger_is_initialized_to(logger_t *logger) {
+  if(logger == (void*)0) {return false;}
+  if(logger->transform_function != (void*)0 && logger->output_function != (void*)0 && logger->log_level >= LOGGER_EMERGENCY && logger->log_level <= LOGGER_DEBUG) {
+    return true;
+  }
+  return false;
+}
+
+/*
+Log reader
+
+logger_reader_open() follows a file written by one of the file sinks,
+from another thread or from another process. The file is mapped and
+records are handed out as views into the mapping, only complete ones:
+text and CSV records once their '\n' is written (the 0 bytes at the end
+of a direct sink file are not written yet), data records once header,
+names and payload are all there. With nothing to read the reader blocks
+on inotify instead of polling. Log rotation is followed: once another
+file shows up at the path (the old one renamed, or deleted and created
+again) the old segment is read to its end and the reader moves on, a
+file cut below the read position (copytruncate) is read from the start
+again. The mapping reaches LOGGER_READER_RESERVE bytes past the end of
+the file, so a growing file only has to be mapped again every few MB.
+Touching a mapped page past the end of the file raises SIGBUS, so every
+call looks at the size first. Once the file shrank, what is left behind
+the read position is read with pread() into a copy instead, the mapping
+is only used again after that copy is used up.
+*/
+#define LOGGER_READER_RESERVE (64 * 1024 * 1024)
+
+#ifdef LOGGER_HAS_INOTIFY
+struct logger_reader {
+  char *path;
+  char const *name;
+  int format;
+  int descriptor;
+  dev_t device;
+  ino_t inode;
+  char *map;
+  size_t mapped;
+  /* File size at the last look and start of the next record */
+  uint64_t size;
+  uint64_t offset;
+  uint64_t segment;
+  int inotify;
+  int file_watch;
+  /* The path may lead to another file than the one read */
+  bool moved;
+  /* Bytes from copy_offset on, read after the file shrank */
+  char *copy;
+  size_t copy_capacity;
+  size_t copy_length;
+  uint64_t copy_offset;
+};
+
+static void
+logger_reader_detach(logger_reader * const reader) {
+  if(reader->map != (void*)0) {munmap(reader->map,reader->mapped);}
+  reader->map = (void*)0;
+  reader->mapped = 0;
+  if(reader->file_watch >= 0) {inotify_rm_watch(reader->inotify,reader->file_watch);}
+  reader->file_watch = -1;
+  if(reader->descriptor >= 0) {close(reader->descriptor);}
+  reader->descriptor = -1;
+  reader->copy_length = 0;
+}
+
+/* Picks up the current size, maps again if the file outgrew the mapping */
+static int
+logger_reader_refresh(logger_reader * const reader) {
+  struct stat status;
+  if(reader->descriptor < 0) {return 0;}
+  if(fstat(reader->descriptor,&status) != 0) {return -1;}
+  uint64_t const size = (uint64_t)status.st_size;
+  if(size < reader->offset) {
+    reader->offset = 0;
+    reader->segment++;
+    reader->copy_length = 0;
+  } else if(size < reader->size) {
+    /* Cut while records were unread, the rest may be cut as well before it is parsed */
+    size_t const length = (size_t)(size - reader->offset);
+    if(length > reader->copy_capacity) {
+      char * const copy = realloc(reader->copy,length);
+      if(copy == (void*)0) {return -1;}
+      reader->copy = copy;
+      reader->copy_capacity = length;
+    }
+    ssize_t const got = pread(reader->descriptor,reader->copy,length,(off_t)reader->offset);
+    if(got < 0) {return -1;}
+    reader->copy_offset = reader->offset;
+    reader->copy_length = (size_t)got;
+    reader->size = reader->offset + (uint64_t)got;
+    return 1;
+  }
+  if(reader->copy_length > 0) {
+    /* The copy stays the view until it is parsed to its end or the file grew past it */
+    if(reader->offset < reader->copy_offset + reader->copy_length && size <= reader->size) {return 1;}
+    reader->copy_length = 0;
+  }
+  if(size > reader->mapped) {
+    if(reader->map != (void*)0) {munmap(reader->map,reader->mapped);}
+    reader->map = (void*)0;
+    reader->mapped = 0;
+    if(size > SIZE_MAX - LOGGER_READER_RESERVE) {return -1;}
+    void * const map = mmap((void*)0,(size_t)size + LOGGER_READER_RESERVE,PROT_READ,MAP_SHARED,reader->descriptor,0);
+    if(map == MAP_FAILED) {return -1;}
+    reader->map = map;
+    reader->mapped = (size_t)size + LOGGER_READER_RESERVE;
+  }
+  reader->size = size;
+  return 1;
+}
+
+/*
+Moves on to the file at the path once it is another one than the file
+read and the latter stopped growing. Returns 0 while there is nothing to
+move on to.
+*/
+static int
+logger_reader_follow(logger_reader * const reader) {
+  struct stat status;
+  int const descriptor = open(reader->path,O_RDONLY | O_CLOEXEC);
+  if(descriptor < 0) {return errno == ENOENT ? 0 : -1;}
+  if(fstat(descriptor,&status) != 0) {
+    close(descriptor);
+    return -1;
+  }
+  if(reader->descriptor >= 0) {
+    struct stat current;
+    if(status.st_dev == reader->device && status.st_ino == reader->inode) {
+      close(descriptor);
+      reader->moved = false;
+      return 0;
+    }
+    if(fstat(reader->descriptor,&current) == 0 && (uint64_t)current.st_size > reader->size) {
+      close(descriptor);
+      return 1;
+    }
+    logger_reader_detach(reader);
+    reader->segment++;
+  }
+  reader->descriptor = descriptor;
+  reader->device = status.st_dev;
+  reader->inode = status.st_ino;
+  reader->size = 0;
+  reader->offset = 0;
+  reader->moved = false;
+  /* Watched through the descriptor, the path may already lead elsewhere */
+  char link[64];
+  snprintf(link,sizeof(link),"/proc/self/fd/%d",descriptor);
+  reader->file_watch = inotify_add_watch(reader->inotify,link,IN_MODIFY | IN_MOVE_SELF);
+  if(reader->file_watch < 0) {
+    reader->file_watch = inotify_add_watch(reader->inotify,reader->path,IN_MODIFY | IN_MOVE_SELF);
+  }
+  return reader->file_watch >= 0 ? 1 : -1;
+}
+
+/* Events only say where to look again, the files themselves are the state */
+static void
+logger_reader_drain(logger_reader * const reader) {
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length;
+  while((length = read(reader->inotify,events,sizeof(events))) > 0) {
+    for(ssize_t offset = 0;offset < length;) {
+      struct inotify_event const * const event = (struct inotify_event const *)(events + offset);
+      if((event->mask & IN_MOVE_SELF) != 0 || (event->len > 0 && strcmp(event->name,reader->name) == 0)) {
+        reader->moved = true;
+      }
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
+
+/* A decimal number that ends before end, strtol() could run past the record */
+static bool
+logger_reader_number(char const ** const cursor,char const * const end,int64_t * const value) {
+  char const *digit = *cursor;
+  bool const negative = digit < end && *digit == '-';
+  if(negative) {digit++;}
+  if(digit == end || *digit < '0' || *digit > '9') {return false;}
+  int64_t number = 0;
+  for(;digit < end && *digit >= '0' && *digit <= '9';digit++) {
+    number = number * 10 + (*digit - '0');
+  }
+  *value = negative ? -number : number;
+  *cursor = digit;
+  return true;
+}
+
+/* "seconds.nanoseconds,level,file,line,message" as written by logger_factory_csv() */
+static void
+logger_reader_csv(logger_record * const record) {
+  char const * const end = record->record + record->length;
+  char const *field = record->record;
+  int64_t seconds;
+  int64_t nanoseconds;
+  int64_t linenumber;
+  if(logger_reader_number(&field,end,&seconds) == false || field == end || *field != '.') {return;}
+  field++;
+  if(logger_reader_number(&field,end,&nanoseconds) == false || field == end || *field != ',') {return;}
+  field++;
+  char const * const level = memchr(field,',',(size_t)(end - field));
+  if(level == (void*)0) {return;}
+  char const * const file = memchr(level + 1,',',(size_t)(end - level - 1));
+  if(file == (void*)0) {return;}
+  char const *line = file + 1;
+  if(logger_reader_number(&line,end,&linenumber) == false || line == end || *line != ',') {return;}
+  for(int index = LOGGER_EMERGENCY;index <= LOGGER_DEBUG;index++) {
+    if((size_t)(level - field) == logger_format_level_csv[index].length - 2
+       && memcmp(field,logger_format_level_csv[index].name + 1,logger_format_level_csv[index].length - 2) == 0) {
+      record->log_level = index;
+    }
+  }
+  record->seconds = seconds;
+  record->nanoseconds = (int32_t)nanoseconds;
+  record->linenumber = (int32_t)linenumber;
+  record->file = level + 1;
+  record->file_length = (size_t)(file - level - 1);
+  record->message = line + 1;
+  record->message_length = (size_t)(end - record->message);
+}
+
+/* Hands out the next complete record of the mapping or the copy */
+static int
+logger_reader_parse(logger_reader * const reader,logger_record * const record) {
+  if(reader->descriptor < 0 || reader->offset >= reader->size) {return 0;}
+  char const *start = reader->map + reader->offset;
+  size_t available = (size_t)(reader->size - reader->offset);
+  if(reader->copy_length > 0) {
+    if(reader->offset >= reader->copy_offset + reader->copy_length) {return 0;}
+    start = reader->copy + (reader->offset - reader->copy_offset);
+    available = (size_t)(reader->copy_offset + reader->copy_length - reader->offset);
+  }
+  memset(record,0,sizeof(logger_record));
+  record->record = start;
+  record->offset = reader->offset;
+  record->segment = reader->segment;
+  record->log_level = -1;
+  if(reader->format == LOGGER_READER_DATA) {
+    logger_data_header header;
+    if(available < sizeof(header)) {return 0;}
+    memcpy(&header,start,sizeof(header));
+    if(memcmp(header.magic,LOGGER_DATA_MAGIC,sizeof(header.magic)) != 0) {return -2;}
+    size_t const rest = available - sizeof(header);
+    uint64_t const names = (uint64_t)header.file_length + header.label_length;
+    if(header.data_length > rest || names > rest - header.data_length) {return 0;}
+    record->length = sizeof(header) + (size_t)names + (size_t)header.data_length;
+    record->log_level = header.log_level;
+    record->sequence = header.sequence;
+    record->seconds = header.seconds;
+    record->nanoseconds = header.nanoseconds;
+    record->linenumber = header.linenumber;
+    record->file = start + sizeof(header);
+    record->file_length = header.file_length;
+    record->label = record->file + header.file_length;
+    record->label_length = header.label_length;
+    record->message = record->label + header.label_length;
+    record->message_length = (size_t)header.data_length;
+    reader->offset += record->length;
+    return 1;
+  }
+  char const * const end = memchr(start,'\n',available);
+  if(end == (void*)0 || memchr(start,'\0',(size_t)(end - start)) != (void*)0) {return 0;}
+  record->length = (size_t)(end - start);
+  reader->offset += record->length + 1;
+  if(reader->format == LOGGER_READER_CSV) {
+    static char const header[] = "timestamp,priority,";
+    if(record->offset == 0 && record->length >= sizeof(header) - 1 && memcmp(start,header,sizeof(header) - 1) == 0) {
+      return logger_reader_parse(reader,record);
+    }
+    logger_reader_csv(record);
+  }
+  return 1;
+}
+#endif
+
+/*
+Parameters:
+-----------
+path
+  File written by logger_factory_file(), logger_factory_direct_file(),
+  logger_factory_csv() or logger_factory_data_file(), it does not have
+  to exist yet
+mode
+  LOGGER_READER_TEXT, LOGGER_READER_CSV or LOGGER_READER_DATA, optionally
+  combined with LOGGER_READER_END
+
+Return Value:
+-------------
+logger_reader *
+  NULL = ERROR
+
+Description:
+------------
+Opens a reader that follows the file and the files that replace it at
+the same path, see "Log reader" above. Starts at the first record or,
+with LOGGER_READER_END, behind the last complete one. Independent of any
+logger instance. Only available on Linux.
+*/
+extern logger_reader *
+logger_reader_open(char const * const path,int mode) {
+  int const format = mode & ~LOGGER_READER_END;
+  if(path == (void*)0 || format < LOGGER_READER_TEXT || format > LOGGER_READER_DATA) {return (void*)0;}
+#ifdef LOGGER_HAS_INOTIFY
+  logger_reader * const reader = calloc(1,sizeof(logger_reader));
+  if(reader == (void*)0) {return (void*)0;}
+  reader->path = strdup(path);
+  reader->format = format;
+  reader->descriptor = -1;
+  reader->file_watch = -1;
+  reader->moved = true;
+  reader->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(reader->path == (void*)0 || reader->inotify < 0) {
+    logger_reader_close(reader);
+    return (void*)0;
+  }
+  /* The directory reports the files showing up at the path */
+  char const * const slash = strrchr(reader->path,'/');
+  reader->name = slash != (void*)0 ? slash + 1 : reader->path;
+  char * const directory = slash == (void*)0 ? strdup(".") : slash == reader->path ? strdup("/") : strndup(reader->path,(size_t)(slash - reader->path));
+  if(directory == (void*)0 || inotify_add_watch(reader->inotify,directory,IN_CREATE | IN_MOVED_TO) < 0 || logger_reader_follow(reader) < 0) {
+    perror("Could not follow log file");
+    free(directory);
+    logger_reader_close(reader);
+    return (void*)0;
+  }
+  free(directory);
+  if((mode & LOGGER_READER_END) != 0 && logger_reader_refresh(reader) > 0) {
+    if(format == LOGGER_READER_DATA) {
+      logger_record record;
+      while(logger_reader_parse(reader,&record) > 0) {}
+    } else if(reader->size > 0) {
+      char const * const last = memrchr(reader->map,'\n',(size_t)reader->size);
+      reader->offset = last != (void*)0 ? (uint64_t)(last - reader->map) + 1 : 0;
+    }
+  }
+  return reader;
+#else
+  fprintf(stderr,"Following a log file needs inotify\n");
+  return (void*)0;
+#endif
+}
+
+/*
+Parameters:
+-----------
+reader
+  Reader from logger_reader_open()
+record
+  Filled with the record, the pointers lead into the mapped file (or the
+  copy of a file that shrank) and stay valid until the next call on the
+  reader
+timeout_ms
+  Time to wait for a record, 0 does not wait, < 0 waits without limit
+
+Return Value:
+-------------
+value > 0 = a record
+value = 0 = no complete record within the timeout
+value < 0 = ERROR (-2 data file that is not made of logger_data_header records)
+
+Description:
+------------
+Returns the next complete record. Blocks on inotify while the file has
+nothing new, follows the file to the next segment after rotation.
+*/
+extern int
+logger_reader_next(logger_reader *reader,logger_record *record,int timeout_ms) {
+  if(reader == (void*)0 || record == (void*)0) {return -1;}
+#ifdef LOGGER_HAS_INOTIFY
+  uint64_t const deadline = logger_monotonic_ns() + (uint64_t)(timeout_ms > 0 ? timeout_ms : 0) * 1000000;
+  while(true) {
+    /* The size of the last call may be stale, the file can be cut in between */
+    if(logger_reader_refresh(reader) < 0) {return -3;}
+    int ret_code = logger_reader_parse(reader,record);
+    if(ret_code != 0) {return ret_code;}
+    logger_reader_drain(reader);
+    if(logger_reader_refresh(reader) < 0) {return -3;}
+    ret_code = logger_reader_parse(reader,record);
+    if(ret_code != 0) {return ret_code;}
+    if(reader->moved) {
+      ret_code = logger_reader_follow(reader);
+      if(ret_code < 0) {return -4;}
+      if(ret_code > 0) {continue;}
+    }
+    int wait = -1;
+    if(timeout_ms >= 0) {
+      uint64_t const now = logger_monotonic_ns();
+      if(now >= deadline) {return 0;}
+      wait = (int)((deadline - now + 999999) / 1000000);
+    }
+    struct pollfd descriptor = {.fd = reader->inotify,.events = POLLIN};
+    if(poll(&descriptor,1,wait) < 0 && errno != EINTR) {return -5;}
+  }
+#else
+  return -1;
+#endif
+}
+
+/*
+Parameters:
+-----------
+reader
+  Reader from logger_reader_open()
+
+Return Value:
+-------------
+value < 0 = ERROR
+value >= 0 = descriptor
+
+Description:
+------------
+A descriptor that becomes readable once logger_reader_next() may have
+something new, for event loops waiting on more than the reader. Reading
+it is left to logger_reader_next().
+*/
+extern int
+logger_reader_descriptor(logger_reader *reader) {
+  if(reader == (void*)0) {return -1;}
+#ifdef LOGGER_HAS_INOTIFY
+  return reader->inotify;
+#else
+  return -1;
+#endif
+}
+
+/* Unmaps and closes everything, records handed out become invalid */
+extern void
+logger_reader_close(logger_reader *reader) {
+  if(reader == (void*)0) {return;}
+#ifdef LOGGER_HAS_INOTIFY
+  logger_reader_detach(reader);
+  if(reader->inotify >= 0) {close(reader->inotify);}
+  free(reader->copy);
+  free(reader->path);
+  free(reader);
+#endif
+}
+
+#ifdef LOGGERTESTSUITE
+
+static void
+tests_preinit_check(void **state) {
+  (void*)state;
+  assert_true(sizeof(logging_context) > 0);
+  char const * const check_pointer = (char const * const)&Logger;
+  for(size_t index = 0;index < sizeof(logging_context);index++) {
+    assert_true(*check_pointer == 0);
+  }
+}
+
+static char tests_output_simple[LOGGER_MESSAGE_BUFFER] = {0};
+
+static int
+tests_init_output(void const * const custom_object,char const * const message) {
+  snprintf((char *)custom_object,LOGGER_MESSAGE_BUFFER,"%s",message);
+  return 1;
+}
+
+static char *
+tests_init_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  assert_true(timestamp->realtime.tv_sec > 0);
+  assert_true(timestamp->realtime.tv_nsec >= 0 && timestamp->realtime.tv_nsec < 1000000000L);
+  assert_true(log_level >= LOGGER_EMERGENCY);
+  assert_true(log_level <= LOGGER_DEBUG);
+  assert_true(file != (void*)0);
+  assert_true(filenumber > -1);
+  assert_true(message != (void*)0);
+  char tmp_buffer[LOGGER_MESSAGE_BUFFER] = {0};
+  char const log_level_mapping[][10] = {
+    "EMERGENCY",
+    "ALERT",
+    "CRITICAL",
+    "ERROR",
+    "WARNING",
+    "NOTICE",
+    "INFO",
+    "DEBUG"
+  };
+  time_t fixed_time = 1633035745;
+  int const offset = strftime(tmp_buffer,LOGGER_MESSAGE_BUFFER,"%c",localtime(&fixed_time));
+  if(offset < 1) {
+    fprintf(stderr,"Could not write time to buffer\n");
+    return (void*)0;
+  }
+  if(snprintf(tmp_buffer + offset,LOGGER_MESSAGE_BUFFER," %-10s %s:%d - %s\n",log_level_mapping[log_level],file,filenumber,message) < 1) {
+    fprintf(stderr,"Could not amalgamate Message - sprintf returned 0 bytes");
+    return (void*)0;
+  }
+  memset(message,0,LOGGER_MESSAGE_BUFFER);
+  memcpy(message,&tmp_buffer,LOGGER_MESSAGE_BUFFER);
+  return message;
+}
+
+static void
+tests_init_check(void **state) {
+  assert_true(logger_setup_context(-1,(void*)0,tests_init_output,tests_init_transform,true) < 1);
+  assert_true(logger_setup_context(LOGGER_DEBUG,(void*)0,(void*)0,tests_init_transform,true) < 1);
+  assert_true(logger_setup_context(LOGGER_DEBUG,(void*)0,tests_init_output,(void*)0,true) < 1);
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_init_transform,true) > 0);
+  assert_true(logger_get_status() == true);
+  logger_toggle(false);
+  assert_true(logger_get_status() == false);
+  logger_toggle(true);
+  assert_true(logger_get_status() == true);
+}
+
+static void
+tests_simpleoutputs_check(void **state) {
+  char expected[LOGGER_MESSAGE_BUFFER] = {0};
+  logger_info("This is one Test");
+  snprintf(expected,LOGGER_MESSAGE_BUFFER,"Thu Sep 30 23:02:25 2021 INFO       %s:%d - This is one Test\n",__FILE__,__LINE__ - 1);
+  assert_string_equal(tests_output_simple,expected);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_debug("This is a parameter test: %s","parameter");
+  snprintf(expected,LOGGER_MESSAGE_BUFFER,"Thu Sep 30 23:02:25 2021 DEBUG      %s:%d - This is a parameter test: parameter\n",__FILE__,__LINE__ - 1);
+  assert_string_equal(tests_output_simple,expected);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_debug("Another slightly longer message 000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000...");
+  snprintf(expected,LOGGER_MESSAGE_BUFFER,"Thu Sep 30 23:02:25 2021 DEBUG      %s:%d - Another slightly longer message 000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000...\n",__FILE__,__LINE__ - 1);
+  assert_string_equal(tests_output_simple,expected);
+  logger_toggle(false);
+  logger_debug("A string that will disappear");
+  assert_string_equal(tests_output_simple,expected);
+  logger_toggle(true);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+}
+
+static void
+tests_simplefile_check(void **state) {
+  assert_true(logger_factory_file(LOGGER_DEBUG,"./logger_tests_long_filename.txt") > 0);
+  assert_true(logger_set_transform(tests_init_transform) == 1);
+  logger_info("this is one exact test output");
+  logger_debug("Another line in the file %s","lsdkfjlsdkfjsldfkjsldfkjsdflksjdflkjsdfklj");
+  fflush(logger_factory_file_file);
+  fclose(logger_factory_file_file);
+  logger_factory_file_file = (void*)0;
+  remove("./logger_tests_long_filename.txt");
+}
+
+static void
+tests_async_file_replace_check(void **state) {
+  assert_true(logger_factory_file(LOGGER_DEBUG,"./logger_tests_replace.txt") > 0);
+  assert_true(logger_set_transform(tests_init_transform) == 1);
+  /* Replacing the file with the writer running, records queued before still reach the previous file */
+  assert_true(logger_setup_async(256,LOGGER_BACKPRESSURE_BLOCK,0) > 0);
+  for(size_t index = 0;index < 200;index++) {
+    logger_info("queued for the previous file %zu",index);
+  }
+  assert_true(logger_factory_file(LOGGER_DEBUG,"./logger_tests_replace.2.txt") > 0);
+  logger_info("first line of the next file");
+  assert_true(logger_sync(-1) > 0);
+  assert_true(logger_stop_async() > 0);
+  FILE *previous = fopen("./logger_tests_replace.txt","r");
+  assert_true(previous != (void*)0);
+  size_t lines = 0;
+  char line[LOGGER_MESSAGE_BUFFER];
+  while(fgets(line,sizeof(line),previous) != (void*)0) {lines++;}
+  fclose(previous);
+  assert_true(lines == 200);
+  fflush(logger_factory_file_file);
+  fclose(logger_factory_file_file);
+  logger_factory_file_file = (void*)0;
+  remove("./logger_tests_replace.txt");
+  remove("./logger_tests_replace.2.txt");
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static void
+tests_simplecsv_check(void **state) {
+  assert_true(logger_factory_csv(LOGGER_DEBUG,"./logger_tests_long_filename.csv") > 0);
+  logger_info("this is the first test");
+  logger_debug("about to finish the test: %s","02034020342394827394");
+  for(size_t index = 0;index < 200;index++) {
+    switch(index % (LOGGER_DEBUG + 1)) {
+      case LOGGER_EMERGENCY:
+        logger_emergency("a message that comes in from the loop");
+        break;
+      case LOGGER_ALERT:
+        logger_alert("a message that comes in from the loop");
+        break;
+      case LOGGER_CRITICAL:
         logger_critical("a message that comes in from the loop");
         break;
       case LOGGER_ERROR:
@@ -519,6 +6931,1653 @@ tests_simplecsv_check(void **state) {
   logger_factory_file_file = (void*)0;
 }
 
+typedef struct {
+  pthread_mutex_t gate;
+  size_t count;
+  size_t errors;
+  size_t reports;
+} tests_async_sink;
+
+static int
+tests_async_output(void const * const custom_object,char const * const message) {
+  tests_async_sink *sink = (tests_async_sink *)custom_object;
+  pthread_mutex_lock(&sink->gate);
+  sink->count++;
+  if(strstr(message," ERROR ") != (void*)0) {sink->errors++;}
+  if(strstr(message,"Dropped ") != (void*)0) {sink->reports++;}
+  pthread_mutex_unlock(&sink->gate);
+  return 1;
+}
+
+static void
+tests_async_backpressure_check(void **state) {
+  tests_async_sink sink = {.count = 0};
+  logger_stats stats;
+  pthread_mutex_init(&sink.gate,(void*)0);
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_async_output,tests_init_transform,true) > 0);
+  assert_true(logger_setup_async(0,LOGGER_BACKPRESSURE_BLOCK,0) < 1);
+  assert_true(logger_setup_async(4,42,0) < 1);
+  /* The writer stalls on the gate, so the queue fills up */
+  pthread_mutex_lock(&sink.gate);
+  assert_true(logger_setup_async(4,LOGGER_BACKPRESSURE_DROP_BY_LEVEL,0) > 0);
+  assert_true(logger_setup_async(4,LOGGER_BACKPRESSURE_DROP_BY_LEVEL,0) < 1);
+  for(size_t index = 0;index < 20;index++) {
+    logger_debug("shed me first %zu",index);
+  }
+  logger_error("never dropped 1");
+  logger_error("never dropped 2");
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.queue_capacity == 4);
+  assert_true(stats.dropped[LOGGER_ERROR] == 0);
+  assert_true(stats.dropped[LOGGER_DEBUG] >= 15);
+  pthread_mutex_unlock(&sink.gate);
+  assert_true(logger_stop_async() > 0);
+  assert_true(logger_stop_async() < 1);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(sink.errors == 2);
+  assert_true(sink.reports == 1);
+  assert_true(stats.written + stats.dropped[LOGGER_DEBUG] == 22);
+
+  /* Blocking with a timeout turns into a drop once the timeout passes */
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+  pthread_mutex_lock(&sink.gate);
+  assert_true(logger_setup_async(2,LOGGER_BACKPRESSURE_BLOCK,5) > 0);
+  for(size_t index = 0;index < 6;index++) {
+    logger_info("blocking %zu",index);
+  }
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.blocked > 0);
+  assert_true(stats.dropped[LOGGER_INFO] >= 3);
+  pthread_mutex_unlock(&sink.gate);
+  assert_true(logger_stop_async() > 0);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.written + stats.dropped[LOGGER_INFO] == 6);
+  pthread_mutex_destroy(&sink.gate);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+typedef struct {
+  pthread_mutex_t gate;
+  size_t count;
+  uint64_t sequences[32];
+  bool priority[32];
+  size_t durable_flushes;
+} tests_priority_sink;
+
+static int
+tests_priority_output(void const * const custom_object,char const * const message) {
+  tests_priority_sink *sink = (tests_priority_sink *)custom_object;
+  pthread_mutex_lock(&sink->gate);
+  if(sink->count < 32) {
+    sink->sequences[sink->count] = logger_current_sequence();
+    sink->priority[sink->count] = strstr(message," CRITICAL ") != (void*)0;
+    sink->count++;
+  }
+  pthread_mutex_unlock(&sink->gate);
+  return 1;
+}
+
+static int
+tests_priority_flush(void const * const custom_object,bool const durable) {
+  tests_priority_sink *sink = (tests_priority_sink *)custom_object;
+  if(durable) {sink->durable_flushes++;}
+  return 1;
+}
+
+static void
+tests_async_priority_check(void **state) {
+  tests_priority_sink sink = {.count = 0};
+  pthread_mutex_init(&sink.gate,(void*)0);
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_priority_output,tests_init_transform,true) > 0);
+  assert_true(logger_set_flush_callback(tests_priority_flush) > 0);
+  assert_true(logger_current_sequence() == 0);
+  pthread_mutex_lock(&sink.gate);
+  assert_true(logger_setup_async(16,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 10;index++) {
+    logger_debug("bulk before %zu",index);
+  }
+  logger_critical("must not wait behind the bulk");
+  for(size_t index = 0;index < 5;index++) {
+    logger_debug("bulk after %zu",index);
+  }
+  pthread_mutex_unlock(&sink.gate);
+  assert_true(logger_stop_async() > 0);
+  assert_true(sink.count == 16);
+  assert_true(sink.durable_flushes == 1);
+  size_t critical_position = sink.count;
+  for(size_t index = 0;index < sink.count;index++) {
+    if(sink.priority[index]) {critical_position = index;}
+  }
+  /* Only the record already in flight at the writer may precede it */
+  assert_true(critical_position <= 1);
+  uint64_t previous = 0;
+  for(size_t index = 0;index < sink.count;index++) {
+    if(index < critical_position) {
+      assert_true(sink.sequences[index] < sink.sequences[critical_position]);
+    }
+    if(sink.priority[index] == false) {
+      assert_true(sink.sequences[index] > previous);
+      previous = sink.sequences[index];
+    }
+  }
+  pthread_mutex_destroy(&sink.gate);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static _Atomic bool tests_shutdown_stalled = false;
+static _Atomic bool tests_shutdown_released = false;
+
+/* Stalls the writer until logger_shutdown() gave up on it */
+static void *
+tests_shutdown_stall(void *custom_object) {
+  tests_priority_sink *sink = custom_object;
+  pthread_mutex_lock(&sink->gate);
+  atomic_store(&tests_shutdown_stalled,true);
+  while(atomic_load(&tests_shutdown_released) == false) {sched_yield();}
+  pthread_mutex_unlock(&sink->gate);
+  return (void*)0;
+}
+
+static void
+tests_async_shutdown_check(void **state) {
+  tests_priority_sink sink = {.count = 0};
+  pthread_mutex_init(&sink.gate,(void*)0);
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_priority_output,tests_init_transform,true) > 0);
+  assert_true(logger_set_flush_callback(tests_priority_flush) > 0);
+  /* Without a pipeline the barrier only flushes */
+  assert_true(logger_sync(0) > 0);
+  assert_true(sink.durable_flushes == 1);
+  assert_true(logger_setup_async(16,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 5;index++) {
+    logger_info("before the barrier %zu",index);
+  }
+  assert_true(logger_sync(-1) > 0);
+  assert_true(sink.count == 5);
+  assert_true(sink.durable_flushes == 2);
+  /* A stalled writer makes the barrier time out, the record stays queued */
+  pthread_mutex_lock(&sink.gate);
+  logger_info("stalled");
+  assert_true(logger_sync(10) == -1);
+  pthread_mutex_unlock(&sink.gate);
+  assert_true(logger_sync(-1) > 0);
+  assert_true(sink.count == 6);
+  assert_true(sink.durable_flushes == 3);
+  /* Shutdown discards what the stalled writer could not write in time */
+  pthread_t stall;
+  assert_true(pthread_create(&stall,(void*)0,tests_shutdown_stall,&sink) == 0);
+  while(atomic_load(&tests_shutdown_stalled) == false) {sched_yield();}
+  for(size_t index = 0;index < 4;index++) {
+    logger_info("behind the stall %zu",index);
+  }
+  logging_queue * const queue = Logger.queue;
+  bool taken = false;
+  while(taken == false) {
+    sched_yield();
+    pthread_mutex_lock(&queue->lock);
+    taken = queue->in_flight != 0;
+    pthread_mutex_unlock(&queue->lock);
+  }
+  /* The writer is stuck with the first record past the deadline, it is detached and that record counts as lost */
+  uint64_t lost = 0;
+  assert_true(logger_shutdown(10,&lost) == -1);
+  assert_true(lost == 4);
+  assert_true(sink.durable_flushes == 3);
+  assert_true(logger_is_enabled(LOGGER_INFO) == false);
+  /* Calls that get past the gate drop their record until the queue is released */
+  logger_toggle(true);
+  logger_info("into the closed queue");
+  logger_stats stats;
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.dropped[LOGGER_INFO] == lost + 1);
+  /* The queue outlives the detached writer */
+  atomic_store(&tests_shutdown_released,true);
+  pthread_join(stall,(void*)0);
+  bool exited = false;
+  while(exited == false) {
+    sched_yield();
+    pthread_mutex_lock(&queue->lock);
+    exited = queue->exited;
+    pthread_mutex_unlock(&queue->lock);
+  }
+  assert_true(sink.count == 7);
+  assert_true(logger_stop_async() > 0);
+  logger_info("synchronous again");
+  assert_true(sink.count == 8);
+  assert_true(logger_shutdown(0,&lost) > 0);
+  assert_true(lost == 0);
+  logger_toggle(true);
+  pthread_mutex_destroy(&sink.gate);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static logger_time tests_clock_last = {{0}};
+
+static char *
+tests_clock_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  tests_clock_last = *timestamp;
+  return message;
+}
+
+static void
+tests_clock_check(void **state) {
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_clock_transform,true) > 0);
+  assert_true(logger_set_clock(0x100) < 1);
+  logger_info("first");
+  logger_time const first = tests_clock_last;
+  logger_info("second");
+  assert_true(tests_clock_last.realtime.tv_sec > first.realtime.tv_sec
+           || (tests_clock_last.realtime.tv_sec == first.realtime.tv_sec && tests_clock_last.realtime.tv_nsec >= first.realtime.tv_nsec));
+  assert_true(tests_clock_last.monotonic.tv_sec == 0 && tests_clock_last.monotonic.tv_nsec == 0);
+  assert_true(logger_set_clock(LOGGER_CLOCK_COARSE | LOGGER_CLOCK_MONOTONIC) > 0);
+  logger_info("third");
+  assert_true(tests_clock_last.monotonic.tv_sec > 0);
+
+  /* Raw TSC stamps, converted before the transform runs */
+  assert_true(logger_set_clock(LOGGER_CLOCK_TSC | LOGGER_CLOCK_MONOTONIC) > 0);
+  assert_true(logger_get_clock() == (LOGGER_CLOCK_TSC | LOGGER_CLOCK_MONOTONIC) || logger_get_clock() == LOGGER_CLOCK_MONOTONIC);
+  struct timespec before,after;
+  clock_gettime(CLOCK_REALTIME,&before);
+  logger_info("tsc");
+  clock_gettime(CLOCK_REALTIME,&after);
+  assert_true(logger_timespec_ns(&tests_clock_last.realtime) > logger_timespec_ns(&before) - 1000000LL);
+  assert_true(logger_timespec_ns(&tests_clock_last.realtime) < logger_timespec_ns(&after) + 1000000LL);
+  assert_true(tests_clock_last.monotonic.tv_sec > 0);
+  assert_true(logger_set_clock(0) > 0);
+
+  /* Sub-second rendering of the factory transforms */
+  logger_time const fixed_time = {.realtime = {.tv_sec = 1633035745,.tv_nsec = 123456789}};
+  char message[LOGGER_MESSAGE_BUFFER] = "sub-second";
+  assert_string_equal(logger_factory_csv_transform(&fixed_time,LOGGER_INFO,"file.c",12,message),"1633035745.123456789,info,file.c,12,sub-second\n");
+  strcpy(message,"sub-second");
+  assert_string_equal(logger_factory_console_transform(&fixed_time,LOGGER_INFO,"file.c",12,message),"Thu Sep 30 23:02:25.123456 2021 INFO       file.c:12 - sub-second\n");
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+}
+
+static void
+tests_format_check(void **state) {
+  char buffer[32];
+  size_t offset = logger_format_signed(buffer,0,sizeof(buffer),0);
+  offset = logger_format_bytes(buffer,offset,sizeof(buffer)," ",1);
+  offset = logger_format_signed(buffer,offset,sizeof(buffer),-5);
+  offset = logger_format_bytes(buffer,offset,sizeof(buffer)," ",1);
+  offset = logger_format_signed(buffer,offset,sizeof(buffer),2147483647);
+  offset = logger_format_bytes(buffer,offset,sizeof(buffer)," ",1);
+  offset = logger_format_unsigned(buffer,offset,sizeof(buffer),42,6);
+  buffer[offset] = '\0';
+  assert_string_equal(buffer,"0 -5 2147483647 000042");
+  offset = logger_format_signed(buffer,0,sizeof(buffer),INT64_MIN);
+  buffer[offset] = '\0';
+  assert_string_equal(buffer,"-9223372036854775808");
+  offset = logger_format_unsigned(buffer,0,sizeof(buffer),UINT64_MAX,0);
+  buffer[offset] = '\0';
+  assert_string_equal(buffer,"18446744073709551615");
+  /* Truncation keeps the terminating byte */
+  offset = logger_format_bytes(buffer,0,8,"0123456789",10);
+  assert_true(offset == 7);
+
+  /* The prefix goes into the headroom behind the message */
+  char message[LOGGER_MESSAGE_BUFFER + LOGGER_TRANSFORM_HEADROOM];
+  memset(message,'x',LOGGER_MESSAGE_BUFFER - 1);
+  message[LOGGER_MESSAGE_BUFFER - 1] = '\0';
+  logger_time const fixed_time = {.realtime = {.tv_sec = 1633035745,.tv_nsec = 5}};
+  assert_true(logger_factory_csv_transform(&fixed_time,LOGGER_DEBUG,"file.c",-1,message) == message);
+  assert_true(strlen(message) == 37 + LOGGER_MESSAGE_BUFFER - 1 + 1);
+  assert_true(strncmp(message,"1633035745.000000005,debug,file.c,-1,xxx",40) == 0);
+  assert_true(message[37 + LOGGER_MESSAGE_BUFFER - 1] == '\n');
+}
+
+static void
+tests_preformatted_check(void **state) {
+  char expected[LOGGER_MESSAGE_BUFFER] = {0};
+  char message[LOGGER_MESSAGE_BUFFER] = "already formatted 100%";
+  assert_true(logger_setup_context(LOGGER_INFO,tests_output_simple,tests_init_output,tests_init_transform,true) > 0);
+  assert_true(logger_is_enabled(LOGGER_INFO) == true);
+  assert_true(logger_is_enabled(LOGGER_DEBUG) == false);
+  logger_log_preformatted(LOGGER_INFO,"caller.cpp",7,message,strlen(message));
+  snprintf(expected,LOGGER_MESSAGE_BUFFER,"Thu Sep 30 23:02:25 2021 INFO       caller.cpp:7 - already formatted 100%%\n");
+  assert_string_equal(tests_output_simple,expected);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_log_preformatted(LOGGER_DEBUG,"caller.cpp",8,message,strlen(message));
+  assert_string_equal(tests_output_simple,"");
+  logger_toggle(false);
+  assert_true(logger_is_enabled(LOGGER_EMERGENCY) == false);
+  logger_toggle(true);
+}
+
+typedef struct {
+  size_t length;
+  size_t calls;
+  bool nested;
+  char tail[32];
+} tests_long_sink;
+
+static char *
+tests_long_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  return message;
+}
+
+static int
+tests_long_output(void const * const custom_object,char const * const message) {
+  tests_long_sink *sink = (tests_long_sink *)custom_object;
+  sink->length = strlen(message);
+  sink->calls++;
+  if(sink->nested) {
+    size_t const length = sink->length;
+    sink->nested = false;
+    logger_info("nested %d",1);
+    assert_true(sink->length == 8);
+    assert_true(strlen(message) == length);
+    sink->length = length;
+  }
+  snprintf(sink->tail,sizeof(sink->tail),"%s",message + (sink->length > 20 ? sink->length - 20 : 0));
+  return 1;
+}
+
+static void
+tests_message_size_check(void **state) {
+  tests_long_sink sink = {0};
+  logger_stats stats;
+  size_t const long_length = LOGGER_MESSAGE_MAX + 100;
+  char *long_text = malloc(long_length + 1);
+  assert_true(long_text != (void*)0);
+  memset(long_text,'y',long_length);
+  long_text[long_length] = '\0';
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_long_output,tests_long_transform,true) > 0);
+  assert_true(logger_get_stats(&stats) > 0);
+  uint64_t const truncated = stats.truncated;
+
+  /* Longer than the per thread buffer, formatted into the arena */
+  logger_info("%.*s",5000,long_text);
+  assert_true(sink.length == 5000);
+  assert_string_equal(sink.tail,"yyyyyyyyyyyyyyyyyyyy");
+  /* Beyond the cap, cut and marked */
+  logger_info("%s",long_text);
+  assert_true(sink.length == LOGGER_MESSAGE_MAX - 1);
+  assert_string_equal(sink.tail,"yyyyyy" LOGGER_TRUNCATION_MARK);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.truncated == truncated + 1);
+  /* Short messages after a long one */
+  logger_info("%s","short");
+  assert_true(sink.length == 5);
+  /* Logging from within the output function keeps the outer message */
+  sink.nested = true;
+  logger_info("%.*s",3000,long_text);
+  assert_true(sink.calls == 5);
+  assert_string_equal(sink.tail,"yyyyyyyyyyyyyyyyyyyy");
+
+  /* Records with long messages through the asynchronous pipeline */
+  assert_true(logger_setup_async(4,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  logger_info("%.*s",7000,long_text);
+  logger_info("%s","short");
+  assert_true(logger_stop_async() > 0);
+  assert_true(sink.calls == 7);
+  assert_true(sink.length == 5);
+  free(long_text);
+}
+
+typedef struct {
+  size_t calls;
+  void const *data;
+  size_t length;
+  int log_level;
+  char label[32];
+  unsigned char payload[64];
+} tests_data_sink;
+
+static int
+tests_data_output(void const * const custom_object,logger_time const * const timestamp,int const log_level,
+                  char const * const file,int const filenumber,char const * const label,void const * const data,size_t const length) {
+  tests_data_sink *sink = (tests_data_sink *)custom_object;
+  sink->calls++;
+  sink->data = data;
+  sink->length = length;
+  sink->log_level = log_level;
+  snprintf(sink->label,sizeof(sink->label),"%s",label);
+  memcpy(sink->payload,data,length < sizeof(sink->payload) ? length : sizeof(sink->payload));
+  return 1;
+}
+
+static void
+tests_data_check(void **state) {
+  char text[512];
+  /* RFC 4648 test vectors */
+  char const * const base64[][2] = {
+    {"",""},{"f","Zg=="},{"fo","Zm8="},{"foo","Zm9v"},{"foob","Zm9vYg=="},{"fooba","Zm9vYmE="},{"foobar","Zm9vYmFy"}
+  };
+  for(size_t index = 0;index < sizeof(base64) / sizeof(base64[0]);index++) {
+    logger_encode_data(LOGGER_DATA_BASE64,text,sizeof(text),base64[index][0],strlen(base64[index][0]));
+    assert_string_equal(text,base64[index][1]);
+  }
+  unsigned char const bytes[] = "hello world!\n\x00\xff\x7f" "ab";
+  assert_true(logger_encode_data(LOGGER_DATA_HEX,text,sizeof(text),bytes,4) == 8);
+  assert_string_equal(text,"68656c6c");
+  logger_encode_data(LOGGER_DATA_HEXDUMP,text,sizeof(text),bytes,18);
+  assert_string_equal(text,
+    "00000000  68 65 6c 6c 6f 20 77 6f  72 6c 64 21 0a 00 ff 7f  |hello world!....|\n"
+    "00000010  61 62                                             |ab|");
+  assert_true(strlen(text) < logger_encoded_size(LOGGER_DATA_HEXDUMP,18));
+  /* Only whole units that fit */
+  assert_true(logger_encode_data(LOGGER_DATA_HEX,text,6,bytes,4) == 4);
+  assert_string_equal(text,"6865");
+  assert_true(logger_encode_data(LOGGER_DATA_BASE64,text,8,"foobar",6) == 4);
+  assert_string_equal(text,"Zm9v");
+  assert_true(logger_encoded_size(42,1) == 0);
+
+  /* The vectorized loops match the scalar ones for all lengths and bytes */
+  unsigned char random[200];
+  for(size_t index = 0;index < sizeof(random);index++) {random[index] = (unsigned char)(index * 167 + 13);}
+  for(size_t length = 0;length <= sizeof(random);length++) {
+    char expected[512];
+    char large[2048];
+    logger_encode_data(LOGGER_DATA_BASE64,large,sizeof(large),random,length);
+    expected[logger_encode_base64_scalar(expected,random,length)] = '\0';
+    assert_string_equal(large,expected);
+    logger_encode_data(LOGGER_DATA_HEX,large,sizeof(large),random,length);
+    for(size_t index = 0;index < length;index++) {
+      snprintf(expected + index * 2,3,"%02x",random[index]);
+    }
+    expected[length * 2] = '\0';
+    assert_string_equal(large,expected);
+  }
+
+  /* Rendered as text without a data callback */
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_long_transform,true) > 0);
+  assert_true(logger_set_data_callback((void*)0,(void*)0) > 0);
+  assert_true(logger_set_data_format(7) <= 0);
+  assert_true(logger_set_data_format(LOGGER_DATA_HEX) > 0);
+  logger_data(LOGGER_INFO,"\x01\x02\xfe",3,"packet");
+  assert_string_equal(tests_output_simple,"packet (3 bytes) 0102fe");
+  assert_true(logger_set_data_format(LOGGER_DATA_HEXDUMP) > 0);
+  logger_data(LOGGER_INFO,bytes,2,(void*)0);
+  assert_string_equal(tests_output_simple," (2 bytes)\n00000000  68 65                                             |he|");
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_data(LOGGER_DEBUG + 1,bytes,2,"invalid");
+  assert_string_equal(tests_output_simple,"");
+
+  /* Zero copy on the synchronous path */
+  tests_data_sink sink = {0};
+  assert_true(logger_set_data_callback(&sink,tests_data_output) > 0);
+  logger_data(LOGGER_WARNING,random,sizeof(random),"frame");
+  assert_true(sink.calls == 1);
+  assert_true(sink.data == random);
+  assert_true(sink.length == sizeof(random));
+  assert_true(sink.log_level == LOGGER_WARNING);
+  assert_string_equal(sink.label,"frame");
+  /* One copy on the asynchronous path, small and large payloads */
+  unsigned char *large = malloc(LOGGER_MESSAGE_BUFFER * 4);
+  assert_true(large != (void*)0);
+  memset(large,0xab,LOGGER_MESSAGE_BUFFER * 4);
+  assert_true(logger_setup_async(4,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  logger_data(LOGGER_INFO,random,16,"small");
+  logger_data(LOGGER_INFO,large,LOGGER_MESSAGE_BUFFER * 4,"large");
+  assert_true(logger_stop_async() > 0);
+  assert_true(sink.calls == 3);
+  assert_true(sink.data != large);
+  assert_true(sink.length == LOGGER_MESSAGE_BUFFER * 4);
+  assert_true(sink.payload[63] == 0xab);
+  assert_string_equal(sink.label,"large");
+  free(large);
+
+  /* Replacing the data file keeps the pipeline, records queued before reach the previous file */
+  assert_true(logger_setup_async(64,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  assert_true(logger_factory_data_file("./logger_tests_data.bin") > 0);
+  for(size_t index = 0;index < 100;index++) {
+    logger_data(LOGGER_INFO,random,16,"frame");
+  }
+  assert_true(logger_factory_data_file("./logger_tests_data.2.bin") > 0);
+  assert_true(Logger.queue != (void*)0);
+  logger_data(LOGGER_INFO,random,16,"frame");
+  assert_true(logger_stop_async() > 0);
+  struct stat data_stat;
+  assert_true(stat("./logger_tests_data.bin",&data_stat) == 0);
+  assert_true((size_t)data_stat.st_size == 100 * (sizeof(logger_data_header) + strlen(__FILE__) + 5 + 16));
+  logger_factory_data_file_exit();
+  assert_true(stat("./logger_tests_data.2.bin",&data_stat) == 0);
+  assert_true((size_t)data_stat.st_size == sizeof(logger_data_header) + strlen(__FILE__) + 5 + 16);
+  remove("./logger_tests_data.bin");
+  remove("./logger_tests_data.2.bin");
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+  assert_true(logger_set_data_callback((void*)0,(void*)0) > 0);
+}
+
+static int tests_backtrace_frames = 0;
+
+static int
+tests_backtrace_output(void const * const custom_object,char const * const message) {
+  void * const *frames = (void*)0;
+  tests_backtrace_frames = logger_current_backtrace(&frames);
+  assert_true(tests_backtrace_frames == 0 || frames != (void*)0);
+  return tests_init_output(custom_object,message);
+}
+
+__attribute__((noinline))
+static void
+tests_backtrace_caller(int const log_level) {
+  logger_log(log_level,__FILE__,__LINE__,"traced %d",log_level);
+}
+
+static void
+tests_backtrace_check(void **state) {
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_backtrace_output,tests_long_transform,true) > 0);
+  assert_true(logger_set_backtrace(LOGGER_DEBUG + 1,4) <= 0);
+  assert_true(logger_set_backtrace(LOGGER_ERROR,0) <= 0);
+  assert_true(logger_set_backtrace(LOGGER_ERROR,4) > 0);
+  /* Below the threshold no trace */
+  tests_backtrace_caller(LOGGER_WARNING);
+  assert_string_equal(tests_output_simple,"traced 4");
+  assert_true(tests_backtrace_frames == 0);
+  /*
+  The first frame is the caller of logger_log(), resolved from .symtab.
+  With optimizations logger_log() may be inlined into the caller, which
+  then is skipped as well.
+  */
+  tests_backtrace_caller(LOGGER_ERROR);
+  assert_true(tests_backtrace_frames > 0 && tests_backtrace_frames <= 4);
+  assert_true(strncmp(tests_output_simple,"traced 3\n  #0 tests_backtrace_c",31) == 0);
+  assert_true(strstr(tests_output_simple," tests_backtrace_check+0x") != (void*)0);
+  /* Same on the writer thread */
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  assert_true(logger_setup_async(4,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  tests_backtrace_caller(LOGGER_CRITICAL);
+  assert_true(logger_stop_async() > 0);
+  assert_true(strstr(tests_output_simple," tests_backtrace_check+0x") != (void*)0);
+  /* Unknown addresses are printed as they are */
+  char text[64];
+  assert_true(logger_symbolize((void *)0x10,text,sizeof(text)) == 4);
+  assert_string_equal(text,"0x10");
+  assert_true(logger_set_backtrace(-1,0) > 0);
+  tests_backtrace_caller(LOGGER_ERROR);
+  assert_string_equal(tests_output_simple,"traced 3");
+}
+
+static void
+tests_instances_check(void **state) {
+  char first_output[LOGGER_MESSAGE_BUFFER] = {0};
+  char second_output[LOGGER_MESSAGE_BUFFER] = {0};
+  assert_true(logger_create(LOGGER_DEBUG + 1,first_output,tests_init_output,tests_long_transform,true) == (void*)0);
+  assert_true(logger_create(LOGGER_DEBUG,first_output,(void*)0,tests_long_transform,true) == (void*)0);
+  logger_t *first = logger_create(LOGGER_INFO,first_output,tests_init_output,tests_long_transform,true);
+  logger_t *second = logger_create(LOGGER_ERROR,second_output,tests_init_output,tests_long_transform,true);
+  assert_true(first != (void*)0 && second != (void*)0);
+  /* Each instance starts on its own cache line */
+  assert_true((uintptr_t)first % LOGGER_CACHE_LINE == 0 && (uintptr_t)second % LOGGER_CACHE_LINE == 0);
+  assert_true(sizeof(logging_context) % LOGGER_CACHE_LINE == 0);
+  assert_true(logger_default() == &Logger);
+  /* Levels and sinks are separate, the default instance is untouched */
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_long_transform,true) > 0);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_info_to(first,"first %d",1);
+  logger_info_to(second,"second %d",2);
+  assert_string_equal(first_output,"first 1");
+  assert_string_equal(second_output,"");
+  assert_string_equal(tests_output_simple,"");
+  logger_error_to(second,"second %d",3);
+  logger_debug("default");
+  assert_string_equal(second_output,"second 3");
+  assert_string_equal(first_output,"first 1");
+  assert_string_equal(tests_output_simple,"default");
+  assert_true(logger_is_enabled_to(first,LOGGER_DEBUG) == false);
+  assert_true(logger_set_loglevel_to(first,LOGGER_DEBUG) > 0);
+  assert_true(logger_is_enabled_to(first,LOGGER_DEBUG) == true);
+  assert_true(logger_is_enabled_to(second,LOGGER_DEBUG) == false);
+  logger_toggle_to(second,false);
+  assert_true(logger_get_status_to(second) == false);
+  assert_true(logger_get_status() == true);
+  /* Asynchronous pipeline per instance */
+  assert_true(logger_setup_async_to(first,8,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  assert_true(logger_setup_async_to(first,8,LOGGER_BACKPRESSURE_BLOCK,-1) <= 0);
+  logger_debug_to(first,"queued %d",4);
+  assert_true(logger_stop_async_to(first) > 0);
+  assert_string_equal(first_output,"queued 4");
+  logger_stats stats;
+  assert_true(logger_get_stats_to(first,&stats) > 0);
+  assert_true(stats.sequence == 2);
+  /* Destroy stops a running pipeline, invalid handles are ignored */
+  assert_true(logger_setup_async_to(first,8,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  logger_info_to(first,"last");
+  logger_destroy(first);
+  assert_string_equal(first_output,"last");
+  logger_destroy(second);
+  logger_destroy((void*)0);
+  logger_destroy(logger_default());
+  assert_true(logger_instances == (void*)0);
+  logger_info_to((void*)0,"nowhere");
+  assert_true(logger_is_enabled_to((void*)0,LOGGER_EMERGENCY) == false);
+}
+
+static void
+tests_gate_check(void **state) {
+  /* The gate has a line of its own, the counters start on another one */
+  assert_true(offsetof(logging_context,gate) == 0);
+  assert_true(offsetof(logging_context,log_level) == LOGGER_CACHE_LINE);
+  assert_true(offsetof(logging_context,sequence) % LOGGER_CACHE_LINE == 0);
+  assert_true(offsetof(logging_context,sequence) > offsetof(logging_context,next_instance));
+  assert_true(logger_setup_context(LOGGER_WARNING,tests_output_simple,tests_init_output,tests_long_transform,true) > 0);
+  assert_true(atomic_load(&Logger.gate) == LOGGER_WARNING + 1);
+  assert_true(logger_is_enabled(LOGGER_WARNING) == true);
+  assert_true(logger_is_enabled(LOGGER_NOTICE) == false);
+  assert_true(logger_is_enabled(-1) == false);
+  logger_toggle(false);
+  assert_true(atomic_load(&Logger.gate) == 0);
+  assert_true(logger_is_enabled(LOGGER_EMERGENCY) == false);
+  logger_toggle(true);
+  /* A log level above LOGGER_DEBUG is capped, invalid levels still do not pass */
+  assert_true(logger_set_loglevel(LOGGER_DEBUG + 2) > 0);
+  assert_true(logger_is_enabled(LOGGER_DEBUG) == true);
+  assert_true(logger_is_enabled(LOGGER_DEBUG + 1) == false);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_log(LOGGER_DEBUG + 1,__FILE__,__LINE__,"invalid");
+  logger_log(-1,__FILE__,__LINE__,"invalid");
+  assert_string_equal(tests_output_simple,"");
+  logger_debug("valid");
+  assert_string_equal(tests_output_simple,"valid");
+}
+
+static size_t tests_config_count = 0;
+
+static int
+tests_config_output(void const * const custom_object,char const * const message) {
+  tests_config_count++;
+  return tests_init_output(custom_object,message);
+}
+
+/* Replaces the file through a rename like most editors do */
+static void
+tests_config_write(char const * const content) {
+  FILE *file = fopen("./logger_tests_config.tmp","w");
+  assert_true(file != (void*)0);
+  fputs(content,file);
+  fclose(file);
+  assert_true(rename("./logger_tests_config.tmp","./logger_tests_config.conf") == 0);
+}
+
+/* Waits until the watcher thread has seen events reloads + rejections in total */
+static void
+tests_config_wait(uint64_t const events) {
+  struct timespec started,now;
+  clock_gettime(CLOCK_MONOTONIC,&started);
+  logger_stats stats = {0};
+  do {
+    assert_true(logger_get_stats(&stats) > 0);
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    assert_true(now.tv_sec - started.tv_sec < 5);
+  } while(stats.config_reloads + stats.config_rejected < events);
+}
+
+static void
+tests_config_check(void **state) {
+  assert_true(logger_setup_context(LOGGER_ERROR,tests_output_simple,tests_config_output,tests_long_transform,true) > 0);
+  assert_true(logger_watch_config((void*)0) <= 0);
+  assert_true(logger_watch_config("./logger_tests_config.missing") <= 0);
+  tests_config_write("# initial\nlevel = warning\nlevel.net/ = debug # comment\nlevel.net/tls/ = 3\n\nsample.info = 3\n");
+  assert_true(logger_watch_config("./logger_tests_config.conf") > 0);
+  assert_true(logger_watch_config("./logger_tests_config.conf") <= 0);
+  /* Base level, module prefixes (the longest wins) and sampling */
+  assert_true(logger_is_enabled(LOGGER_DEBUG) == true);
+  tests_config_count = 0;
+  logger_log(LOGGER_NOTICE,"app/main.c",1,"filtered");
+  logger_log(LOGGER_WARNING,"app/main.c",2,"base");
+  assert_string_equal(tests_output_simple,"base");
+  logger_log(LOGGER_DEBUG,"net/socket.c",3,"module");
+  assert_string_equal(tests_output_simple,"module");
+  logger_log(LOGGER_WARNING,"net/tls/handshake.c",4,"longest prefix");
+  assert_string_equal(tests_output_simple,"module");
+  assert_true(tests_config_count == 2);
+  for(int index = 0;index < 9;index++) {
+    logger_log(LOGGER_INFO,"net/socket.c",5,"sampled %d",index);
+  }
+  assert_true(tests_config_count == 5);
+  /* Reload with a sink, then an invalid file that must not change anything */
+  tests_config_write("level = info\nsink = ./logger_tests_config.log\n");
+  tests_config_wait(3);
+  assert_true(logger_is_enabled(LOGGER_DEBUG) == false);
+  logger_info("to the sink");
+  assert_true(tests_config_count == 5);
+  tests_config_write("level = info\nlevel.net/ = verbose\n");
+  tests_config_wait(4);
+  tests_config_write("level = info\nunknown = 1\n");
+  tests_config_wait(5);
+  tests_config_write("sink = ./logger_tests_config_missing/sink.log\n");
+  tests_config_wait(6);
+  logger_stats stats;
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.config_reloads == 2 && stats.config_rejected == 4);
+  logger_info("still to the sink");
+  assert_true(tests_config_count == 5);
+  assert_true(logger_unwatch_config() > 0);
+  assert_true(logger_unwatch_config() <= 0);
+  /* Without the file the setup values apply again */
+  assert_true(logger_is_enabled(LOGGER_WARNING) == false);
+  logger_error("output again");
+  assert_string_equal(tests_output_simple,"output again");
+  char content[128] = {0};
+  FILE *sink = fopen("./logger_tests_config.log","r");
+  assert_true(sink != (void*)0);
+  assert_true(fread(content,1,sizeof(content) - 1,sink) > 0);
+  fclose(sink);
+  assert_string_equal(content,"to the sinkstill to the sink");
+  remove("./logger_tests_config.log");
+  remove("./logger_tests_config.conf");
+}
+
+static int tests_sites_line = 0;
+
+__attribute__((noinline))
+static void
+tests_sites_caller(int const value) {
+  tests_sites_line = __LINE__ + 1;
+  logger_debug("site one %d",value);
+  logger_debug("site two %d",value);
+}
+
+static void
+tests_sites_check(void **state) {
+  assert_true(logger_setup_context(LOGGER_INFO,tests_output_simple,tests_init_output,tests_long_transform,true) > 0);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  tests_sites_caller(1);
+  assert_string_equal(tests_output_simple,"");
+  /* Format substring, both states */
+  assert_true(logger_site_control("format \"site two\" +p") == 1);
+  tests_sites_caller(2);
+  assert_string_equal(tests_output_simple,"site two 2");
+  assert_true(logger_is_enabled(LOGGER_DEBUG) == false);
+  assert_true(logger_site_control("format \"site two\" -p") == 1);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  tests_sites_caller(3);
+  assert_string_equal(tests_output_simple,"");
+  /* File glob against the path or its last component, line ranges */
+  char query[128];
+  snprintf(query,sizeof(query),"file *logger.c line %d +p",tests_sites_line);
+  assert_true(logger_site_control(query) == 1);
+  tests_sites_caller(4);
+  assert_string_equal(tests_output_simple,"site one 4");
+  snprintf(query,sizeof(query),"file logger.c line %d-%d -p",tests_sites_line,tests_sites_line + 1);
+  assert_true(logger_site_control(query) == 2);
+  assert_true(logger_site_control("file nothing.c +p") == 0);
+  /* Every macro use is registered */
+  int const sites = logger_site_control("+p");
+  assert_true(sites > 20);
+  assert_true(logger_site_control("-p") == sites);
+  /* Invalid queries */
+  assert_true(logger_site_control((void*)0) < 0);
+  assert_true(logger_site_control("file logger.c") < 0);
+  assert_true(logger_site_control("line x-1 +p") < 0);
+  assert_true(logger_site_control("line 9-1 +p") < 0);
+  assert_true(logger_site_control("format \"open +p") < 0);
+  assert_true(logger_site_control("level debug +p") < 0);
+  /* Silent stays silent */
+  assert_true(logger_site_control("format \"site one\" +p") == 1);
+  logger_toggle(false);
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  tests_sites_caller(5);
+  assert_string_equal(tests_output_simple,"");
+  logger_toggle(true);
+  /* Queries from the config file, invalid ones reject the file */
+  tests_config_write("site = format \"site one\" -p\nsite = format \"site two\" +p\n");
+  assert_true(logger_watch_config("./logger_tests_config.conf") > 0);
+  tests_sites_caller(6);
+  assert_string_equal(tests_output_simple,"site two 6");
+  assert_true(logger_unwatch_config() > 0);
+  tests_config_write("site = line 1-2\n");
+  assert_true(logger_watch_config("./logger_tests_config.conf") <= 0);
+  assert_true(logger_site_control("-p") == sites);
+  remove("./logger_tests_config.conf");
+}
+
+/* Number of lines in file_path that contain text */
+static int
+tests_fork_count(char const * const file_path,char const * const text) {
+  FILE *stream = fopen(file_path,"r");
+  if(stream == (void*)0) {return -1;}
+  char line[LOGGER_MESSAGE_BUFFER];
+  int count = 0;
+  while(fgets(line,sizeof(line),stream) != (void*)0) {
+    if(strstr(line,text) != (void*)0) {count++;}
+  }
+  fclose(stream);
+  return count;
+}
+
+typedef struct {
+  pid_t parent;
+  _Atomic bool stop;
+  _Atomic size_t written;
+  _Atomic size_t inherited;
+  _Atomic size_t child;
+} tests_fork_sink;
+
+/* About 20 us per record, a thread that keeps logging keeps the queue full */
+static int
+tests_fork_output(void const * const custom_object,char const * const message) {
+  tests_fork_sink *sink = (tests_fork_sink *)custom_object;
+  int64_t const until = logger_monotonic_ns() + 20000;
+  while(logger_monotonic_ns() < until) {}
+  if(strstr(message,"child") != (void*)0) {
+    atomic_fetch_add(&sink->child,1);
+  } else if(getpid() != sink->parent) {
+    atomic_fetch_add(&sink->inherited,1);
+  } else {
+    atomic_fetch_add(&sink->written,1);
+  }
+  return 1;
+}
+
+static void *
+tests_fork_logging_thread(void *custom_object) {
+  tests_fork_sink *sink = custom_object;
+  for(size_t index = 0;atomic_load(&sink->stop) == false;index++) {
+    logger_info("busy parent %zu",index);
+  }
+  return (void*)0;
+}
+
+static void
+tests_fork_check(void **state) {
+  assert_true(logger_factory_file(LOGGER_DEBUG,"./logger_tests_fork.log") > 0);
+  assert_true(logger_setup_async(64,LOGGER_BACKPRESSURE_BLOCK,0) > 0);
+  for(int index = 0;index < 20;index++) {
+    logger_info("parent before fork %d",index);
+  }
+  /* Queue and stdio buffers are empty in the child, it writes only its own lines */
+  pid_t child = fork();
+  assert_true(child >= 0);
+  if(child == 0) {
+    logger_info("child after fork");
+    logger_stop_async();
+    _exit(0);
+  }
+  int status = 0;
+  assert_true(waitpid(child,&status,0) == child);
+  assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  logger_info("parent after fork");
+  /* With reopening the child writes to a file of its own */
+  logger_set_fork_reopen(true);
+  child = fork();
+  assert_true(child >= 0);
+  if(child == 0) {
+    logger_info("reopened child");
+    logger_stop_async();
+    _exit(0);
+  }
+  assert_true(waitpid(child,&status,0) == child);
+  assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  logger_set_fork_reopen(false);
+  logger_info("parent at the end");
+  assert_true(logger_stop_async() > 0);
+  fflush(logger_factory_file_file);
+  char reopened[64];
+  snprintf(reopened,sizeof(reopened),"./logger_tests_fork.log.%ld",(long)child);
+  assert_true(tests_fork_count("./logger_tests_fork.log","parent before fork") == 20);
+  assert_true(tests_fork_count("./logger_tests_fork.log","parent before fork 19") == 1);
+  assert_true(tests_fork_count("./logger_tests_fork.log","child after fork") == 1);
+  assert_true(tests_fork_count("./logger_tests_fork.log","parent after fork") == 1);
+  assert_true(tests_fork_count("./logger_tests_fork.log","reopened child") == 0);
+  assert_true(tests_fork_count("./logger_tests_fork.log","parent at the end") == 1);
+  assert_true(tests_fork_count(reopened,"reopened child") == 1);
+  assert_true(tests_fork_count(reopened,"parent") == 0);
+  fclose(logger_factory_file_file);
+  logger_factory_file_file = (void*)0;
+  remove("./logger_tests_fork.log");
+  remove(reopened);
+
+  /* A thread that keeps logging does not hold up the fork, the child drops what the parent queued */
+  tests_fork_sink sink = {.parent = getpid()};
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_fork_output,tests_init_transform,true) > 0);
+  assert_true(logger_setup_async(1024,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  pthread_t thread;
+  assert_true(pthread_create(&thread,(void*)0,tests_fork_logging_thread,&sink) == 0);
+  for(int round = 0;round < 3;round++) {
+    while(atomic_load(&sink.written) < (size_t)(round + 1) * 100) {}
+    child = fork();
+    assert_true(child >= 0);
+    if(child == 0) {
+      logger_info("child %d",round);
+      logger_stop_async();
+      _exit(atomic_load(&sink.inherited) == 0 && atomic_load(&sink.child) == 1 ? 0 : 1);
+    }
+    assert_true(waitpid(child,&status,0) == child);
+    assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  atomic_store(&sink.stop,true);
+  assert_true(pthread_join(thread,(void*)0) == 0);
+  assert_true(logger_stop_async() > 0);
+  assert_true(atomic_load(&sink.child) == 0 && atomic_load(&sink.inherited) == 0);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static void *
+tests_pool_free_thread(void *custom_object) {
+  logger_pool_free(custom_object);
+  return (void*)0;
+}
+
+static void
+tests_pool_check(void **state) {
+  logger_stats before;
+  logger_stats stats;
+  assert_true(logger_get_stats(&before) > 0);
+  assert_true(before.pool_cap == LOGGER_POOL_CAP);
+  /* A freed chunk goes back to the cache of this thread */
+  char *chunk = logger_pool_alloc(5000);
+  assert_true(chunk != (void*)0);
+  memset(chunk,0x5a,8192);
+  logger_pool_free(chunk);
+  assert_true(logger_pool_alloc(8192) == chunk);
+  /* Chunks freed by another thread reach the shared lists once it exits */
+  pthread_t thread;
+  assert_true(pthread_create(&thread,(void*)0,tests_pool_free_thread,chunk) == 0);
+  pthread_join(thread,(void*)0);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.pool_returns > before.pool_returns);
+  assert_true(stats.pool_reserved >= LOGGER_POOL_SLAB);
+  assert_true(stats.pool_available <= stats.pool_reserved);
+  /* Long messages and payloads of queued records */
+  tests_long_sink sink = {.length = 0};
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_long_output,tests_long_transform,true) > 0);
+  assert_true(logger_setup_async(16,LOGGER_BACKPRESSURE_DROP_NEWEST,0) > 0);
+  char long_message[3 * LOGGER_MESSAGE_BUFFER];
+  memset(long_message,'x',sizeof(long_message) - 1);
+  long_message[sizeof(long_message) - 1] = '\0';
+  static char payload[LOGGER_POOL_CLASS_MAX + 1];
+  logger_info("%s",long_message);
+  assert_true(logger_sync(-1) > 0);
+  assert_true(sink.length == sizeof(long_message) - 1);
+  logger_data(LOGGER_INFO,payload,16384,"pooled");
+  logger_data(LOGGER_INFO,payload,sizeof(payload),"large");
+  assert_true(logger_sync(-1) > 0);
+  assert_true(sink.calls == 3);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.pool_large == before.pool_large + 1);
+  assert_true(stats.pool_exhausted == before.pool_exhausted);
+  /* Over the cap payloads are dropped, also when blocking with nothing queued */
+  assert_true(logger_set_memory_cap(0) > 0);
+  logger_data(LOGGER_INFO,payload,sizeof(payload),"over the cap");
+  assert_true(logger_set_backpressure(LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  logger_data(LOGGER_INFO,payload,sizeof(payload),"still over the cap");
+  assert_true(logger_sync(-1) > 0);
+  assert_true(sink.calls == 3);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.pool_cap == 0);
+  assert_true(stats.pool_exhausted == before.pool_exhausted + 2);
+  assert_true(stats.dropped[LOGGER_INFO] == before.dropped[LOGGER_INFO] + 2);
+  assert_true(logger_set_memory_cap(LOGGER_POOL_CAP) > 0);
+  assert_true(logger_stop_async() > 0);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static void
+tests_memory_check(void **state) {
+  logger_stats before;
+  logger_stats stats;
+  assert_true(logger_set_memory_options(0x100) < 1);
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_init_transform,true) > 0);
+  assert_true(logger_get_stats(&before) > 0);
+  /* Every option falls back quietly if the system lacks it */
+  int const options[] = {
+    0,
+    LOGGER_MEMORY_PREFAULT,
+    LOGGER_MEMORY_PREFAULT | LOGGER_MEMORY_THP | LOGGER_MEMORY_LOCK,
+    LOGGER_MEMORY_PREFAULT | LOGGER_MEMORY_HUGETLB
+  };
+  for(size_t index = 0;index < sizeof(options) / sizeof(options[0]);index++) {
+    assert_true(logger_set_memory_options(options[index]) > 0);
+    assert_true(logger_setup_async(256,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+    assert_true(logger_get_stats(&stats) > 0);
+    assert_true(stats.memory_mapped >= before.memory_mapped + 257 * sizeof(logging_record));
+    assert_true(stats.memory_huge <= stats.memory_mapped);
+    assert_true(stats.memory_locked <= stats.memory_mapped);
+    if((options[index] & LOGGER_MEMORY_LOCK) == 0) {assert_true(stats.memory_locked == before.memory_locked);}
+    memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+    logger_info("mapped %zu",index);
+    assert_true(logger_stop_async() > 0);
+    assert_true(strstr(tests_output_simple,"mapped") != (void*)0);
+    assert_true(logger_get_stats(&stats) > 0);
+    assert_true(stats.memory_mapped == before.memory_mapped);
+    assert_true(stats.memory_huge == before.memory_huge);
+    assert_true(stats.memory_locked == before.memory_locked);
+  }
+  assert_true(logger_set_memory_options(LOGGER_MEMORY_PREFAULT) > 0);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+/* Makes every CPU look like part of the node of shard */
+static void
+tests_numa_route(size_t const shard) {
+  for(size_t cpu = 0;cpu < LOGGER_NUMA_CPUS;cpu++) {
+    logger_numa.cpu_shard[cpu] = (uint8_t)shard;
+  }
+}
+
+static void
+tests_numa_check(void **state) {
+  tests_priority_sink sink = {.count = 0};
+  logger_stats stats;
+  pthread_mutex_init(&sink.gate,(void*)0);
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_priority_output,tests_init_transform,true) > 0);
+  assert_true(logger_set_flush_callback(tests_priority_flush) > 0);
+  assert_true(logger_set_numa(0x100) < 1);
+  /* Two shards on any host: a second node with the CPUs and memory of the first */
+  logging_numa const saved = *logger_numa_topology();
+  logger_numa.count = 2;
+  logger_numa.node[1] = logger_numa.node[0];
+#ifdef LOGGER_HAS_AFFINITY
+  logger_numa.cpus[1] = logger_numa.cpus[0];
+#endif
+  assert_true(logger_set_numa(LOGGER_NUMA_SHARDS | LOGGER_NUMA_BIND | LOGGER_NUMA_PIN) == 2);
+  /* The writers stall on the gate while the records alternate between the shards */
+  pthread_mutex_lock(&sink.gate);
+  assert_true(logger_setup_async(8,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 12;index++) {
+    tests_numa_route(index / 3 % 2);
+    logger_info("sharded %zu",index);
+  }
+  tests_numa_route(1);
+  logger_critical("not merged");
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.queue_shards == 2);
+  assert_true(stats.queue_capacity == 16);
+  assert_true(stats.queued == 13);
+  pthread_mutex_unlock(&sink.gate);
+  assert_true(logger_sync(-1) > 0);
+  assert_true(sink.count == 13);
+  /* One durable flush for the priority record and one per shard for the barrier */
+  assert_true(sink.durable_flushes == 3);
+  /* Normal records are merged in sequence order */
+  uint64_t previous = 0;
+  for(size_t index = 0;index < sink.count;index++) {
+    if(sink.priority[index]) {continue;}
+    assert_true(sink.sequences[index] > previous);
+    previous = sink.sequences[index];
+  }
+  uint64_t lost = 0;
+  assert_true(logger_shutdown(-1,&lost) > 0);
+  assert_true(lost == 0);
+  assert_true(logger_stop_async() > 0);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.written == 13);
+  assert_true(stats.queue_shards == 0);
+  logger_toggle(true);
+  logger_numa = saved;
+  assert_true(logger_set_numa(0) == 1);
+  pthread_mutex_destroy(&sink.gate);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static void
+tests_threads_check(void **state) {
+  tests_priority_sink sink = {.count = 0};
+  pthread_mutex_init(&sink.gate,(void*)0);
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_priority_output,tests_init_transform,true) > 0);
+  assert_true(logger_set_thread_scheduling(42,0) < 1);
+  assert_true(logger_set_thread_scheduling(LOGGER_SCHED_BATCH,20) < 1);
+  assert_true(logger_set_writer_wait(42,0) < 1);
+#ifdef LOGGER_HAS_AFFINITY
+  assert_true(logger_set_thread_affinity("0-") < 1);
+  assert_true(logger_set_thread_affinity("") < 1);
+  assert_true(logger_set_thread_affinity("0") > 0);
+#endif
+  assert_true(logger_set_thread_scheduling(LOGGER_SCHED_BATCH,5) > 0);
+  assert_true(logger_set_thread_name("tests-writer-thread") > 0);
+  assert_true(logger_set_writer_wait(LOGGER_WAIT_SPIN,500) > 0);
+  assert_true(logger_setup_async(16,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 5;index++) {
+    logger_info("spun %zu",index);
+    assert_true(logger_sync(-1) > 0);
+  }
+  assert_true(sink.count == 5);
+#ifdef LOGGER_HAS_AFFINITY
+  /* The writer applied the settings before it wrote anything */
+  pthread_t const writer = Logger.queue->writer;
+  char name[16];
+  assert_true(pthread_getname_np(writer,name,sizeof(name)) == 0);
+  assert_string_equal(name,"tests-writer-th");
+  int policy;
+  struct sched_param parameter;
+  assert_true(pthread_getschedparam(writer,&policy,&parameter) == 0);
+  assert_true(policy == SCHED_BATCH);
+  cpu_set_t cpus;
+  assert_true(pthread_getaffinity_np(writer,sizeof(cpus),&cpus) == 0);
+  assert_true(CPU_COUNT(&cpus) == 1 && CPU_ISSET(0,&cpus));
+#endif
+  /* A writer that never sleeps still notices records and the stop */
+  assert_true(logger_set_writer_wait(LOGGER_WAIT_SPIN,-1) > 0);
+  logger_info("spinning");
+  assert_true(logger_sync(-1) > 0);
+  assert_true(logger_stop_async() > 0);
+  assert_true(sink.count == 6);
+  assert_true(logger_set_writer_wait(LOGGER_WAIT_BLOCK,0) > 0);
+  assert_true(logger_set_thread_affinity((void*)0) > 0);
+  assert_true(logger_set_thread_scheduling(LOGGER_SCHED_INHERIT,0) > 0);
+  assert_true(logger_set_thread_name((void*)0) > 0);
+  /* Back to leaving the scheduling of later threads alone */
+  Logger.threads.has_scheduling = false;
+  pthread_mutex_destroy(&sink.gate);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+typedef struct {
+  pthread_mutex_t gate;
+  _Atomic size_t written;
+  _Atomic size_t flushed;
+  _Atomic size_t flushes;
+  int64_t cost_ns;
+} tests_flush_sink;
+
+static int
+tests_flush_output(void const * const custom_object,char const * const message) {
+  tests_flush_sink *sink = (tests_flush_sink *)custom_object;
+  pthread_mutex_lock(&sink->gate);
+  atomic_fetch_add(&sink->written,1);
+  pthread_mutex_unlock(&sink->gate);
+  return 1;
+}
+
+/* A sink whose flushes take cost_ns */
+static int
+tests_flush_flush(void const * const custom_object,bool const durable) {
+  tests_flush_sink *sink = (tests_flush_sink *)custom_object;
+  int64_t const started = logger_monotonic_ns();
+  while(logger_monotonic_ns() - started < sink->cost_ns) {}
+  atomic_store(&sink->flushed,atomic_load(&sink->written));
+  if(durable == false) {atomic_fetch_add(&sink->flushes,1);}
+  return 1;
+}
+
+static void
+tests_flush_check(void **state) {
+  tests_flush_sink sink = {.cost_ns = 0};
+  pthread_mutex_init(&sink.gate,(void*)0);
+  logger_stats stats;
+  assert_true(logger_setup_context(LOGGER_DEBUG,&sink,tests_flush_output,tests_init_transform,true) > 0);
+  assert_true(logger_set_flush_callback(tests_flush_flush) > 0);
+  assert_true(logger_set_flush_latency(-1,64) < 1);
+  assert_true(logger_set_flush_latency(1000,0) < 1);
+  /* Fixed batches: full ones and the rest once the lane ran empty */
+  assert_true(logger_set_flush_latency(0,4) > 0);
+  pthread_mutex_lock(&sink.gate);
+  assert_true(logger_setup_async(16,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 10;index++) {
+    logger_info("fixed %zu",index);
+  }
+  pthread_mutex_unlock(&sink.gate);
+  assert_true(logger_sync(-1) > 0);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.flushes == 3);
+  assert_true(stats.flush_batch == 4);
+  assert_true(stats.flush_delay_ns == 0);
+  assert_true(logger_stop_async() > 0);
+  /* Sparse records are flushed one by one without waiting for more */
+  assert_true(logger_set_flush_latency(100000,64) > 0);
+  assert_true(logger_setup_async(256,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 5;index++) {
+    logger_info("sparse %zu",index);
+    int64_t const logged = logger_monotonic_ns();
+    while(atomic_load(&sink.flushed) < 11 + index && logger_monotonic_ns() - logged < 1000000000LL) {
+      nanosleep(&(struct timespec){.tv_nsec = 1000000},(void*)0);
+    }
+    assert_true(atomic_load(&sink.flushed) == 11 + index);
+    nanosleep(&(struct timespec){.tv_nsec = 5000000},(void*)0);
+  }
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(stats.flush_batch == 1);
+  assert_true(stats.flush_delay_ns == 0);
+  assert_true(stats.arrival_ns > 1000000);
+  assert_true(logger_stop_async() > 0);
+  /* Dense records to a slow sink are batched, within the bounds */
+  sink.cost_ns = 2000000;
+  atomic_store(&sink.flushes,0);
+  assert_true(logger_set_flush_latency(50000,32) > 0);
+  assert_true(logger_setup_async(256,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  for(size_t index = 0;index < 200;index++) {
+    logger_info("dense %zu",index);
+  }
+  assert_true(logger_sync(-1) > 0);
+  assert_true(logger_get_stats(&stats) > 0);
+  assert_true(atomic_load(&sink.flushes) < 20);
+  assert_true(stats.flush_batch > 1 && stats.flush_batch <= 32);
+  assert_true(stats.flush_delay_ns <= 50000000);
+  assert_true(stats.flush_cost_ns >= 1000000);
+  assert_true(logger_stop_async() > 0);
+  assert_true(atomic_load(&sink.written) == 215);
+  assert_true(logger_set_flush_latency(LOGGER_FLUSH_DELAY_US,LOGGER_BATCH_RECORDS) > 0);
+  pthread_mutex_destroy(&sink.gate);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+typedef struct {
+  _Atomic size_t written;
+  _Atomic size_t synced;
+  _Atomic size_t durable_flushes;
+  _Atomic size_t failures;
+} tests_durable_sink;
+
+/* Without the localtime() of tests_init_transform, the threads log synchronously */
+static char *
+tests_durable_transform(logger_time const * const timestamp,int const log_level,char const * const file,int const filenumber,char *message) {
+  return message;
+}
+
+static int
+tests_durable_output(void const * const custom_object,char const * const message) {
+  atomic_fetch_add(&((tests_durable_sink *)custom_object)->written,1);
+  return 1;
+}
+
+/* Durable flushes take 2 ms, like a disk */
+static int
+tests_durable_flush(void const * const custom_object,bool const durable) {
+  tests_durable_sink *sink = (tests_durable_sink *)custom_object;
+  if(durable) {
+    size_t const written = atomic_load(&sink->written);
+    nanosleep(&(struct timespec){.tv_nsec = 2000000},(void*)0);
+    atomic_store(&sink->synced,written);
+    atomic_fetch_add(&sink->durable_flushes,1);
+  }
+  return 1;
+}
+
+static void *
+tests_durable_thread(void *custom_object) {
+  tests_durable_sink *sink = (tests_durable_sink *)custom_object;
+  for(size_t index = 0;index < 20;index++) {
+    if(logger_durable(LOGGER_NOTICE,"audit %zu",index) < 1) {atomic_fetch_add(&sink->failures,1);}
+  }
+  return (void*)0;
+}
+
+static void
+tests_durability_check(void **state) {
+  tests_durable_sink sink = {.written = 0};
+  assert_true(logger_setup_context(LOGGER_INFO,&sink,tests_durable_output,tests_durable_transform,true) > 0);
+  assert_true(logger_set_flush_callback(tests_durable_flush) > 0);
+  assert_true(logger_set_durability(8,0) < 1);
+  assert_true(logger_set_durability(LOGGER_DURABILITY_INTERVAL,0) < 1);
+  for(int pipeline = 0;pipeline < 2;pipeline++) {
+    if(pipeline == 1) {assert_true(logger_setup_async(256,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);}
+    size_t const flushes = atomic_load(&sink.durable_flushes);
+    /* Returns once the record is synced, filtered records are not logged */
+    assert_true(logger_durable(LOGGER_INFO,"acknowledged") > 0);
+    assert_true(atomic_load(&sink.synced) == atomic_load(&sink.written));
+    assert_true(logger_durable(LOGGER_DEBUG,"filtered") == 0);
+    /* ERROR and above only wait with LOGGER_DURABILITY_ERROR */
+    logger_error("not durable");
+    assert_true(logger_set_durability(LOGGER_DURABILITY_ERROR,0) > 0);
+    logger_error("durable");
+    assert_true(atomic_load(&sink.synced) == atomic_load(&sink.written));
+    assert_true(atomic_load(&sink.durable_flushes) == flushes + 2);
+    assert_true(logger_set_durability(LOGGER_DURABILITY_NONE,0) > 0);
+    /* Concurrent callers share flushes */
+    pthread_t threads[8];
+    size_t const before = atomic_load(&sink.durable_flushes);
+    for(size_t index = 0;index < 8;index++) {
+      assert_true(pthread_create(&threads[index],(void*)0,tests_durable_thread,&sink) == 0);
+    }
+    for(size_t index = 0;index < 8;index++) {
+      pthread_join(threads[index],(void*)0);
+    }
+    assert_true(atomic_load(&sink.failures) == 0);
+    /* 160 calls, each flush serves two of them on average at least */
+    assert_true(atomic_load(&sink.durable_flushes) - before < 80);
+  }
+  /* An idle writer syncs what it wrote once the interval passed */
+  assert_true(logger_set_durability(LOGGER_DURABILITY_INTERVAL,20) > 0);
+  size_t const flushes = atomic_load(&sink.durable_flushes);
+  logger_info("synced later");
+  int64_t const logged = logger_monotonic_ns();
+  while(atomic_load(&sink.durable_flushes) == flushes && logger_monotonic_ns() - logged < 1000000000LL) {
+    nanosleep(&(struct timespec){.tv_nsec = 1000000},(void*)0);
+  }
+  assert_true(atomic_load(&sink.durable_flushes) > flushes);
+  assert_true(atomic_load(&sink.synced) == atomic_load(&sink.written));
+  assert_true(logger_stop_async() > 0);
+  assert_true(logger_set_durability(LOGGER_DURABILITY_NONE,0) > 0);
+  memset(&Logger.stats,0,sizeof(Logger.stats));
+}
+
+static char *
+tests_direct_transform(logger_time const * const timestamp,int const log_level,char const * const file,int const filenumber,char *message) {
+  size_t const length = strlen(message);
+  message[length] = '\n';
+  message[length + 1] = '\0';
+  return message;
+}
+
+/* Reads the whole file into a 0 terminated buffer */
+static char *
+tests_direct_read(char const * const path,size_t * const size) {
+  FILE * const stream = fopen(path,"rb");
+  assert_true(stream != (void*)0);
+  fseek(stream,0,SEEK_END);
+  *size = ftell(stream);
+  rewind(stream);
+  char * const content = malloc(*size + 1);
+  assert_true(fread(content,1,*size,stream) == *size);
+  content[*size] = '\0';
+  fclose(stream);
+  return content;
+}
+
+static void
+tests_direct_check(void **state) {
+  char const * const path = "./logger_tests_direct.log";
+  assert_true(logger_factory_direct_file(LOGGER_DEBUG,(void*)0) < 1);
+  assert_true(logger_factory_direct_file(LOGGER_DEBUG,path) > 0);
+  assert_true(logger_set_transform(tests_direct_transform) == 1);
+  /* A flush pads the tail block, the next one rewrites it */
+  char expected[64] = "";
+  for(int round = 0;round < 2;round++) {
+    logger_info("line %d",round);
+    strcat(expected,round == 0 ? "line 0\n" : "line 1\n");
+    assert_true(logger_sync(-1) > 0);
+    size_t size;
+    char * const content = tests_direct_read(path,&size);
+    assert_true(size == LOGGER_DIRECT_BLOCK);
+    assert_true(memcmp(content,expected,strlen(expected)) == 0);
+    for(size_t index = strlen(expected);index < size;index++) {
+      assert_true(content[index] == '\0');
+    }
+    free(content);
+  }
+  /* Enough for both buffers to be written a few times */
+  assert_true(logger_setup_async(1024,LOGGER_BACKPRESSURE_BLOCK,-1) > 0);
+  size_t total = strlen(expected);
+  for(int index = 2;index < 40000;index++) {
+    char line[128];
+    total += snprintf(line,sizeof(line),"line %d %s\n",index,"padding the record to about eighty bytes ........................");
+    logger_info("line %d %s",index,"padding the record to about eighty bytes ........................");
+  }
+  assert_true(logger_stop_async() > 0);
+  logger_factory_direct_file_exit();
+  assert_true(logger_factory_direct_file_sink == (void*)0);
+  /* Closed: cut to the real size, every line once and in order */
+  size_t size;
+  char * const content = tests_direct_read(path,&size);
+  assert_true(size == total);
+  assert_true(strlen(content) == size);
+  char const *line = content;
+  for(int index = 0;index < 40000;index++) {
+    assert_true(strncmp(line,"line ",5) == 0 && atoi(line + 5) == index);
+    line = strchr(line,'\n') + 1;
+  }
+  assert_true(*line == '\0');
+  free(content);
+  remove(path);
+}
+
+static void *
+tests_reader_append(void *argument) {
+  nanosleep(&(struct timespec){.tv_nsec = 50000000},(void*)0);
+  FILE * const stream = fopen((char const *)argument,"a");
+  fputs("1633035747.5,debug,x.c,1,waited\n",stream);
+  fclose(stream);
+  return (void*)0;
+}
+
+static void
+tests_reader_message(logger_record const * const record,char const * const message) {
+  assert_true(record->message_length == strlen(message));
+  assert_true(memcmp(record->message,message,record->message_length) == 0);
+}
+
+static void
+tests_reader_check(void **state) {
+  char const * const path = "./logger_tests_reader.csv";
+  char const * const rotated = "./logger_tests_reader.csv.1";
+  logger_record record;
+  remove(path);
+  remove(rotated);
+  assert_true(logger_reader_open((void*)0,LOGGER_READER_CSV) == (void*)0);
+  assert_true(logger_reader_open(path,7) == (void*)0);
+  assert_true(logger_reader_next((void*)0,&record,0) < 0);
+  /* Opened before the file exists */
+  logger_reader * const reader = logger_reader_open(path,LOGGER_READER_CSV);
+  assert_true(reader != (void*)0);
+  assert_true(logger_reader_descriptor(reader) >= 0);
+  assert_true(logger_reader_next(reader,&record,0) == 0);
+  FILE *stream = fopen(path,"a");
+  fputs("timestamp,priority,filename,linenumber,message\n1633035745.123456789,info,file.c,12,hello, world\n1633035746.000000001,err",stream);
+  fflush(stream);
+  assert_true(logger_reader_next(reader,&record,1000) == 1);
+  assert_true(record.segment == 0 && record.offset == 47);
+  assert_true(record.length == strlen("1633035745.123456789,info,file.c,12,hello, world"));
+  assert_true(record.seconds == 1633035745 && record.nanoseconds == 123456789);
+  assert_true(record.log_level == LOGGER_INFO && record.linenumber == 12);
+  assert_true(record.file_length == 6 && memcmp(record.file,"file.c",6) == 0);
+  tests_reader_message(&record,"hello, world");
+  /* Only complete records */
+  assert_true(logger_reader_next(reader,&record,0) == 0);
+  fputs("or,main.c,-1,second\n",stream);
+  fflush(stream);
+  assert_true(logger_reader_next(reader,&record,0) == 1);
+  assert_true(record.log_level == LOGGER_ERROR && record.linenumber == -1);
+  tests_reader_message(&record,"second");
+  /* Blocks until the writer appends */
+  pthread_t thread;
+  assert_true(pthread_create(&thread,(void*)0,tests_reader_append,(void *)path) == 0);
+  assert_true(logger_reader_next(reader,&record,-1) == 1);
+  pthread_join(thread,(void*)0);
+  assert_true(record.log_level == LOGGER_DEBUG && record.nanoseconds == 5);
+  tests_reader_message(&record,"waited");
+  /* Rotation: the old segment to its end, then the new file */
+  fputs("1633035748.0,info,x.c,2,last\nnot a csv line\n",stream);
+  fclose(stream);
+  assert_true(rename(path,rotated) == 0);
+  stream = fopen(path,"w");
+  fputs("1633035749.0,notice,y.c,3,first in the next segment\n",stream);
+  fclose(stream);
+  assert_true(logger_reader_next(reader,&record,1000) == 1);
+  assert_true(record.segment == 0);
+  tests_reader_message(&record,"last");
+  assert_true(logger_reader_next(reader,&record,1000) == 1);
+  assert_true(record.log_level == -1 && record.length == 14 && memcmp(record.record,"not a csv line",14) == 0);
+  assert_true(logger_reader_next(reader,&record,1000) == 1);
+  assert_true(record.segment == 1 && record.offset == 0 && record.log_level == LOGGER_NOTICE);
+  tests_reader_message(&record,"first in the next segment");
+  /* Cut below the read position */
+  stream = fopen(path,"w");
+  fputs("1.0,alert,z.c,4,x\n",stream);
+  fclose(stream);
+  assert_true(logger_reader_next(reader,&record,1000) == 1);
+  assert_true(record.segment == 2 && record.log_level == LOGGER_ALERT);
+  tests_reader_message(&record,"x");
+  assert_true(logger_reader_next(reader,&record,10) == 0);
+  logger_reader_close(reader);
+  remove(rotated);
+
+  /* Cut while records are unread (copytruncate), nothing past the end of the file is touched */
+  char line[128];
+  int const line_length = snprintf(line,sizeof(line),"1633035750.000000000,info,cut.c,%03d,a record long enough to spread the file over several pages\n",0);
+  stream = fopen(path,"w");
+  for(int index = 0;index < 200;index++) {
+    fprintf(stream,"1633035750.000000000,info,cut.c,%03d,a record long enough to spread the file over several pages\n",index);
+  }
+  fclose(stream);
+  logger_reader * const cut = logger_reader_open(path,LOGGER_READER_CSV);
+  assert_true(cut != (void*)0);
+  assert_true(logger_reader_next(cut,&record,0) == 1 && record.linenumber == 0);
+  assert_true(logger_reader_next(cut,&record,0) == 1 && record.linenumber == 1);
+  assert_true(truncate(path,5 * line_length + 10) == 0);
+  for(int index = 2;index < 5;index++) {
+    assert_true(logger_reader_next(cut,&record,0) == 1);
+    assert_true(record.segment == 0 && record.linenumber == index && record.offset == (uint64_t)(index * line_length));
+  }
+  assert_true(logger_reader_next(cut,&record,0) == 0);
+  /* Cut to nothing and written again */
+  assert_true(truncate(path,0) == 0);
+  assert_true(logger_reader_next(cut,&record,0) == 0);
+  stream = fopen(path,"a");
+  fputs("1.0,alert,z.c,4,after the cut\n",stream);
+  fclose(stream);
+  assert_true(logger_reader_next(cut,&record,1000) == 1);
+  assert_true(record.segment == 1 && record.offset == 0);
+  tests_reader_message(&record,"after the cut");
+  logger_reader_close(cut);
+
+  /* Data records as written by logger_factory_data_file() */
+  assert_true(logger_setup_context(LOGGER_DEBUG,tests_output_simple,tests_init_output,tests_init_transform,true) > 0);
+  assert_true(logger_factory_data_file(path) > 0);
+  logger_data(LOGGER_WARNING,"\x01\x02\x03",3,"skipped");
+  fflush(logger_factory_data_file_file);
+  logger_reader * const data = logger_reader_open(path,LOGGER_READER_DATA | LOGGER_READER_END);
+  assert_true(data != (void*)0);
+  assert_true(logger_reader_next(data,&record,0) == 0);
+  logger_data(LOGGER_CRITICAL,"\x04\x05",2,"frame");
+  assert_true(logger_reader_next(data,&record,1000) == 1);
+  assert_true(record.log_level == LOGGER_CRITICAL && record.sequence > 0 && record.seconds > 0);
+  assert_true(record.label_length == 5 && memcmp(record.label,"frame",5) == 0);
+  assert_true(record.file_length == strlen(__FILE__) && memcmp(record.file,__FILE__,record.file_length) == 0);
+  assert_true(record.message_length == 2 && memcmp(record.message,"\x04\x05",2) == 0);
+  assert_true(record.length == sizeof(logger_data_header) + record.file_length + 5 + 2);
+  logger_reader_close(data);
+  logger_factory_data_file_exit();
+  /* Not a data file */
+  logger_reader * const text = logger_reader_open(path,LOGGER_READER_DATA);
+  stream = fopen(path,"w");
+  fputs("plain text, long enough to be taken for a record header\n",stream);
+  fclose(stream);
+  assert_true(logger_reader_next(text,&record,1000) == -2);
+  logger_reader_close(text);
+  remove(path);
+}
+
+/* Reads the committed records like tools/loggerd.c and frees them */
+static size_t
+tests_shared_drain(logging_shared * const shared,size_t * const pads) {
+  size_t count = 0;
+  uint64_t const tail = __atomic_load_n(&shared->header->tail,__ATOMIC_RELAXED);
+  uint64_t const head = __atomic_load_n(&shared->header->head,__ATOMIC_ACQUIRE);
+  uint64_t cursor = tail;
+  while(cursor != head) {
+    logger_ring_record const * const record = (logger_ring_record const *)(shared->data + (cursor & shared->mask));
+    uint32_t const size = __atomic_load_n(&record->size,__ATOMIC_ACQUIRE);
+    if(size == 0) {break;}
+    if(size & LOGGER_RING_PAD) {
+      (*pads)++;
+    } else {
+      assert_true(record->file_length == strlen(__FILE__) && memcmp(record + 1,__FILE__,record->file_length) == 0);
+      assert_true(memcmp((char const *)(record + 1) + record->file_length,"record ",7) == 0);
+      assert_true(size % 8 == 0 && size >= sizeof(logger_ring_record) + record->file_length + record->message_length);
+      count++;
+    }
+    cursor += size & ~LOGGER_RING_PAD;
+  }
+  for(uint64_t position = tail;position < cursor;position++) {
+    shared->data[position & shared->mask] = 0;
+  }
+  __atomic_store_n(&shared->header->tail,cursor,__ATOMIC_RELEASE);
+  return count;
+}
+
+static void *
+tests_shared_producer(void *argument) {
+  for(int index = 0;index < 2000;index++) {
+    logger_info("record %d of thread %d",index,(int)(intptr_t)argument);
+  }
+  return (void*)0;
+}
+
+static void
+tests_shared_check(void **state) {
+  char const * const directory = "./logger_tests_shared";
+  size_t pads = 0;
+  assert_true(logger_factory_shared(LOGGER_DEBUG + 1,directory,0) < 1);
+  assert_true(logger_factory_shared(LOGGER_INFO,directory,5000) > 0);
+  logging_shared * const shared = logger_factory_shared_ring;
+  assert_true(shared != (void*)0 && Logger.shared == shared);
+  assert_true(memcmp(shared->header->magic,LOGGER_RING_MAGIC,4) == 0);
+  assert_true(shared->header->capacity == 8192 && shared->header->header_size == sizeof(logger_ring_header));
+  assert_true(shared->header->pid == getpid());
+  /* The process holds the ring as long as it lives */
+  int const descriptor = open(shared->path,O_RDWR);
+  assert_true(descriptor >= 0);
+  assert_true(flock(descriptor,LOCK_EX | LOCK_NB) != 0);
+
+  /* A raw record, no transform or output */
+  memset(tests_output_simple,0,LOGGER_MESSAGE_BUFFER);
+  logger_debug("record filtered");
+  logger_warning("record %d",1);
+  logger_ring_record const *record = (logger_ring_record const *)shared->data;
+  assert_true(record->size == ((sizeof(logger_ring_record) + strlen(__FILE__) + 8 + 7) & ~7u));
+  assert_true(record->log_level == LOGGER_WARNING && record->linenumber == __LINE__ - 3);
+  assert_true(record->sequence > 0 && record->seconds > 0);
+  assert_true(record->message_length == 8 && memcmp((char const *)(record + 1) + record->file_length,"record 1",8) == 0);
+  assert_true(shared->header->head == record->size);
+  assert_true(tests_shared_drain(shared,&pads) == 1);
+  /* Durable messages are done once they are in the ring, nothing is flushed */
+  assert_true(Logger.flush_function == (void*)0);
+  assert_true(logger_log_durable(LOGGER_INFO,__FILE__,__LINE__,"record durable") == 1);
+  logger_critical("record critical");
+  assert_true(tests_shared_drain(shared,&pads) == 2);
+  /* Cut to a quarter of the ring */
+  char long_message[5000];
+  memset(long_message,'x',sizeof(long_message) - 1);
+  long_message[sizeof(long_message) - 1] = '\0';
+  memcpy(long_message,"record ",7);
+  logger_info("%s",long_message);
+  record = (logger_ring_record const *)(shared->data + (shared->header->tail & shared->mask));
+  assert_true(record->message_length == 8192 / 4 - sizeof(logger_ring_record) - 256);
+  assert_true(tests_shared_drain(shared,&pads) == 1);
+
+  /* A full ring drops and counts */
+  int written = 0;
+  while(shared->header->dropped == 0) {
+    logger_info("record %d",written++);
+  }
+  assert_true(shared->header->head - shared->header->tail <= 8192);
+  assert_true(tests_shared_drain(shared,&pads) == (size_t)written - 1);
+  /* Several threads while the ring is drained, the end of the data is padded */
+  uint64_t const dropped = shared->header->dropped;
+  pthread_t threads[4];
+  for(intptr_t index = 0;index < 4;index++) {
+    assert_true(pthread_create(&threads[index],(void*)0,tests_shared_producer,(void *)index) == 0);
+  }
+  size_t count = 0;
+  for(int done = 0;done < 4;) {
+    count += tests_shared_drain(shared,&pads);
+    if(pthread_tryjoin_np(threads[done],(void*)0) == 0) {done++;}
+  }
+  count += tests_shared_drain(shared,&pads);
+  assert_true(count + (shared->header->dropped - dropped) == 4 * 2000);
+  assert_true(pads > 0);
+  assert_true(shared->header->head == shared->header->tail);
+
+  /* A forked child writes into the ring of its parent and leaves it in place at its exit */
+  pid_t const child = fork();
+  assert_true(child >= 0);
+  if(child == 0) {
+    logger_info("record from the child");
+    size_t const drained = tests_shared_drain(shared,&pads);
+    logger_factory_shared_exit();
+    _exit(drained == 1 ? 0 : 1);
+  }
+  int status = 0;
+  assert_true(waitpid(child,&status,0) == child);
+  assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  assert_true(access(shared->path,F_OK) == 0);
+  assert_true(flock(descriptor,LOCK_EX | LOCK_NB) != 0);
+  logger_info("record after the child");
+  assert_true(tests_shared_drain(shared,&pads) == 1);
+
+  /* A drained ring goes at exit, another one stays for the daemon */
+  char path[256];
+  snprintf(path,sizeof(path),"%s",shared->path);
+  logger_factory_shared_exit();
+  assert_true(Logger.shared == (void*)0);
+  assert_true(access(path,F_OK) != 0);
+  close(descriptor);
+  assert_true(logger_factory_shared(LOGGER_INFO,directory,0) > 0);
+  assert_true(logger_factory_shared_ring->header->capacity == LOGGER_SHARED_CAPACITY);
+  snprintf(path,sizeof(path),"%s",logger_factory_shared_ring->path);
+  logger_info("record left");
+  logger_factory_shared_exit();
+  int const left = open(path,O_RDWR);
+  assert_true(left >= 0);
+  assert_true(flock(left,LOCK_EX | LOCK_NB) == 0);
+  close(left);
+  remove(path);
+  rmdir(directory);
+}
+
 int main(int argc,char *argv[argc]) {
   printf("Starting Test Suite ...\n");
   struct CMUnitTest const tests[] = {
@@ -526,9 +8585,394 @@ int main(int argc,char *argv[argc]) {
     cmocka_unit_test(tests_init_check),
     cmocka_unit_test(tests_simpleoutputs_check),
     cmocka_unit_test(tests_simplefile_check),
+    cmocka_unit_test(tests_async_file_replace_check),
     cmocka_unit_test(tests_simplecsv_check),
+    cmocka_unit_test(tests_async_backpressure_check),
+    cmocka_unit_test(tests_async_priority_check),
+    cmocka_unit_test(tests_async_shutdown_check),
+    cmocka_unit_test(tests_clock_check),
+    cmocka_unit_test(tests_format_check),
+    cmocka_unit_test(tests_preformatted_check),
+    cmocka_unit_test(tests_message_size_check),
+    cmocka_unit_test(tests_data_check),
+    cmocka_unit_test(tests_backtrace_check),
+    cmocka_unit_test(tests_instances_check),
+    cmocka_unit_test(tests_gate_check),
+    cmocka_unit_test(tests_config_check),
+    cmocka_unit_test(tests_sites_check),
+    cmocka_unit_test(tests_fork_check),
+    cmocka_unit_test(tests_pool_check),
+    cmocka_unit_test(tests_memory_check),
+    cmocka_unit_test(tests_numa_check),
+    cmocka_unit_test(tests_threads_check),
+    cmocka_unit_test(tests_flush_check),
+    cmocka_unit_test(tests_durability_check),
+    cmocka_unit_test(tests_direct_check),
+    cmocka_unit_test(tests_reader_check),
+    cmocka_unit_test(tests_shared_check),
   };
   return cmocka_run_group_tests(tests,(void*)0,(void*)0);
 }
 
 #endif /* Test Suite */
+
+#ifdef LOGGERBENCHSUITE
+/*
+Micro benchmarks, build with
+  cc -O2 -pthread -DLOGGERBENCHSUITE src/logger.c -o logger_bench
+and run all of them or only the ones named on the command line.
+*/
+
+static uint64_t
+bench_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (uint64_t)logger_timespec_ns(&now);
+}
+
+/* The snprintf based transforms the formatting layer replaced */
+static char *
+bench_snprintf_console_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  char tmp_buffer[LOGGER_MESSAGE_BUFFER] = {0};
+  char const log_level_mapping[][10] = {
+    "EMERGENCY","ALERT","CRITICAL","ERROR","WARNING","NOTICE","INFO","DEBUG"
+  };
+  struct tm broken_down;
+  localtime_r(&timestamp->realtime.tv_sec,&broken_down);
+  size_t offset = strftime(tmp_buffer,LOGGER_MESSAGE_BUFFER,"%a %b %e %H:%M:%S",&broken_down);
+  offset += snprintf(tmp_buffer + offset,LOGGER_MESSAGE_BUFFER - offset,".%06ld",timestamp->realtime.tv_nsec / 1000);
+  offset += strftime(tmp_buffer + offset,LOGGER_MESSAGE_BUFFER - offset," %Y",&broken_down);
+  snprintf(tmp_buffer + offset,LOGGER_MESSAGE_BUFFER - offset," %-10s %s:%d - %s\n",log_level_mapping[log_level],file,filenumber,message);
+  memset(message,0,LOGGER_MESSAGE_BUFFER);
+  memcpy(message,&tmp_buffer,LOGGER_MESSAGE_BUFFER);
+  return message;
+}
+
+static char *
+bench_snprintf_csv_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  char tmp_buffer[LOGGER_MESSAGE_BUFFER] = {0};
+  char const log_level_mapping[][10] = {
+    "emergency","alert","critical","error","warning","notice","info","debug"
+  };
+  snprintf(tmp_buffer,LOGGER_MESSAGE_BUFFER,"%lld.%09ld,%s,%s,%i,%s\n",(long long)timestamp->realtime.tv_sec,timestamp->realtime.tv_nsec,log_level_mapping[log_level],file,filenumber,message);
+  memset(message,0,LOGGER_MESSAGE_BUFFER);
+  memcpy(message,&tmp_buffer,LOGGER_MESSAGE_BUFFER);
+  return message;
+}
+
+static double
+bench_transform(logger_transform transform,size_t const iterations) {
+  char message[LOGGER_MESSAGE_BUFFER];
+  char const text[] = "connection 42 accepted from 10.0.0.1:5555";
+  logger_time now;
+  logger_clock_now(0,&now);
+  size_t checksum = 0;
+  uint64_t const started = bench_now_ns();
+  for(size_t index = 0;index < iterations;index++) {
+    memcpy(message,text,sizeof(text));
+    now.realtime.tv_nsec = (now.realtime.tv_nsec + 1000) % 1000000000L;
+    checksum += (size_t)transform(&now,(int)(index % (LOGGER_DEBUG + 1)),"./src/network/listener.c",(int)(index % 5000),message)[40];
+  }
+  uint64_t const finished = bench_now_ns();
+  if(checksum == 0) {fprintf(stderr,"unexpected checksum\n");}
+  return (double)(finished - started) / iterations;
+}
+
+static void
+bench_format(void) {
+  size_t const iterations = 2000000;
+  double const console_fast = bench_transform(logger_factory_console_transform,iterations);
+  double const console_snprintf = bench_transform(bench_snprintf_console_transform,iterations);
+  double const csv_fast = bench_transform(logger_factory_csv_transform,iterations);
+  double const csv_snprintf = bench_transform(bench_snprintf_csv_transform,iterations);
+  printf("format: console %.1f ns/msg (snprintf %.1f ns/msg, %.1fx)\n",console_fast,console_snprintf,console_snprintf / console_fast);
+  printf("format: csv     %.1f ns/msg (snprintf %.1f ns/msg, %.1fx)\n",csv_fast,csv_snprintf,csv_snprintf / csv_fast);
+}
+
+/* Reference: the usual "%02x" loop */
+static size_t
+bench_snprintf_hex(char * const output,unsigned char const * const input,size_t const length) {
+  for(size_t index = 0;index < length;index++) {
+    snprintf(output + index * 2,3,"%02x",input[index]);
+  }
+  return length * 2;
+}
+
+static void
+bench_data(void) {
+  size_t const iterations = 200000;
+  unsigned char packet[1500];
+  static char text[1500 / 16 * LOGGER_DATA_HEXDUMP_LINE + LOGGER_DATA_HEXDUMP_LINE];
+  for(size_t index = 0;index < sizeof(packet);index++) {packet[index] = (unsigned char)(index * 31 + 7);}
+  int const formats[] = {LOGGER_DATA_HEX,LOGGER_DATA_HEXDUMP,LOGGER_DATA_BASE64};
+  char const * const names[] = {"hex","hexdump","base64"};
+  uint64_t start = bench_now_ns();
+  for(size_t iteration = 0;iteration < iterations;iteration++) {
+    bench_snprintf_hex(text,packet,sizeof(packet));
+  }
+  double const reference = (double)(bench_now_ns() - start) / iterations;
+  printf("data: %%02x loop %9.1f ns/packet (1500 bytes)\n",reference);
+  for(size_t format = 0;format < sizeof(formats) / sizeof(formats[0]);format++) {
+    start = bench_now_ns();
+    for(size_t iteration = 0;iteration < iterations;iteration++) {
+      logger_encode_data(formats[format],text,sizeof(text),packet,sizeof(packet));
+    }
+    double const encoded = (double)(bench_now_ns() - start) / iterations;
+    printf("data: %-10s %9.1f ns/packet (%.1fx)\n",names[format],encoded,reference / encoded);
+  }
+}
+
+static int
+bench_discard_output(void const * const custom_object,char const * const message) {
+  return 1;
+}
+
+static char *
+bench_identity_transform(logger_time const * const timestamp,int const log_level,char const * const file, int const filenumber,char * message) {
+  return message;
+}
+
+static _Atomic bool bench_gate_running = false;
+
+/* Logs messages that pass the gate, so sequence and counters keep changing */
+static void *
+bench_gate_writer(void *argument) {
+  int index = 0;
+  while(atomic_load_explicit(&bench_gate_running,memory_order_relaxed)) {
+    logger_error("passing %d",index++);
+  }
+  return (void*)0;
+}
+
+/*
+Filtered calls, stores ns per call. Measured in thread cpu time, so more
+threads than cpus do not inflate the result.
+*/
+static void *
+bench_gate_filtered(void *argument) {
+  size_t const iterations = 20000000;
+  struct timespec started,finished;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&started);
+  for(size_t index = 0;index < iterations;index++) {
+    logger_debug("filtered %zu",index);
+  }
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&finished);
+  *(double *)argument = (double)(logger_timespec_ns(&finished) - logger_timespec_ns(&started)) / iterations;
+  return (void*)0;
+}
+
+static void
+bench_gate(void) {
+  long const processors = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t const threads = processors > 2 ? (size_t)processors : 2;
+  pthread_t filtered[threads];
+  double results[threads];
+  pthread_t writer;
+  logger_setup_context(LOGGER_ERROR,(void*)0,bench_discard_output,bench_identity_transform,true);
+  bench_gate_filtered(&results[0]);
+  printf("gate: filtered call %6.2f ns (1 thread)\n",results[0]);
+  atomic_store(&bench_gate_running,true);
+  pthread_create(&writer,(void*)0,bench_gate_writer,(void*)0);
+  for(size_t index = 0;index < threads;index++) {
+    pthread_create(&filtered[index],(void*)0,bench_gate_filtered,&results[index]);
+  }
+  double total = 0;
+  for(size_t index = 0;index < threads;index++) {
+    pthread_join(filtered[index],(void*)0);
+    total += results[index];
+  }
+  atomic_store(&bench_gate_running,false);
+  pthread_join(writer,(void*)0);
+  printf("gate: filtered call %6.2f ns (%zu threads + 1 logging, %ld cpus)\n",total / threads,threads,processors);
+}
+
+/*
+First burst into a fresh queue, which touches every record once. The
+slowest call shows the page fault spikes that pre-faulting moves into
+logger_setup_async().
+*/
+static void
+bench_memory(void) {
+  size_t const burst = 60000;
+  int const options[] = {0,LOGGER_MEMORY_PREFAULT,LOGGER_MEMORY_PREFAULT | LOGGER_MEMORY_THP,LOGGER_MEMORY_PREFAULT | LOGGER_MEMORY_HUGETLB};
+  char const * const names[] = {"lazy","prefault","prefault+thp","prefault+hugetlb"};
+  logger_setup_context(LOGGER_DEBUG,(void*)0,bench_discard_output,bench_identity_transform,true);
+  for(size_t option = 0;option < sizeof(options) / sizeof(options[0]);option++) {
+    logger_set_memory_options(options[option]);
+    uint64_t const started = bench_now_ns();
+    logger_setup_async(burst + 1,LOGGER_BACKPRESSURE_BLOCK,-1);
+    uint64_t const ready = bench_now_ns();
+    uint64_t slowest = 0;
+    for(size_t index = 0;index < burst;index++) {
+      uint64_t const before = bench_now_ns();
+      logger_info("burst message %zu",index);
+      uint64_t const took = bench_now_ns() - before;
+      if(took > slowest) {slowest = took;}
+    }
+    uint64_t const finished = bench_now_ns();
+    logger_stats stats;
+    logger_get_stats(&stats);
+    logger_stop_async();
+    printf("memory: %-16s setup %7.2f ms, burst %6.1f ns/msg, slowest %7.1f us (%zu MiB huge)\n",names[option],
+           (double)(ready - started) / 1e6,(double)(finished - ready) / burst,(double)slowest / 1e3,stats.memory_huge >> 20);
+  }
+  logger_set_memory_options(LOGGER_MEMORY_PREFAULT);
+}
+
+static _Atomic uint64_t bench_wait_written = 0;
+
+static int
+bench_wait_output(void const * const custom_object,char const * const message) {
+  atomic_fetch_add_explicit(&bench_wait_written,1,memory_order_release);
+  return 1;
+}
+
+/*
+Wake-up latency of an idle writer: time from logging into an empty queue
+until the output function ran, with a pause in between so the writer is
+idle again each time. Spinning needs a CPU of its own, on a single CPU
+the writer polls away the time slice of the logging thread.
+*/
+static void
+bench_wait(void) {
+  size_t const rounds = 2000;
+  int const spins[] = {0,50,-1};
+  char const * const names[] = {"block","spin 50us","spin forever"};
+  logger_setup_context(LOGGER_DEBUG,(void*)0,bench_wait_output,bench_identity_transform,true);
+  for(size_t mode = 0;mode < sizeof(spins) / sizeof(spins[0]);mode++) {
+    logger_set_writer_wait(mode == 0 ? LOGGER_WAIT_BLOCK : LOGGER_WAIT_SPIN,spins[mode]);
+    logger_setup_async(1024,LOGGER_BACKPRESSURE_BLOCK,-1);
+    uint64_t total = 0;
+    uint64_t slowest = 0;
+    for(size_t index = 0;index < rounds;index++) {
+      uint64_t const written = atomic_load(&bench_wait_written);
+      struct timespec const pause = {.tv_sec = 0,.tv_nsec = 100000L};
+      nanosleep(&pause,(void*)0);
+      uint64_t const before = bench_now_ns();
+      logger_info("wake up %zu",index);
+      while(atomic_load_explicit(&bench_wait_written,memory_order_acquire) == written) {}
+      uint64_t const took = bench_now_ns() - before;
+      total += took;
+      if(took > slowest) {slowest = took;}
+    }
+    logger_stop_async();
+    printf("wait: %-12s %8.1f ns average, slowest %8.1f us\n",names[mode],(double)total / rounds,(double)slowest / 1e3);
+  }
+  logger_set_writer_wait(LOGGER_WAIT_BLOCK,0);
+}
+
+#define BENCH_FLUSH_MESSAGES 20000
+
+/* Buffered sink that flushes into /dev/null, one write() per flush */
+static struct {
+  int descriptor;
+  char buffer[1 << 20];
+  size_t length;
+  size_t written;
+  size_t flushed;
+  uint64_t syscalls;
+  uint64_t delay;
+  uint64_t slowest;
+  _Atomic uint64_t logged[BENCH_FLUSH_MESSAGES];
+} bench_flush_sink;
+
+static int
+bench_flush_output(void const * const custom_object,char const * const message) {
+  size_t const length = strlen(message);
+  if(bench_flush_sink.length + length <= sizeof(bench_flush_sink.buffer)) {
+    memcpy(bench_flush_sink.buffer + bench_flush_sink.length,message,length);
+    bench_flush_sink.length += length;
+  }
+  bench_flush_sink.written++;
+  return 1;
+}
+
+static int
+bench_flush_flush(void const * const custom_object,bool const durable) {
+  if(bench_flush_sink.length > 0) {
+    if(write(bench_flush_sink.descriptor,bench_flush_sink.buffer,bench_flush_sink.length) < 0) {return 0;}
+    bench_flush_sink.syscalls++;
+    bench_flush_sink.length = 0;
+  }
+  uint64_t const now = bench_now_ns();
+  for(;bench_flush_sink.flushed < bench_flush_sink.written;bench_flush_sink.flushed++) {
+    uint64_t const took = now - atomic_load(&bench_flush_sink.logged[bench_flush_sink.flushed]);
+    bench_flush_sink.delay += took;
+    if(took > bench_flush_sink.slowest) {bench_flush_sink.slowest = took;}
+  }
+  return 1;
+}
+
+/*
+Sweeps the offered load and compares flushing every record, the fixed
+batches of LOGGER_BATCH_RECORDS and the adaptive flushing: write()
+calls per message and the delay from logging a record to its flush.
+*/
+static void
+bench_flush(void) {
+  uint64_t const rates[] = {1000,10000,100000,1000000,0};
+  int const delays[] = {0,0,LOGGER_FLUSH_DELAY_US};
+  size_t const batches[] = {1,LOGGER_BATCH_RECORDS,LOGGER_BATCH_RECORDS};
+  char const * const names[] = {"every record","fixed","adaptive"};
+  bench_flush_sink.descriptor = open("/dev/null",O_WRONLY);
+  logger_setup_context(LOGGER_DEBUG,(void*)0,bench_flush_output,bench_identity_transform,true);
+  logger_set_flush_callback(bench_flush_flush);
+  for(size_t rate = 0;rate < sizeof(rates) / sizeof(rates[0]);rate++) {
+    size_t messages = rates[rate] > 0 ? rates[rate] / 4 : BENCH_FLUSH_MESSAGES;
+    if(messages > BENCH_FLUSH_MESSAGES) {messages = BENCH_FLUSH_MESSAGES;}
+    for(size_t mode = 0;mode < sizeof(names) / sizeof(names[0]);mode++) {
+      bench_flush_sink.written = 0;
+      bench_flush_sink.flushed = 0;
+      bench_flush_sink.syscalls = 0;
+      bench_flush_sink.delay = 0;
+      bench_flush_sink.slowest = 0;
+      logger_set_flush_latency(delays[mode],batches[mode]);
+      logger_setup_async(4096,LOGGER_BACKPRESSURE_BLOCK,-1);
+      uint64_t const started = bench_now_ns();
+      for(size_t index = 0;index < messages;index++) {
+        if(rates[rate] > 0) {
+          /* Sleeps once the producer is ahead of schedule, sending the rest in bursts */
+          uint64_t const due = started + index * 1000000000ULL / rates[rate];
+          uint64_t const now = bench_now_ns();
+          if(due > now + 100000) {
+            struct timespec const pause = {.tv_sec = 0,.tv_nsec = (long)(due - now)};
+            nanosleep(&pause,(void*)0);
+          }
+        }
+        atomic_store(&bench_flush_sink.logged[index],bench_now_ns());
+        logger_info("offered load %zu",index);
+      }
+      logger_stop_async();
+      char offered[32] = "unlimited";
+      if(rates[rate] > 0) {snprintf(offered,sizeof(offered),"%llu/s",(unsigned long long)rates[rate]);}
+      printf("flush: %-10s %-12s %6.3f syscalls/msg, delay %9.1f us average, %9.1f us slowest\n",offered,names[mode],
+             (double)bench_flush_sink.syscalls / messages,(double)bench_flush_sink.delay / messages / 1e3,(double)bench_flush_sink.slowest / 1e3);
+    }
+  }
+  logger_set_flush_latency(LOGGER_FLUSH_DELAY_US,LOGGER_BATCH_RECORDS);
+  close(bench_flush_sink.descriptor);
+}
+
+int main(int argc,char *argv[argc]) {
+  struct {
+    char const *name;
+    void (*run)(void);
+  } const benchmarks[] = {
+    {"format",bench_format},
+    {"data",bench_data},
+    {"gate",bench_gate},
+    {"memory",bench_memory},
+    {"wait",bench_wait},
+    {"flush",bench_flush},
+  };
+  for(size_t index = 0;index < sizeof(benchmarks) / sizeof(benchmarks[0]);index++) {
+    bool selected = argc < 2;
+    for(int argument = 1;argument < argc;argument++) {
+      if(strcmp(argv[argument],benchmarks[index].name) == 0) {selected = true;}
+    }
+    if(selected) {benchmarks[index].run();}
+  }
+  return 0;
+}
+
+#endif /* Bench Suite */
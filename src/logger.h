@@ -16,9 +16,14 @@
 #include <setjmp.h>
 #include <cmocka.h>
 #include <unistd.h>
+#include <sys/wait.h>
 
 #endif /* Test Suite */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
 To not collide with Linux Syslog, we add a check for certain values
 and define accordingly.
@@ -52,29 +57,421 @@ TODO: Find a better way to determine if syslog is available
   };
 #endif
 
+/*
+Timestamp handed to the transform function. monotonic is only set with
+LOGGER_CLOCK_MONOTONIC, otherwise it is zero.
+*/
+typedef struct {
+  struct timespec realtime;
+  struct timespec monotonic;
+} logger_time;
+
+enum {
+  LOGGER_CLOCK_COARSE = 1,
+  LOGGER_CLOCK_MONOTONIC = 2,
+  LOGGER_CLOCK_TSC = 4
+};
+
 typedef int (*logger_push_log)(void const * const,char const * const);
-typedef char *(*logger_transform)(time_t const,int const,char const * const, int const,char *);
+typedef char *(*logger_transform)(logger_time const * const,int const,char const * const, int const,char *);
+typedef int (*logger_flush)(void const * const,bool const);
+typedef int (*logger_push_data)(void const * const,logger_time const * const,int const,char const * const,int const,char const * const,void const * const,size_t const);
+typedef size_t (*logger_generate)(void *,char *,size_t);
+
+/*
+Handle of a logger instance, see logger_create(). The functions without
+handle work on the default instance, logger_default() returns it.
+*/
+typedef struct logger_instance logger_t;
+
+/*
+Call site of one of the logging macros, see logger_site_control(). With
+GCC/Clang on ELF targets every macro use places one of these in the
+logger_sites section, the library finds all of them through the
+__start_/__stop_ symbols of the section. enabled is checked inline: 0
+follows the log level, 1 logs the site regardless of it. Define
+LOGGER_NO_SITES to get the plain logger_log() calls instead. C++ always
+gets them: a site in an inline function lands in a COMDAT section, which
+conflicts with the sites of the other functions.
+*/
+typedef struct {
+  char const *file;
+  char const *arguments;
+  int linenumber;
+  int log_level;
+  unsigned char enabled;
+} logger_site;
+
+#if defined(__GNUC__) && defined(__ELF__) && !defined(LOGGER_NO_SITES) && !defined(__cplusplus)
+#define LOGGER_SITE_LOG(log_level,...) do { \
+    static logger_site logger_site_entry __attribute__((section("logger_sites"),used,aligned(8))) = {__FILE__,#__VA_ARGS__,__LINE__,log_level,0}; \
+    if(__builtin_expect(__atomic_load_n(&logger_site_entry.enabled,__ATOMIC_RELAXED) != 0,0)) { \
+      logger_log_site(&logger_site_entry,__VA_ARGS__); \
+    } else { \
+      logger_log(log_level,__FILE__,__LINE__,__VA_ARGS__); \
+    } \
+  } while(0)
+#else
+#define LOGGER_SITE_LOG(log_level,...) logger_log(log_level,__FILE__,__LINE__,__VA_ARGS__)
+#endif
+
+#define logger_emergency(...) LOGGER_SITE_LOG(LOGGER_EMERGENCY,__VA_ARGS__)
+#define logger_alert(...) LOGGER_SITE_LOG(LOGGER_ALERT,__VA_ARGS__)
+#define logger_critical(...) LOGGER_SITE_LOG(LOGGER_CRITICAL,__VA_ARGS__)
+#define logger_error(...) LOGGER_SITE_LOG(LOGGER_ERROR,__VA_ARGS__)
+#define logger_warning(...) LOGGER_SITE_LOG(LOGGER_WARNING,__VA_ARGS__)
+#define logger_notice(...) LOGGER_SITE_LOG(LOGGER_NOTICE,__VA_ARGS__)
+#define logger_info(...) LOGGER_SITE_LOG(LOGGER_INFO,__VA_ARGS__)
+#define logger_debug(...) LOGGER_SITE_LOG(LOGGER_DEBUG,__VA_ARGS__)
+#define logger_data(log_level,data,length,label) logger_log_data(log_level,__FILE__,__LINE__,data,length,label)
+#define logger_durable(log_level,...) logger_log_durable(log_level,__FILE__,__LINE__,__VA_ARGS__)
 
-#define logger_emergency(...) logger_log(LOGGER_EMERGENCY,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_alert(...) logger_log(LOGGER_ALERT,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_critical(...) logger_log(LOGGER_CRITICAL,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_error(...) logger_log(LOGGER_ERROR,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_warning(...) logger_log(LOGGER_WARNING,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_notice(...) logger_log(LOGGER_NOTICE,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_info(...) logger_log(LOGGER_INFO,__FILE__,__LINE__,__VA_ARGS__)
-#define logger_debug(...) logger_log(LOGGER_DEBUG,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_emergency_to(logger,...) logger_log_to(logger,LOGGER_EMERGENCY,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_alert_to(logger,...) logger_log_to(logger,LOGGER_ALERT,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_critical_to(logger,...) logger_log_to(logger,LOGGER_CRITICAL,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_error_to(logger,...) logger_log_to(logger,LOGGER_ERROR,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_warning_to(logger,...) logger_log_to(logger,LOGGER_WARNING,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_notice_to(logger,...) logger_log_to(logger,LOGGER_NOTICE,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_info_to(logger,...) logger_log_to(logger,LOGGER_INFO,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_debug_to(logger,...) logger_log_to(logger,LOGGER_DEBUG,__FILE__,__LINE__,__VA_ARGS__)
+#define logger_data_to(logger,log_level,data,length,label) logger_log_data_to(logger,log_level,__FILE__,__LINE__,data,length,label)
+#define logger_durable_to(logger,log_level,...) logger_log_durable_to(logger,log_level,__FILE__,__LINE__,__VA_ARGS__)
 
+/*
+Messages up to LOGGER_MESSAGE_BUFFER - 1 bytes are formatted into a per
+thread buffer, longer ones into a per thread arena that grows up to
+LOGGER_MESSAGE_MAX - 1 bytes. Anything beyond is cut and ends with
+LOGGER_TRUNCATION_MARK. Transform functions may always append
+LOGGER_TRANSFORM_HEADROOM bytes behind the message.
+*/
 #define LOGGER_MESSAGE_BUFFER 2048
+#ifndef LOGGER_MESSAGE_MAX
+#define LOGGER_MESSAGE_MAX 65536
+#endif
+#define LOGGER_TRANSFORM_HEADROOM 512
+#define LOGGER_TRUNCATION_MARK "...[truncated]"
+#define LOGGER_PRIORITY_CAPACITY 64
+#define LOGGER_BACKTRACE_DEPTH 32
+#define LOGGER_BATCH_RECORDS 64
+/* Default bounds of the adaptive flushing, see logger_set_flush_latency() */
+#ifndef LOGGER_FLUSH_DELAY_US
+#define LOGGER_FLUSH_DELAY_US 1000
+#endif
+#ifndef LOGGER_SHUTDOWN_TIMEOUT_MS
+#define LOGGER_SHUTDOWN_TIMEOUT_MS 2000
+#endif
+/* Write unit and buffer size of logger_factory_direct_file() */
+#define LOGGER_DIRECT_BLOCK 4096
+#ifndef LOGGER_DIRECT_BUFFER
+#define LOGGER_DIRECT_BUFFER (1024 * 1024)
+#endif
+/* Ring directory and size of logger_factory_shared() */
+#ifndef LOGGER_SHARED_DIRECTORY
+#define LOGGER_SHARED_DIRECTORY "/dev/shm/logger"
+#endif
+#ifndef LOGGER_SHARED_CAPACITY
+#define LOGGER_SHARED_CAPACITY (4 * 1024 * 1024)
+#endif
+/* Memory for long messages and payloads in the queue, see logger_set_memory_cap() */
+#ifndef LOGGER_POOL_CAP
+#define LOGGER_POOL_CAP (64 * 1024 * 1024)
+#endif
+
+/*
+Behaviour of the asynchronous pipeline once its queue is full,
+see logger_setup_async()
+*/
+enum {
+  LOGGER_BACKPRESSURE_BLOCK = 0,
+  LOGGER_BACKPRESSURE_DROP_NEWEST = 1,
+  LOGGER_BACKPRESSURE_DROP_OLDEST = 2,
+  LOGGER_BACKPRESSURE_DROP_BY_LEVEL = 3
+};
+
+/*
+Backing of the large buffers (queue records, record pool),
+see logger_set_memory_options()
+*/
+enum {
+  LOGGER_MEMORY_PREFAULT = 1,
+  LOGGER_MEMORY_HUGETLB = 2,
+  LOGGER_MEMORY_THP = 4,
+  LOGGER_MEMORY_LOCK = 8
+};
+
+/*
+Layout of the asynchronous pipeline on NUMA hosts, see logger_set_numa()
+*/
+enum {
+  LOGGER_NUMA_SHARDS = 1,
+  LOGGER_NUMA_BIND = 2,
+  LOGGER_NUMA_PIN = 4
+};
+
+/*
+Scheduling of the background threads and how an idle writer waits,
+see logger_set_thread_scheduling() and logger_set_writer_wait()
+*/
+enum {
+  LOGGER_SCHED_INHERIT = 0,
+  LOGGER_SCHED_BATCH = 1,
+  LOGGER_SCHED_IDLE = 2
+};
+
+enum {
+  LOGGER_WAIT_BLOCK = 0,
+  LOGGER_WAIT_SPIN = 1
+};
+
+/*
+When the output is flushed to stable storage besides logger_sync() and
+LOGGER_CRITICAL and above, see logger_set_durability(). Can be combined.
+*/
+enum {
+  LOGGER_DURABILITY_NONE = 0,
+  LOGGER_DURABILITY_INTERVAL = 1,
+  LOGGER_DURABILITY_ERROR = 2
+};
+
+/*
+Text rendering of data messages without a data callback,
+see logger_set_data_format()
+*/
+enum {
+  LOGGER_DATA_HEXDUMP = 0,
+  LOGGER_DATA_HEX = 1,
+  LOGGER_DATA_BASE64 = 2
+};
+
+/*
+Record header of the binary data file (logger_factory_data_file),
+followed by file_length bytes file name, label_length bytes label and
+data_length bytes payload. Fields are in host byte order.
+*/
+#define LOGGER_DATA_MAGIC "LGD1"
+typedef struct {
+  char magic[4];
+  int32_t log_level;
+  uint64_t sequence;
+  int64_t seconds;
+  int32_t nanoseconds;
+  int32_t linenumber;
+  uint32_t file_length;
+  uint32_t label_length;
+  uint64_t data_length;
+} logger_data_header;
+
+/*
+Ring file of logger_factory_shared(), drained by tools/loggerd.c. The
+header is followed by capacity bytes of records (a power of 2), the
+record at position p starts at header_size + p % capacity. Producers
+reserve by moving head, the daemon zeroes what it has read and then
+moves tail, both only grow and are accessed with __atomic builtins.
+dropped counts the records that found the ring full. Fields are in host
+byte order, head and tail have a cache line each.
+*/
+#define LOGGER_RING_MAGIC "LGR1"
+typedef struct {
+  char magic[4];
+  uint32_t header_size;
+  uint64_t capacity;
+  int64_t pid;
+  char name[16];
+  uint64_t dropped;
+  char reserved_header[16];
+  uint64_t head;
+  char reserved_head[56];
+  uint64_t tail;
+  char reserved_tail[56];
+} logger_ring_header;
+
+/*
+Record in the ring, followed by file_length bytes file name and
+message_length bytes message, size is the whole record padded to 8
+bytes. size is written last, it is 0 until the record is complete. With
+LOGGER_RING_PAD set it only fills the data up to its end, the next
+record starts at the beginning.
+*/
+#define LOGGER_RING_PAD 0x80000000u
+typedef struct {
+  uint32_t size;
+  int32_t log_level;
+  uint64_t sequence;
+  int64_t seconds;
+  int32_t nanoseconds;
+  int32_t linenumber;
+  uint32_t file_length;
+  uint32_t message_length;
+} logger_ring_record;
+
+typedef struct {
+  uint64_t queued;
+  uint64_t written;
+  uint64_t blocked;
+  uint64_t dropped[LOGGER_DEBUG + 1];
+  uint64_t sequence;
+  uint64_t truncated;
+  uint64_t config_reloads;
+  uint64_t config_rejected;
+  size_t queue_depth;
+  size_t queue_capacity;
+  size_t priority_depth;
+  size_t queue_shards;
+  /*
+  Batch flushes and the current decisions of the writer, see
+  logger_set_flush_latency(). With shards the decisions of the shard
+  with the highest arrival rate.
+  */
+  uint64_t flushes;
+  size_t flush_batch;
+  uint64_t flush_delay_ns;
+  uint64_t arrival_ns;
+  uint64_t flush_cost_ns;
+  /* Record storage, shared by all instances */
+  size_t pool_reserved;
+  size_t pool_available;
+  size_t pool_cap;
+  uint64_t pool_refills;
+  uint64_t pool_returns;
+  uint64_t pool_large;
+  uint64_t pool_exhausted;
+  size_t memory_mapped;
+  size_t memory_huge;
+  size_t memory_locked;
+} logger_stats;
+
+/* Files a reader follows, see logger_reader_open() */
+enum {
+  LOGGER_READER_TEXT = 0,
+  LOGGER_READER_CSV = 1,
+  LOGGER_READER_DATA = 2,
+  /* Flag, skips the records already written */
+  LOGGER_READER_END = 8
+};
+
+typedef struct logger_reader logger_reader;
+
+/*
+A record handed out by logger_reader_next(). record/length span the whole
+record in the mapped file, text and CSV lines without their '\n'. CSV
+and data records are split into their fields as well (log_level is -1
+where that is not possible), label and sequence only exist for data
+records, message is the payload there.
+*/
+typedef struct {
+  char const *record;
+  size_t length;
+  /* Offset in the segment, segments followed before this one */
+  uint64_t offset;
+  uint64_t segment;
+  int log_level;
+  uint64_t sequence;
+  int64_t seconds;
+  int32_t nanoseconds;
+  int32_t linenumber;
+  char const *file;
+  size_t file_length;
+  char const *label;
+  size_t label_length;
+  char const *message;
+  size_t message_length;
+} logger_record;
 
 extern void logger_log(int,char const * const,int,char const * const, ...);
+extern void logger_log_preformatted(int,char const * const,int,char *,size_t);
+extern void logger_log_generated(int,char const * const,int,logger_generate,void *);
+extern void logger_log_data(int,char const * const,int,void const * const,size_t,char const * const);
+extern int logger_log_durable(int,char const * const,int,char const * const, ...);
+extern bool logger_is_enabled(int);
 extern int logger_setup_context(int,void *,logger_push_log,logger_transform,bool);
 extern int logger_set_output_callback(logger_push_log);
 extern int logger_set_loglevel(int);
 extern int logger_set_transform(logger_transform);
+extern int logger_set_flush_callback(logger_flush);
+extern int logger_set_data_callback(void *,logger_push_data);
+extern int logger_set_data_format(int);
+extern size_t logger_encoded_size(int,size_t);
+extern size_t logger_encode_data(int,char *,size_t,void const * const,size_t);
+extern int logger_set_clock(int);
+extern int logger_get_clock(void);
+extern uint64_t logger_current_sequence(void);
+extern int logger_set_backtrace(int,int);
+extern int logger_current_backtrace(void * const **);
+extern size_t logger_symbolize(void const * const,char *,size_t);
 extern void logger_toggle(bool);
 extern bool logger_get_status(void);
 extern bool logger_is_initialized(void);
 extern int logger_factory_console(int);
 extern int logger_factory_file(int,char const * const);
+extern int logger_factory_direct_file(int,char const * const);
+extern int logger_factory_data_file(char const * const);
+extern int logger_factory_shared(int,char const * const,size_t);
+extern int logger_setup_async(size_t,int,int);
+extern int logger_set_backpressure(int,int);
+extern int logger_set_numa(int);
+extern int logger_set_thread_affinity(char const * const);
+extern int logger_set_thread_scheduling(int,int);
+extern int logger_set_thread_name(char const * const);
+extern int logger_set_writer_wait(int,int);
+extern int logger_set_flush_latency(int,size_t);
+extern int logger_set_durability(int,int);
+extern int logger_stop_async(void);
+extern int logger_sync(int);
+extern int logger_shutdown(int,uint64_t *);
+extern int logger_get_stats(logger_stats *);
+extern int logger_set_memory_cap(size_t);
+extern int logger_set_memory_options(int);
+
+extern int logger_watch_config(char const * const);
+extern int logger_unwatch_config(void);
+extern void logger_log_site(logger_site *,char const * const, ...);
+extern int logger_site_control(char const * const);
+extern void logger_set_fork_reopen(bool);
+
+extern logger_t *logger_create(int,void *,logger_push_log,logger_transform,bool);
+extern void logger_destroy(logger_t *);
+extern logger_t *logger_default(void);
+extern void logger_log_to(logger_t *,int,char const * const,int,char const * const, ...);
+extern void logger_log_preformatted_to(logger_t *,int,char const * const,int,char *,size_t);
+extern void logger_log_generated_to(logger_t *,int,char const * const,int,logger_generate,void *);
+extern void logger_log_data_to(logger_t *,int,char const * const,int,void const * const,size_t,char const * const);
+extern int logger_log_durable_to(logger_t *,int,char const * const,int,char const * const, ...);
+extern bool logger_is_enabled_to(logger_t *,int);
+extern int logger_set_output_callback_to(logger_t *,logger_push_log);
+extern int logger_set_loglevel_to(logger_t *,int);
+extern int logger_set_transform_to(logger_t *,logger_transform);
+extern int logger_set_flush_callback_to(logger_t *,logger_flush);
+extern int logger_set_data_callback_to(logger_t *,void *,logger_push_data);
+extern int logger_set_data_format_to(logger_t *,int);
+extern int logger_set_clock_to(logger_t *,int);
+extern int logger_get_clock_to(logger_t *);
+extern int logger_set_backtrace_to(logger_t *,int,int);
+extern void logger_toggle_to(logger_t *,bool);
+extern bool logger_get_status_to(logger_t *);
+extern bool logger_is_initialized_to(logger_t *);
+extern int logger_setup_async_to(logger_t *,size_t,int,int);
+extern int logger_set_backpressure_to(logger_t *,int,int);
+extern int logger_set_numa_to(logger_t *,int);
+extern int logger_set_thread_affinity_to(logger_t *,char const * const);
+extern int logger_set_thread_scheduling_to(logger_t *,int,int);
+extern int logger_set_thread_name_to(logger_t *,char const * const);
+extern int logger_set_writer_wait_to(logger_t *,int,int);
+extern int logger_set_flush_latency_to(logger_t *,int,size_t);
+extern int logger_set_durability_to(logger_t *,int,int);
+extern int logger_stop_async_to(logger_t *);
+extern int logger_sync_to(logger_t *,int);
+extern int logger_shutdown_to(logger_t *,int,uint64_t *);
+extern int logger_get_stats_to(logger_t *,logger_stats *);
+extern int logger_watch_config_to(logger_t *,char const * const);
+extern int logger_unwatch_config_to(logger_t *);
+
+extern logger_reader *logger_reader_open(char const * const,int);
+extern int logger_reader_next(logger_reader *,logger_record *,int);
+extern int logger_reader_descriptor(logger_reader *);
+extern void logger_reader_close(logger_reader *);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // HEADER CHECK
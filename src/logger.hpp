@@ -0,0 +1,436 @@
+/*
+C++ frontend for the logging library (C++20, header-only).
+
+The format string is parsed at compile time: every conversion is checked
+against the type of its argument and the literal pieces in between are
+located once, in the consteval constructor of logger::format_string.
+At runtime the arguments are written in a fixed, unrolled sequence for
+each call site; there is no printf format parsing left. The finished
+message is written through logger_log_generated(), so C and C++ callers
+share the same context, buffers, transform and output functions.
+
+Format strings use the printf syntax of logger_log():
+  %[flags][width][.precision][length]conversion
+with the conversions d i u o x X c s f F e E g G a A p and %%.
+Length modifiers are accepted but not needed, the argument type decides.
+'*' for width / precision and %n are not supported.
+
+Usage:
+  logger::info("accepted %s:%d",host,port);
+  logger::log(LOGGER_WARNING,"queue at %zu%%",fill_level);
+
+A mismatch between format string and arguments fails to compile with a
+call to logger::detail::format_error() in the diagnostic.
+*/
+
+#ifndef KVK_LOGGER_HPP
+#define KVK_LOGGER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "logger.h"
+
+namespace logger {
+namespace detail {
+
+/* Not constexpr: calling it from the consteval parser is a compile error */
+inline void format_error(char const *) {}
+
+struct spec {
+  char conversion = 0;
+  bool left = false;
+  bool simple = true;
+  unsigned int width = 0;
+  int precision = -1;
+  /* printf spec used for the conversions without a fast path */
+  char fallback[24] = {};
+};
+
+struct piece {
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  bool has_percent = false;
+};
+
+template <typename T>
+using bare = std::remove_cvref_t<T>;
+
+template <typename T>
+constexpr bool is_string_v =
+    std::is_same_v<std::decay_t<bare<T>>,char const *>
+ || std::is_same_v<std::decay_t<bare<T>>,char *>
+ || std::is_same_v<bare<T>,std::string>
+ || std::is_same_v<bare<T>,std::string_view>;
+
+template <typename T>
+constexpr bool is_integer_v = std::is_integral_v<bare<T>> || std::is_enum_v<bare<T>>;
+
+template <typename T>
+constexpr bool is_pointer_v = (std::is_pointer_v<std::decay_t<bare<T>>> && !is_string_v<T>)
+                            || std::is_same_v<bare<T>,std::nullptr_t>;
+
+template <typename T>
+consteval bool accepts(char conversion) {
+  switch(conversion) {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+      return is_integer_v<T>;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      return std::is_floating_point_v<bare<T>>;
+    case 's':
+      return is_string_v<T>;
+    case 'p':
+      return is_pointer_v<T> || is_string_v<T>;
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+consteval char const *fallback_length() {
+  if constexpr(std::is_same_v<bare<T>,long double>) {
+    return "L";
+  } else if constexpr(is_integer_v<T>) {
+    return "ll";
+  } else {
+    return "";
+  }
+}
+
+/*
+Append-only view on the message buffer. Stores at most capacity - 1
+bytes, length also counts the bytes that did not fit (like snprintf).
+*/
+struct writer {
+  char *buffer;
+  std::size_t length;
+  std::size_t capacity;
+
+  std::size_t room() const {return length + 1 < capacity ? capacity - 1 - length : 0;}
+
+  void append(char const *data,std::size_t size) {
+    std::memcpy(buffer + length,data,size < room() ? size : room());
+    length += size;
+  }
+
+  void fill(char character,std::size_t count) {
+    std::memset(buffer + length,character,count < room() ? count : room());
+    length += count;
+  }
+};
+
+inline constexpr char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+inline void write_unsigned(writer &out,unsigned long long value,char conversion) {
+  char digits[24];
+  char *cursor = digits + sizeof(digits);
+  if(conversion == 'x' || conversion == 'X') {
+    char const *alphabet = conversion == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+    do {
+      *--cursor = alphabet[value & 0xf];
+      value >>= 4;
+    } while(value != 0);
+  } else if(conversion == 'o') {
+    do {
+      *--cursor = static_cast<char>('0' + (value & 7));
+      value >>= 3;
+    } while(value != 0);
+  } else {
+    while(value >= 100) {
+      cursor -= 2;
+      std::memcpy(cursor,&digit_pairs[(value % 100) * 2],2);
+      value /= 100;
+    }
+    if(value >= 10) {
+      cursor -= 2;
+      std::memcpy(cursor,&digit_pairs[value * 2],2);
+    } else {
+      *--cursor = static_cast<char>('0' + value);
+    }
+  }
+  out.append(cursor,digits + sizeof(digits) - cursor);
+}
+
+inline void write_literal(writer &out,std::string_view text,piece const &literal) {
+  if(literal.has_percent == false) {
+    out.append(text.data() + literal.begin,literal.end - literal.begin);
+    return;
+  }
+  for(std::size_t index = literal.begin;index < literal.end;index++) {
+    out.append(&text[index],1);
+    if(text[index] == '%') {index++;}
+  }
+}
+
+inline void write_string(writer &out,spec const &conversion,char const *data,std::size_t size) {
+  if(conversion.precision >= 0 && size > static_cast<std::size_t>(conversion.precision)) {
+    size = conversion.precision;
+  }
+  std::size_t const padding = conversion.width > size ? conversion.width - size : 0;
+  if(conversion.left == false) {out.fill(' ',padding);}
+  out.append(data,size);
+  if(conversion.left) {out.fill(' ',padding);}
+}
+
+template <typename T>
+inline void write_fallback(writer &out,spec const &conversion,T const &value) {
+  char buffer[512];
+  int length;
+  if constexpr(std::is_same_v<bare<T>,long double>) {
+    length = std::snprintf(buffer,sizeof(buffer),conversion.fallback,value);
+  } else if constexpr(std::is_floating_point_v<bare<T>>) {
+    length = std::snprintf(buffer,sizeof(buffer),conversion.fallback,static_cast<double>(value));
+  } else if constexpr(is_pointer_v<T>) {
+    length = std::snprintf(buffer,sizeof(buffer),conversion.fallback,static_cast<void const *>(value));
+  } else if constexpr(is_string_v<T>) {
+    length = std::snprintf(buffer,sizeof(buffer),conversion.fallback,static_cast<void const *>(std::string_view(value).data()));
+  } else if constexpr(std::is_signed_v<bare<T>>) {
+    length = std::snprintf(buffer,sizeof(buffer),conversion.fallback,static_cast<long long>(value));
+  } else {
+    length = std::snprintf(buffer,sizeof(buffer),conversion.fallback,static_cast<unsigned long long>(value));
+  }
+  if(length > 0) {
+    out.append(buffer,static_cast<std::size_t>(length) < sizeof(buffer) ? length : sizeof(buffer) - 1);
+  }
+}
+
+template <typename T>
+inline void write_argument(writer &out,spec const &conversion,T const &value) {
+  if constexpr(is_string_v<T>) {
+    if(conversion.conversion == 'p') {
+      write_fallback(out,conversion,value);
+    } else if constexpr(std::is_array_v<bare<T>>) {
+      write_string(out,conversion,value,std::strlen(value));
+    } else if constexpr(std::is_pointer_v<bare<T>>) {
+      char const *text = value != nullptr ? value : "(null)";
+      write_string(out,conversion,text,std::strlen(text));
+    } else {
+      std::string_view const text(value);
+      write_string(out,conversion,text.data(),text.size());
+    }
+  } else if constexpr(std::is_enum_v<bare<T>>) {
+    write_argument(out,conversion,static_cast<std::underlying_type_t<bare<T>>>(value));
+  } else if constexpr(is_integer_v<T>) {
+    if(conversion.conversion == 'c') {
+      char const character = static_cast<char>(value);
+      write_string(out,conversion,&character,1);
+    } else if(conversion.simple == false) {
+      write_fallback(out,conversion,value);
+    } else if constexpr(std::is_same_v<bare<T>,bool>) {
+      write_unsigned(out,value ? 1 : 0,conversion.conversion);
+    } else if constexpr(std::is_signed_v<bare<T>>) {
+      long long const number = value;
+      if(number < 0 && (conversion.conversion == 'd' || conversion.conversion == 'i')) {
+        out.append("-",1);
+        write_unsigned(out,0ULL - static_cast<unsigned long long>(number),conversion.conversion);
+      } else if(conversion.conversion == 'd' || conversion.conversion == 'i') {
+        write_unsigned(out,static_cast<unsigned long long>(number),conversion.conversion);
+      } else {
+        /* Same as printf: the bits reinterpreted in the argument's own width */
+        write_unsigned(out,static_cast<std::make_unsigned_t<bare<T>>>(value),conversion.conversion);
+      }
+    } else {
+      write_unsigned(out,value,conversion.conversion);
+    }
+  } else {
+    write_fallback(out,conversion,value);
+  }
+}
+
+} // namespace detail
+
+/*
+Format string checked against the argument types Args at compile time.
+Constructed implicitly from a string literal; also records the call site.
+*/
+template <typename... Args>
+class basic_format_string {
+public:
+  template <std::size_t N>
+  consteval basic_format_string(char const (&text)[N],std::source_location where = std::source_location::current())
+    : text_(text,N - 1),file_(where.file_name()),line_(static_cast<int>(where.line())) {
+    parse();
+  }
+
+  void format_to(detail::writer &out,Args const &... args) const {
+    format_to(out,std::index_sequence_for<Args...>{},args...);
+  }
+
+  char const *file() const {return file_;}
+  int line() const {return line_;}
+
+private:
+  static constexpr std::size_t argument_count = sizeof...(Args);
+
+  template <std::size_t... Index>
+  void format_to(detail::writer &out,std::index_sequence<Index...>,Args const &... args) const {
+    detail::write_literal(out,text_,literals_[0]);
+    ((detail::write_argument(out,specs_[Index],args),detail::write_literal(out,text_,literals_[Index + 1])),...);
+  }
+
+  /*
+  Type check of one argument. Also completes its printf fallback spec:
+  the written "%[flags][width][.precision]" followed by the length
+  modifier matching the argument type and the conversion character.
+  */
+  template <std::size_t Index>
+  consteval void check(std::string_view written) {
+    using type = std::tuple_element_t<Index,std::tuple<Args...>>;
+    detail::spec &conversion = specs_[Index];
+    if(detail::accepts<type>(conversion.conversion) == false) {
+      detail::format_error("argument type does not match the conversion");
+    }
+    if(written.size() + 4 > sizeof(conversion.fallback)) {
+      detail::format_error("conversion specification too long");
+      return;
+    }
+    std::size_t length = 0;
+    for(char const character : written) {
+      conversion.fallback[length++] = character;
+    }
+    if(conversion.conversion != 'p' && conversion.conversion != 'c' && conversion.conversion != 's') {
+      for(char const *modifier = detail::fallback_length<type>();*modifier != '\0';modifier++) {
+        conversion.fallback[length++] = *modifier;
+      }
+    }
+    conversion.fallback[length++] = conversion.conversion;
+    conversion.fallback[length] = '\0';
+  }
+
+  template <std::size_t... Index>
+  consteval void check_all(std::array<std::string_view,argument_count> const &written,std::index_sequence<Index...>) {
+    (check<Index>(written[Index]),...);
+  }
+
+  consteval void parse() {
+    std::array<std::string_view,argument_count> written{};
+    std::size_t argument = 0;
+    std::size_t literal_begin = 0;
+    bool has_percent = false;
+    for(std::size_t index = 0;index < text_.size();index++) {
+      if(text_[index] != '%') {continue;}
+      if(index + 1 < text_.size() && text_[index + 1] == '%') {
+        has_percent = true;
+        index++;
+        continue;
+      }
+      if(argument >= argument_count) {
+        detail::format_error("more conversions than arguments");
+        return;
+      }
+      std::size_t const spec_begin = index;
+      detail::spec conversion;
+      index++;
+      while(index < text_.size() && std::string_view("-+ #0").find(text_[index]) != std::string_view::npos) {
+        if(text_[index] == '-') {
+          conversion.left = true;
+        } else {
+          conversion.simple = false;
+        }
+        index++;
+      }
+      while(index < text_.size() && text_[index] >= '0' && text_[index] <= '9') {
+        conversion.width = conversion.width * 10 + (text_[index] - '0');
+        index++;
+      }
+      if(index < text_.size() && text_[index] == '.') {
+        conversion.precision = 0;
+        index++;
+        while(index < text_.size() && text_[index] >= '0' && text_[index] <= '9') {
+          conversion.precision = conversion.precision * 10 + (text_[index] - '0');
+          index++;
+        }
+      }
+      std::size_t const modifier_begin = index;
+      while(index < text_.size() && std::string_view("hljztL").find(text_[index]) != std::string_view::npos) {
+        index++;
+      }
+      if(index >= text_.size()) {
+        detail::format_error("incomplete conversion at the end of the format string");
+        return;
+      }
+      if(text_[index] == '*' || text_[index] == 'n') {
+        detail::format_error("'*' and %n are not supported");
+        return;
+      }
+      conversion.conversion = text_[index];
+      /* Strings and characters handle width and precision themselves */
+      if((conversion.width != 0 || conversion.precision >= 0) && conversion.conversion != 's' && conversion.conversion != 'c') {
+        conversion.simple = false;
+      }
+      written[argument] = text_.substr(spec_begin,modifier_begin - spec_begin);
+      literals_[argument] = {literal_begin,spec_begin,has_percent};
+      specs_[argument] = conversion;
+      argument++;
+      literal_begin = index + 1;
+      has_percent = false;
+    }
+    literals_[argument] = {literal_begin,text_.size(),has_percent};
+    if(argument != argument_count) {
+      detail::format_error("fewer conversions than arguments");
+      return;
+    }
+    check_all(written,std::index_sequence_for<Args...>{});
+  }
+
+  std::string_view text_;
+  char const *file_;
+  int line_;
+  std::array<detail::piece,argument_count + 1> literals_{};
+  std::array<detail::spec,argument_count> specs_{};
+};
+
+template <typename... Args>
+using format_string = basic_format_string<std::type_identity_t<Args>...>;
+
+/*
+Formats through logger_log_generated() into the per-thread buffers of the
+library. Filtered levels return before any formatting. Long messages are
+formatted a second time into the arena, messages that still do not fit
+end with LOGGER_TRUNCATION_MARK like those of logger_log().
+*/
+template <typename... Args>
+inline void log(int log_level,format_string<Args...> format,Args const &... args) {
+  if(logger_is_enabled(log_level) == false) {return;}
+  auto generate = [&](char *buffer,std::size_t capacity) {
+    detail::writer out{buffer,0,capacity};
+    format.format_to(out,args...);
+    return out.length;
+  };
+  logger_log_generated(log_level,format.file(),format.line(),[](void *custom_object,char *buffer,std::size_t capacity) {
+    return (*static_cast<decltype(generate) *>(custom_object))(buffer,capacity);
+  },&generate);
+}
+
+template <typename... Args>
+inline void emergency(format_string<Args...> format,Args const &... args) {log(LOGGER_EMERGENCY,format,args...);}
+template <typename... Args>
+inline void alert(format_string<Args...> format,Args const &... args) {log(LOGGER_ALERT,format,args...);}
+template <typename... Args>
+inline void critical(format_string<Args...> format,Args const &... args) {log(LOGGER_CRITICAL,format,args...);}
+template <typename... Args>
+inline void error(format_string<Args...> format,Args const &... args) {log(LOGGER_ERROR,format,args...);}
+template <typename... Args>
+inline void warning(format_string<Args...> format,Args const &... args) {log(LOGGER_WARNING,format,args...);}
+template <typename... Args>
+inline void notice(format_string<Args...> format,Args const &... args) {log(LOGGER_NOTICE,format,args...);}
+template <typename... Args>
+inline void info(format_string<Args...> format,Args const &... args) {log(LOGGER_INFO,format,args...);}
+template <typename... Args>
+inline void debug(format_string<Args...> format,Args const &... args) {log(LOGGER_DEBUG,format,args...);}
+
+} // namespace logger
+
+#endif // KVK_LOGGER_HPP
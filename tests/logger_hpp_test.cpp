@@ -0,0 +1,128 @@
+/*
+Sample / check program for the C++ frontend in src/logger.hpp.
+Build with
+  cc -c -O2 -pthread src/logger.c -o logger.o
+  c++ -std=c++20 -O2 -pthread tests/logger_hpp_test.cpp logger.o -o logger_hpp_test
+*/
+#include "../src/logger.hpp"
+
+#include <cassert>
+#include <cinttypes>
+
+static char tests_output[LOGGER_MESSAGE_BUFFER];
+static std::string tests_long_output;
+
+static int
+tests_output_capture(void const * const custom_object,char const * const message) {
+  std::snprintf(tests_output,LOGGER_MESSAGE_BUFFER,"%s",message);
+  tests_long_output = message;
+  return 1;
+}
+
+/* Logs from within the output function, the outer message must survive */
+static int
+tests_output_nested(void const * const custom_object,char const * const message) {
+  std::string const outer(message);
+  logger_set_output_callback(tests_output_capture);
+  logger::info("nested %d",2);
+  logger_set_output_callback(tests_output_nested);
+  tests_long_output = outer + "|" + tests_long_output;
+  return 1;
+}
+
+static char *
+tests_message_only(logger_time const * const timestamp,int const log_level,char const * const file,int const filenumber,char *message) {
+  return message;
+}
+
+static void
+tests_expect(char const *expected) {
+  if(std::strcmp(tests_output,expected) != 0) {
+    std::fprintf(stderr,"expected \"%s\", got \"%s\"\n",expected,tests_output);
+    std::abort();
+  }
+  tests_output[0] = '\0';
+}
+
+enum class tests_color : std::uint8_t {red = 1,green = 2};
+
+/* The C macros compile in inline member functions next to free functions */
+struct tests_macro_caller {
+  void debug(int value) {logger_debug("member %d",value);}
+};
+
+static void
+tests_macro_free(int value) {
+  logger_warning("free %d",value);
+}
+
+int main() {
+  if(logger_setup_context(LOGGER_INFO,nullptr,tests_output_capture,tests_message_only,true) <= 0) {
+    std::fprintf(stderr,"Could not initialize logger\n");
+    return 1;
+  }
+  logger::info("plain text");
+  tests_expect("plain text");
+  logger::info("%d %i %u %x %X %o",-42,7,42u,255,255,8);
+  tests_expect("-42 7 42 ff FF 10");
+  logger::warning("%lld %llu %zu",INT64_MIN,UINT64_MAX,static_cast<std::size_t>(12));
+  tests_expect("-9223372036854775808 18446744073709551615 12");
+  logger::info("[%5d] [%-5d] [%05d] [%+d]",42,42,42,42);
+  tests_expect("[   42] [42   ] [00042] [+42]");
+  logger::info("%s|%8s|%-8s|%.3s",std::string("str"),"right",std::string_view("left"),"truncated");
+  tests_expect("str|   right|left    |tru");
+  logger::info("%c%c %.2f %g",'o','k',3.14159,0.5);
+  tests_expect("ok 3.14 0.5");
+  logger::info("100%% of %d%%",3);
+  tests_expect("100% of 3%");
+  logger::info("%x %d",static_cast<unsigned char>(200),tests_color::green);
+  tests_expect("c8 2");
+  logger::info("%x",-1);
+  tests_expect("ffffffff");
+  char const *nothing = nullptr;
+  logger::info("%s",nothing);
+  tests_expect("(null)");
+  logger::debug("filtered %d",1);
+  tests_expect("");
+  logger_toggle(false);
+  logger::error("inactive");
+  tests_expect("");
+  logger_toggle(true);
+  /* C and C++ callers share the context */
+  logger_error("from %s","C");
+  tests_expect("from C");
+  logger::error("from %s","C++");
+  tests_expect("from C++");
+  tests_macro_caller{}.debug(1);
+  tests_expect("");
+  tests_macro_free(2);
+  tests_expect("free 2");
+  /* Long messages grow into the arena, cut ones are marked and counted */
+  logger_stats stats;
+  std::string const payload(LOGGER_MESSAGE_BUFFER * 3,'x');
+  logger::info("<%s>",payload);
+  assert(tests_long_output == "<" + payload + ">");
+  tests_output[0] = '\0';
+  std::string const oversized(LOGGER_MESSAGE_MAX,'y');
+  logger::info("%s",oversized);
+  assert(tests_long_output.size() == LOGGER_MESSAGE_MAX - 1);
+  assert(tests_long_output.ends_with("y" LOGGER_TRUNCATION_MARK));
+  assert(logger_get_stats(&stats) > 0 && stats.truncated == 1);
+  tests_output[0] = '\0';
+  logger_set_output_callback(tests_output_nested);
+  logger::info("outer %d",1);
+  assert(tests_long_output == "outer 1|nested 2");
+  logger::info("outer %s",payload);
+  assert(tests_long_output == "outer " + payload + "|nested 2");
+  logger_set_output_callback(tests_output_capture);
+  tests_output[0] = '\0';
+
+#ifdef LOGGER_HPP_EXPECT_COMPILE_ERROR
+  /* Each of these must fail to compile */
+  logger::info("%d","not a number");
+  logger::info("%s %s","one argument");
+  logger::info("%f",1);
+#endif
+  std::printf("logger.hpp checks passed\n");
+  return 0;
+}
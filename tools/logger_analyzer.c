@@ -0,0 +1,660 @@
+/*
+Native analyzer for the files written by the logger factories.
+
+Replaces the spreadsheet logger_csv_analyzer.ods for anything larger than
+a few hundred MB. The input file is mapped into memory, split into one
+chunk per worker thread at line boundaries and every chunk is parsed in
+parallel. Each worker keeps its own tables, which are merged once all
+workers have finished, so the parsing threads never share a cache line.
+
+Produced statistics:
+- Records per log level
+- Records per file and per file:line
+- Records per time bucket (bucket width selectable)
+- Top N messages
+
+Besides CSV the analyzer reads the binary data file of
+logger_factory_data_file() and the ring files of logger_factory_shared(),
+both recognized by their magic. Their records are parsed by one thread,
+data records are counted by their label, rings from tail to head (what
+loggerd has not drained yet).
+
+Build:
+  cc -O2 -pthread tools/logger_analyzer.c -o logger_analyzer
+
+Usage:
+  logger_analyzer [-j threads] [-b bucket_seconds] [-n top_n] file.csv ...
+*/
+
+#include "../src/logger.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ANALYZER_LEVELS 8
+#define ANALYZER_MAX_THREADS 256
+
+enum {
+  ANALYZER_CSV = 0,
+  ANALYZER_DATA = 1,
+  ANALYZER_RING = 2
+};
+
+static char const analyzer_level_names[ANALYZER_LEVELS][10] = {
+  "emergency",
+  "alert",
+  "critical",
+  "error",
+  "warning",
+  "notice",
+  "info",
+  "debug"
+};
+
+/*
+Open addressing hash table keyed by a string view into the mapped file
+plus an integer. The integer carries the line number for file:line keys
+and the bucket start for time buckets. Views are never copied, the mapping
+outlives every table.
+*/
+typedef struct {
+  char const *key;
+  uint32_t key_length;
+  int64_t number;
+  uint64_t hash;
+  uint64_t count;
+} analyzer_entry;
+
+typedef struct {
+  analyzer_entry *entries;
+  size_t capacity;
+  size_t used;
+} analyzer_table;
+
+typedef struct {
+  /* Aligned so that two workers never share a cache line */
+  _Alignas(64) char const *begin;
+  char const *end;
+  int64_t bucket_width;
+  int format;
+  uint64_t records;
+  uint64_t malformed;
+  /* A table could not grow, the counts are incomplete */
+  bool failed;
+  uint64_t levels[ANALYZER_LEVELS];
+  analyzer_table files;
+  analyzer_table lines;
+  analyzer_table buckets;
+  analyzer_table messages;
+} analyzer_worker;
+
+static uint64_t
+analyzer_hash(char const *data,size_t length,uint64_t seed) {
+  uint64_t hash = seed ^ (length * 0x9e3779b97f4a7c15ULL);
+  while(length >= 8) {
+    uint64_t word;
+    memcpy(&word,data,8);
+    hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 32;
+    data += 8;
+    length -= 8;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail,data,length);
+  hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+static int
+analyzer_table_init(analyzer_table *table,size_t capacity) {
+  table->entries = calloc(capacity,sizeof(analyzer_entry));
+  if(table->entries == (void*)0) {return -1;}
+  table->capacity = capacity;
+  table->used = 0;
+  return 1;
+}
+
+static int
+analyzer_table_grow(analyzer_table *table) {
+  analyzer_entry *old_entries = table->entries;
+  size_t const old_capacity = table->capacity;
+  if(analyzer_table_init(table,old_capacity * 2) <= 0) {
+    table->entries = old_entries;
+    table->capacity = old_capacity;
+    return -1;
+  }
+  for(size_t index = 0;index < old_capacity;index++) {
+    if(old_entries[index].count == 0) {continue;}
+    size_t slot = old_entries[index].hash & (table->capacity - 1);
+    while(table->entries[slot].count != 0) {
+      slot = (slot + 1) & (table->capacity - 1);
+    }
+    table->entries[slot] = old_entries[index];
+    table->used++;
+  }
+  free(old_entries);
+  return 1;
+}
+
+static int
+analyzer_table_add(analyzer_table *table,char const *key,uint32_t key_length,int64_t number,uint64_t count) {
+  if((table->used + 1) * 2 > table->capacity && analyzer_table_grow(table) <= 0) {
+    return -1;
+  }
+  uint64_t const hash = analyzer_hash(key,key_length,(uint64_t)number);
+  size_t slot = hash & (table->capacity - 1);
+  for(;;) {
+    analyzer_entry *entry = &table->entries[slot];
+    if(entry->count == 0) {
+      entry->key = key;
+      entry->key_length = key_length;
+      entry->number = number;
+      entry->hash = hash;
+      entry->count = count;
+      table->used++;
+      return 1;
+    }
+    if(entry->hash == hash && entry->number == number && entry->key_length == key_length && memcmp(entry->key,key,key_length) == 0) {
+      entry->count += count;
+      return 1;
+    }
+    slot = (slot + 1) & (table->capacity - 1);
+  }
+}
+
+static int
+analyzer_table_merge(analyzer_table *target,analyzer_table const *source) {
+  for(size_t index = 0;index < source->capacity;index++) {
+    analyzer_entry const *entry = &source->entries[index];
+    if(entry->count == 0) {continue;}
+    if(analyzer_table_add(target,entry->key,entry->key_length,entry->number,entry->count) <= 0) {
+      return -1;
+    }
+  }
+  return 1;
+}
+
+/*
+Maps the priority column onto the numeric log level. The names are
+distinct in their first two characters, which avoids a strcmp chain.
+*/
+static int
+analyzer_level(char const *name,size_t length) {
+  if(length < 2) {return -1;}
+  int level = -1;
+  switch(name[0]) {
+    case 'e': level = name[1] == 'm' ? 0 : 3; break;
+    case 'a': level = 1; break;
+    case 'c': level = 2; break;
+    case 'w': level = 4; break;
+    case 'n': level = 5; break;
+    case 'i': level = 6; break;
+    case 'd': level = 7; break;
+    default: return -1;
+  }
+  if(strlen(analyzer_level_names[level]) != length || memcmp(analyzer_level_names[level],name,length) != 0) {
+    return -1;
+  }
+  return level;
+}
+
+/*
+Parses the leading integer part of a field. Anything after the digits
+(for example a fractional part) is ignored.
+*/
+static int64_t
+analyzer_integer(char const *field,char const *end) {
+  int64_t value = 0;
+  bool negative = false;
+  if(field < end && *field == '-') {
+    negative = true;
+    field++;
+  }
+  while(field < end && *field >= '0' && *field <= '9') {
+    value = value * 10 + (*field - '0');
+    field++;
+  }
+  return negative ? -value : value;
+}
+
+static int
+analyzer_add_record(analyzer_worker *worker,int level,int64_t timestamp,char const *file,uint32_t file_length,
+                    int64_t linenumber,char const *message,size_t message_length) {
+  int64_t bucket = timestamp - timestamp % worker->bucket_width;
+  worker->records++;
+  worker->levels[level]++;
+  if(analyzer_table_add(&worker->files,file,file_length,0,1) <= 0
+     || analyzer_table_add(&worker->lines,file,file_length,linenumber,1) <= 0
+     || analyzer_table_add(&worker->buckets,"",0,bucket,1) <= 0
+     || analyzer_table_add(&worker->messages,message,message_length,0,1) <= 0) {
+    return -1;
+  }
+  return 1;
+}
+
+/*
+Record layout: timestamp,priority,filename,linenumber,message
+The message is the remainder of the line and may contain commas.
+*/
+static int
+analyzer_parse_line(analyzer_worker *worker,char const *line,char const *end) {
+  char const *fields[4];
+  char const *cursor = line;
+  for(size_t index = 0;index < 4;index++) {
+    char const *comma = memchr(cursor,',',end - cursor);
+    if(comma == (void*)0) {
+      worker->malformed++;
+      return 1;
+    }
+    fields[index] = comma;
+    cursor = comma + 1;
+  }
+  int const level = analyzer_level(fields[0] + 1,fields[1] - fields[0] - 1);
+  if(level < 0) {
+    worker->malformed++;
+    return 1;
+  }
+  char const * const file = fields[1] + 1;
+  char const * const message = fields[3] + 1;
+  return analyzer_add_record(worker,level,analyzer_integer(line,fields[0]),file,fields[2] - file,
+                             analyzer_integer(fields[2] + 1,fields[3]),message,end - message);
+}
+
+/*
+Record layout: logger_data_header, file name, label, payload. Records
+have no separator, parsing stops at the first one that does not fit.
+Zero bytes at the end are the padding of a direct file sink.
+*/
+static int
+analyzer_parse_data(analyzer_worker *worker) {
+  char const *cursor = worker->begin;
+  while(cursor < worker->end) {
+    size_t const available = worker->end - cursor;
+    logger_data_header header;
+    if(available < sizeof(header) || cursor[0] == '\0') {
+      if(cursor[0] != '\0') {worker->malformed++;}
+      break;
+    }
+    memcpy(&header,cursor,sizeof(header));
+    uint64_t const rest = available - sizeof(header);
+    uint64_t const names = (uint64_t)header.file_length + header.label_length;
+    if(memcmp(header.magic,LOGGER_DATA_MAGIC,sizeof(header.magic)) != 0
+       || header.data_length > rest || names > rest - header.data_length) {
+      worker->malformed++;
+      break;
+    }
+    char const * const file = cursor + sizeof(header);
+    if(header.log_level < 0 || header.log_level >= ANALYZER_LEVELS) {
+      worker->malformed++;
+    } else if(analyzer_add_record(worker,header.log_level,header.seconds,file,header.file_length,header.linenumber,
+                                  file + header.file_length,header.label_length) <= 0) {
+      return -1;
+    }
+    cursor += sizeof(header) + names + header.data_length;
+  }
+  return 1;
+}
+
+/*
+Ring layout: logger_ring_header, then capacity bytes of records. Only the
+records between tail and head are live, a record with size 0 was reserved
+but never completed (the producer died or is still writing) and ends the
+scan.
+*/
+static int
+analyzer_parse_ring(analyzer_worker *worker) {
+  logger_ring_header header;
+  size_t const size = worker->end - worker->begin;
+  if(size < sizeof(header)) {
+    worker->malformed++;
+    return 1;
+  }
+  memcpy(&header,worker->begin,sizeof(header));
+  if(header.header_size < sizeof(header) || header.capacity < sizeof(logger_ring_record)
+     || (header.capacity & (header.capacity - 1)) != 0 || header.header_size > size
+     || header.capacity > size - header.header_size || header.head - header.tail > header.capacity) {
+    worker->malformed++;
+    return 1;
+  }
+  char const * const data = worker->begin + header.header_size;
+  uint64_t const mask = header.capacity - 1;
+  uint64_t cursor = header.tail;
+  while(cursor != header.head) {
+    logger_ring_record record;
+    uint64_t const offset = cursor & mask;
+    if(header.capacity - offset < sizeof(record)) {
+      worker->malformed++;
+      break;
+    }
+    memcpy(&record,data + offset,sizeof(record));
+    uint64_t const length = record.size & ~LOGGER_RING_PAD;
+    if(record.size == 0 || length % 8 != 0 || length > header.capacity - offset || length > header.head - cursor) {
+      if(record.size != 0) {worker->malformed++;}
+      break;
+    }
+    if((record.size & LOGGER_RING_PAD) == 0) {
+      char const * const file = data + offset + sizeof(record);
+      if(length < sizeof(record) || (uint64_t)record.file_length + record.message_length > length - sizeof(record)
+         || record.log_level < 0 || record.log_level >= ANALYZER_LEVELS) {
+        worker->malformed++;
+      } else if(analyzer_add_record(worker,record.log_level,record.seconds,file,record.file_length,record.linenumber,
+                                    file + record.file_length,record.message_length) <= 0) {
+        return -1;
+      }
+    }
+    cursor += length;
+  }
+  return 1;
+}
+
+static void *
+analyzer_worker_run(void *custom_object) {
+  analyzer_worker *worker = custom_object;
+  if(worker->format != ANALYZER_CSV) {
+    int const ret_code = worker->format == ANALYZER_DATA ? analyzer_parse_data(worker) : analyzer_parse_ring(worker);
+    if(ret_code <= 0) {worker->failed = true;}
+    return (void*)0;
+  }
+  char const *cursor = worker->begin;
+  while(cursor < worker->end) {
+    char const *newline = memchr(cursor,'\n',worker->end - cursor);
+    char const *line_end = newline != (void*)0 ? newline : worker->end;
+    char const *content_end = line_end;
+    if(content_end > cursor && content_end[-1] == '\r') {content_end--;}
+    if(content_end > cursor && analyzer_parse_line(worker,cursor,content_end) <= 0) {
+      worker->failed = true;
+      break;
+    }
+    cursor = line_end + 1;
+  }
+  return (void*)0;
+}
+
+static int
+analyzer_compare_count(void const *left,void const *right) {
+  analyzer_entry const *a = left;
+  analyzer_entry const *b = right;
+  if(a->count != b->count) {return a->count < b->count ? 1 : -1;}
+  return a->number < b->number ? -1 : a->number > b->number;
+}
+
+static int
+analyzer_compare_number(void const *left,void const *right) {
+  analyzer_entry const *a = left;
+  analyzer_entry const *b = right;
+  return a->number < b->number ? -1 : a->number > b->number;
+}
+
+/*
+Compacts the used entries of a table to its front and sorts them.
+Returns the number of used entries.
+*/
+static size_t
+analyzer_table_sort(analyzer_table *table,int (*compare)(void const *,void const *)) {
+  size_t used = 0;
+  for(size_t index = 0;index < table->capacity;index++) {
+    if(table->entries[index].count != 0) {
+      table->entries[used++] = table->entries[index];
+    }
+  }
+  qsort(table->entries,used,sizeof(analyzer_entry),compare);
+  return used;
+}
+
+static void
+analyzer_report(analyzer_worker *total,size_t top_n,size_t bytes,double seconds) {
+  printf("records: %llu, malformed: %llu, bytes: %zu, %.3f s, %.1f MB/s\n",
+         (unsigned long long)total->records,(unsigned long long)total->malformed,
+         bytes,seconds,seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+  printf("\nlevels:\n");
+  for(size_t level = 0;level < ANALYZER_LEVELS;level++) {
+    printf("  %-10s %llu\n",analyzer_level_names[level],(unsigned long long)total->levels[level]);
+  }
+  size_t used = analyzer_table_sort(&total->files,analyzer_compare_count);
+  printf("\nfiles (top %zu of %zu):\n",top_n < used ? top_n : used,used);
+  for(size_t index = 0;index < used && index < top_n;index++) {
+    analyzer_entry const *entry = &total->files.entries[index];
+    printf("  %10llu %.*s\n",(unsigned long long)entry->count,(int)entry->key_length,entry->key);
+  }
+  used = analyzer_table_sort(&total->lines,analyzer_compare_count);
+  printf("\nlines (top %zu of %zu):\n",top_n < used ? top_n : used,used);
+  for(size_t index = 0;index < used && index < top_n;index++) {
+    analyzer_entry const *entry = &total->lines.entries[index];
+    printf("  %10llu %.*s:%lld\n",(unsigned long long)entry->count,(int)entry->key_length,entry->key,(long long)entry->number);
+  }
+  used = analyzer_table_sort(&total->buckets,analyzer_compare_number);
+  printf("\ntime buckets (%lld s):\n",(long long)total->bucket_width);
+  for(size_t index = 0;index < used;index++) {
+    analyzer_entry const *entry = &total->buckets.entries[index];
+    time_t const bucket = (time_t)entry->number;
+    char time_buffer[32] = {0};
+    strftime(time_buffer,sizeof(time_buffer),"%Y-%m-%d %H:%M:%S",gmtime(&bucket));
+    printf("  %s %10llu\n",time_buffer,(unsigned long long)entry->count);
+  }
+  used = analyzer_table_sort(&total->messages,analyzer_compare_count);
+  printf("\nmessages (top %zu of %zu):\n",top_n < used ? top_n : used,used);
+  for(size_t index = 0;index < used && index < top_n;index++) {
+    analyzer_entry const *entry = &total->messages.entries[index];
+    printf("  %10llu %.*s\n",(unsigned long long)entry->count,(int)entry->key_length,entry->key);
+  }
+}
+
+static int
+analyzer_worker_init(analyzer_worker *worker,int64_t bucket_width) {
+  memset(worker,0,sizeof(analyzer_worker));
+  worker->bucket_width = bucket_width;
+  if(analyzer_table_init(&worker->files,64) <= 0
+     || analyzer_table_init(&worker->lines,1024) <= 0
+     || analyzer_table_init(&worker->buckets,1024) <= 0
+     || analyzer_table_init(&worker->messages,4096) <= 0) {
+    return -1;
+  }
+  return 1;
+}
+
+static void
+analyzer_worker_free(analyzer_worker *worker) {
+  free(worker->files.entries);
+  free(worker->lines.entries);
+  free(worker->buckets.entries);
+  free(worker->messages.entries);
+}
+
+/*
+Parameters:
+-----------
+path
+  File written by logger_factory_csv(), logger_factory_data_file() or
+  logger_factory_shared()
+
+thread_count
+  Number of parsing threads, the file is split into as many chunks
+
+bucket_width
+  Width of the time buckets in seconds
+
+top_n
+  Number of entries printed for the top lists
+
+Return Value:
+-------------
+value <= 0 = ERROR
+value > 0 = SUCCESS
+
+Description:
+------------
+Maps the file, splits it into chunks at line boundaries, parses the chunks
+in parallel and prints the merged report to stdout. Binary files are
+parsed as one chunk.
+*/
+static int
+analyzer_run(char const * const path,size_t thread_count,int64_t bucket_width,size_t top_n) {
+  int const descriptor = open(path,O_RDONLY);
+  if(descriptor < 0) {
+    perror("Could not open file for analysis");
+    return -1;
+  }
+  struct stat file_stat;
+  if(fstat(descriptor,&file_stat) != 0) {
+    perror("Could not stat file for analysis");
+    close(descriptor);
+    return -1;
+  }
+  size_t const size = file_stat.st_size;
+  if(size == 0) {
+    close(descriptor);
+    printf("%s: empty\n",path);
+    return 1;
+  }
+  char const *data = mmap((void*)0,size,PROT_READ,MAP_PRIVATE | MAP_POPULATE,descriptor,0);
+  close(descriptor);
+  if(data == MAP_FAILED) {
+    perror("Could not map file for analysis");
+    return -1;
+  }
+  madvise((void*)data,size,MADV_SEQUENTIAL | MADV_WILLNEED);
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC,&started);
+
+  char const *begin = data;
+  char const *end = data + size;
+  int format = ANALYZER_CSV;
+  if(size >= 4 && memcmp(data,LOGGER_DATA_MAGIC,4) == 0) {
+    format = ANALYZER_DATA;
+    thread_count = 1;
+  } else if(size >= 4 && memcmp(data,LOGGER_RING_MAGIC,4) == 0) {
+    format = ANALYZER_RING;
+    thread_count = 1;
+  }
+  /* A direct file sink that was not closed pads its last block with 0 bytes */
+  while(format == ANALYZER_CSV && end > begin && end[-1] == '\0') {end--;}
+  if(format == ANALYZER_CSV && size > 10 && memcmp(data,"timestamp,",10) == 0) {
+    char const *newline = memchr(data,'\n',size);
+    begin = newline != (void*)0 ? newline + 1 : end;
+  }
+  if(thread_count > (size_t)(end - begin) / 4096 + 1) {
+    thread_count = (end - begin) / 4096 + 1;
+  }
+  analyzer_worker *workers = aligned_alloc(64,sizeof(analyzer_worker) * (thread_count + 1));
+  pthread_t *threads = calloc(thread_count,sizeof(pthread_t));
+  if(workers == (void*)0 || threads == (void*)0) {
+    fprintf(stderr,"Could not allocate analyzer workers\n");
+    munmap((void*)data,size);
+    free(workers);
+    free(threads);
+    return -2;
+  }
+  int ret_code = 1;
+  size_t started_threads = 0;
+  char const *chunk_begin = begin;
+  for(size_t index = 0;index < thread_count;index++) {
+    char const *chunk_end = end;
+    if(index + 1 < thread_count) {
+      chunk_end = begin + (end - begin) / thread_count * (index + 1);
+      if(chunk_end < chunk_begin) {chunk_end = chunk_begin;}
+      char const *newline = memchr(chunk_end,'\n',end - chunk_end);
+      chunk_end = newline != (void*)0 ? newline + 1 : end;
+    }
+    if(analyzer_worker_init(&workers[index],bucket_width) <= 0) {
+      fprintf(stderr,"Could not allocate analyzer tables\n");
+      ret_code = -2;
+      break;
+    }
+    workers[index].begin = chunk_begin;
+    workers[index].end = chunk_end;
+    workers[index].format = format;
+    if(pthread_create(&threads[index],(void*)0,analyzer_worker_run,&workers[index]) != 0) {
+      fprintf(stderr,"Could not start analyzer thread\n");
+      analyzer_worker_free(&workers[index]);
+      ret_code = -3;
+      break;
+    }
+    started_threads++;
+    chunk_begin = chunk_end;
+  }
+  for(size_t index = 0;index < started_threads;index++) {
+    pthread_join(threads[index],(void*)0);
+  }
+  analyzer_worker *total = &workers[thread_count];
+  if(ret_code > 0 && analyzer_worker_init(total,bucket_width) <= 0) {
+    ret_code = -2;
+  }
+  for(size_t index = 0;index < started_threads;index++) {
+    if(workers[index].failed) {
+      fprintf(stderr,"Could not grow analyzer tables, out of memory\n");
+      ret_code = -2;
+      break;
+    }
+  }
+  if(ret_code > 0) {
+    for(size_t index = 0;index < started_threads;index++) {
+      total->records += workers[index].records;
+      total->malformed += workers[index].malformed;
+      for(size_t level = 0;level < ANALYZER_LEVELS;level++) {
+        total->levels[level] += workers[index].levels[level];
+      }
+      if(analyzer_table_merge(&total->files,&workers[index].files) <= 0
+         || analyzer_table_merge(&total->lines,&workers[index].lines) <= 0
+         || analyzer_table_merge(&total->buckets,&workers[index].buckets) <= 0
+         || analyzer_table_merge(&total->messages,&workers[index].messages) <= 0) {
+        fprintf(stderr,"Could not merge analyzer tables\n");
+        ret_code = -2;
+        break;
+      }
+    }
+  }
+  if(ret_code > 0) {
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC,&finished);
+    double const seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    printf("%s (%zu threads)\n",path,started_threads);
+    analyzer_report(total,top_n,size,seconds);
+    analyzer_worker_free(total);
+  }
+  for(size_t index = 0;index < started_threads;index++) {
+    analyzer_worker_free(&workers[index]);
+  }
+  free(workers);
+  free(threads);
+  munmap((void*)data,size);
+  return ret_code;
+}
+
+int main(int argc,char *argv[argc]) {
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  long bucket_width = 60;
+  long top_n = 10;
+  int option;
+  while((option = getopt(argc,argv,"j:b:n:h")) != -1) {
+    switch(option) {
+      case 'j': threads = strtol(optarg,(void*)0,10); break;
+      case 'b': bucket_width = strtol(optarg,(void*)0,10); break;
+      case 'n': top_n = strtol(optarg,(void*)0,10); break;
+      default:
+        fprintf(stderr,"Usage: %s [-j threads] [-b bucket_seconds] [-n top_n] file ...\n",argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+  if(optind >= argc || threads < 1 || bucket_width < 1 || top_n < 0) {
+    fprintf(stderr,"Usage: %s [-j threads] [-b bucket_seconds] [-n top_n] file ...\n",argv[0]);
+    return 1;
+  }
+  if(threads > ANALYZER_MAX_THREADS) {threads = ANALYZER_MAX_THREADS;}
+  int ret_code = 0;
+  for(int index = optind;index < argc;index++) {
+    if(analyzer_run(argv[index],threads,bucket_width,top_n) <= 0) {
+      ret_code = 1;
+    }
+  }
+  return ret_code;
+}
@@ -0,0 +1,467 @@
+/*
+Local logging daemon for logger_factory_shared().
+
+Processes set up with logger_factory_shared() write raw records into a
+shared memory ring each (logger_ring_header in logger.h) and never format
+or write anything themselves. loggerd finds the rings in the ring
+directory, drains all of them, merges the records by timestamp, formats
+them like logger_factory_file() or logger_factory_csv() and writes one
+consolidated output, rotated by size.
+
+Producers do not wake the daemon, that would cost them a system call:
+while records arrive loggerd keeps draining, once all rings are empty it
+looks again after the poll interval or when inotify reports a new ring.
+A producer holds a shared flock() on its ring, once loggerd can take the
+lock exclusively the process is gone. Its ring is drained and removed,
+records that a crash left half written are reported as lost. Records a
+full ring dropped are reported as a warning of the producer.
+
+Build:
+  cc -O2 tools/loggerd.c -o loggerd
+
+Usage:
+  loggerd [-d ring_directory] [-o output] [-c] [-s rotate_bytes] [-k keep] [-i poll_ms]
+
+SIGHUP reopens the output (for an external logrotate), SIGINT and SIGTERM
+drain the rings once more and exit.
+*/
+
+#include "../src/logger.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Records per merge round, the rings are released after every round */
+#define LOGGERD_BATCH 4096
+/* How often rings are checked for producers that are gone */
+#define LOGGERD_REAP_NS 100000000LL
+
+static char const loggerd_level_names[LOGGER_DEBUG + 1][13] = {
+  " EMERGENCY  ",
+  " ALERT      ",
+  " CRITICAL   ",
+  " ERROR      ",
+  " WARNING    ",
+  " NOTICE     ",
+  " INFO       ",
+  " DEBUG      "
+};
+
+static char const loggerd_csv_names[LOGGER_DEBUG + 1][10] = {
+  "emergency",
+  "alert",
+  "critical",
+  "error",
+  "warning",
+  "notice",
+  "info",
+  "debug"
+};
+
+typedef struct {
+  char *path;
+  int descriptor;
+  logger_ring_header *header;
+  char *data;
+  size_t size;
+  uint64_t mask;
+  /* Read position, ahead of tail until the round releases the records */
+  uint64_t cursor;
+  logger_ring_record const *next;
+  uint64_t dropped;
+  char process[40];
+} loggerd_ring;
+
+static struct {
+  char const *directory;
+  char const *output_path;
+  FILE *output;
+  bool csv;
+  uint64_t rotate_bytes;
+  int keep;
+  uint64_t written;
+  loggerd_ring **rings;
+  size_t ring_count;
+  int inotify;
+  /* Cache of the formatted second */
+  time_t second;
+  char date[64];
+} loggerd = {.second = -1};
+
+static volatile sig_atomic_t loggerd_stop = 0;
+static volatile sig_atomic_t loggerd_reopen = 0;
+
+static void
+loggerd_signal(int signal_number) {
+  if(signal_number == SIGHUP) {
+    loggerd_reopen = 1;
+  } else {
+    loggerd_stop = 1;
+  }
+}
+
+static int64_t
+loggerd_monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int
+loggerd_open_output(void) {
+  if(loggerd.output_path == (void*)0) {
+    loggerd.output = stdout;
+    return 1;
+  }
+  loggerd.output = fopen(loggerd.output_path,"a");
+  if(loggerd.output == (void*)0) {
+    perror("Could not open loggerd output");
+    return -1;
+  }
+  setvbuf(loggerd.output,(void*)0,_IOFBF,1 << 20);
+  struct stat status;
+  loggerd.written = fstat(fileno(loggerd.output),&status) == 0 ? (uint64_t)status.st_size : 0;
+  if(loggerd.csv && loggerd.written == 0) {
+    fputs("timestamp,priority,filename,linenumber,message\n",loggerd.output);
+  }
+  return 1;
+}
+
+/* output -> output.1 -> ... -> output.<keep>, the oldest one is dropped */
+static int
+loggerd_rotate(void) {
+  fclose(loggerd.output);
+  size_t const length = strlen(loggerd.output_path) + 16;
+  char from[length];
+  char to[length];
+  for(int index = loggerd.keep - 1;index > 0;index--) {
+    snprintf(from,length,"%s.%d",loggerd.output_path,index);
+    snprintf(to,length,"%s.%d",loggerd.output_path,index + 1);
+    rename(from,to);
+  }
+  snprintf(to,length,"%s.1",loggerd.output_path);
+  if(loggerd.keep > 0) {
+    rename(loggerd.output_path,to);
+  } else {
+    unlink(loggerd.output_path);
+  }
+  if(loggerd_open_output() <= 0) {
+    /* Records keep going somewhere */
+    loggerd.output_path = (void*)0;
+    loggerd.output = stdout;
+    return -1;
+  }
+  return 1;
+}
+
+static void
+loggerd_emit(loggerd_ring const * const ring,int log_level,int64_t seconds,int32_t nanoseconds,
+             char const * const file,size_t file_length,int32_t linenumber,char const * const message,size_t message_length) {
+  if(log_level < LOGGER_EMERGENCY || log_level > LOGGER_DEBUG) {log_level = LOGGER_DEBUG;}
+  int written;
+  if(loggerd.csv) {
+    written = fprintf(loggerd.output,"%lld.%09d,%s,%s:%.*s,%d,",(long long)seconds,(int)nanoseconds,
+                      loggerd_csv_names[log_level],ring->process,(int)file_length,file,(int)linenumber);
+  } else {
+    if(loggerd.second != (time_t)seconds) {
+      time_t const second = (time_t)seconds;
+      struct tm broken_down;
+      localtime_r(&second,&broken_down);
+      strftime(loggerd.date,sizeof(loggerd.date),"%a %b %e %H:%M:%S.%%06d %Y",&broken_down);
+      loggerd.second = second;
+    }
+    written = fprintf(loggerd.output,loggerd.date,(int)(nanoseconds / 1000));
+    written += fprintf(loggerd.output,"%s%s %.*s:%d - ",loggerd_level_names[log_level],ring->process,(int)file_length,file,(int)linenumber);
+  }
+  fwrite(message,1,message_length,loggerd.output);
+  fputc('\n',loggerd.output);
+  loggerd.written += (uint64_t)written + message_length + 1;
+  if(loggerd.output_path != (void*)0 && loggerd.rotate_bytes > 0 && loggerd.written >= loggerd.rotate_bytes) {
+    loggerd_rotate();
+  }
+}
+
+static void
+loggerd_notice(loggerd_ring const * const ring,int log_level,char const * const message) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME,&now);
+  loggerd_emit(ring,log_level,now.tv_sec,(int32_t)now.tv_nsec,"loggerd",7,0,message,strlen(message));
+}
+
+/* The next committed record of the ring, (void*)0 if there is none yet */
+static logger_ring_record const *
+loggerd_peek(loggerd_ring * const ring) {
+  uint64_t const capacity = ring->mask + 1;
+  /* Records read in this round are not zeroed yet, head is the bound */
+  uint64_t const head = __atomic_load_n(&ring->header->head,__ATOMIC_ACQUIRE);
+  while(ring->cursor != head) {
+    logger_ring_record const * const record = (logger_ring_record const *)(ring->data + (ring->cursor & ring->mask));
+    uint32_t const size = __atomic_load_n(&record->size,__ATOMIC_ACQUIRE);
+    if(size == 0) {return (void*)0;}
+    uint64_t const length = size & ~LOGGER_RING_PAD;
+    if((size & LOGGER_RING_PAD) == 0 && length >= sizeof(logger_ring_record) && length <= capacity - (ring->cursor & ring->mask)
+       && (uint64_t)record->file_length + record->message_length <= length - sizeof(logger_ring_record)) {
+      return record;
+    }
+    if((size & LOGGER_RING_PAD) == 0 || length % 8 != 0 || length != capacity - (ring->cursor & ring->mask)) {
+      fprintf(stderr,"Corrupt record in %s, skipping the rest of the ring\n",ring->path);
+      ring->cursor = head;
+      return (void*)0;
+    }
+    ring->cursor += length;
+  }
+  return (void*)0;
+}
+
+/* Zeroes what was read, producers rely on 0 for records not written yet */
+static void
+loggerd_release(loggerd_ring * const ring) {
+  uint64_t const tail = __atomic_load_n(&ring->header->tail,__ATOMIC_RELAXED);
+  if(ring->cursor == tail) {return;}
+  uint64_t const capacity = ring->mask + 1;
+  uint64_t const start = tail & ring->mask;
+  uint64_t const length = ring->cursor - tail;
+  if(start + length <= capacity) {
+    memset(ring->data + start,0,length);
+  } else {
+    memset(ring->data + start,0,capacity - start);
+    memset(ring->data,0,length - (capacity - start));
+  }
+  __atomic_store_n(&ring->header->tail,ring->cursor,__ATOMIC_RELEASE);
+}
+
+static void
+loggerd_report_dropped(loggerd_ring * const ring) {
+  uint64_t const dropped = __atomic_load_n(&ring->header->dropped,__ATOMIC_RELAXED);
+  if(dropped == ring->dropped) {return;}
+  char message[96];
+  snprintf(message,sizeof(message),"%llu records dropped, the ring was full",(unsigned long long)(dropped - ring->dropped));
+  loggerd_notice(ring,LOGGER_WARNING,message);
+  ring->dropped = dropped;
+}
+
+/*
+Writes up to LOGGERD_BATCH records, always the oldest of all rings next,
+and releases them. Returns the number of records written.
+*/
+static size_t
+loggerd_drain(void) {
+  size_t count = 0;
+  for(size_t index = 0;index < loggerd.ring_count;index++) {
+    loggerd.rings[index]->next = loggerd_peek(loggerd.rings[index]);
+  }
+  while(count < LOGGERD_BATCH) {
+    loggerd_ring *oldest = (void*)0;
+    for(size_t index = 0;index < loggerd.ring_count;index++) {
+      logger_ring_record const * const record = loggerd.rings[index]->next;
+      if(record == (void*)0) {continue;}
+      if(oldest == (void*)0 || record->seconds < oldest->next->seconds
+         || (record->seconds == oldest->next->seconds && record->nanoseconds < oldest->next->nanoseconds)) {
+        oldest = loggerd.rings[index];
+      }
+    }
+    if(oldest == (void*)0) {break;}
+    logger_ring_record const * const record = oldest->next;
+    char const * const file = (char const *)(record + 1);
+    loggerd_emit(oldest,record->log_level,record->seconds,record->nanoseconds,file,record->file_length,
+                 record->linenumber,file + record->file_length,record->message_length);
+    oldest->cursor += record->size;
+    oldest->next = loggerd_peek(oldest);
+    count++;
+  }
+  for(size_t index = 0;index < loggerd.ring_count;index++) {
+    loggerd_release(loggerd.rings[index]);
+    loggerd_report_dropped(loggerd.rings[index]);
+  }
+  return count;
+}
+
+static void
+loggerd_ring_close(loggerd_ring * const ring) {
+  munmap(ring->header,ring->size);
+  close(ring->descriptor);
+  free(ring->path);
+  free(ring);
+}
+
+static int
+loggerd_ring_open(char const * const path) {
+  for(size_t index = 0;index < loggerd.ring_count;index++) {
+    if(strcmp(loggerd.rings[index]->path,path) == 0) {return 0;}
+  }
+  loggerd_ring * const ring = calloc(1,sizeof(loggerd_ring));
+  loggerd_ring ** const rings = realloc(loggerd.rings,(loggerd.ring_count + 1) * sizeof(loggerd_ring *));
+  if(ring == (void*)0 || rings == (void*)0 || (ring->path = strdup(path)) == (void*)0) {
+    free(ring);
+    return -1;
+  }
+  loggerd.rings = rings;
+  struct stat status;
+  ring->descriptor = open(path,O_RDWR | O_CLOEXEC);
+  if(ring->descriptor < 0 || fstat(ring->descriptor,&status) != 0 || (size_t)status.st_size < sizeof(logger_ring_header)) {
+    if(ring->descriptor >= 0) {close(ring->descriptor);}
+    free(ring->path);
+    free(ring);
+    return -1;
+  }
+  ring->size = (size_t)status.st_size;
+  void * const map = mmap((void*)0,ring->size,PROT_READ | PROT_WRITE,MAP_SHARED,ring->descriptor,0);
+  if(map == MAP_FAILED) {
+    perror("Could not map logger ring");
+    close(ring->descriptor);
+    free(ring->path);
+    free(ring);
+    return -1;
+  }
+  ring->header = map;
+  uint64_t const capacity = ring->header->capacity;
+  if(memcmp(ring->header->magic,LOGGER_RING_MAGIC,sizeof(ring->header->magic)) != 0 || ring->header->header_size < sizeof(logger_ring_header)
+     || capacity < 4096 || (capacity & (capacity - 1)) != 0 || ring->header->header_size + capacity != ring->size) {
+    fprintf(stderr,"Not a logger ring: %s\n",path);
+    close(ring->descriptor);
+    munmap(map,ring->size);
+    free(ring->path);
+    free(ring);
+    return -1;
+  }
+  ring->data = (char *)map + ring->header->header_size;
+  ring->mask = capacity - 1;
+  ring->cursor = __atomic_load_n(&ring->header->tail,__ATOMIC_ACQUIRE);
+  char name[sizeof(ring->header->name) + 1] = {0};
+  memcpy(name,ring->header->name,sizeof(ring->header->name));
+  snprintf(ring->process,sizeof(ring->process),"%s[%lld]",name[0] != '\0' ? name : "process",(long long)ring->header->pid);
+  loggerd.rings[loggerd.ring_count++] = ring;
+  return 1;
+}
+
+static void
+loggerd_scan(void) {
+  DIR * const directory = opendir(loggerd.directory);
+  if(directory == (void*)0) {return;}
+  struct dirent *entry;
+  while((entry = readdir(directory)) != (void*)0) {
+    size_t const length = strlen(entry->d_name);
+    if(length < 6 || entry->d_name[0] == '.' || strcmp(entry->d_name + length - 5,".ring") != 0) {continue;}
+    char path[strlen(loggerd.directory) + length + 2];
+    snprintf(path,sizeof(path),"%s/%s",loggerd.directory,entry->d_name);
+    loggerd_ring_open(path);
+  }
+  closedir(directory);
+}
+
+/*
+Removes the rings of processes that are gone: their lock is free, so
+everything committed is there to be drained.
+*/
+static void
+loggerd_reap(void) {
+  for(size_t index = 0;index < loggerd.ring_count;) {
+    loggerd_ring * const ring = loggerd.rings[index];
+    if(flock(ring->descriptor,LOCK_EX | LOCK_NB) != 0) {
+      index++;
+      continue;
+    }
+    while((ring->next = loggerd_peek(ring)) != (void*)0) {
+      logger_ring_record const * const record = ring->next;
+      char const * const file = (char const *)(record + 1);
+      loggerd_emit(ring,record->log_level,record->seconds,record->nanoseconds,file,record->file_length,
+                   record->linenumber,file + record->file_length,record->message_length);
+      ring->cursor += record->size;
+    }
+    loggerd_report_dropped(ring);
+    uint64_t const head = __atomic_load_n(&ring->header->head,__ATOMIC_ACQUIRE);
+    if(head != ring->cursor) {
+      char message[96];
+      snprintf(message,sizeof(message),"process ended while writing, %llu bytes of records lost",(unsigned long long)(head - ring->cursor));
+      loggerd_notice(ring,LOGGER_WARNING,message);
+    }
+    unlink(ring->path);
+    loggerd_ring_close(ring);
+    loggerd.rings[index] = loggerd.rings[--loggerd.ring_count];
+  }
+}
+
+int main(int argc,char *argv[argc]) {
+  long interval_ms = 10;
+  long long rotate_bytes = 0;
+  long keep = 5;
+  int option;
+  loggerd.directory = LOGGER_SHARED_DIRECTORY;
+  while((option = getopt(argc,argv,"d:o:cs:k:i:h")) != -1) {
+    switch(option) {
+      case 'd': loggerd.directory = optarg; break;
+      case 'o': loggerd.output_path = strcmp(optarg,"-") != 0 ? optarg : (void*)0; break;
+      case 'c': loggerd.csv = true; break;
+      case 's': rotate_bytes = strtoll(optarg,(void*)0,10); break;
+      case 'k': keep = strtol(optarg,(void*)0,10); break;
+      case 'i': interval_ms = strtol(optarg,(void*)0,10); break;
+      default:
+        fprintf(stderr,"Usage: %s [-d ring_directory] [-o output] [-c] [-s rotate_bytes] [-k keep] [-i poll_ms]\n",argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+  if(optind != argc || interval_ms < 1 || rotate_bytes < 0 || keep < 0 || keep > 1000) {
+    fprintf(stderr,"Usage: %s [-d ring_directory] [-o output] [-c] [-s rotate_bytes] [-k keep] [-i poll_ms]\n",argv[0]);
+    return 1;
+  }
+  loggerd.rotate_bytes = (uint64_t)rotate_bytes;
+  loggerd.keep = (int)keep;
+  if(mkdir(loggerd.directory,0777) != 0 && errno != EEXIST) {
+    perror("Could not create the ring directory");
+    return 1;
+  }
+  loggerd.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(loggerd.inotify < 0 || inotify_add_watch(loggerd.inotify,loggerd.directory,IN_CREATE | IN_MOVED_TO) < 0) {
+    perror("Could not watch the ring directory");
+    return 1;
+  }
+  if(loggerd_open_output() <= 0) {return 1;}
+  struct sigaction action = {.sa_handler = loggerd_signal};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT,&action,(void*)0);
+  sigaction(SIGTERM,&action,(void*)0);
+  sigaction(SIGHUP,&action,(void*)0);
+  /* Rings left by processes that ended while no daemon was running */
+  loggerd_scan();
+  int64_t reaped = 0;
+  while(loggerd_stop == 0) {
+    size_t const count = loggerd_drain();
+    if(loggerd_reopen != 0 && loggerd.output_path != (void*)0) {
+      loggerd_reopen = 0;
+      fclose(loggerd.output);
+      if(loggerd_open_output() <= 0) {
+        loggerd.output_path = (void*)0;
+        loggerd.output = stdout;
+      }
+    }
+    int64_t const now = loggerd_monotonic_ns();
+    if(now - reaped >= LOGGERD_REAP_NS) {
+      loggerd_reap();
+      reaped = now;
+    }
+    if(count > 0) {continue;}
+    fflush(loggerd.output);
+    struct pollfd descriptor = {.fd = loggerd.inotify,.events = POLLIN};
+    if(poll(&descriptor,1,(int)interval_ms) > 0) {
+      char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+      while(read(loggerd.inotify,events,sizeof(events)) > 0) {}
+      loggerd_scan();
+    }
+  }
+  while(loggerd_drain() > 0) {}
+  loggerd_reap();
+  for(size_t index = 0;index < loggerd.ring_count;index++) {
+    loggerd_ring_close(loggerd.rings[index]);
+  }
+  free(loggerd.rings);
+  fclose(loggerd.output);
+  return 0;
+}